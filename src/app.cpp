@@ -6,9 +6,7 @@ using namespace glm;
 
 void DemoNode::input_key(int key, int scancode, int action, int mods) {}
 
-App::App(int argc, char **argv) {
-	_renderer = Renderer {};
-}
+App::App(int argc, char **argv) : _renderer {} {}
 
 int App::run() {
 
@@ -61,30 +59,42 @@ int App::run() {
 
 	// todo
 
+	// start every load before waiting on any of them so they overlap
+	AssetServer assets;
+	MeshHandle mesh_1 = assets.load_mesh("assets/models/viking_room.obj");
+	MeshHandle mesh_2 = assets.load_mesh("assets/models/sphere.obj");
+	MeshHandle mesh_3 = assets.load_mesh("assets/models/plane.obj");
+
+	for (auto handle : { mesh_1, mesh_2, mesh_3 }) {
+		if (handle.wait() != OK) {
+			LOG_ERR("Failed to load %s", handle.get_path());
+			_renderer.destroy();
+			return EXIT_FAILURE;
+		}
+	}
+
 	Node3D scene { "demo scene" };
 
-	Renderer::Mesh mesh_1 { .name = "viking room mesh" };
-	Renderer::Mesh::load_from_obj(&mesh_1, "assets/models/viking_room.obj");
-	MeshInstance inst_1 { "instance 1", &mesh_1 };
+	MeshInstance inst_1 { "instance 1", mesh_1.get() };
 	inst_1.transform = translate(mat4(1.0f), vec3(0.0f, 0.0f, 0.0f));
 	scene.add_child(&inst_1);
 
-	Renderer::Mesh mesh_2 { .name = "sphere mesh" };
-	Renderer::Mesh::load_from_obj(&mesh_2, "assets/models/sphere.obj");
-	MeshInstance inst_2 { "instance 2", &mesh_2 };
+	MeshInstance inst_2 { "instance 2", mesh_2.get() };
 	inst_2.transform =
 			scale(translate(mat4(1.0f), vec3(0.0f, 0.0f, 0.5f)), vec3(0.2f));
 	inst_1.add_child(&inst_2);
 
-	Renderer::Mesh mesh_3 { .name = "plane mesh" };
-	Renderer::Mesh::load_from_obj(&mesh_3, "assets/models/plane.obj");
-	MeshInstance inst_3 { "instance 3", &mesh_3 };
+	MeshInstance inst_3 { "instance 3", mesh_3.get() };
 	inst_3.transform = rotate(
 			translate(scale(mat4(1.0f), vec3(0.05f)), vec3(0.0f, 0.0f, -0.1f)),
 			pi<float>() * 0.5f,
 			vec3(1.0f, 0.0f, 0.0f));
 	scene.add_child(&inst_3);
 
+#ifdef USE_MESH_CACHE
+	MeshCache::print_stats();
+#endif
+
 	DemoNode node {};
 	scene.add_child(&node);
 
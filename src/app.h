@@ -1,6 +1,8 @@
 #ifndef __APP_H__
 #define __APP_H__
 
+#include "renderer/asset_server.h"
+#include "renderer/mesh_cache.h"
 #include "renderer/renderer.h"
 #include "scene/mesh_instance.h"
 #include "scene/scene.h"
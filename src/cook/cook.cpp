@@ -0,0 +1,628 @@
+// opal_cook converts the source assets into a single pack of GPU-ready data
+// that the renderer maps and uploads from directly.
+//
+// usage: opal_cook <asset directory> <pack file>
+//
+// Entries are named by their path relative to the parent of the asset
+// directory, so `src/assets/models/sphere.obj` becomes
+// `assets/models/sphere.obj`. Cooking is incremental: sources whose hash
+// matches the entries of the existing pack are copied over as is.
+
+#include "../renderer/asset_pack.h"
+#include "../renderer/ktx2_loader.h"
+#include "../renderer/mesh_codec.h"
+#include "../renderer/meshlet_builder.h"
+#include "../renderer/obj_loader.h"
+#include "../renderer/renderer.h"
+#include "../scene/gltf_scene.h"
+#include "../utils/file.h"
+#include "../utils/hash.h"
+#include "../utils/log.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+using namespace Opal;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// bump this when the output of the cooker changes without the pack layout
+// changing, so every source gets cooked again
+constexpr uint64_t COOK_VERSION = 6;
+
+enum SourceType {
+	SOURCE_UNKNOWN,
+	SOURCE_OBJ,
+	SOURCE_GLTF,
+	SOURCE_IMAGE,
+	SOURCE_KTX2,
+};
+
+struct PendingEntry {
+	std::string name;
+	// everything but the name and data location
+	AssetPack::Entry entry;
+	// freshly cooked data, or empty when data points into the old pack
+	std::vector<uint8_t> cooked;
+	std::span<const uint8_t> data;
+};
+
+SourceType _source_type(const fs::path &path) {
+	std::string ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) {
+		return (char)std::tolower((unsigned char)c);
+	});
+
+	if (ext == ".obj")
+		return SOURCE_OBJ;
+	if (ext == ".gltf" || ext == ".glb")
+		return SOURCE_GLTF;
+	if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" ||
+		ext == ".bmp")
+		return SOURCE_IMAGE;
+	if (ext == ".ktx2")
+		return SOURCE_KTX2;
+	return SOURCE_UNKNOWN;
+}
+
+bool _hash_file(const std::string &path, uint64_t *hash) {
+	MappedFile file;
+	if (!file.open(path, MappedFile::HINT_SEQUENTIAL))
+		return false;
+	*hash = hash_bytes(file.data(), file.size(), *hash);
+	return true;
+}
+
+/**
+ * Hashes the source along with the files it depends on and the settings that
+ * change the cooked output.
+ */
+Error _source_hash(const std::string &path, SourceType type, uint64_t *hash) {
+
+	*hash = hash_u64(COOK_VERSION);
+
+	if (type == SOURCE_OBJ) {
+		const float epsilon = MESH_WELD_EPSILON;
+		*hash				= hash_bytes(&epsilon, sizeof(epsilon), *hash);
+	}
+
+	if (type == SOURCE_OBJ || type == SOURCE_GLTF) {
+		*hash = hash_u64(MESH_VERTEX_CACHE_SIZE, *hash);
+		*hash = hash_u64(MESH_LOD_COUNT, *hash);
+		*hash = hash_u64(MeshletBuilder::MAX_VERTICES, *hash);
+		*hash = hash_u64(MeshletBuilder::MAX_TRIANGLES, *hash);
+
+		// meshes are cooked with the vertex format these settings pick
+#ifdef USE_COMPACT_VERTICES
+		*hash = hash_u64(1, *hash);
+#endif
+#ifdef COMPACT_HALF_POSITIONS
+		*hash = hash_u64(2, *hash);
+#endif
+#ifdef USE_POSITION_STREAM
+		*hash = hash_u64(3, *hash);
+#endif
+	}
+
+	ERR_FAIL_COND_V_MSG(
+			!_hash_file(path, hash), FAIL, "Failed to read %s", path.c_str());
+
+	if (type == SOURCE_OBJ || type == SOURCE_GLTF) {
+		std::vector<std::string> dependencies;
+		if (type == SOURCE_OBJ)
+			ERR_TRY(ObjLoader::get_dependencies(path.c_str(), &dependencies));
+		else
+			ERR_TRY(GltfScene::get_dependencies(path.c_str(), &dependencies));
+
+		for (const std::string &dependency : dependencies) {
+			ERR_FAIL_COND_V_MSG(
+					!_hash_file(dependency, hash),
+					FAIL,
+					"Failed to read %s",
+					dependency.c_str());
+		}
+	}
+
+	return OK;
+}
+
+PendingEntry &_add_entry(
+		std::vector<PendingEntry> *entries,
+		std::string name,
+		AssetPack::EntryType type,
+		uint64_t source_hash) {
+
+	PendingEntry &pending	  = entries->emplace_back();
+	pending.name			  = std::move(name);
+	pending.entry			  = {};
+	pending.entry.name_hash	  = AssetPack::hash_name(pending.name);
+	pending.entry.source_hash = source_hash;
+	pending.entry.type		  = type;
+	return pending;
+}
+
+void _append(std::vector<uint8_t> *out, const void *data, size_t size) {
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	out->insert(out->end(), bytes, bytes + size);
+}
+
+void _add_mesh(
+		std::vector<PendingEntry> *entries,
+		std::string name,
+		uint64_t source_hash,
+		const std::vector<Vertex> &vertices,
+		const std::vector<uint32_t> &indices,
+		const std::vector<Renderer::Mesh::Lod> &lods,
+		const std::vector<Renderer::Mesh::Submesh> &submeshes,
+		const std::vector<glm::vec4> &material_colors) {
+
+	PendingEntry &pending = _add_entry(
+			entries, std::move(name), AssetPack::ENTRY_MESH, source_hash);
+
+	// worked out here so loading the mesh never needs it decoded on the CPU
+	Renderer::Mesh mesh;
+	mesh.lods	   = lods;
+	mesh.submeshes = submeshes;
+	Renderer::prepare_mesh(&mesh, vertices, indices);
+	const glm::vec4 bounds(mesh.bounds_center, mesh.bounds_radius);
+
+	std::vector<uint8_t> vertex_data;
+	std::vector<uint8_t> index_data;
+	MeshCodec::encode_vertices(vertices, &vertex_data);
+	MeshCodec::encode_indices(indices, &index_data);
+
+	pending.entry.mesh = {
+		.vertex_count	   = (uint32_t)vertices.size(),
+		.index_count	   = (uint32_t)indices.size(),
+		.lod_count		   = (uint32_t)lods.size(),
+		.submesh_count	   = (uint32_t)submeshes.size(),
+		.material_count	   = (uint32_t)material_colors.size(),
+		.meshlet_count	   = (uint32_t)mesh.meshlets.size(),
+		.lod_meshlet_count = (uint32_t)mesh.lod_meshlets.size(),
+		.vertex_data_size  = vertex_data.size(),
+		.index_data_size   = index_data.size(),
+	};
+
+	pending.cooked.reserve(
+			sizeof(VertexFormat) + sizeof(bounds) +
+			lods.size() * sizeof(Renderer::Mesh::Lod) +
+			submeshes.size() * sizeof(Renderer::Mesh::Submesh) +
+			material_colors.size() * sizeof(glm::vec4) +
+			mesh.meshlets.size() * sizeof(Renderer::Mesh::Meshlet) +
+			mesh.lod_meshlets.size() * sizeof(uint32_t) + vertex_data.size() +
+			index_data.size());
+	_append(&pending.cooked, &mesh.format, sizeof(VertexFormat));
+	_append(&pending.cooked, &bounds, sizeof(bounds));
+	_append(
+			&pending.cooked,
+			lods.data(),
+			lods.size() * sizeof(Renderer::Mesh::Lod));
+	_append(
+			&pending.cooked,
+			submeshes.data(),
+			submeshes.size() * sizeof(Renderer::Mesh::Submesh));
+	_append(
+			&pending.cooked,
+			material_colors.data(),
+			material_colors.size() * sizeof(glm::vec4));
+	_append(
+			&pending.cooked,
+			mesh.meshlets.data(),
+			mesh.meshlets.size() * sizeof(Renderer::Mesh::Meshlet));
+	_append(
+			&pending.cooked,
+			mesh.lod_meshlets.data(),
+			mesh.lod_meshlets.size() * sizeof(uint32_t));
+	_append(&pending.cooked, vertex_data.data(), vertex_data.size());
+	_append(&pending.cooked, index_data.data(), index_data.size());
+}
+
+Error _cook_obj(
+		std::vector<PendingEntry> *entries,
+		const std::string &name,
+		const std::string &path,
+		uint64_t source_hash) {
+
+	Renderer::Mesh mesh;
+	ERR_TRY(Renderer::Mesh::import_obj(&mesh, path.c_str()));
+
+	_add_mesh(
+			entries,
+			name,
+			source_hash,
+			mesh.vertices,
+			mesh.indices,
+			mesh.lods,
+			mesh.submeshes,
+			mesh.material_colors);
+
+	return OK;
+}
+
+Error _cook_gltf(
+		std::vector<PendingEntry> *entries,
+		const std::string &name,
+		const std::string &path,
+		uint64_t source_hash) {
+
+	std::string json;
+	std::vector<GltfScene::CookedPrimitive> primitives;
+	ERR_TRY(GltfScene::cook(path.c_str(), &json, &primitives));
+
+	// the node tree is still built from the json at load time
+	PendingEntry &raw =
+			_add_entry(entries, name, AssetPack::ENTRY_RAW, source_hash);
+	_append(&raw.cooked, json.data(), json.size());
+
+	for (const auto &primitive : primitives) {
+		_add_mesh(
+				entries,
+				GltfScene::get_primitive_name(
+						name.c_str(), primitive.mesh, primitive.primitive),
+				source_hash,
+				primitive.vertices,
+				primitive.indices,
+				primitive.lods,
+				{},
+				{});
+	}
+
+	return OK;
+}
+
+float _srgb_to_linear(float c) {
+	return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float _linear_to_srgb(float c) {
+	return c <= 0.0031308f ? c * 12.92f
+						   : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+/**
+ * Writes the next mip level by averaging every 2x2 block of the given level.
+ * Odd edges reuse their last row or column.
+ *
+ * Color channels are averaged in linear space, the same way the GPU filters
+ * srgb images, so the smaller levels don't get darker. Alpha is already
+ * linear.
+ */
+void _downsample(
+		const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst) {
+
+	static const auto to_linear = [] {
+		std::array<float, 256> table;
+		for (size_t i = 0; i < table.size(); ++i)
+			table[i] = _srgb_to_linear(i / 255.0f);
+		return table;
+	}();
+
+	const uint32_t dst_width  = std::max(1u, width / 2);
+	const uint32_t dst_height = std::max(1u, height / 2);
+
+	for (uint32_t y = 0; y < dst_height; ++y) {
+		const uint32_t y0 = std::min(y * 2, height - 1);
+		const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+		for (uint32_t x = 0; x < dst_width; ++x) {
+			const uint32_t x0 = std::min(x * 2, width - 1);
+			const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+			const uint8_t *texels[4] = {
+				src + (y0 * width + x0) * 4,
+				src + (y0 * width + x1) * 4,
+				src + (y1 * width + x0) * 4,
+				src + (y1 * width + x1) * 4,
+			};
+
+			for (uint32_t c = 0; c < 3; ++c) {
+				float sum = 0.0f;
+				for (const uint8_t *texel : texels)
+					sum += to_linear[texel[c]];
+				*dst++ = (uint8_t)std::lround(
+						_linear_to_srgb(sum * 0.25f) * 255.0f);
+			}
+
+			const uint32_t alpha =
+					texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3];
+			*dst++ = (uint8_t)((alpha + 2) / 4);
+		}
+	}
+}
+
+Error _cook_image(
+		std::vector<PendingEntry> *entries,
+		const std::string &name,
+		const std::string &path,
+		uint64_t source_hash) {
+
+	Renderer::Pixels pixels;
+	ERR_TRY(Renderer::Pixels::load(&pixels, path.c_str()));
+
+	uint32_t width	= (uint32_t)pixels.width;
+	uint32_t height = (uint32_t)pixels.height;
+
+	const uint32_t mip_levels = Renderer::get_mip_level_count(width, height);
+
+	PendingEntry &pending = _add_entry(
+			entries, name, AssetPack::ENTRY_TEXTURE, source_hash);
+
+	pending.entry.texture = {
+		.width		= width,
+		.height		= height,
+		.mip_levels = mip_levels,
+		.format		= VK_FORMAT_R8G8B8A8_SRGB,
+	};
+
+	size_t size = 0;
+	for (uint32_t level = 0; level < mip_levels; ++level)
+		size += (size_t)std::max(1u, width >> level) *
+				std::max(1u, height >> level) * 4;
+
+	std::vector<uint8_t> &out = pending.cooked;
+	out.resize(size);
+	memcpy(out.data(), pixels.data.get(), (size_t)width * height * 4);
+
+	uint8_t *level = out.data();
+	for (uint32_t i = 1; i < mip_levels; ++i) {
+		uint8_t *next = level + (size_t)width * height * 4;
+		_downsample(level, width, height, next);
+
+		level  = next;
+		width  = std::max(1u, width / 2);
+		height = std::max(1u, height / 2);
+	}
+
+	return OK;
+}
+
+Error _cook_ktx2(
+		std::vector<PendingEntry> *entries,
+		const std::string &name,
+		const std::string &path,
+		uint64_t source_hash) {
+
+	// block compressed levels are stored as is, only supercompression is
+	// undone so the renderer can upload straight from the pack
+	Ktx2Loader::Data ktx;
+	ERR_TRY(Ktx2Loader::load(path.c_str(), &ktx));
+
+	PendingEntry &pending = _add_entry(
+			entries, name, AssetPack::ENTRY_TEXTURE, source_hash);
+
+	pending.entry.texture = {
+		.width		= ktx.width,
+		.height		= ktx.height,
+		.mip_levels = ktx.mip_levels,
+		.format		= (uint32_t)ktx.format,
+	};
+	pending.cooked = std::move(ktx.levels);
+
+	return OK;
+}
+
+uint64_t _align_up(uint64_t value, uint64_t align) {
+	return (value + align - 1) & ~(align - 1);
+}
+
+Error _write_pack(
+		const std::string &filename, std::vector<PendingEntry> *entries) {
+
+	// sorted by hash so the runtime can binary search the table
+	std::sort(
+			entries->begin(),
+			entries->end(),
+			[](const PendingEntry &a, const PendingEntry &b) {
+				if (a.entry.name_hash != b.entry.name_hash)
+					return a.entry.name_hash < b.entry.name_hash;
+				return a.name < b.name;
+			});
+
+	std::string names;
+	for (PendingEntry &pending : *entries) {
+		pending.entry.name_offset = (uint32_t)names.size();
+		pending.entry.name_length = (uint32_t)pending.name.size();
+		names += pending.name;
+
+		if (!pending.cooked.empty())
+			pending.data = pending.cooked;
+	}
+
+	AssetPack::Header header {
+		.version	  = AssetPack::VERSION,
+		.vertex_size  = sizeof(Vertex),
+		.entry_count  = (uint32_t)entries->size(),
+		.names_offset = sizeof(AssetPack::Header) +
+						entries->size() * sizeof(AssetPack::Entry),
+		.names_size	  = names.size(),
+	};
+	memcpy(header.magic, AssetPack::MAGIC, sizeof(AssetPack::MAGIC));
+
+	uint64_t offset = header.names_offset + header.names_size;
+	for (PendingEntry &pending : *entries) {
+		offset				 = _align_up(offset, AssetPack::DATA_ALIGN);
+		pending.entry.offset = offset;
+		pending.entry.size	 = pending.data.size();
+		offset += pending.entry.size;
+	}
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	ERR_FAIL_COND_V_MSG(
+			!file.is_open(), FAIL, "Failed to open %s", filename.c_str());
+
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	for (const PendingEntry &pending : *entries) {
+		file.write(
+				reinterpret_cast<const char *>(&pending.entry),
+				sizeof(pending.entry));
+	}
+	file.write(names.data(), names.size());
+
+	const char zeros[AssetPack::DATA_ALIGN] = {};
+	uint64_t position = header.names_offset + header.names_size;
+	for (const PendingEntry &pending : *entries) {
+		file.write(zeros, pending.entry.offset - position);
+		file.write(
+				reinterpret_cast<const char *>(pending.data.data()),
+				pending.data.size());
+		position = pending.entry.offset + pending.entry.size;
+	}
+
+	ERR_FAIL_COND_V_MSG(
+			!file.good(), FAIL, "Failed to write %s", filename.c_str());
+
+	return OK;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+
+	if (argc != 3) {
+		LOG_ERR("usage: %s <asset directory> <pack file>", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const auto start_time = std::chrono::high_resolution_clock::now();
+
+	const fs::path asset_dir = fs::weakly_canonical(argv[1]);
+	const std::string pack_path = argv[2];
+
+	std::error_code ec;
+	if (!fs::is_directory(asset_dir, ec)) {
+		LOG_ERR("%s is not a directory", asset_dir.string().c_str());
+		return EXIT_FAILURE;
+	}
+
+	// entries of the previous pack grouped by the source they came from
+	AssetPack old_pack;
+	std::unordered_map<std::string_view, std::vector<const AssetPack::Entry *>>
+			old_sources;
+	if (old_pack.open(pack_path)) {
+		for (const AssetPack::Entry &entry : old_pack.get_entries()) {
+			old_sources[AssetPack::get_source_name(old_pack.get_name(entry))]
+					.push_back(&entry);
+		}
+	}
+
+	// walk the sources in a fixed order so the pack is reproducible
+	std::vector<fs::path> sources;
+	for (const auto &file : fs::recursive_directory_iterator(asset_dir, ec)) {
+		if (file.is_regular_file() &&
+			_source_type(file.path()) != SOURCE_UNKNOWN)
+			sources.push_back(file.path());
+	}
+	std::sort(sources.begin(), sources.end());
+
+	ERR_FAIL_COND_V_MSG(
+			ec,
+			EXIT_FAILURE,
+			"Failed to list %s: %s",
+			asset_dir.string().c_str(),
+			ec.message().c_str());
+
+	std::vector<PendingEntry> entries;
+	uint32_t cooked = 0;
+	uint32_t reused = 0;
+	bool failed		= false;
+
+	for (const fs::path &source : sources) {
+		const std::string path = source.string();
+		const std::string name =
+				(asset_dir.filename() / source.lexically_relative(asset_dir))
+						.generic_string();
+		const SourceType type = _source_type(source);
+
+		uint64_t source_hash;
+		if (_source_hash(path, type, &source_hash) != OK) {
+			failed = true;
+			continue;
+		}
+
+		auto old = old_sources.find(name);
+		if (old != old_sources.end() &&
+			old->second.front()->source_hash == source_hash) {
+			for (const AssetPack::Entry *entry : old->second) {
+				PendingEntry &pending = entries.emplace_back();
+				pending.name  = std::string(old_pack.get_name(*entry));
+				pending.entry = *entry;
+				pending.data  = old_pack.get_data(*entry);
+			}
+			reused++;
+			continue;
+		}
+
+		Error err = FAIL;
+		switch (type) {
+			case SOURCE_OBJ:
+				err = _cook_obj(&entries, name, path, source_hash);
+				break;
+			case SOURCE_GLTF:
+				err = _cook_gltf(&entries, name, path, source_hash);
+				break;
+			case SOURCE_IMAGE:
+				err = _cook_image(&entries, name, path, source_hash);
+				break;
+			case SOURCE_KTX2:
+				err = _cook_ktx2(&entries, name, path, source_hash);
+				break;
+			default:
+				break;
+		}
+
+		if (err != OK) {
+			LOG_ERR("Failed to cook %s", path.c_str());
+			failed = true;
+			continue;
+		}
+
+		LOG_INFO("cooked %s", name.c_str());
+		cooked++;
+	}
+
+	if (failed)
+		return EXIT_FAILURE;
+
+	if (cooked == 0 && reused == old_sources.size() && old_pack.is_open()) {
+		LOG_INFO("%s is up to date", pack_path.c_str());
+		return EXIT_SUCCESS;
+	}
+
+	// write next to the old pack first since reused entries are still read
+	// from it, and so a failed cook never leaves a partial pack behind
+	const std::string temp_path = pack_path + ".tmp";
+	if (_write_pack(temp_path, &entries) != OK)
+		return EXIT_FAILURE;
+
+	old_pack.close();
+
+	fs::rename(temp_path, pack_path, ec);
+	ERR_FAIL_COND_V_MSG(
+			ec,
+			EXIT_FAILURE,
+			"Failed to move %s into place: %s",
+			pack_path.c_str(),
+			ec.message().c_str());
+
+	const double cook_time_ms =
+			std::chrono::duration<double, std::milli>(
+					std::chrono::high_resolution_clock::now() - start_time)
+					.count();
+
+	LOG_INFO(
+			"wrote %s in %.2f ms (%u sources cooked, %u reused)",
+			pack_path.c_str(),
+			cook_time_ms,
+			cooked,
+			reused);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include "asset_pack.h"
+#include "renderer.h"
+
+#include <algorithm>
+
+using namespace Opal;
+
+bool AssetPack::open(const std::string &filename) {
+
+	close();
+
+	// entries are read in whatever order the app asks for them
+	if (!_file.open(filename, MappedFile::HINT_RANDOM))
+		return false;
+
+	Header header;
+	if (_file.size() < sizeof(header)) {
+		LOG_WARN("Asset pack %s is truncated", filename.c_str());
+		close();
+		return false;
+	}
+	memcpy(&header, _file.data(), sizeof(header));
+
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+		header.version != VERSION || header.vertex_size != sizeof(Vertex)) {
+		LOG_WARN("Asset pack %s is out of date, recook it", filename.c_str());
+		close();
+		return false;
+	}
+
+	const uint64_t table_size = (uint64_t)header.entry_count * sizeof(Entry);
+	if (sizeof(header) + table_size > _file.size() ||
+		header.names_offset + header.names_size > _file.size()) {
+		LOG_WARN("Asset pack %s is truncated", filename.c_str());
+		close();
+		return false;
+	}
+
+	const uint8_t *data = _file.data();
+	_entries = { reinterpret_cast<const Entry *>(data + sizeof(header)),
+				 header.entry_count };
+	_names	 = reinterpret_cast<const char *>(data + header.names_offset);
+
+	for (const Entry &entry : _entries) {
+		if (entry.offset + entry.size > _file.size() ||
+			(uint64_t)entry.name_offset + entry.name_length >
+					header.names_size) {
+			LOG_WARN("Asset pack %s has invalid entries", filename.c_str());
+			close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void AssetPack::close() {
+	_file.close();
+	_entries = {};
+	_names	 = nullptr;
+}
+
+const AssetPack::Entry *AssetPack::find(std::string_view name) const {
+
+	const uint64_t hash = hash_name(name);
+
+	auto it = std::lower_bound(
+			_entries.begin(),
+			_entries.end(),
+			hash,
+			[](const Entry &entry, uint64_t hash) {
+				return entry.name_hash < hash;
+			});
+
+	for (; it != _entries.end() && it->name_hash == hash; ++it) {
+		if (get_name(*it) == name)
+			return &*it;
+	}
+
+	return nullptr;
+}
+
+std::string_view AssetPack::get_name(const Entry &entry) const {
+	return { _names + entry.name_offset, entry.name_length };
+}
+
+std::span<const uint8_t> AssetPack::get_data(const Entry &entry) const {
+	return { _file.data() + entry.offset, entry.size };
+}
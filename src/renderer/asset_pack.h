@@ -0,0 +1,140 @@
+#ifndef __ASSET_PACK_H__
+#define __ASSET_PACK_H__
+
+#include "../typedefs.h"
+#include "../utils/file.h"
+#include "../utils/hash.h"
+
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace Opal {
+
+/**
+ * @brief Read-only view of a pack of cooked assets.
+ *
+ * Packs are written by the opal_cook tool. They hold data that is ready to
+ * upload: meshes with their levels of detail and submeshes, with the vertices
+ * and indices compressed by MeshCodec, and textures with their whole mip
+ * chain that are uploaded straight from the memory mapping.
+ *
+ * The file starts with a Header, followed by the Entry table sorted by name
+ * hash and the entry names. Entry data comes after that, with every entry
+ * aligned to DATA_ALIGN.
+ */
+class AssetPack {
+
+public:
+	/**
+	 * Bump this when the layout of the pack or the output of the cooker
+	 * changes so packs get rebuilt from scratch.
+	 */
+	static constexpr uint32_t VERSION = 5;
+
+	static constexpr char MAGIC[4] = { 'O', 'P', 'A', 'K' };
+
+	// alignment of the data of every entry, matches the largest
+	// optimalBufferCopyOffsetAlignment seen in the wild.
+	static constexpr uint64_t DATA_ALIGN = 256;
+
+	enum EntryType : uint32_t {
+		// the VertexFormat the vertices are packed into and a vec4 with the
+		// bounds center and radius, lod_count Renderer::Mesh::Lod structs,
+		// submesh_count Renderer::Mesh::Submesh structs, material_count vec4
+		// colors, meshlet_count Renderer::Mesh::Meshlet structs and
+		// lod_meshlet_count uint32_t, followed by vertex_data_size bytes of
+		// encoded vertices and index_data_size bytes of encoded indices
+		ENTRY_MESH,
+		// tightly packed mip levels, largest first
+		ENTRY_TEXTURE,
+		// the source file as is
+		ENTRY_RAW,
+	};
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		// used to catch changes to the Vertex struct
+		uint32_t vertex_size;
+		uint32_t entry_count;
+		uint64_t names_offset;
+		uint64_t names_size;
+	};
+
+	struct MeshInfo {
+		uint32_t vertex_count;
+		uint32_t index_count;
+		uint32_t lod_count;
+		uint32_t submesh_count;
+		uint32_t material_count;
+		uint32_t meshlet_count;
+		uint32_t lod_meshlet_count;
+		uint64_t vertex_data_size;
+		uint64_t index_data_size;
+	};
+
+	struct TextureInfo {
+		uint32_t width;
+		uint32_t height;
+		uint32_t mip_levels;
+		// VkFormat of the pixels
+		uint32_t format;
+	};
+
+	struct Entry {
+		uint64_t name_hash;
+		// hash of the source files the entry was cooked from, so the cooker
+		// can skip sources that haven't changed
+		uint64_t source_hash;
+		uint32_t name_offset;
+		uint32_t name_length;
+		uint32_t type;
+		uint32_t reserved;
+		uint64_t offset;
+		uint64_t size;
+		union {
+			MeshInfo mesh;
+			TextureInfo texture;
+		};
+	};
+
+	/**
+	 * @brief Maps the pack and validates its header and entry table.
+	 * @returns false if the file is missing or isn't a valid pack.
+	 */
+	bool open(const std::string &filename);
+	void close();
+
+	bool is_open() const { return _file.is_open(); }
+
+	/**
+	 * @returns the entry with the given name or nullptr if there isn't one.
+	 */
+	const Entry *find(std::string_view name) const;
+
+	std::span<const Entry> get_entries() const { return _entries; }
+	std::string_view get_name(const Entry &entry) const;
+	std::span<const uint8_t> get_data(const Entry &entry) const;
+
+	static uint64_t hash_name(std::string_view name) {
+		return hash_bytes(name.data(), name.size());
+	}
+
+	/**
+	 * @returns the name of the source file an entry was cooked from. Entries
+	 * cooked from part of a file are named `<source>#<part>`.
+	 */
+	static std::string_view get_source_name(std::string_view name) {
+		return name.substr(0, name.find('#'));
+	}
+
+protected:
+	MappedFile _file;
+	std::span<const Entry> _entries;
+	const char *_names = nullptr;
+};
+
+} // namespace Opal
+
+#endif // __ASSET_PACK_H__
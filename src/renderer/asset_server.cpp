@@ -0,0 +1,116 @@
+#include "asset_server.h"
+
+using namespace Opal;
+
+AssetServer::AssetServer(uint32_t thread_count) : _pool(thread_count) {}
+
+MeshHandle AssetServer::load_mesh(const char *filename) {
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto [it, inserted] = _meshes.emplace(filename, MeshHandle {});
+	if (inserted) {
+		it->second = MeshHandle::_create(filename);
+		_load_mesh(it->second);
+	}
+
+	return it->second;
+}
+
+TextureHandle AssetServer::load_texture(const char *filename) {
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto [it, inserted] = _textures.emplace(filename, TextureHandle {});
+	if (inserted) {
+		it->second = TextureHandle::_create(filename);
+		_load_texture(it->second);
+	}
+
+	return it->second;
+}
+
+MeshHandle AssetServer::load_geometry(const Geometry &geometry) {
+
+	const std::string name = geometry.get_name();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto [it, inserted] = _meshes.emplace(name, MeshHandle {});
+	if (inserted) {
+		it->second = MeshHandle::_create(name.c_str());
+		_load_geometry(it->second, geometry);
+	}
+
+	return it->second;
+}
+
+Job AssetServer::_load_mesh(MeshHandle handle) {
+
+	co_await _pool.schedule();
+
+	Renderer *renderer = Renderer::get_singleton();
+	Renderer::Mesh *mesh = &handle._state->value;
+	mesh->name			 = handle.get_path();
+
+	Error err = FAIL;
+	if (renderer == nullptr) {
+		LOG_ERR("Cannot load mesh %s before the renderer is initialized",
+				mesh->name);
+	} else {
+		err = renderer->load_mesh(mesh, mesh->name);
+	}
+
+	// the copies are only staged so far
+	if (err == OK)
+		err = renderer->wait_for_uploads(mesh->upload_ticket);
+
+	handle._complete(err);
+}
+
+Job AssetServer::_load_geometry(MeshHandle handle, Geometry geometry) {
+
+	co_await _pool.schedule();
+
+	Renderer *renderer = Renderer::get_singleton();
+	Renderer::Mesh *mesh = &handle._state->value;
+	mesh->name			 = handle.get_path();
+
+	Error err = FAIL;
+	if (renderer == nullptr) {
+		LOG_ERR("Cannot generate mesh %s before the renderer is initialized",
+				mesh->name);
+	} else if (geometry.generate(&mesh->vertices, &mesh->indices) == OK) {
+		err = renderer->upload_mesh(
+				mesh,
+				mesh->vertices.data(),
+				(uint32_t)mesh->vertices.size(),
+				mesh->indices.data(),
+				(uint32_t)mesh->indices.size());
+	}
+
+	if (err == OK)
+		err = renderer->wait_for_uploads(mesh->upload_ticket);
+
+	handle._complete(err);
+}
+
+Job AssetServer::_load_texture(TextureHandle handle) {
+
+	co_await _pool.schedule();
+
+	Renderer *renderer = Renderer::get_singleton();
+
+	Error err = FAIL;
+	if (renderer == nullptr) {
+		LOG_ERR("Cannot load texture %s before the renderer is initialized",
+				handle.get_path());
+	} else {
+		err = renderer->load_image(&handle._state->value, handle.get_path());
+	}
+
+	if (err == OK)
+		err = renderer->wait_for_uploads(handle._state->value.upload_ticket);
+
+	handle._complete(err);
+}
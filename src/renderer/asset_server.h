@@ -0,0 +1,158 @@
+#ifndef __ASSET_SERVER_H__
+#define __ASSET_SERVER_H__
+
+#include "../utils/task.h"
+#include "../utils/thread_pool.h"
+#include "geometry.h"
+#include "renderer.h"
+
+#include <condition_variable>
+#include <coroutine>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Opal {
+
+/**
+ * @brief Shared reference to an asset that is loaded in the background.
+ *
+ * The handle becomes ready once the asset is decoded and its GPU copy has
+ * completed. Handles can be waited on from a regular thread with wait() or
+ * awaited from a coroutine with `co_await handle`, which resumes the
+ * coroutine with a pointer to the asset, or nullptr if loading failed.
+ */
+template <typename T> class AssetHandle {
+
+public:
+	AssetHandle() = default;
+
+	bool is_valid() const { return _state != nullptr; }
+
+	bool is_ready() const {
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		return _state->ready;
+	}
+
+	/**
+	 * @brief Blocks until the asset has finished loading.
+	 */
+	Error wait() const {
+		std::unique_lock<std::mutex> lock(_state->mutex);
+		_state->condition.wait(lock, [this] { return _state->ready; });
+		return _state->error;
+	}
+
+	/**
+	 * @returns the asset, or nullptr if it isn't ready or failed to load.
+	 */
+	T *get() const {
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		return _state->ready && _state->error == OK ? &_state->value : nullptr;
+	}
+
+	const char *get_path() const { return _state->path.c_str(); }
+
+	bool await_ready() const { return is_ready(); }
+
+	bool await_suspend(std::coroutine_handle<> handle) {
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		if (_state->ready)
+			return false;
+		_state->waiters.push_back(handle);
+		return true;
+	}
+
+	T *await_resume() const { return get(); }
+
+protected:
+	friend class AssetServer;
+
+	struct State {
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool ready	= false;
+		Error error = OK;
+
+		std::string path;
+		T value;
+
+		// coroutines to resume once the asset is ready
+		std::vector<std::coroutine_handle<>> waiters;
+	};
+
+	std::shared_ptr<State> _state;
+
+	static AssetHandle _create(const char *path) {
+		AssetHandle handle;
+		handle._state		= std::make_shared<State>();
+		handle._state->path = path;
+		return handle;
+	}
+
+	void _complete(Error error) {
+		std::vector<std::coroutine_handle<>> waiters;
+		{
+			std::lock_guard<std::mutex> lock(_state->mutex);
+			_state->ready = true;
+			_state->error = error;
+			waiters.swap(_state->waiters);
+		}
+		_state->condition.notify_all();
+
+		// waiters continue on the thread that finished the load
+		for (auto waiter : waiters)
+			waiter.resume();
+	}
+};
+
+typedef AssetHandle<Renderer::Mesh> MeshHandle;
+typedef AssetHandle<Renderer::Image> TextureHandle;
+
+/**
+ * @brief Loads meshes and textures on a pool of worker threads.
+ *
+ * Every load runs as a coroutine on the pool, so parsing, welding, decoding
+ * and the GPU upload of different assets all overlap. Loading the same path
+ * twice returns the same handle, and so does generating the same geometry.
+ *
+ * The renderer must be initialized before loading anything, and the handles
+ * must outlive Renderer::destroy() since the renderer frees the uploaded
+ * buffers and images through them.
+ */
+class AssetServer {
+
+public:
+	/**
+	 * @param thread_count number of worker threads. 0 uses one per hardware
+	 * thread.
+	 */
+	explicit AssetServer(uint32_t thread_count = 0);
+
+	MeshHandle load_mesh(const char *filename);
+	TextureHandle load_texture(const char *filename);
+
+	/**
+	 * @brief Generates and uploads the geometry without touching the disk.
+	 * Geometries with the same parameters share one mesh, named by
+	 * Geometry::get_name().
+	 */
+	MeshHandle load_geometry(const Geometry &geometry);
+
+protected:
+	ThreadPool _pool;
+
+	std::mutex _mutex;
+	std::unordered_map<std::string, MeshHandle> _meshes;
+	std::unordered_map<std::string, TextureHandle> _textures;
+
+	Job _load_mesh(MeshHandle handle);
+	Job _load_geometry(MeshHandle handle, Geometry geometry);
+	Job _load_texture(TextureHandle handle);
+};
+
+} // namespace Opal
+
+#endif // __ASSET_SERVER_H__
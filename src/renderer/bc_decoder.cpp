@@ -0,0 +1,199 @@
+#include "bc_decoder.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Opal;
+
+namespace {
+
+void _unpack_565(uint16_t color, uint8_t *rgb) {
+	const uint32_t r = (color >> 11) & 0x1f;
+	const uint32_t g = (color >> 5) & 0x3f;
+	const uint32_t b = color & 0x1f;
+	rgb[0]			 = (uint8_t)((r << 3) | (r >> 2));
+	rgb[1]			 = (uint8_t)((g << 2) | (g >> 4));
+	rgb[2]			 = (uint8_t)((b << 3) | (b >> 2));
+}
+
+} // namespace
+
+bool BcDecoder::can_decode(VkFormat format) {
+	return get_decoded_format(format) != VK_FORMAT_UNDEFINED;
+}
+
+VkFormat BcDecoder::get_decoded_format(VkFormat format) {
+	switch (format) {
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+			return VK_FORMAT_R8G8B8A8_SRGB;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+			return VK_FORMAT_R8G8B8A8_UNORM;
+		default:
+			return VK_FORMAT_UNDEFINED;
+	}
+}
+
+Error BcDecoder::decode(
+		VkFormat format,
+		const uint8_t *blocks,
+		uint32_t width,
+		uint32_t height,
+		uint8_t *rgba) {
+
+	size_t block_size;
+	void (*decode_block)(const uint8_t *, uint8_t *);
+
+	switch (format) {
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+			block_size	 = 8;
+			decode_block = [](const uint8_t *block, uint8_t *out) {
+				_decode_bc1(block, true, out);
+			};
+			break;
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			block_size	 = 8;
+			decode_block = [](const uint8_t *block, uint8_t *out) {
+				_decode_bc1(block, false, out);
+			};
+			break;
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+			block_size	 = 16;
+			decode_block = _decode_bc3;
+			break;
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+			block_size	 = 8;
+			decode_block = _decode_bc4;
+			break;
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+			block_size	 = 16;
+			decode_block = _decode_bc5;
+			break;
+		default:
+			LOG_ERR("Can't decode block compressed format %d", (int)format);
+			return FAIL;
+	}
+
+	const uint32_t blocks_x = (width + 3) / 4;
+	const uint32_t blocks_y = (height + 3) / 4;
+
+	uint8_t texels[16 * 4];
+
+	for (uint32_t by = 0; by < blocks_y; ++by) {
+		for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+			decode_block(blocks, texels);
+			blocks += block_size;
+
+			// blocks on the right and bottom edges can hang over the image
+			const uint32_t rows = std::min(4u, height - by * 4);
+			const uint32_t cols = std::min(4u, width - bx * 4);
+
+			for (uint32_t y = 0; y < rows; ++y) {
+				memcpy(rgba + ((size_t)(by * 4 + y) * width + bx * 4) * 4,
+					   texels + y * 16,
+					   cols * 4);
+			}
+		}
+	}
+
+	return OK;
+}
+
+void BcDecoder::_decode_colors(
+		const uint8_t *block,
+		bool opaque,
+		bool allow_transparent,
+		uint8_t *out) {
+
+	const uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+	const uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+
+	uint8_t palette[4][4];
+	_unpack_565(c0, palette[0]);
+	_unpack_565(c1, palette[1]);
+	palette[0][3] = palette[1][3] = 255;
+
+	if (c0 > c1 || !allow_transparent) {
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+		palette[2][3] = palette[3][3] = 255;
+	} else {
+		// 3 color mode, the last entry is transparent black
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+			palette[3][c] = 0;
+		}
+		palette[2][3] = 255;
+		palette[3][3] = opaque ? 255 : 0;
+	}
+
+	const uint32_t indices = (uint32_t)block[4] | ((uint32_t)block[5] << 8) |
+							 ((uint32_t)block[6] << 16) |
+							 ((uint32_t)block[7] << 24);
+
+	for (uint32_t i = 0; i < 16; ++i)
+		memcpy(out + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+}
+
+void BcDecoder::_decode_channel(const uint8_t *block, uint8_t *out) {
+
+	const uint32_t a0 = block[0];
+	const uint32_t a1 = block[1];
+
+	uint8_t palette[8] = { (uint8_t)a0, (uint8_t)a1 };
+	if (a0 > a1) {
+		for (uint32_t i = 1; i < 7; ++i)
+			palette[i + 1] = (uint8_t)(((7 - i) * a0 + i * a1) / 7);
+	} else {
+		for (uint32_t i = 1; i < 5; ++i)
+			palette[i + 1] = (uint8_t)(((5 - i) * a0 + i * a1) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	// 16 3-bit indices packed into the last 6 bytes
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; ++i)
+		indices |= (uint64_t)block[2 + i] << (8 * i);
+
+	for (uint32_t i = 0; i < 16; ++i)
+		out[i * 4] = palette[(indices >> (i * 3)) & 7];
+}
+
+void BcDecoder::_decode_bc1(const uint8_t *block, bool opaque, uint8_t *out) {
+	_decode_colors(block, opaque, true, out);
+}
+
+void BcDecoder::_decode_bc3(const uint8_t *block, uint8_t *out) {
+	// the color block always uses 4 color mode in BC2 and BC3
+	_decode_colors(block + 8, true, false, out);
+	_decode_channel(block, out + 3);
+}
+
+void BcDecoder::_decode_bc4(const uint8_t *block, uint8_t *out) {
+	for (uint32_t i = 0; i < 16; ++i) {
+		out[i * 4 + 1] = 0;
+		out[i * 4 + 2] = 0;
+		out[i * 4 + 3] = 255;
+	}
+	_decode_channel(block, out);
+}
+
+void BcDecoder::_decode_bc5(const uint8_t *block, uint8_t *out) {
+	for (uint32_t i = 0; i < 16; ++i) {
+		out[i * 4 + 2] = 0;
+		out[i * 4 + 3] = 255;
+	}
+	_decode_channel(block, out);
+	_decode_channel(block + 8, out + 1);
+}
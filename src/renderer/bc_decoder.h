@@ -0,0 +1,59 @@
+#ifndef __BC_DECODER_H__
+#define __BC_DECODER_H__
+
+#include "../utils/error.h"
+#include "vk_types.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Opal {
+
+/**
+ * @brief CPU decoder for block compressed textures.
+ *
+ * Used as a fallback on devices that can't sample BC formats, so the texture
+ * can still be uploaded as plain RGBA8 at the cost of 4-8x the memory.
+ *
+ * BC1, BC3, BC4 and BC5 are supported. BC7 has to be sampled by the device.
+ */
+class BcDecoder {
+
+public:
+	static bool can_decode(VkFormat format);
+
+	/**
+	 * @returns the RGBA8 format the given format decodes to.
+	 */
+	static VkFormat get_decoded_format(VkFormat format);
+
+	/**
+	 * @brief Decodes one mip level into tightly packed RGBA8 texels.
+	 * @param rgba must hold width * height * 4 bytes.
+	 */
+	static Error decode(
+			VkFormat format,
+			const uint8_t *blocks,
+			uint32_t width,
+			uint32_t height,
+			uint8_t *rgba);
+
+protected:
+	// decodes a 4x4 block into 16 RGBA8 texels
+	static void _decode_bc1(const uint8_t *block, bool opaque, uint8_t *out);
+	static void _decode_bc3(const uint8_t *block, uint8_t *out);
+	static void _decode_bc4(const uint8_t *block, uint8_t *out);
+	static void _decode_bc5(const uint8_t *block, uint8_t *out);
+
+	// decodes one BC4 style channel into every 4th byte of out
+	static void _decode_channel(const uint8_t *block, uint8_t *out);
+	static void _decode_colors(
+			const uint8_t *block,
+			bool opaque,
+			bool allow_transparent,
+			uint8_t *out);
+};
+
+} // namespace Opal
+
+#endif // __BC_DECODER_H__
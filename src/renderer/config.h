@@ -9,6 +9,82 @@
 #define WINDOW_TITLE "Opal"
 #define WINDOW_INIT_SIZE 1280, 720
 
+// ASSET SETTINGS
+
+// pack of cooked assets written by opal_cook, relative to the working
+// directory. assets that aren't in the pack are imported from their source.
+#define ASSET_PACK_PATH "assets.pak"
+
+// caches imported meshes as binary files so they can skip parsing next run
+#define USE_MESH_CACHE
+
+// where mesh cache entries are written, relative to the working directory
+#define MESH_CACHE_DIR "cache/meshes/"
+
+// imported vertices that land in the same grid cell of this size are welded
+// together. 0 only welds exact duplicates.
+#define MESH_WELD_EPSILON 0.0f
+
+// imported meshes are reordered for a post-transform vertex cache of this
+// many entries. 0 keeps the triangles in file order.
+#define MESH_VERTEX_CACHE_SIZE 16
+
+// packs mesh vertices into 16 bit positions and texture coordinates and 8 bit
+// colors when they are uploaded, and drops attributes that never change.
+#define USE_COMPACT_VERTICES
+
+// stores compact positions as half floats instead of normalizing them to the
+// mesh bounds
+// #define COMPACT_HALF_POSITIONS
+
+// stores positions in their own tightly packed stream in front of the other
+// attributes, so depth only passes fetch nothing else
+#define USE_POSITION_STREAM
+
+// imported meshes get up to this many levels of detail, each with about half
+// the triangles of the one before. 1 only keeps the full detail mesh.
+#define MESH_LOD_COUNT 4
+
+// the coarsest level whose error stays below this many pixels on screen is
+// drawn
+#define MESH_LOD_PIXEL_ERROR 1.0f
+
+// fraction the screen space error has to move past the threshold before a
+// mesh switches level, so meshes near the threshold don't flicker between
+// levels
+#define MESH_LOD_HYSTERESIS 0.25f
+
+// largest staging buffer an upload allocates. bigger meshes are copied to the
+// GPU through it in chunks.
+#define UPLOAD_STAGING_WINDOW (64ull << 20)
+
+// persistently mapped ring that buffer uploads are staged in. at least twice
+// UPLOAD_STAGING_WINDOW, so a chunk can be written while the last one copies.
+#define UPLOAD_RING_SIZE (128ull << 20)
+
+// meshes are sub-allocated from one shared vertex buffer and one shared index
+// buffer of these sizes. meshes that don't fit get buffers of their own.
+#define GEOMETRY_ARENA_VERTEX_SIZE (256ull << 20)
+#define GEOMETRY_ARENA_INDEX_SIZE (64ull << 20)
+
+// RENDER SETTINGS
+
+// splits meshes into meshlets that are culled against the view frustum and
+// by their normal cones on the CPU before drawing
+#define USE_MESHLET_CULLING
+
+// size limits of each meshlet
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// draws the scene into the depth buffer with a position only pipeline first,
+// so the color pass only shades the closest surface of every pixel
+#define USE_DEPTH_PREPASS
+
+// vertices a StaticBatch puts into one mesh before starting the next. meshes
+// this small get 16 bit indices.
+#define STATIC_BATCH_MAX_VERTICES 65536
+
 // VULKAN SETTINGS
 
 #define VK_APP_NAME "Opal Demo"
@@ -26,10 +102,10 @@
 #define VMA_DUMP_STATS_ON_DESTROY
 
 // required vulkan api version
-#define VK_REQUIRED_API_VERSION VK_API_VERSION_1_1
+#define VK_REQUIRED_API_VERSION VK_API_VERSION_1_2
 
 // minimum vulkan api version supported by device
-#define VK_DEVICE_MINIMUM_VERSION VK_API_VERSION_1_1
+#define VK_DEVICE_MINIMUM_VERSION VK_API_VERSION_1_2
 
 // vulkan instance extensions
 const std::vector<const char *> VK_INSTANCE_EXTENSIONS {
@@ -71,6 +147,9 @@ const VkPhysicalDeviceFeatures VK_REQUIRED_DEVICE_FEATURES {
 	.samplerAnisotropy = VK_TRUE,
 };
 const VkPhysicalDeviceVulkan11Features VK_REQUIRED_DEVICE_FEATURES_11 {};
-const VkPhysicalDeviceVulkan12Features VK_REQUIRED_DEVICE_FEATURES_12 {};
+const VkPhysicalDeviceVulkan12Features VK_REQUIRED_DEVICE_FEATURES_12 {
+	// tracks when uploads on the transfer queue complete
+	.timelineSemaphore = VK_TRUE,
+};
 
 #endif // __CONFIG_H__
\ No newline at end of file
@@ -0,0 +1,257 @@
+#include "geometry.h"
+
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+
+using namespace Opal;
+
+namespace {
+
+const glm::vec3 WHITE = glm::vec3(1.0f);
+
+/**
+ * Adds the triangles of a grid of su by sv quads whose (su + 1) * (sv + 1)
+ * vertices start at base, row by row. Triangles are counter clockwise when
+ * u runs right and v runs up.
+ *
+ * Pinched grids collapse their first and last rows into single points, like
+ * the poles of a sphere, so the triangles that would be degenerate there are
+ * left out.
+ */
+void _add_quads(
+		std::vector<uint32_t> *indices,
+		uint32_t base,
+		uint32_t su,
+		uint32_t sv,
+		bool pinched = false) {
+
+	for (uint32_t j = 0; j < sv; ++j) {
+		for (uint32_t i = 0; i < su; ++i) {
+			const uint32_t a = base + j * (su + 1) + i;
+			const uint32_t b = a + 1;
+			const uint32_t c = b + su + 1;
+			const uint32_t d = a + su + 1;
+
+			if (!pinched || j > 0)
+				indices->insert(indices->end(), { a, b, c });
+			if (!pinched || j + 1 < sv)
+				indices->insert(indices->end(), { a, c, d });
+		}
+	}
+}
+
+/**
+ * Adds a flat patch spanning u_axis and v_axis from origin, which faces along
+ * their cross product.
+ */
+void _add_patch(
+		std::vector<Vertex> *vertices,
+		std::vector<uint32_t> *indices,
+		glm::vec3 origin,
+		glm::vec3 u_axis,
+		glm::vec3 v_axis,
+		uint32_t su,
+		uint32_t sv,
+		glm::vec2 tex_scale = glm::vec2(1.0f)) {
+
+	const uint32_t base = (uint32_t)vertices->size();
+
+	for (uint32_t j = 0; j <= sv; ++j) {
+		for (uint32_t i = 0; i <= su; ++i) {
+			const float u = (float)i / su;
+			const float v = (float)j / sv;
+			vertices->push_back({
+					.pos	   = origin + u_axis * u + v_axis * v,
+					.color	   = WHITE,
+					.tex_coord = glm::vec2(u, 1.0f - v) * tex_scale,
+			});
+		}
+	}
+
+	_add_quads(indices, base, su, sv);
+}
+
+void _generate_box(
+		const Geometry &geometry,
+		std::vector<Vertex> *vertices,
+		std::vector<uint32_t> *indices) {
+
+	const glm::vec3 h  = geometry.size * 0.5f;
+	const glm::uvec3 s = geometry.segments;
+	const glm::vec3 x  = glm::vec3(geometry.size.x, 0.0f, 0.0f);
+	const glm::vec3 y  = glm::vec3(0.0f, geometry.size.y, 0.0f);
+	const glm::vec3 z  = glm::vec3(0.0f, 0.0f, geometry.size.z);
+
+	// +x, -x, +y, -y, +z, -z
+	_add_patch(vertices, indices, { h.x, -h.y, h.z }, -z, y, s.z, s.y);
+	_add_patch(vertices, indices, { -h.x, -h.y, -h.z }, z, y, s.z, s.y);
+	_add_patch(vertices, indices, { -h.x, h.y, h.z }, x, -z, s.x, s.z);
+	_add_patch(vertices, indices, { -h.x, -h.y, -h.z }, x, z, s.x, s.z);
+	_add_patch(vertices, indices, { -h.x, -h.y, h.z }, x, y, s.x, s.y);
+	_add_patch(vertices, indices, { h.x, -h.y, -h.z }, -x, y, s.x, s.y);
+}
+
+/**
+ * Point on the unit circle around y. Angles run from +x towards -z, so
+ * surfaces of revolution are counter clockwise from outside with the angle
+ * as u and height as v.
+ */
+glm::vec2 _circle(uint32_t slice, uint32_t slices) {
+	const float angle = 2.0f * glm::pi<float>() * slice / slices;
+	return glm::vec2(std::cos(angle), -std::sin(angle));
+}
+
+void _generate_sphere(
+		const Geometry &geometry,
+		std::vector<Vertex> *vertices,
+		std::vector<uint32_t> *indices) {
+
+	const float radius	  = geometry.size.x;
+	const uint32_t slices = geometry.segments.x;
+	const uint32_t stacks = geometry.segments.y;
+
+	// from the bottom pole up, with the seam duplicated for the texture
+	for (uint32_t j = 0; j <= stacks; ++j) {
+		const float v	  = (float)j / stacks;
+		const float angle = glm::pi<float>() * v;
+		const float ring  = std::sin(angle);
+		const float y	  = -std::cos(angle);
+
+		for (uint32_t i = 0; i <= slices; ++i) {
+			const glm::vec2 circle = _circle(i, slices) * ring;
+			vertices->push_back({
+					.pos	   = glm::vec3(circle.x, y, circle.y) * radius,
+					.color	   = WHITE,
+					.tex_coord = glm::vec2((float)i / slices, 1.0f - v),
+			});
+		}
+	}
+
+	_add_quads(indices, 0, slices, stacks, true);
+}
+
+void _generate_cylinder(
+		const Geometry &geometry,
+		std::vector<Vertex> *vertices,
+		std::vector<uint32_t> *indices) {
+
+	const float radius	  = geometry.size.x;
+	const float height	  = geometry.size.y;
+	const uint32_t slices = geometry.segments.x;
+	const uint32_t stacks = geometry.segments.y;
+
+	for (uint32_t j = 0; j <= stacks; ++j) {
+		const float v = (float)j / stacks;
+		const float y = (v - 0.5f) * height;
+
+		for (uint32_t i = 0; i <= slices; ++i) {
+			const glm::vec2 circle = _circle(i, slices) * radius;
+			vertices->push_back({
+					.pos	   = glm::vec3(circle.x, y, circle.y),
+					.color	   = WHITE,
+					.tex_coord = glm::vec2((float)i / slices, 1.0f - v),
+			});
+		}
+	}
+
+	_add_quads(indices, 0, slices, stacks);
+
+	// caps are fans around their center, with the texture mapped onto the
+	// disc from above
+	for (float side : { 1.0f, -1.0f }) {
+		const uint32_t center = (uint32_t)vertices->size();
+		vertices->push_back({
+				.pos	   = glm::vec3(0.0f, side * height * 0.5f, 0.0f),
+				.color	   = WHITE,
+				.tex_coord = glm::vec2(0.5f),
+		});
+
+		for (uint32_t i = 0; i < slices; ++i) {
+			const glm::vec2 circle = _circle(i, slices);
+			vertices->push_back({
+					.pos	   = glm::vec3(circle.x, side, circle.y) *
+							 glm::vec3(radius, height * 0.5f, radius),
+					.color	   = WHITE,
+					.tex_coord = circle * 0.5f + 0.5f,
+			});
+		}
+
+		for (uint32_t i = 0; i < slices; ++i) {
+			const uint32_t a = center + 1 + i;
+			const uint32_t b = center + 1 + (i + 1) % slices;
+			if (side > 0.0f)
+				indices->insert(indices->end(), { center, a, b });
+			else
+				indices->insert(indices->end(), { center, b, a });
+		}
+	}
+}
+
+} // namespace
+
+std::string Geometry::get_name() const {
+	static const char *TYPE_NAMES[] = {
+		"box", "sphere", "plane", "cylinder", "grid",
+	};
+
+	char name[160];
+	snprintf(
+			name,
+			sizeof(name),
+			"geometry:%s %.9g %.9g %.9g %u %u %u",
+			type < std::size(TYPE_NAMES) ? TYPE_NAMES[type] : "unknown",
+			size.x,
+			size.y,
+			size.z,
+			segments.x,
+			segments.y,
+			segments.z);
+	return name;
+}
+
+Error Geometry::generate(
+		std::vector<Vertex> *vertices, std::vector<uint32_t> *indices) const {
+
+	vertices->clear();
+	indices->clear();
+
+	switch (type) {
+		case BOX:
+			_generate_box(*this, vertices, indices);
+			break;
+		case SPHERE:
+			_generate_sphere(*this, vertices, indices);
+			break;
+		case PLANE:
+			_add_patch(
+					vertices,
+					indices,
+					glm::vec3(-size.x * 0.5f, 0.0f, size.z * 0.5f),
+					glm::vec3(size.x, 0.0f, 0.0f),
+					glm::vec3(0.0f, 0.0f, -size.z),
+					segments.x,
+					segments.y);
+			break;
+		case GRID:
+			// the texture repeats once per cell
+			_add_patch(
+					vertices,
+					indices,
+					glm::vec3(-size.x * 0.5f, 0.0f, size.z * 0.5f),
+					glm::vec3(size.x, 0.0f, 0.0f),
+					glm::vec3(0.0f, 0.0f, -size.z),
+					(uint32_t)size.x * segments.x,
+					(uint32_t)size.z * segments.y,
+					glm::vec2(size.x, size.z));
+			break;
+		case CYLINDER:
+			_generate_cylinder(*this, vertices, indices);
+			break;
+		default:
+			ERR_FAIL_COND_V_MSG(
+					true, FAIL, "Unknown geometry type %u", (uint32_t)type);
+	}
+
+	return OK;
+}
@@ -0,0 +1,100 @@
+#ifndef __GEOMETRY_H__
+#define __GEOMETRY_H__
+
+#include "renderer.h"
+
+#include <string>
+
+namespace Opal {
+
+/**
+ * @brief Parameters of a procedurally generated mesh.
+ *
+ * Shapes are centered on the origin with +y up and wound counter clockwise
+ * seen from outside, the same as imported meshes. Vertices are white and
+ * texture coordinates stretch the texture once over each face, except on
+ * grids where it repeats once per cell.
+ *
+ * Two geometries with the same parameters always generate the same mesh, so
+ * get_name() can be used to share a single upload between them.
+ */
+struct Geometry {
+	enum Type : uint32_t {
+		// size is the extent along each axis, segments the number of
+		// quads along each of them
+		BOX,
+		// size.x is the radius, segments.x the slices around y and
+		// segments.y the stacks from pole to pole
+		SPHERE,
+		// lies in the xz plane facing +y. size.x and size.z are the extent,
+		// segments.x and segments.y the quads along them
+		PLANE,
+		// size.x is the radius and size.y the height, segments.x the slices
+		// around y and segments.y the quads along y. both ends are capped.
+		CYLINDER,
+		// a plane with size.x by size.z cells that are a unit wide each,
+		// split into segments.x by segments.y quads per cell
+		GRID,
+	};
+
+	Type type;
+	glm::vec3 size;
+	glm::uvec3 segments;
+
+	static Geometry box(glm::vec3 size, glm::uvec3 segments = glm::uvec3(1)) {
+		return { BOX, size, glm::max(segments, glm::uvec3(1)) };
+	}
+
+	static Geometry sphere(float radius, uint32_t slices, uint32_t stacks) {
+		return {
+			SPHERE,
+			glm::vec3(radius),
+			glm::uvec3(std::max(slices, 3u), std::max(stacks, 2u), 1),
+		};
+	}
+
+	static Geometry plane(float width, float depth, uint32_t segments = 1) {
+		segments = std::max(segments, 1u);
+		return {
+			PLANE,
+			glm::vec3(width, 0.0f, depth),
+			glm::uvec3(segments, segments, 1),
+		};
+	}
+
+	static Geometry cylinder(
+			float radius, float height, uint32_t slices, uint32_t stacks = 1) {
+		return {
+			CYLINDER,
+			glm::vec3(radius, height, radius),
+			glm::uvec3(std::max(slices, 3u), std::max(stacks, 1u), 1),
+		};
+	}
+
+	static Geometry
+	grid(uint32_t columns, uint32_t rows, uint32_t segments_per_cell = 1) {
+		segments_per_cell = std::max(segments_per_cell, 1u);
+		return {
+			GRID,
+			glm::vec3(std::max(columns, 1u), 0.0f, std::max(rows, 1u)),
+			glm::uvec3(segments_per_cell, segments_per_cell, 1),
+		};
+	}
+
+	/**
+	 * @returns a name unique to the type and parameters. It's used as the
+	 * name of the generated mesh.
+	 */
+	std::string get_name() const;
+
+	/**
+	 * @brief Replaces the vertices and indices with the generated shape.
+	 */
+	Error generate(
+			std::vector<Vertex> *vertices,
+			std::vector<uint32_t> *indices) const;
+};
+
+} // namespace Opal
+
+#endif // __GEOMETRY_H__
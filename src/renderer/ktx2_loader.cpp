@@ -0,0 +1,176 @@
+#include "ktx2_loader.h"
+#include "renderer.h"
+
+#include <zlib.h>
+
+using namespace Opal;
+
+namespace {
+
+// everything in the header is little endian and the fields are naturally
+// aligned, but the file data might not be
+struct Header {
+	uint8_t identifier[12];
+	uint32_t vk_format;
+	uint32_t type_size;
+	uint32_t pixel_width;
+	uint32_t pixel_height;
+	uint32_t pixel_depth;
+	uint32_t layer_count;
+	uint32_t face_count;
+	uint32_t level_count;
+	uint32_t supercompression_scheme;
+	uint32_t dfd_byte_offset;
+	uint32_t dfd_byte_length;
+	uint32_t kvd_byte_offset;
+	uint32_t kvd_byte_length;
+	uint64_t sgd_byte_offset;
+	uint64_t sgd_byte_length;
+};
+
+struct LevelIndex {
+	uint64_t byte_offset;
+	uint64_t byte_length;
+	uint64_t uncompressed_byte_length;
+};
+
+static_assert(sizeof(Header) == 80, "KTX2 header must be 80 bytes");
+static_assert(sizeof(LevelIndex) == 24, "KTX2 level index must be 24 bytes");
+
+} // namespace
+
+bool Ktx2Loader::is_ktx2(std::span<const uint8_t> data) {
+	return data.size() >= sizeof(IDENTIFIER) &&
+		   memcmp(data.data(), IDENTIFIER, sizeof(IDENTIFIER)) == 0;
+}
+
+Error Ktx2Loader::load(const char *filename, Data *out) {
+	MappedFile file;
+	ERR_FAIL_COND_V_MSG(
+			!file.open(filename, MappedFile::HINT_WILL_NEED),
+			FAIL,
+			"Failed to load texture: can't open %s",
+			filename);
+
+	if (parse({ file.data(), file.size() }, out) != OK) {
+		LOG_ERR("Failed to load texture %s", filename);
+		return FAIL;
+	}
+
+	return OK;
+}
+
+Error Ktx2Loader::parse(std::span<const uint8_t> data, Data *out) {
+
+	ERR_FAIL_COND_V_MSG(
+			!is_ktx2(data) || data.size() < sizeof(Header),
+			FAIL,
+			"Not a KTX2 file");
+
+	Header header;
+	memcpy(&header, data.data(), sizeof(header));
+
+	ERR_FAIL_COND_V_MSG(
+			header.pixel_width == 0 || header.pixel_height == 0 ||
+					header.pixel_depth > 1 || header.layer_count > 1 ||
+					header.face_count != 1,
+			FAIL,
+			"Only 2D KTX2 textures are supported");
+
+	// vkFormat is undefined for Basis Universal payloads which have to be
+	// transcoded, the same goes for supercompression schemes we can't undo
+	ERR_FAIL_COND_V_MSG(
+			header.vk_format == VK_FORMAT_UNDEFINED,
+			FAIL,
+			"Basis Universal KTX2 textures are not supported");
+	ERR_FAIL_COND_V_MSG(
+			header.supercompression_scheme != SUPERCOMPRESSION_NONE &&
+					header.supercompression_scheme !=
+							SUPERCOMPRESSION_ZLIB,
+			FAIL,
+			"Unsupported KTX2 supercompression scheme %u",
+			header.supercompression_scheme);
+
+	const VkFormat format = (VkFormat)header.vk_format;
+	ERR_FAIL_COND_V_MSG(
+			Renderer::get_level_size(format, 1, 1) == 0,
+			FAIL,
+			"Unsupported KTX2 texture format %u",
+			header.vk_format);
+
+	// a level count of 0 asks for the chain to be generated at load time,
+	// which we only do for decoded images
+	const uint32_t level_count = std::max(1u, header.level_count);
+	ERR_FAIL_COND_V_MSG(
+			level_count > Renderer::get_mip_level_count(
+								  header.pixel_width, header.pixel_height),
+			FAIL,
+			"Invalid KTX2 level count %u",
+			level_count);
+	ERR_FAIL_COND_V_MSG(
+			data.size() < sizeof(Header) + level_count * sizeof(LevelIndex),
+			FAIL,
+			"KTX2 level index is truncated");
+
+	out->width		= header.pixel_width;
+	out->height		= header.pixel_height;
+	out->mip_levels = level_count;
+	out->format		= format;
+
+	VkDeviceSize total_size = 0;
+	for (uint32_t level = 0; level < level_count; ++level) {
+		total_size += Renderer::get_level_size(
+				format,
+				std::max(1u, header.pixel_width >> level),
+				std::max(1u, header.pixel_height >> level));
+	}
+
+	out->levels.resize(total_size);
+
+	uint8_t *dst = out->levels.data();
+	for (uint32_t level = 0; level < level_count; ++level) {
+		LevelIndex index;
+		memcpy(&index,
+			   data.data() + sizeof(Header) + level * sizeof(LevelIndex),
+			   sizeof(index));
+
+		const VkDeviceSize level_size = Renderer::get_level_size(
+				format,
+				std::max(1u, header.pixel_width >> level),
+				std::max(1u, header.pixel_height >> level));
+
+		ERR_FAIL_COND_V_MSG(
+				index.byte_offset > data.size() ||
+						index.byte_length > data.size() - index.byte_offset,
+				FAIL,
+				"KTX2 level %u is out of bounds",
+				level);
+
+		const uint8_t *src = data.data() + index.byte_offset;
+
+		if (header.supercompression_scheme == SUPERCOMPRESSION_ZLIB) {
+			uLongf length = (uLongf)level_size;
+			const int err =
+					uncompress(dst, &length, src, (uLong)index.byte_length);
+			ERR_FAIL_COND_V_MSG(
+					err != Z_OK || length != level_size,
+					FAIL,
+					"Failed to inflate KTX2 level %u: %d",
+					level,
+					err);
+		} else {
+			ERR_FAIL_COND_V_MSG(
+					index.byte_length != level_size,
+					FAIL,
+					"KTX2 level %u has %llu bytes, expected %llu",
+					level,
+					(unsigned long long)index.byte_length,
+					(unsigned long long)level_size);
+			memcpy(dst, src, level_size);
+		}
+
+		dst += level_size;
+	}
+
+	return OK;
+}
@@ -0,0 +1,63 @@
+#ifndef __KTX2_LOADER_H__
+#define __KTX2_LOADER_H__
+
+#include "../utils/error.h"
+#include "vk_types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Opal {
+
+/**
+ * @brief Reader for KTX2 texture containers.
+ *
+ * Only single 2D images are supported, no arrays, cube maps or 3D textures.
+ * Level data can be stored as is or zlib supercompressed. Basis Universal
+ * and Zstd payloads are rejected since there is no transcoder for them here,
+ * so they have to be converted to a BC format before they are cooked.
+ */
+class Ktx2Loader {
+
+public:
+	struct Data {
+		uint32_t width		= 0;
+		uint32_t height		= 0;
+		uint32_t mip_levels = 0;
+		VkFormat format		= VK_FORMAT_UNDEFINED;
+		// tightly packed mip levels, largest first
+		std::vector<uint8_t> levels;
+	};
+
+	static constexpr uint8_t IDENTIFIER[12] = {
+		0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'
+	};
+
+	enum Supercompression : uint32_t {
+		SUPERCOMPRESSION_NONE	  = 0,
+		SUPERCOMPRESSION_BASIS_LZ = 1,
+		SUPERCOMPRESSION_ZSTD	  = 2,
+		SUPERCOMPRESSION_ZLIB	  = 3,
+	};
+
+	/**
+	 * @returns true if the data starts with the KTX2 identifier.
+	 */
+	static bool is_ktx2(std::span<const uint8_t> data);
+
+	/**
+	 * @brief Reads and parses the given KTX2 file.
+	 */
+	static Error load(const char *filename, Data *out);
+
+	/**
+	 * @brief Parses a KTX2 file that is already in memory.
+	 */
+	static Error parse(std::span<const uint8_t> data, Data *out);
+};
+
+} // namespace Opal
+
+#endif // __KTX2_LOADER_H__
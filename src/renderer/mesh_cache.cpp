@@ -0,0 +1,402 @@
+#include "mesh_cache.h"
+#include "mesh_codec.h"
+#include "meshlet_builder.h"
+
+#include "../utils/file.h"
+#include "../utils/hash.h"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace Opal;
+
+namespace fs = std::filesystem;
+
+MeshCache::Stats MeshCache::_stats {};
+
+namespace {
+
+struct CacheHeader {
+	char magic[4];
+	uint32_t version;
+	// used to catch changes to the Vertex struct
+	uint32_t vertex_size;
+	uint32_t path_length;
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint64_t content_hash;
+	uint64_t vertex_count;
+	uint64_t index_count;
+	uint64_t import_time_us;
+	// entries welded with a different epsilon are rebuilt
+	float weld_epsilon;
+	// and so are entries optimized for a different vertex cache size
+	uint32_t vertex_cache;
+	// or built with a different number of levels of detail
+	uint32_t max_lod_count;
+	// entries in the level table after the indices
+	uint32_t lod_count;
+	// and entries ordered for different meshlets
+	uint32_t meshlet_vertices;
+	uint32_t meshlet_triangles;
+	// entries in the submesh and material color tables after the levels
+	uint32_t submesh_count;
+	uint32_t material_count;
+	// sizes of the MeshCodec encoded vertices and indices after the tables
+	uint64_t vertex_data_size;
+	uint64_t index_data_size;
+};
+
+constexpr char CACHE_MAGIC[4] = { 'O', 'P', 'M', 'C' };
+
+// the source path is stored after the header, padded so the tables after it
+// stay aligned.
+constexpr size_t CACHE_DATA_ALIGN = 16;
+
+size_t _align_up(size_t value, size_t align) {
+	return (value + align - 1) & ~(align - 1);
+}
+
+bool _hash_source(const char *source_path, uint64_t *hash) {
+	MappedFile source;
+	if (!source.open(source_path, MappedFile::HINT_SEQUENTIAL))
+		return false;
+	*hash = hash_bytes(source.data(), source.size());
+	return true;
+}
+
+/**
+ * Takes count items of type T off the bytes left in an entry.
+ * @returns false if there aren't that many bytes left.
+ */
+template <typename T>
+bool _take(uint64_t *left, uint64_t count, uint64_t *bytes) {
+	if (count > *left / sizeof(T))
+		return false;
+	*bytes = count * sizeof(T);
+	*left -= *bytes;
+	return true;
+}
+
+double _elapsed_ms(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(
+				   std::chrono::high_resolution_clock::now() - start)
+			.count();
+}
+
+} // namespace
+
+std::string MeshCache::_entry_path(const char *source_path) {
+	char name[32];
+	snprintf(
+			name,
+			sizeof(name),
+			"%016llx.mesh",
+			(unsigned long long)hash_bytes(source_path, strlen(source_path)));
+	return std::string(MESH_CACHE_DIR) + name;
+}
+
+bool MeshCache::load(Renderer::Mesh *mesh, const char *source_path) {
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// each call gets its own error so one failing can't be hidden by the
+	// other succeeding
+	std::error_code size_ec;
+	std::error_code mtime_ec;
+	const auto source_size	= fs::file_size(source_path, size_ec);
+	const auto source_mtime = fs::last_write_time(source_path, mtime_ec);
+
+	// let the importer report missing source files
+	if (size_ec || mtime_ec) {
+		_stats.misses++;
+		return false;
+	}
+
+	const std::string entry_path = _entry_path(source_path);
+	const size_t path_length	 = strlen(source_path);
+
+	bool mtime_changed = false;
+	{
+		MappedFile entry;
+		if (!entry.open(entry_path, MappedFile::HINT_WILL_NEED)) {
+			_stats.misses++;
+			return false;
+		}
+
+		if (entry.size() < sizeof(CacheHeader)) {
+			_stats.misses++;
+			return false;
+		}
+
+		CacheHeader header;
+		memcpy(&header, entry.data(), sizeof(header));
+
+		const size_t data_offset =
+				_align_up(sizeof(CacheHeader) + path_length, CACHE_DATA_ALIGN);
+		const uint8_t *stored_path = entry.data() + sizeof(CacheHeader);
+
+		if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+			header.version != VERSION || header.vertex_size != sizeof(Vertex) ||
+			header.weld_epsilon != MESH_WELD_EPSILON ||
+			header.vertex_cache != MESH_VERTEX_CACHE_SIZE ||
+			header.max_lod_count != MESH_LOD_COUNT ||
+			header.meshlet_vertices != MeshletBuilder::MAX_VERTICES ||
+			header.meshlet_triangles != MeshletBuilder::MAX_TRIANGLES ||
+			header.path_length != path_length ||
+			header.source_size != source_size || entry.size() < data_offset ||
+			memcmp(stored_path, source_path, path_length) != 0) {
+			_stats.misses++;
+			return false;
+		}
+
+		// every table has to fit in the rest of the entry. the counts are
+		// checked before they are multiplied, so a corrupt header can't
+		// overflow the sizes into passing
+		using Lod	  = Renderer::Mesh::Lod;
+		using Submesh = Renderer::Mesh::Submesh;
+
+		uint64_t left		   = entry.size() - data_offset;
+		uint64_t lod_bytes	   = 0;
+		uint64_t submesh_bytes = 0;
+		uint64_t color_bytes   = 0;
+		uint64_t vertex_bytes  = 0;
+		uint64_t index_bytes   = 0;
+
+		const bool tables_fit =
+				_take<Lod>(&left, header.lod_count, &lod_bytes) &&
+				_take<Submesh>(&left, header.submesh_count, &submesh_bytes) &&
+				_take<glm::vec4>(&left, header.material_count, &color_bytes) &&
+				_take<uint8_t>(&left, header.vertex_data_size, &vertex_bytes) &&
+				_take<uint8_t>(&left, header.index_data_size, &index_bytes);
+
+		// the counts are only checked by decoding, which needs room for
+		// them first
+		const bool counts_fit =
+				header.vertex_count <=
+						MeshCodec::get_max_vertex_count(vertex_bytes) &&
+				header.index_count <=
+						MeshCodec::get_max_index_count(index_bytes);
+		if (!tables_fit || !counts_fit) {
+			_stats.misses++;
+			return false;
+		}
+
+		// the source was touched since the entry was written so only trust
+		// the entry if the contents are still the same.
+		if (header.source_mtime !=
+			(int64_t)source_mtime.time_since_epoch().count()) {
+			uint64_t content_hash;
+			if (!_hash_source(source_path, &content_hash) ||
+				content_hash != header.content_hash) {
+				_stats.misses++;
+				return false;
+			}
+			mtime_changed = true;
+		}
+
+		const uint8_t *tables = entry.data() + data_offset;
+		const auto lods =
+				reinterpret_cast<const Renderer::Mesh::Lod *>(tables);
+		const auto submeshes =
+				reinterpret_cast<const Renderer::Mesh::Submesh *>(
+						tables + lod_bytes);
+		const auto colors = reinterpret_cast<const glm::vec4 *>(
+				tables + lod_bytes + submesh_bytes);
+
+		const uint8_t *vertex_data =
+				tables + lod_bytes + submesh_bytes + color_bytes;
+		const uint8_t *index_data = vertex_data + vertex_bytes;
+
+		// decode straight into the mesh
+		mesh->vertices.resize(header.vertex_count);
+		mesh->indices.resize(header.index_count);
+		if (MeshCodec::decode_vertices(
+					{ vertex_data, vertex_bytes },
+					mesh->vertices) != OK ||
+				MeshCodec::decode_indices(
+						{ index_data, index_bytes },
+						mesh->indices) != OK) {
+			mesh->vertices.clear();
+			mesh->indices.clear();
+			_stats.misses++;
+			return false;
+		}
+
+		mesh->lods.assign(lods, lods + header.lod_count);
+		mesh->submeshes.assign(submeshes, submeshes + header.submesh_count);
+		mesh->material_colors.assign(colors, colors + header.material_count);
+
+		const double load_ms = _elapsed_ms(start);
+
+		_stats.hits++;
+		_stats.hit_time_us += (uint64_t)(load_ms * 1000.0);
+		_stats.saved_import_time_us += header.import_time_us;
+
+		LOG_INFO(
+				"mesh cache hit: %s in %.2f ms (import took %.2f ms)",
+				source_path,
+				load_ms,
+				header.import_time_us / 1000.0);
+	}
+
+	// refresh the stored mtime so we don't rehash the source next time.
+	if (mtime_changed) {
+		std::fstream file(
+				entry_path, std::ios::in | std::ios::out | std::ios::binary);
+		CacheHeader header;
+		if (file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+			header.source_mtime =
+					(int64_t)source_mtime.time_since_epoch().count();
+			file.seekp(0);
+			file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		}
+	}
+
+	return true;
+}
+
+Error MeshCache::store(
+		const Renderer::Mesh *mesh,
+		const char *source_path,
+		double import_time_ms) {
+
+	_stats.miss_time_us += (uint64_t)(import_time_ms * 1000.0);
+
+	std::error_code ec;
+	const auto source_size = fs::file_size(source_path, ec);
+	ERR_FAIL_COND_V_MSG(
+			ec,
+			FAIL,
+			"Failed to stat mesh source %s: %s",
+			source_path,
+			ec.message().c_str());
+
+	const auto source_mtime = fs::last_write_time(source_path, ec);
+	ERR_FAIL_COND_V_MSG(
+			ec,
+			FAIL,
+			"Failed to stat mesh source %s: %s",
+			source_path,
+			ec.message().c_str());
+
+	uint64_t content_hash;
+	ERR_FAIL_COND_V_MSG(
+			!_hash_source(source_path, &content_hash),
+			FAIL,
+			"Failed to hash mesh source %s",
+			source_path);
+
+	fs::create_directories(MESH_CACHE_DIR, ec);
+	ERR_FAIL_COND_V_MSG(
+			ec,
+			FAIL,
+			"Failed to create mesh cache directory %s: %s",
+			MESH_CACHE_DIR,
+			ec.message().c_str());
+
+	const size_t path_length = strlen(source_path);
+
+	std::vector<uint8_t> vertex_data;
+	std::vector<uint8_t> index_data;
+	MeshCodec::encode_vertices(mesh->vertices, &vertex_data);
+	MeshCodec::encode_indices(mesh->indices, &index_data);
+
+	CacheHeader header {
+		.version		   = VERSION,
+		.vertex_size	   = sizeof(Vertex),
+		.path_length	   = (uint32_t)path_length,
+		.source_size	   = source_size,
+		.source_mtime	   = (int64_t)source_mtime.time_since_epoch().count(),
+		.content_hash	   = content_hash,
+		.vertex_count	   = mesh->vertices.size(),
+		.index_count	   = mesh->indices.size(),
+		.import_time_us	   = (uint64_t)(import_time_ms * 1000.0),
+		.weld_epsilon	   = MESH_WELD_EPSILON,
+		.vertex_cache	   = MESH_VERTEX_CACHE_SIZE,
+		.max_lod_count	   = MESH_LOD_COUNT,
+		.lod_count		   = (uint32_t)mesh->lods.size(),
+		.meshlet_vertices  = MeshletBuilder::MAX_VERTICES,
+		.meshlet_triangles = MeshletBuilder::MAX_TRIANGLES,
+		.submesh_count	   = (uint32_t)mesh->submeshes.size(),
+		.material_count	   = (uint32_t)mesh->material_colors.size(),
+		.vertex_data_size  = vertex_data.size(),
+		.index_data_size   = index_data.size(),
+	};
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+
+	const size_t padding =
+			_align_up(sizeof(CacheHeader) + path_length, CACHE_DATA_ALIGN) -
+			(sizeof(CacheHeader) + path_length);
+	const char zeros[CACHE_DATA_ALIGN] = {};
+
+	// write to a temporary file first so a crash never leaves a partial entry
+	// behind.
+	const std::string entry_path = _entry_path(source_path);
+	const std::string temp_path	 = entry_path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		ERR_FAIL_COND_V_MSG(
+				!file.is_open(),
+				FAIL,
+				"Failed to open mesh cache entry %s",
+				temp_path.c_str());
+
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(source_path, path_length);
+		file.write(zeros, padding);
+		file.write(
+				reinterpret_cast<const char *>(mesh->lods.data()),
+				mesh->lods.size() * sizeof(Renderer::Mesh::Lod));
+		file.write(
+				reinterpret_cast<const char *>(mesh->submeshes.data()),
+				mesh->submeshes.size() * sizeof(Renderer::Mesh::Submesh));
+		file.write(
+				reinterpret_cast<const char *>(mesh->material_colors.data()),
+				mesh->material_colors.size() * sizeof(glm::vec4));
+		file.write(
+				reinterpret_cast<const char *>(vertex_data.data()),
+				vertex_data.size());
+		file.write(
+				reinterpret_cast<const char *>(index_data.data()),
+				index_data.size());
+
+		ERR_FAIL_COND_V_MSG(
+				!file.good(),
+				FAIL,
+				"Failed to write mesh cache entry %s",
+				temp_path.c_str());
+	}
+
+	fs::rename(temp_path, entry_path, ec);
+	ERR_FAIL_COND_V_MSG(
+			ec,
+			FAIL,
+			"Failed to move mesh cache entry into place %s: %s",
+			entry_path.c_str(),
+			ec.message().c_str());
+
+	return OK;
+}
+
+void MeshCache::print_stats() {
+	const uint32_t hits	  = _stats.hits;
+	const uint32_t misses = _stats.misses;
+
+	LOG_INFO("mesh cache: %u hits, %u misses", hits, misses);
+	if (hits > 0) {
+		const double hit_ms	  = _stats.hit_time_us / 1000.0;
+		const double saved_ms = _stats.saved_import_time_us / 1000.0;
+		LOG_INFO(
+				"mesh cache: hits loaded in %.2f ms, importing them took "
+				"%.2f ms (%.1fx faster)",
+				hit_ms,
+				saved_ms,
+				hit_ms > 0.0 ? saved_ms / hit_ms : 0.0);
+	}
+	if (misses > 0) {
+		LOG_INFO(
+				"mesh cache: misses imported in %.2f ms",
+				_stats.miss_time_us / 1000.0);
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include "renderer.h"
+
+#include <atomic>
+
+namespace Opal {
+
+/**
+ * @brief On-disk cache of imported mesh data.
+ *
+ * Stores the final deduplicated vertices and indices of an imported mesh, along
+ * with its levels of detail and submeshes, in a versioned binary file so later
+ * runs can skip parsing the source file. Vertices and indices are compressed
+ * with MeshCodec. Cache entries are keyed by the source
+ * path and validated against the source's size, modification time and content
+ * hash. Material libraries aren't checked, so edits to them only show up once
+ * the source itself changes.
+ */
+class MeshCache {
+
+public:
+	/**
+	 * Bump this when the layout of the cache file or the output of the
+	 * importer changes so old entries get rebuilt.
+	 */
+	static constexpr uint32_t VERSION = 7;
+
+	/**
+	 * @brief Fills the mesh from the cache if there is a valid entry for the
+	 * given source file.
+	 * @returns true on a cache hit.
+	 */
+	static bool load(Renderer::Mesh *mesh, const char *source_path);
+
+	/**
+	 * @brief Writes the mesh data to the cache entry for the given source file.
+	 * @param import_time_ms how long the uncached import took. This is kept in
+	 * the entry so hits can report how much time they saved.
+	 */
+	static Error store(
+			const Renderer::Mesh *mesh,
+			const char *source_path,
+			double import_time_ms);
+
+	/**
+	 * @brief Logs the cache hit and miss counters along with load times.
+	 */
+	static void print_stats();
+
+protected:
+	struct Stats {
+		std::atomic<uint32_t> hits	 = 0;
+		std::atomic<uint32_t> misses = 0;
+		// total time spent loading hits
+		std::atomic<uint64_t> hit_time_us = 0;
+		// total time the hits originally took to import
+		std::atomic<uint64_t> saved_import_time_us = 0;
+		// total time spent importing misses
+		std::atomic<uint64_t> miss_time_us = 0;
+	};
+
+	static Stats _stats;
+
+	static std::string _entry_path(const char *source_path);
+};
+
+} // namespace Opal
+
+#endif // __MESH_CACHE_H__
@@ -0,0 +1,453 @@
+#include "mesh_codec.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESH_CODEC_SSE2
+#endif
+
+#include <limits>
+
+using namespace Opal;
+
+namespace {
+
+constexpr size_t VERTEX_SIZE = sizeof(Vertex);
+constexpr uint32_t BLOCK	 = MeshCodec::BLOCK_VERTICES;
+constexpr uint32_t GROUP	 = MeshCodec::GROUP_SIZE;
+
+static_assert(BLOCK % GROUP == 0, "blocks have to be made of whole groups");
+
+// bits per value of each group header code
+constexpr uint32_t GROUP_BITS[4] = { 0, 2, 4, 8 };
+
+uint8_t _zigzag(uint8_t delta) {
+	return (uint8_t)((delta << 1) ^ (uint8_t)((int8_t)delta >> 7));
+}
+
+size_t _get_header_size(uint32_t group_count) {
+	return (group_count + 3) / 4;
+}
+
+/**
+ * Packs a group of zigzag encoded values with the fewest bits that fit all
+ * of them. Values are stored from the high bits of each byte down.
+ * @returns the header code of the group.
+ */
+uint32_t _encode_group(const uint8_t *values, std::vector<uint8_t> *out) {
+	uint8_t largest = 0;
+	for (uint32_t i = 0; i < GROUP; ++i)
+		largest = std::max(largest, values[i]);
+
+	uint32_t code = 3;
+	if (largest == 0)
+		code = 0;
+	else if (largest < 4)
+		code = 1;
+	else if (largest < 16)
+		code = 2;
+
+	const uint32_t bits		  = GROUP_BITS[code];
+	const uint32_t per_byte	  = bits > 0 ? 8 / bits : 0;
+	const uint8_t value_mask  = (uint8_t)((1u << bits) - 1);
+	const size_t packed_bytes = bits * GROUP / 8;
+
+	for (size_t i = 0; i < packed_bytes; ++i) {
+		uint8_t byte = 0;
+		for (uint32_t j = 0; j < per_byte; ++j) {
+			byte |= (uint8_t)((values[i * per_byte + j] & value_mask)
+							  << (8 - bits * (j + 1)));
+		}
+		out->push_back(byte);
+	}
+
+	return code;
+}
+
+/**
+ * @returns how many bytes the groups of a stream take, from its header.
+ */
+size_t _get_stream_size(const uint8_t *header, uint32_t group_count) {
+	size_t size = 0;
+	for (uint32_t g = 0; g < group_count; ++g)
+		size += GROUP_BITS[(header[g / 4] >> (g % 4 * 2)) & 3] * GROUP / 8;
+	return size;
+}
+
+#ifdef MESH_CODEC_SSE2
+/**
+ * Unpacks a group written by _encode_group into 16 zigzag encoded values.
+ */
+__m128i _decode_group(const uint8_t *data, uint32_t code) {
+	const __m128i two_bits	= _mm_set1_epi8(0x03);
+	const __m128i four_bits = _mm_set1_epi8(0x0f);
+
+	switch (code) {
+		case 1: {
+			int32_t word;
+			memcpy(&word, data, sizeof(word));
+			const __m128i packed = _mm_cvtsi32_si128(word);
+
+			const __m128i a =
+					_mm_and_si128(_mm_srli_epi16(packed, 6), two_bits);
+			const __m128i b =
+					_mm_and_si128(_mm_srli_epi16(packed, 4), two_bits);
+			const __m128i c =
+					_mm_and_si128(_mm_srli_epi16(packed, 2), two_bits);
+			const __m128i d = _mm_and_si128(packed, two_bits);
+
+			return _mm_unpacklo_epi16(
+					_mm_unpacklo_epi8(a, b), _mm_unpacklo_epi8(c, d));
+		}
+		case 2: {
+			// the high nibble of each byte is the first of its two values
+			const __m128i packed =
+					_mm_loadl_epi64(reinterpret_cast<const __m128i *>(data));
+			const __m128i high =
+					_mm_and_si128(_mm_srli_epi16(packed, 4), four_bits);
+			return _mm_unpacklo_epi8(high, _mm_and_si128(packed, four_bits));
+		}
+		case 3:
+			return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+		default:
+			return _mm_setzero_si128();
+	}
+}
+#else
+// the SSE2 decoder undoes the zigzag on whole groups at once
+uint8_t _unzigzag(uint8_t value) {
+	return (uint8_t)((value >> 1) ^ (uint8_t)-(value & 1));
+}
+#endif
+
+/**
+ * Decodes the groups of one byte of the vertex into the byte values,
+ * continuing from the byte of the previous vertex.
+ */
+void _decode_stream(
+		const uint8_t *header,
+		const uint8_t *data,
+		uint32_t group_count,
+		uint8_t *values,
+		uint8_t *last) {
+
+#ifdef MESH_CODEC_SSE2
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i low = _mm_set1_epi8(0x7f);
+
+	__m128i carry = _mm_set1_epi8((char)*last);
+	for (uint32_t g = 0; g < group_count; ++g) {
+		const uint32_t code = (header[g / 4] >> (g % 4 * 2)) & 3;
+		__m128i v			= _decode_group(data, code);
+		data += GROUP_BITS[code] * GROUP / 8;
+
+		// (v >> 1) ^ -(v & 1), there are no 8 bit shifts
+		const __m128i sign =
+				_mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, one));
+		v = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(v, 1), low), sign);
+
+		// prefix sum of the 16 differences in 4 steps
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi8(v, carry);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(values + g * GROUP), v);
+
+		// broadcast the last byte
+		carry = _mm_unpackhi_epi8(v, v);
+		carry = _mm_shufflehi_epi16(carry, _MM_SHUFFLE(3, 3, 3, 3));
+		carry = _mm_unpackhi_epi64(carry, carry);
+	}
+#else
+	uint8_t value = *last;
+	for (uint32_t g = 0; g < group_count; ++g) {
+		const uint32_t bits = GROUP_BITS[(header[g / 4] >> (g % 4 * 2)) & 3];
+		if (bits == 0) {
+			memset(values + g * GROUP, value, GROUP);
+			continue;
+		}
+
+		const uint32_t per_byte	 = 8 / bits;
+		const uint8_t value_mask = (uint8_t)((1u << bits) - 1);
+
+		for (uint32_t i = 0; i < GROUP; ++i) {
+			const uint32_t shift = 8 - bits * (i % per_byte + 1);
+			value += _unzigzag((data[i / per_byte] >> shift) & value_mask);
+			values[g * GROUP + i] = value;
+		}
+		data += bits * GROUP / 8;
+	}
+#endif
+}
+
+#ifdef MESH_CODEC_SSE2
+/**
+ * Transposes 16 streams of 16 bytes into 16 rows of 16 bytes, one per
+ * vertex.
+ */
+void _transpose(const __m128i *streams, __m128i *rows) {
+	__m128i pairs[16];
+	for (int i = 0; i < 8; ++i) {
+		pairs[i] = _mm_unpacklo_epi8(streams[2 * i], streams[2 * i + 1]);
+		pairs[i + 8] = _mm_unpackhi_epi8(streams[2 * i], streams[2 * i + 1]);
+	}
+
+	// pairs[h * 8 + i] holds bytes 2i, 2i + 1 of vertices h * 8 up to 8
+	__m128i quads[16];
+	for (int h = 0; h < 2; ++h) {
+		for (int i = 0; i < 4; ++i) {
+			const __m128i a = pairs[h * 8 + 2 * i];
+			const __m128i b = pairs[h * 8 + 2 * i + 1];
+			quads[h * 8 + i]	 = _mm_unpacklo_epi16(a, b);
+			quads[h * 8 + 4 + i] = _mm_unpackhi_epi16(a, b);
+		}
+	}
+
+	// quads[g * 4 + i] holds bytes 4i up to 4 of vertices g * 4 up to 4
+	__m128i octs[16];
+	for (int g = 0; g < 4; ++g) {
+		for (int i = 0; i < 2; ++i) {
+			const __m128i a = quads[g * 4 + 2 * i];
+			const __m128i b = quads[g * 4 + 2 * i + 1];
+			octs[g * 4 + i]		= _mm_unpacklo_epi32(a, b);
+			octs[g * 4 + 2 + i] = _mm_unpackhi_epi32(a, b);
+		}
+	}
+
+	// octs[p * 2 + i] holds bytes 8i up to 8 of vertices p * 2 and p * 2 + 1
+	for (int p = 0; p < 8; ++p) {
+		rows[p * 2]		= _mm_unpacklo_epi64(octs[p * 2], octs[p * 2 + 1]);
+		rows[p * 2 + 1] = _mm_unpackhi_epi64(octs[p * 2], octs[p * 2 + 1]);
+	}
+}
+#endif
+
+/**
+ * Interleaves the byte streams of a block back into vertices.
+ */
+void _store_vertices(
+		const uint8_t (*streams)[BLOCK], uint32_t count, uint8_t *out) {
+	uint32_t i = 0;
+
+#ifdef MESH_CODEC_SSE2
+	static_assert(VERTEX_SIZE % 16 == 0);
+	for (; i + GROUP <= count; i += GROUP) {
+		for (size_t k = 0; k < VERTEX_SIZE; k += 16) {
+			__m128i columns[16];
+			__m128i rows[16];
+			for (int c = 0; c < 16; ++c) {
+				columns[c] = _mm_loadu_si128(
+						reinterpret_cast<const __m128i *>(streams[k + c] + i));
+			}
+			_transpose(columns, rows);
+			for (int r = 0; r < 16; ++r) {
+				_mm_storeu_si128(
+						reinterpret_cast<__m128i *>(
+								out + (i + r) * VERTEX_SIZE + k),
+						rows[r]);
+			}
+		}
+	}
+#endif
+
+	for (; i < count; ++i) {
+		for (size_t k = 0; k < VERTEX_SIZE; ++k)
+			out[i * VERTEX_SIZE + k] = streams[k][i];
+	}
+}
+
+} // namespace
+
+void MeshCodec::encode_vertices(
+		std::span<const Vertex> vertices, std::vector<uint8_t> *out) {
+
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(vertices.data());
+
+	uint8_t last[VERTEX_SIZE] = {};
+	uint8_t deltas[BLOCK];
+
+	for (size_t first = 0; first < vertices.size(); first += BLOCK) {
+		const uint32_t count =
+				(uint32_t)std::min<size_t>(BLOCK, vertices.size() - first);
+		const uint32_t group_count = (count + GROUP - 1) / GROUP;
+
+		for (size_t k = 0; k < VERTEX_SIZE; ++k) {
+			// the last group is padded with zeros, which fit any width
+			memset(deltas, 0, sizeof(deltas));
+			for (uint32_t i = 0; i < count; ++i) {
+				const uint8_t value = bytes[(first + i) * VERTEX_SIZE + k];
+				deltas[i]			= _zigzag((uint8_t)(value - last[k]));
+				last[k]				= value;
+			}
+
+			// the header goes in front and is filled in as groups are packed
+			const size_t header = out->size();
+			out->resize(header + _get_header_size(group_count), 0);
+
+			for (uint32_t g = 0; g < group_count; ++g) {
+				const uint32_t code = _encode_group(deltas + g * GROUP, out);
+				(*out)[header + g / 4] |= (uint8_t)(code << (g % 4 * 2));
+			}
+		}
+	}
+}
+
+Error MeshCodec::decode_vertices(
+		std::span<const uint8_t> data, std::span<Vertex> vertices) {
+
+	VertexDecoder decoder(data);
+	ERR_TRY(decoder.decode(vertices));
+	return decoder.finish();
+}
+
+void MeshCodec::encode_indices(
+		std::span<const uint32_t> indices, std::vector<uint8_t> *out) {
+
+	uint32_t last = 0;
+	for (uint32_t index : indices) {
+		const int32_t delta	 = (int32_t)(index - last);
+		uint32_t value		 = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+		last				 = index;
+
+		while (value >= 0x80) {
+			out->push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out->push_back((uint8_t)value);
+	}
+}
+
+Error MeshCodec::decode_indices(
+		std::span<const uint8_t> data, std::span<uint32_t> indices) {
+
+	IndexDecoder decoder(data);
+	ERR_TRY(decoder.decode(indices));
+	return decoder.finish();
+}
+
+uint64_t MeshCodec::get_max_vertex_count(uint64_t size) {
+	// every stream spends at least one header byte on each 4 groups, even
+	// when none of them has any bits
+	return size / VERTEX_SIZE * 4 * GROUP;
+}
+
+uint64_t MeshCodec::get_max_index_count(uint64_t size) {
+	// every index takes at least one byte
+	return size;
+}
+
+Error VertexDecoder::decode(std::span<Vertex> vertices) {
+
+	ERR_FAIL_COND_V_MSG(
+			_ended && !vertices.empty(),
+			FAIL,
+			"Vertices can only be decoded in whole blocks");
+
+	uint8_t *out = reinterpret_cast<uint8_t *>(vertices.data());
+
+	alignas(16) uint8_t streams[VERTEX_SIZE][BLOCK];
+
+	for (size_t first = 0; first < vertices.size(); first += BLOCK) {
+		const uint32_t count =
+				(uint32_t)std::min<size_t>(BLOCK, vertices.size() - first);
+		const uint32_t group_count = (count + GROUP - 1) / GROUP;
+		const size_t header_size   = _get_header_size(group_count);
+
+		for (size_t k = 0; k < VERTEX_SIZE; ++k) {
+			ERR_FAIL_COND_V_MSG(
+					_data.size() - _offset < header_size,
+					FAIL,
+					"Encoded vertices are truncated");
+			const uint8_t *header = _data.data() + _offset;
+			_offset += header_size;
+
+			const size_t size = _get_stream_size(header, group_count);
+			ERR_FAIL_COND_V_MSG(
+					_data.size() - _offset < size,
+					FAIL,
+					"Encoded vertices are truncated");
+
+			_decode_stream(
+					header,
+					_data.data() + _offset,
+					group_count,
+					streams[k],
+					&_last[k]);
+			_offset += size;
+
+			// the padding of the last group isn't part of the stream
+			_last[k] = streams[k][count - 1];
+		}
+
+		_store_vertices(streams, count, out + first * VERTEX_SIZE);
+	}
+
+	_ended = vertices.size() % BLOCK != 0;
+
+	return OK;
+}
+
+Error VertexDecoder::finish() const {
+	ERR_FAIL_COND_V_MSG(
+			_offset != _data.size(),
+			FAIL,
+			"Encoded vertices don't match the vertex count");
+	return OK;
+}
+
+namespace {
+
+template <typename T>
+Error _decode_indices(
+		const uint8_t **in,
+		const uint8_t *end,
+		uint32_t *last,
+		std::span<T> indices) {
+
+	const uint8_t *p = *in;
+	uint32_t index	 = *last;
+
+	for (T &out : indices) {
+		uint32_t value = 0;
+		for (uint32_t shift = 0;; shift += 7) {
+			ERR_FAIL_COND_V_MSG(
+					p == end || shift > 28,
+					FAIL,
+					"Encoded indices are truncated");
+			const uint8_t byte = *p++;
+			value |= (uint32_t)(byte & 0x7f) << shift;
+			if (byte < 0x80)
+				break;
+		}
+
+		index += (value >> 1) ^ (uint32_t)-(int32_t)(value & 1);
+		ERR_FAIL_COND_V_MSG(
+				index > std::numeric_limits<T>::max(),
+				FAIL,
+				"Encoded index %u doesn't fit",
+				index);
+		out = (T)index;
+	}
+
+	*in	  = p;
+	*last = index;
+
+	return OK;
+}
+
+} // namespace
+
+Error IndexDecoder::decode(std::span<uint32_t> indices) {
+	return _decode_indices(&_in, _end, &_last, indices);
+}
+
+Error IndexDecoder::decode(std::span<uint16_t> indices) {
+	return _decode_indices(&_in, _end, &_last, indices);
+}
+
+Error IndexDecoder::finish() const {
+	ERR_FAIL_COND_V_MSG(
+			_in != _end, FAIL, "Encoded indices don't match the index count");
+	return OK;
+}
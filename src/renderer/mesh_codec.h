@@ -0,0 +1,138 @@
+#ifndef __MESH_CODEC_H__
+#define __MESH_CODEC_H__
+
+#include "renderer.h"
+
+#include <span>
+
+namespace Opal {
+
+/**
+ * @brief Lossless compression of stored mesh vertices and indices.
+ *
+ * Vertices are encoded in blocks of up to BLOCK_VERTICES. Within a block,
+ * every byte of the Vertex struct becomes its own stream of differences from
+ * the same byte of the previous vertex, zigzag encoded so small changes in
+ * either direction are small numbers. After vertex cache optimization
+ * neighbouring vertices are close, so most of those are tiny. Each group of
+ * 16 differences is packed with 0, 2, 4 or 8 bits per value, picked per group
+ * and stored in a 2 bit header in front of the stream's groups.
+ *
+ * The decoder unpacks a whole group, undoes the differences and transposes
+ * the streams back into vertices 16 at a time with SSE2 when it's available,
+ * and falls back to the same steps one byte at a time otherwise.
+ *
+ * Indices are stored as the zigzag encoded difference from the previous
+ * index, 7 bits per byte with the high bit marking that more bytes follow.
+ */
+class MeshCodec {
+
+public:
+	static constexpr uint32_t BLOCK_VERTICES = 256;
+	static constexpr uint32_t GROUP_SIZE	 = 16;
+
+	/**
+	 * @brief Appends the encoded vertices to out.
+	 */
+	static void encode_vertices(
+			std::span<const Vertex> vertices, std::vector<uint8_t> *out);
+
+	/**
+	 * @brief Decodes exactly vertices.size() vertices from data.
+	 * @returns FAIL if data is truncated or has bytes left over.
+	 */
+	static Error decode_vertices(
+			std::span<const uint8_t> data, std::span<Vertex> vertices);
+
+	/**
+	 * @brief Appends the encoded indices to out.
+	 */
+	static void encode_indices(
+			std::span<const uint32_t> indices, std::vector<uint8_t> *out);
+
+	/**
+	 * @brief Decodes exactly indices.size() indices from data.
+	 * @returns FAIL if data is truncated or has bytes left over.
+	 */
+	static Error decode_indices(
+			std::span<const uint8_t> data, std::span<uint32_t> indices);
+
+	/**
+	 * @returns the most vertices that size encoded bytes can decode to, so
+	 * counts read from a file can be checked before allocating for them.
+	 */
+	static uint64_t get_max_vertex_count(uint64_t size);
+
+	/**
+	 * @returns the most indices that size encoded bytes can decode to.
+	 */
+	static uint64_t get_max_index_count(uint64_t size);
+};
+
+/**
+ * @brief Decodes vertices encoded by MeshCodec a range at a time, so they can
+ * be written straight to where they are used, like upload staging memory,
+ * without decoding the whole mesh first.
+ */
+class VertexDecoder {
+
+public:
+	explicit VertexDecoder(std::span<const uint8_t> data) : _data(data) {}
+
+	/**
+	 * @brief Decodes the next vertices.size() vertices. Every range but the
+	 * last must be a whole number of MeshCodec::BLOCK_VERTICES.
+	 * @returns FAIL if the data is truncated.
+	 */
+	Error decode(std::span<Vertex> vertices);
+
+	/**
+	 * @returns FAIL if the data has bytes left over.
+	 */
+	Error finish() const;
+
+protected:
+	std::span<const uint8_t> _data;
+	size_t _offset = 0;
+	// a range that ended inside a block was decoded, so nothing can follow
+	bool _ended = false;
+	// the last vertex decoded, which the next block's differences are from
+	uint8_t _last[sizeof(Vertex)] = {};
+};
+
+/**
+ * @brief Decodes indices encoded by MeshCodec a range at a time, optionally
+ * narrowing them to 16 bits on the way.
+ */
+class IndexDecoder {
+
+public:
+	explicit IndexDecoder(std::span<const uint8_t> data) :
+			_in(data.data()), _end(data.data() + data.size()) {}
+
+	/**
+	 * @brief Decodes the next indices.size() indices.
+	 * @returns FAIL if the data is truncated.
+	 */
+	Error decode(std::span<uint32_t> indices);
+
+	/**
+	 * @brief Like the 32 bit decode.
+	 * @returns FAIL as well if an index doesn't fit in 16 bits.
+	 */
+	Error decode(std::span<uint16_t> indices);
+
+	/**
+	 * @returns FAIL if the data has bytes left over.
+	 */
+	Error finish() const;
+
+protected:
+	const uint8_t *_in;
+	const uint8_t *_end;
+	uint32_t _last = 0;
+};
+
+} // namespace Opal
+
+#endif // __MESH_CODEC_H__
@@ -0,0 +1,353 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <numeric>
+
+using namespace Opal;
+
+namespace {
+
+constexpr uint32_t INVALID_VERTEX = UINT32_MAX;
+
+/**
+ * FIFO cache that only keeps the time each vertex was last added. A vertex is
+ * still cached while fewer than size vertices were added after it.
+ */
+struct CacheSimulator {
+	std::vector<uint32_t> added;
+	uint32_t size;
+	uint32_t time;
+
+	CacheSimulator(size_t vertex_count, uint32_t cache_size) :
+			added(vertex_count, 0), size(cache_size), time(cache_size + 1) {}
+
+	bool contains(uint32_t vertex) const {
+		return time - added[vertex] <= size;
+	}
+
+	// @returns 1 on a cache miss
+	uint32_t access(uint32_t vertex) {
+		if (contains(vertex))
+			return 0;
+		added[vertex] = time++;
+		return 1;
+	}
+
+	void flush() { time += size + 1; }
+};
+
+} // namespace
+
+MeshOptimizer::CacheStats MeshOptimizer::analyze_vertex_cache(
+		std::span<const uint32_t> indices,
+		size_t vertex_count,
+		uint32_t cache_size) {
+
+	CacheStats stats;
+	if (indices.size() < 3)
+		return stats;
+
+	CacheSimulator cache(vertex_count, cache_size);
+	std::vector<bool> used(vertex_count, false);
+
+	uint32_t misses		 = 0;
+	uint32_t used_count = 0;
+	for (uint32_t index : indices) {
+		misses += cache.access(index);
+		if (!used[index]) {
+			used[index] = true;
+			used_count++;
+		}
+	}
+
+	stats.acmr = (float)misses / (float)(indices.size() / 3);
+	stats.atvr = (float)misses / (float)used_count;
+	return stats;
+}
+
+void MeshOptimizer::optimize_vertex_cache(
+		std::vector<uint32_t> *indices,
+		size_t vertex_count,
+		uint32_t cache_size,
+		std::vector<uint32_t> *clusters) {
+
+	const size_t triangle_count = indices->size() / 3;
+
+	if (clusters)
+		clusters->clear();
+	if (triangle_count == 0)
+		return;
+
+	// triangles using each vertex, packed back to back. trailing indices
+	// that don't make a whole triangle aren't part of any
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (size_t i = 0; i < triangle_count * 3; ++i)
+		offsets[(*indices)[i] + 1]++;
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	std::vector<uint32_t> adjacency(triangle_count * 3);
+	{
+		std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangle_count * 3; ++i)
+			adjacency[next[(*indices)[i]]++] = (uint32_t)(i / 3);
+	}
+
+	// triangles using each vertex that haven't been emitted yet
+	std::vector<uint32_t> live(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v)
+		live[v] = offsets[v + 1] - offsets[v];
+
+	CacheSimulator cache(vertex_count, cache_size);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<uint32_t> dead_end;
+	std::vector<uint32_t> candidates;
+
+	std::vector<uint32_t> out;
+	out.reserve(indices->size());
+
+	size_t cursor	 = 0;
+	uint32_t fanning = INVALID_VERTEX;
+	bool jumped		 = true;
+
+	while (true) {
+		if (fanning == INVALID_VERTEX) {
+			// nothing next to the last fan is left, so continue from the most
+			// recently used vertex that still has triangles, or the next
+			// unused one in input order
+			while (!dead_end.empty() && fanning == INVALID_VERTEX) {
+				const uint32_t vertex = dead_end.back();
+				dead_end.pop_back();
+				if (live[vertex] > 0)
+					fanning = vertex;
+			}
+			while (cursor < vertex_count && fanning == INVALID_VERTEX) {
+				if (live[cursor] > 0)
+					fanning = (uint32_t)cursor;
+				cursor++;
+			}
+			if (fanning == INVALID_VERTEX)
+				break;
+			jumped = true;
+		}
+
+		if (jumped && clusters)
+			clusters->push_back((uint32_t)(out.size() / 3));
+		jumped = false;
+
+		// emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t i = offsets[fanning]; i < offsets[fanning + 1]; ++i) {
+			const uint32_t triangle = adjacency[i];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = true;
+
+			for (uint32_t corner = 0; corner < 3; ++corner) {
+				const uint32_t vertex = (*indices)[triangle * 3 + corner];
+				out.push_back(vertex);
+				dead_end.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+				cache.access(vertex);
+			}
+		}
+
+		// fan around the neighbour that will still be cached once all of its
+		// triangles are emitted, preferring the one that was cached first
+		uint32_t next	= INVALID_VERTEX;
+		int64_t best	= -1;
+		for (uint32_t vertex : candidates) {
+			if (live[vertex] == 0)
+				continue;
+
+			const uint32_t age = cache.time - cache.added[vertex];
+			int64_t priority   = 0;
+			if (age + 2 * live[vertex] <= cache_size)
+				priority = age;
+
+			if (priority > best) {
+				best = priority;
+				next = vertex;
+			}
+		}
+
+		fanning = next;
+	}
+
+	if (clusters)
+		clusters->push_back((uint32_t)triangle_count);
+
+	// leftover indices stay at the end so the range keeps its size
+	out.insert(
+			out.end(), indices->begin() + triangle_count * 3, indices->end());
+	*indices = std::move(out);
+}
+
+void MeshOptimizer::optimize_overdraw(
+		std::vector<uint32_t> *indices,
+		const std::vector<Vertex> &vertices,
+		const std::vector<uint32_t> &clusters,
+		uint32_t cache_size,
+		float threshold) {
+
+	const size_t triangle_count = indices->size() / 3;
+	if (triangle_count == 0 || clusters.size() < 2)
+		return;
+
+	CacheSimulator cache(vertices.size(), cache_size);
+	auto triangle_misses = [&](uint32_t triangle) {
+		return cache.access((*indices)[triangle * 3 + 0]) +
+			   cache.access((*indices)[triangle * 3 + 1]) +
+			   cache.access((*indices)[triangle * 3 + 2]);
+	};
+
+	// split each cluster again wherever the triangles so far already reuse
+	// the cache about as well as the whole cluster does
+	std::vector<uint32_t> splits;
+	for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+		const uint32_t start = clusters[c];
+		const uint32_t end	 = clusters[c + 1];
+
+		cache.flush();
+		uint32_t cluster_misses = 0;
+		for (uint32_t t = start; t < end; ++t)
+			cluster_misses += triangle_misses(t);
+
+		const float max_acmr =
+				threshold * (float)cluster_misses / (float)(end - start);
+
+		cache.flush();
+		splits.push_back(start);
+
+		uint32_t misses = 0;
+		uint32_t count	= 0;
+		for (uint32_t t = start; t < end; ++t) {
+			misses += triangle_misses(t);
+			count++;
+
+			if (t + 1 < end && (float)misses <= max_acmr * (float)count) {
+				splits.push_back(t + 1);
+				cache.flush();
+				misses = 0;
+				count  = 0;
+			}
+		}
+	}
+	splits.push_back((uint32_t)triangle_count);
+
+	glm::vec3 mesh_center(0.0f);
+	for (const Vertex &vertex : vertices)
+		mesh_center += vertex.pos;
+	mesh_center /= (float)std::max<size_t>(vertices.size(), 1);
+
+	// clusters that face away from the middle of the mesh are more likely to
+	// occlude the rest, so they get drawn first
+	const size_t cluster_count = splits.size() - 1;
+	std::vector<float> sort_keys(cluster_count);
+	for (size_t c = 0; c < cluster_count; ++c) {
+		glm::vec3 center(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+
+		for (uint32_t t = splits[c]; t < splits[c + 1]; ++t) {
+			const glm::vec3 &a = vertices[(*indices)[t * 3 + 0]].pos;
+			const glm::vec3 &b = vertices[(*indices)[t * 3 + 1]].pos;
+			const glm::vec3 &d = vertices[(*indices)[t * 3 + 2]].pos;
+
+			const glm::vec3 cross = glm::cross(b - a, d - a);
+			const float weight	  = glm::length(cross);
+
+			center += (a + b + d) * (weight / 3.0f);
+			normal += cross;
+			area += weight;
+		}
+
+		const float normal_length = glm::length(normal);
+		if (area > 0.0f && normal_length > 0.0f) {
+			sort_keys[c] = glm::dot(
+					center / area - mesh_center, normal / normal_length);
+		} else {
+			sort_keys[c] = 0.0f;
+		}
+	}
+
+	std::vector<uint32_t> order(cluster_count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return sort_keys[a] > sort_keys[b];
+	});
+
+	std::vector<uint32_t> out;
+	out.reserve(indices->size());
+	for (uint32_t c : order) {
+		out.insert(
+				out.end(),
+				indices->begin() + splits[c] * 3,
+				indices->begin() + splits[c + 1] * 3);
+	}
+
+	*indices = std::move(out);
+}
+
+void MeshOptimizer::optimize_vertex_fetch(
+		std::vector<Vertex> *vertices, std::vector<uint32_t> *indices) {
+
+	std::vector<uint32_t> remap(vertices->size(), INVALID_VERTEX);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices->size());
+
+	for (uint32_t &index : *indices) {
+		if (remap[index] == INVALID_VERTEX) {
+			remap[index] = (uint32_t)reordered.size();
+			reordered.push_back((*vertices)[index]);
+		}
+		index = remap[index];
+	}
+
+	*vertices = std::move(reordered);
+}
+
+void MeshOptimizer::optimize(
+		std::vector<Vertex> *vertices,
+		std::vector<uint32_t> *indices,
+		std::span<const Renderer::Mesh::Submesh> submeshes,
+		uint32_t cache_size,
+		const char *name) {
+
+	if (indices->size() < 3 || cache_size == 0)
+		return;
+
+	const CacheStats before =
+			analyze_vertex_cache(*indices, vertices->size(), cache_size);
+
+	// triangles can't move between submeshes, so each one is sorted on its
+	// own
+	std::vector<uint32_t> range;
+	std::vector<uint32_t> clusters;
+	auto optimize_range = [&](uint32_t first_index, uint32_t index_count) {
+		const auto begin = indices->begin() + first_index;
+		range.assign(begin, begin + index_count);
+
+		optimize_vertex_cache(&range, vertices->size(), cache_size, &clusters);
+		optimize_overdraw(&range, *vertices, clusters, cache_size);
+		std::copy(range.begin(), range.end(), begin);
+	};
+
+	if (submeshes.empty())
+		optimize_range(0, (uint32_t)indices->size());
+	for (const Renderer::Mesh::Submesh &submesh : submeshes)
+		optimize_range(submesh.first_index, submesh.index_count);
+
+	optimize_vertex_fetch(vertices, indices);
+
+	const CacheStats after =
+			analyze_vertex_cache(*indices, vertices->size(), cache_size);
+
+	LOG_INFO(
+			"optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+			name,
+			before.acmr,
+			after.acmr,
+			before.atvr,
+			after.atvr);
+}
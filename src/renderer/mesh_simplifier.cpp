@@ -0,0 +1,415 @@
+#include "mesh_simplifier.h"
+
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <tuple>
+#include <unordered_set>
+
+using namespace Opal;
+
+namespace {
+
+// collapses may turn a triangle by at most about 75 degrees
+constexpr float MIN_NORMAL_DOT = 0.25f;
+
+// stop adding levels once simplifying removes less than this fraction
+constexpr float MIN_LOD_REDUCTION = 0.1f;
+
+/**
+ * Weighted sum of the squared distances to a set of planes, stored as the
+ * upper triangle of a symmetric 4x4 matrix.
+ */
+struct Quadric {
+	double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+	double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+	double a22 = 0.0, a23 = 0.0;
+	double a33	  = 0.0;
+	double weight = 0.0;
+
+	void add_plane(double x, double y, double z, double w, double area) {
+		a00 += area * x * x;
+		a01 += area * x * y;
+		a02 += area * x * z;
+		a03 += area * x * w;
+		a11 += area * y * y;
+		a12 += area * y * z;
+		a13 += area * y * w;
+		a22 += area * z * z;
+		a23 += area * z * w;
+		a33 += area * w * w;
+		weight += area;
+	}
+
+	Quadric &operator+=(const Quadric &other) {
+		a00 += other.a00;
+		a01 += other.a01;
+		a02 += other.a02;
+		a03 += other.a03;
+		a11 += other.a11;
+		a12 += other.a12;
+		a13 += other.a13;
+		a22 += other.a22;
+		a23 += other.a23;
+		a33 += other.a33;
+		weight += other.weight;
+		return *this;
+	}
+
+	// @returns the mean squared distance, weighted by the planes' areas
+	double error(const glm::vec3 &point) const {
+		const double x = point.x;
+		const double y = point.y;
+		const double z = point.z;
+
+		const double error = a00 * x * x + a11 * y * y + a22 * z * z + a33 +
+							 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+							 2.0 * (a03 * x + a13 * y + a23 * z);
+
+		// rounding can push points on all planes slightly below zero
+		return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+	}
+};
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+/**
+ * @returns for every vertex the index of one vertex all vertices at the same
+ * position map to.
+ */
+std::vector<uint32_t> _group_positions(const std::vector<Vertex> &vertices) {
+	std::vector<uint32_t> order(vertices.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	auto key = [&](uint32_t vertex) {
+		const glm::vec3 &pos = vertices[vertex].pos;
+		return std::make_tuple(pos.x, pos.y, pos.z);
+	};
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return key(a) < key(b);
+	});
+
+	std::vector<uint32_t> group(vertices.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		const bool same = i > 0 && key(order[i]) == key(order[i - 1]);
+		group[order[i]] = same ? group[order[i - 1]] : order[i];
+	}
+	return group;
+}
+
+// @returns the face normal scaled by twice the triangle's area
+glm::vec3
+_get_normal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+	return glm::cross(b - a, c - a);
+}
+
+} // namespace
+
+void MeshSimplifier::simplify(
+		const std::vector<Vertex> &vertices,
+		std::span<const uint32_t> indices,
+		size_t target_index_count,
+		float max_error,
+		std::vector<uint32_t> *out,
+		float *error) {
+
+	out->assign(indices.begin(), indices.end());
+	*error = 0.0f;
+	if (out->size() <= target_index_count)
+		return;
+
+	const size_t vertex_count = vertices.size();
+	const std::vector<uint32_t> group = _group_positions(vertices);
+
+	// vertices sharing their position with others lie on an attribute seam
+	std::vector<uint32_t> group_size(vertex_count, 0);
+	for (size_t v = 0; v < vertex_count; ++v)
+		group_size[group[v]]++;
+
+	std::vector<bool> locked(vertex_count, false);
+	for (size_t v = 0; v < vertex_count; ++v)
+		locked[v] = group_size[group[v]] > 1;
+
+	// edges only used in one direction lie on an open border
+	std::unordered_set<uint64_t> edges;
+	auto edge_key = [&](uint32_t a, uint32_t b) {
+		return (uint64_t)group[a] << 32 | group[b];
+	};
+	for (size_t i = 0; i < out->size(); i += 3) {
+		for (uint32_t corner = 0; corner < 3; ++corner) {
+			edges.insert(edge_key(
+					(*out)[i + corner], (*out)[i + (corner + 1) % 3]));
+		}
+	}
+	for (size_t i = 0; i < out->size(); i += 3) {
+		for (uint32_t corner = 0; corner < 3; ++corner) {
+			const uint32_t a = (*out)[i + corner];
+			const uint32_t b = (*out)[i + (corner + 1) % 3];
+			if (!edges.contains(edge_key(b, a))) {
+				locked[a] = true;
+				locked[b] = true;
+			}
+		}
+	}
+
+	// planes of the triangles around every position
+	std::vector<Quadric> quadrics(vertex_count);
+	for (size_t i = 0; i < out->size(); i += 3) {
+		const glm::vec3 &a = vertices[(*out)[i + 0]].pos;
+		const glm::vec3 &b = vertices[(*out)[i + 1]].pos;
+		const glm::vec3 &c = vertices[(*out)[i + 2]].pos;
+
+		const glm::vec3 normal = _get_normal(a, b, c);
+		const float length	   = glm::length(normal);
+		if (length == 0.0f)
+			continue;
+
+		const glm::vec3 n = normal * (1.0f / length);
+		const double w	  = -(double)glm::dot(n, a);
+		for (uint32_t corner = 0; corner < 3; ++corner) {
+			quadrics[group[(*out)[i + corner]]].add_plane(
+					n.x, n.y, n.z, w, length * 0.5);
+		}
+	}
+
+	std::vector<uint32_t> collapse(vertex_count);
+	std::iota(collapse.begin(), collapse.end(), 0);
+
+	const double max_cost = (double)max_error * (double)max_error;
+	double cost			  = 0.0;
+
+	std::vector<Collapse> candidates;
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> adjacency;
+	std::vector<bool> touched;
+
+	while (out->size() > target_index_count) {
+		const size_t triangle_count = out->size() / 3;
+
+		// an unlocked vertex has no other vertex at its position, so it can
+		// collapse into the exact neighbour its triangles already use
+		candidates.clear();
+		for (size_t i = 0; i < out->size(); i += 3) {
+			for (uint32_t corner = 0; corner < 3; ++corner) {
+				const uint32_t from = (*out)[i + corner];
+				if (locked[from])
+					continue;
+
+				for (uint32_t other = 1; other < 3; ++other) {
+					const uint32_t to = (*out)[i + (corner + other) % 3];
+
+					Quadric merged = quadrics[group[from]];
+					merged += quadrics[group[to]];
+					candidates.push_back(Collapse {
+							.from = from,
+							.to	  = to,
+							.cost = merged.error(vertices[to].pos),
+					});
+				}
+			}
+		}
+
+		std::sort(
+				candidates.begin(),
+				candidates.end(),
+				[](const Collapse &a, const Collapse &b) {
+					return a.cost < b.cost;
+				});
+
+		// triangles using each vertex, packed back to back
+		offsets.assign(vertex_count + 1, 0);
+		for (uint32_t index : *out)
+			offsets[index + 1]++;
+		std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+		adjacency.resize(out->size());
+		{
+			std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < out->size(); ++i)
+				adjacency[next[(*out)[i]]++] = (uint32_t)(i / 3);
+		}
+
+		auto flips = [&](const Collapse &collapse) {
+			const glm::vec3 &target = vertices[collapse.to].pos;
+
+			for (uint32_t i = offsets[collapse.from];
+					i < offsets[collapse.from + 1];
+					++i) {
+				const uint32_t *triangle = &(*out)[adjacency[i] * 3];
+
+				// triangles on the collapsed edge disappear
+				if (group[triangle[0]] == group[collapse.to] ||
+						group[triangle[1]] == group[collapse.to] ||
+						group[triangle[2]] == group[collapse.to])
+					continue;
+
+				glm::vec3 before[3];
+				glm::vec3 after[3];
+				for (uint32_t corner = 0; corner < 3; ++corner) {
+					before[corner] = vertices[triangle[corner]].pos;
+					after[corner]  = triangle[corner] == collapse.from
+										? target
+										: before[corner];
+				}
+
+				const glm::vec3 a =
+						_get_normal(before[0], before[1], before[2]);
+				const glm::vec3 b = _get_normal(after[0], after[1], after[2]);
+				if (glm::dot(a, b) <=
+						MIN_NORMAL_DOT * glm::length(a) * glm::length(b))
+					return true;
+			}
+			return false;
+		};
+
+		// each collapse removes about two triangles, don't overshoot the
+		// target by much
+		const size_t excess = triangle_count - target_index_count / 3;
+		const size_t limit	= excess / 2 + 1;
+		size_t applied		= 0;
+
+		// collapses in one pass must not share any triangles, since the flip
+		// test only sees the triangles as they were before the pass
+		touched.assign(vertex_count, false);
+		for (const Collapse &candidate : candidates) {
+			if (applied >= limit || candidate.cost > max_cost)
+				break;
+			if (touched[group[candidate.from]] || touched[group[candidate.to]])
+				continue;
+			if (flips(candidate))
+				continue;
+
+			collapse[candidate.from] = candidate.to;
+			quadrics[group[candidate.to]] += quadrics[group[candidate.from]];
+			cost = std::max(cost, candidate.cost);
+			applied++;
+
+			for (uint32_t i = offsets[candidate.from];
+					i < offsets[candidate.from + 1];
+					++i) {
+				for (uint32_t corner = 0; corner < 3; ++corner)
+					touched[group[(*out)[adjacency[i] * 3 + corner]]] = true;
+			}
+		}
+
+		if (applied == 0)
+			break;
+
+		// apply the collapses and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t i = 0; i < out->size(); i += 3) {
+			const uint32_t a = collapse[(*out)[i + 0]];
+			const uint32_t b = collapse[(*out)[i + 1]];
+			const uint32_t c = collapse[(*out)[i + 2]];
+			if (group[a] == group[b] || group[b] == group[c] ||
+					group[c] == group[a])
+				continue;
+
+			(*out)[write++] = a;
+			(*out)[write++] = b;
+			(*out)[write++] = c;
+		}
+		out->resize(write);
+	}
+
+	*error = (float)std::sqrt(cost);
+}
+
+void MeshSimplifier::build_lods(
+		const std::vector<Vertex> &vertices,
+		std::vector<uint32_t> *indices,
+		std::vector<Renderer::Mesh::Lod> *lods,
+		std::vector<Renderer::Mesh::Submesh> *submeshes,
+		uint32_t lod_count,
+		uint32_t cache_size) {
+
+	const uint32_t full_count = (uint32_t)indices->size();
+
+	lods->clear();
+	lods->push_back(Renderer::Mesh::Lod {
+			.first_index = 0,
+			.index_count = full_count,
+			.error		 = 0.0f,
+	});
+
+	// each submesh is simplified on its own so triangles never change
+	// material. their shared edges are open borders and stay in place.
+	std::vector<Renderer::Mesh::Submesh> ranges(
+			submeshes->begin(), submeshes->end());
+	if (ranges.empty())
+		ranges.push_back({ 0, full_count, 0 });
+
+	// every level is simplified from the full mesh so the quadrics measure
+	// the error against the original surface
+	std::vector<uint32_t> lod;
+	std::vector<uint32_t> part;
+	std::vector<Renderer::Mesh::Submesh> level_submeshes;
+	size_t target = full_count;
+	for (uint32_t level = 1; level < lod_count; ++level) {
+		target = target / 6 * 3;
+		if (target == 0)
+			break;
+
+		lod.clear();
+		level_submeshes.clear();
+		float error = 0.0f;
+
+		for (const Renderer::Mesh::Submesh &range : ranges) {
+			// every submesh gets its share of the level's triangles
+			const size_t range_target =
+					(size_t)((double)target * range.index_count / full_count) /
+					3 * 3;
+
+			float part_error;
+			simplify(
+					vertices,
+					std::span(
+							indices->data() + range.first_index,
+							range.index_count),
+					range_target,
+					FLT_MAX,
+					&part,
+					&part_error);
+			if (part.empty())
+				continue;
+
+			if (cache_size > 0)
+				MeshOptimizer::optimize_vertex_cache(
+						&part, vertices.size(), cache_size, nullptr);
+
+			level_submeshes.push_back({
+					.first_index = (uint32_t)(indices->size() + lod.size()),
+					.index_count = (uint32_t)part.size(),
+					.material	 = range.material,
+			});
+			lod.insert(lod.end(), part.begin(), part.end());
+			error = std::max(error, part_error);
+		}
+
+		const Renderer::Mesh::Lod &previous = lods->back();
+		if ((float)lod.size() >
+				(float)previous.index_count * (1.0f - MIN_LOD_REDUCTION))
+			break;
+
+		lods->push_back(Renderer::Mesh::Lod {
+				.first_index = (uint32_t)indices->size(),
+				.index_count = (uint32_t)lod.size(),
+				.error		 = std::max(error, previous.error),
+		});
+		indices->insert(indices->end(), lod.begin(), lod.end());
+		if (!submeshes->empty()) {
+			submeshes->insert(
+					submeshes->end(),
+					level_submeshes.begin(),
+					level_submeshes.end());
+		}
+		target = lod.size();
+	}
+}
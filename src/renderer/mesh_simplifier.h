@@ -0,0 +1,60 @@
+#ifndef __MESH_SIMPLIFIER_H__
+#define __MESH_SIMPLIFIER_H__
+
+#include "renderer.h"
+
+#include <span>
+
+namespace Opal {
+
+/**
+ * @brief Builds lower detail versions of meshes for LODs.
+ *
+ * Edges are collapsed in order of their quadric error (see "Surface
+ * Simplification Using Quadric Error Metrics" by Garland and Heckbert). Only
+ * the index buffer is simplified, every vertex collapses onto one of its
+ * neighbours so all levels share the same vertex buffer.
+ *
+ * Vertices on open borders and on attribute seams are never moved, so
+ * silhouettes of open meshes and texture seams stay intact.
+ */
+class MeshSimplifier {
+
+public:
+	/**
+	 * @brief Simplifies the triangles down to at most target_index_count
+	 * indices, or as far as max_error allows.
+	 * @param max_error how far in object space the surface is allowed to
+	 * move.
+	 * @param error set to how far the surface moved.
+	 */
+	static void simplify(
+			const std::vector<Vertex> &vertices,
+			std::span<const uint32_t> indices,
+			size_t target_index_count,
+			float max_error,
+			std::vector<uint32_t> *out,
+			float *error);
+
+	/**
+	 * @brief Appends up to lod_count - 1 simplified levels to the indices,
+	 * each with about half the triangles of the one before it.
+	 * @param lods filled with one entry for every level, including the full
+	 * detail one at the start.
+	 * @param submeshes the ranges of the full detail level. the ranges of
+	 * every new level are appended. empty if the whole mesh is one range.
+	 * @param cache_size vertex cache size the new levels are ordered for, 0
+	 * keeps the order of the simplifier.
+	 */
+	static void build_lods(
+			const std::vector<Vertex> &vertices,
+			std::vector<uint32_t> *indices,
+			std::vector<Renderer::Mesh::Lod> *lods,
+			std::vector<Renderer::Mesh::Submesh> *submeshes,
+			uint32_t lod_count,
+			uint32_t cache_size);
+};
+
+} // namespace Opal
+
+#endif // __MESH_SIMPLIFIER_H__
@@ -0,0 +1,412 @@
+#include "meshlet_builder.h"
+
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numbers>
+#include <numeric>
+
+using namespace Opal;
+
+namespace {
+
+constexpr uint32_t INVALID_TRIANGLE = UINT32_MAX;
+
+// how much a triangle facing away from the meshlet's average normal counts
+// against it, relative to being a whole meshlet radius away
+constexpr float CONE_WEIGHT = 2.0f;
+
+/**
+ * The meshlet being built. Both ordering and splitting end meshlets with the
+ * same fits() test, so the split finds the meshlets the order was built for.
+ */
+struct MeshletState {
+	// id of the meshlet each vertex was last added to
+	std::vector<uint32_t> stamp;
+	uint32_t id				= 0;
+	uint32_t vertex_count	= 0;
+	uint32_t triangle_count = 0;
+
+	MeshletState(size_t vertex_count) : stamp(vertex_count, UINT32_MAX) {}
+
+	bool contains(uint32_t vertex) const { return stamp[vertex] == id; }
+
+	uint32_t count_new_vertices(const uint32_t *triangle) const {
+		uint32_t count = 0;
+		for (uint32_t corner = 0; corner < 3; ++corner) {
+			bool seen = contains(triangle[corner]);
+			for (uint32_t other = 0; other < corner; ++other)
+				seen |= triangle[other] == triangle[corner];
+			if (!seen)
+				count++;
+		}
+		return count;
+	}
+
+	bool fits(const uint32_t *triangle) const {
+		return triangle_count < MeshletBuilder::MAX_TRIANGLES &&
+			   vertex_count + count_new_vertices(triangle) <=
+					   MeshletBuilder::MAX_VERTICES;
+	}
+
+	void add(const uint32_t *triangle) {
+		for (uint32_t corner = 0; corner < 3; ++corner) {
+			if (!contains(triangle[corner])) {
+				stamp[triangle[corner]] = id;
+				vertex_count++;
+			}
+		}
+		triangle_count++;
+	}
+
+	void finish() {
+		id++;
+		vertex_count   = 0;
+		triangle_count = 0;
+	}
+};
+
+} // namespace
+
+void MeshletBuilder::optimize(
+		std::vector<Vertex> *vertices,
+		std::vector<uint32_t> *indices,
+		const std::vector<Renderer::Mesh::Lod> &lods,
+		const std::vector<Renderer::Mesh::Submesh> &submeshes) {
+
+	if (MAX_TRIANGLES == 0 || indices->empty())
+		return;
+
+	// submeshes split the levels further, meshlets never cross either
+	if (!submeshes.empty()) {
+		for (const Renderer::Mesh::Submesh &submesh : submeshes) {
+			optimize_range(
+					*vertices,
+					indices,
+					submesh.first_index,
+					submesh.index_count);
+		}
+	} else if (lods.empty()) {
+		optimize_range(*vertices, indices, 0, (uint32_t)indices->size());
+	} else {
+		for (const Renderer::Mesh::Lod &lod : lods)
+			optimize_range(
+					*vertices, indices, lod.first_index, lod.index_count);
+	}
+
+	MeshOptimizer::optimize_vertex_fetch(vertices, indices);
+}
+
+void MeshletBuilder::optimize_range(
+		const std::vector<Vertex> &vertices,
+		std::vector<uint32_t> *indices,
+		uint32_t first_index,
+		uint32_t index_count) {
+
+	const uint32_t triangle_count = index_count / 3;
+	const uint32_t *triangles	  = indices->data() + first_index;
+	if (triangle_count == 0)
+		return;
+
+	std::vector<glm::vec3> normals(triangle_count);
+	std::vector<glm::vec3> centroids(triangle_count);
+	float area = 0.0f;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		const glm::vec3 &a = vertices[triangles[t * 3 + 0]].pos;
+		const glm::vec3 &b = vertices[triangles[t * 3 + 1]].pos;
+		const glm::vec3 &c = vertices[triangles[t * 3 + 2]].pos;
+
+		const glm::vec3 normal = glm::cross(b - a, c - a);
+		const float length	   = glm::length(normal);
+
+		normals[t]	 = length > 0.0f ? normal * (1.0f / length) : normal;
+		centroids[t] = (a + b + c) * (1.0f / 3.0f);
+		area += length * 0.5f;
+	}
+
+	// radius of a full meshlet if the surface was flat, to weigh distances
+	const float meshlet_count =
+			std::ceil((float)triangle_count / (float)MAX_TRIANGLES);
+	const float expected_radius = std::max(
+			std::sqrt(area / meshlet_count / std::numbers::pi_v<float>),
+			FLT_MIN);
+
+	// triangles using each vertex, packed back to back
+	std::vector<uint32_t> offsets(vertices.size() + 1, 0);
+	for (uint32_t i = 0; i < triangle_count * 3; ++i)
+		offsets[triangles[i] + 1]++;
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	std::vector<uint32_t> adjacency(triangle_count * 3);
+	{
+		std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < triangle_count * 3; ++i)
+			adjacency[next[triangles[i]]++] = i / 3;
+	}
+
+	MeshletState meshlet(vertices.size());
+	std::vector<uint32_t> meshlet_vertices;
+	glm::vec3 normal_sum(0.0f);
+	glm::vec3 centroid_sum(0.0f);
+
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<uint32_t> order;
+	order.reserve(triangle_count);
+	uint32_t cursor = 0;
+
+	while (order.size() < triangle_count) {
+		const glm::vec3 center =
+				centroid_sum * (1.0f / std::max(meshlet.triangle_count, 1u));
+		const float normal_length = glm::length(normal_sum);
+		const glm::vec3 axis	  = normal_length > 0.0f
+										? normal_sum * (1.0f / normal_length)
+										: normal_sum;
+
+		// grow over the neighbour that adds the fewest vertices, then the
+		// closest one facing the same way
+		uint32_t best		= INVALID_TRIANGLE;
+		uint32_t best_extra = UINT32_MAX;
+		float best_score	= FLT_MAX;
+		for (uint32_t vertex : meshlet_vertices) {
+			for (uint32_t i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+				const uint32_t t = adjacency[i];
+				if (emitted[t] || !meshlet.fits(&triangles[t * 3]))
+					continue;
+
+				const uint32_t extra =
+						meshlet.count_new_vertices(&triangles[t * 3]);
+				const float score =
+						glm::distance(centroids[t], center) / expected_radius +
+						CONE_WEIGHT * (1.0f - glm::dot(normals[t], axis));
+
+				if (extra < best_extra ||
+						(extra == best_extra && score < best_score)) {
+					best	   = t;
+					best_extra = extra;
+					best_score = score;
+				}
+			}
+		}
+
+		// nothing next to the meshlet fits, continue from the next triangle
+		// in the old order, which starts a new meshlet if it doesn't fit
+		// either
+		if (best == INVALID_TRIANGLE) {
+			while (emitted[cursor])
+				cursor++;
+			best = cursor;
+
+			if (!meshlet.fits(&triangles[best * 3])) {
+				meshlet.finish();
+				meshlet_vertices.clear();
+				normal_sum	 = glm::vec3(0.0f);
+				centroid_sum = glm::vec3(0.0f);
+			}
+		}
+
+		for (uint32_t corner = 0; corner < 3; ++corner) {
+			const uint32_t vertex = triangles[best * 3 + corner];
+			if (!meshlet.contains(vertex))
+				meshlet_vertices.push_back(vertex);
+		}
+		meshlet.add(&triangles[best * 3]);
+		normal_sum	 = normal_sum + normals[best];
+		centroid_sum = centroid_sum + centroids[best];
+
+		emitted[best] = true;
+		order.push_back(best);
+	}
+
+	std::vector<uint32_t> reordered;
+	reordered.reserve(index_count);
+	for (uint32_t t : order) {
+		reordered.push_back(triangles[t * 3 + 0]);
+		reordered.push_back(triangles[t * 3 + 1]);
+		reordered.push_back(triangles[t * 3 + 2]);
+	}
+
+	// the triangles are still drawn from the index buffer, so put each
+	// meshlet back into vertex cache order. its triangles stay the same so
+	// it still splits in the same place.
+	std::vector<uint32_t> local;
+	std::vector<uint32_t> remap;
+	MeshletState split(vertices.size());
+	size_t start = 0;
+
+	auto optimize_meshlet = [&](size_t end) {
+		local.clear();
+		remap.clear();
+		for (size_t i = start; i < end; ++i) {
+			auto it = std::find(remap.begin(), remap.end(), reordered[i]);
+			local.push_back((uint32_t)(it - remap.begin()));
+			if (it == remap.end())
+				remap.push_back(reordered[i]);
+		}
+
+		MeshOptimizer::optimize_vertex_cache(
+				&local, remap.size(), MESH_VERTEX_CACHE_SIZE, nullptr);
+		for (size_t i = start; i < end; ++i)
+			reordered[i] = remap[local[i - start]];
+
+		start = end;
+		split.finish();
+	};
+
+	if (MESH_VERTEX_CACHE_SIZE > 0) {
+		for (size_t i = 0; i < reordered.size(); i += 3) {
+			if (!split.fits(&reordered[i]))
+				optimize_meshlet(i);
+			split.add(&reordered[i]);
+		}
+		optimize_meshlet(reordered.size());
+	}
+
+	std::copy(
+			reordered.begin(), reordered.end(), indices->begin() + first_index);
+}
+
+void MeshletBuilder::build(
+		std::span<const Vertex> vertices,
+		std::span<const uint32_t> indices,
+		uint32_t first_index,
+		uint32_t index_count,
+		uint32_t material,
+		std::vector<Renderer::Mesh::Meshlet> *meshlets) {
+
+	MeshletState meshlet(vertices.size());
+	uint32_t start	   = first_index;
+	const uint32_t end = first_index + index_count - index_count % 3;
+
+	auto finish = [&](uint32_t i) {
+		if (i == start)
+			return;
+
+		Renderer::Mesh::Meshlet &bounds = meshlets->emplace_back();
+		bounds.first_index				= start;
+		bounds.index_count				= i - start;
+		bounds.material					= material;
+		_compute_bounds(vertices, indices.subspan(start, i - start), &bounds);
+
+		start = i;
+		meshlet.finish();
+	};
+
+	for (uint32_t i = first_index; i < end; i += 3) {
+		if (!meshlet.fits(&indices[i]))
+			finish(i);
+		meshlet.add(&indices[i]);
+	}
+
+	finish(end);
+}
+
+void MeshletBuilder::build_mesh(
+		Renderer::Mesh *mesh,
+		std::span<const Vertex> vertices,
+		std::span<const uint32_t> indices) {
+
+	mesh->meshlets.clear();
+	mesh->lod_meshlets.clear();
+
+	if (MAX_TRIANGLES == 0)
+		return;
+
+	// submeshes are sorted, so the ones of each level follow the last one
+	size_t submesh = 0;
+	auto add_level = [&](uint32_t first_index, uint32_t index_count) {
+		mesh->lod_meshlets.push_back((uint32_t)mesh->meshlets.size());
+
+		if (mesh->submeshes.empty()) {
+			build(
+					vertices,
+					indices,
+					first_index,
+					index_count,
+					0,
+					&mesh->meshlets);
+			return;
+		}
+
+		for (; submesh < mesh->submeshes.size() &&
+				mesh->submeshes[submesh].first_index <
+						first_index + index_count;
+				++submesh) {
+			const Renderer::Mesh::Submesh &range = mesh->submeshes[submesh];
+			build(
+					vertices,
+					indices,
+					range.first_index,
+					range.index_count,
+					range.material,
+					&mesh->meshlets);
+		}
+	};
+
+	if (mesh->lods.empty())
+		add_level(0, (uint32_t)indices.size());
+	for (const Renderer::Mesh::Lod &lod : mesh->lods)
+		add_level(lod.first_index, lod.index_count);
+
+	mesh->lod_meshlets.push_back((uint32_t)mesh->meshlets.size());
+}
+
+void MeshletBuilder::_compute_bounds(
+		std::span<const Vertex> vertices,
+		std::span<const uint32_t> indices,
+		Renderer::Mesh::Meshlet *meshlet) {
+
+	glm::vec3 min = vertices[indices[0]].pos;
+	glm::vec3 max = min;
+	for (uint32_t index : indices) {
+		min = glm::min(min, vertices[index].pos);
+		max = glm::max(max, vertices[index].pos);
+	}
+
+	meshlet->center = (min + max) * 0.5f;
+	meshlet->radius = 0.0f;
+	for (uint32_t index : indices) {
+		meshlet->radius = std::max(
+				meshlet->radius,
+				glm::distance(vertices[index].pos, meshlet->center));
+	}
+
+	// the cone axis is the average of the triangle normals and the cone has
+	// to be wide enough to hold all of them
+	std::vector<glm::vec3> normals;
+	normals.reserve(indices.size() / 3);
+	glm::vec3 axis(0.0f);
+	for (size_t i = 0; i + 3 <= indices.size(); i += 3) {
+		const glm::vec3 &a	   = vertices[indices[i + 0]].pos;
+		const glm::vec3 &b	   = vertices[indices[i + 1]].pos;
+		const glm::vec3 &c	   = vertices[indices[i + 2]].pos;
+		const glm::vec3 normal = glm::cross(b - a, c - a);
+		const float length	   = glm::length(normal);
+		if (length > 0.0f) {
+			normals.push_back(normal * (1.0f / length));
+			axis = axis + normals.back();
+		}
+	}
+
+	// a cutoff of 1 never culls anything
+	meshlet->cone_axis	 = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet->cone_cutoff = 1.0f;
+
+	const float axis_length = glm::length(axis);
+	if (axis_length == 0.0f)
+		return;
+	axis = axis * (1.0f / axis_length);
+
+	float min_dot = 1.0f;
+	for (const glm::vec3 &normal : normals)
+		min_dot = std::min(min_dot, glm::dot(axis, normal));
+
+	// some triangles face more than 90 degrees away from the axis
+	if (min_dot <= 0.0f)
+		return;
+
+	meshlet->cone_axis = axis;
+	// sine of the cone's half angle, see MeshInstance for the test
+	meshlet->cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
@@ -0,0 +1,84 @@
+#ifndef __MESHLET_BUILDER_H__
+#define __MESHLET_BUILDER_H__
+
+#include "renderer.h"
+
+#include <span>
+
+namespace Opal {
+
+/**
+ * @brief Splits index ranges into meshlets that can be culled on their own.
+ *
+ * Meshlets are contiguous ranges of the index buffer. A meshlet ends once the
+ * next triangle would take it past the vertex or triangle limit, so they can
+ * be found again with a single scan of the indices when a mesh is uploaded
+ * instead of being stored alongside it.
+ *
+ * For the meshlets to be worth culling, the importer first reorders the
+ * triangles so each meshlet grows over neighbouring triangles facing the
+ * same way, which keeps their bounds small and their normal cones narrow.
+ */
+class MeshletBuilder {
+
+public:
+	// limits the importer ordered the triangles for, 0 when meshes aren't
+	// split into meshlets
+#ifdef USE_MESHLET_CULLING
+	static constexpr uint32_t MAX_VERTICES	= MESHLET_MAX_VERTICES;
+	static constexpr uint32_t MAX_TRIANGLES = MESHLET_MAX_TRIANGLES;
+#else
+	static constexpr uint32_t MAX_VERTICES	= 0;
+	static constexpr uint32_t MAX_TRIANGLES = 0;
+#endif
+
+	/**
+	 * @brief Reorders the triangles of every level and submesh into
+	 * meshlets and then the vertices into the order the triangles use them.
+	 */
+	static void optimize(
+			std::vector<Vertex> *vertices,
+			std::vector<uint32_t> *indices,
+			const std::vector<Renderer::Mesh::Lod> &lods,
+			const std::vector<Renderer::Mesh::Submesh> &submeshes);
+
+	/**
+	 * @brief Reorders the triangles of the given range of indices so that
+	 * splitting it with build() gives compact meshlets.
+	 */
+	static void optimize_range(
+			const std::vector<Vertex> &vertices,
+			std::vector<uint32_t> *indices,
+			uint32_t first_index,
+			uint32_t index_count);
+
+	/**
+	 * @brief Appends the meshlets of the given range of indices, which is
+	 * drawn with the given material.
+	 */
+	static void build(
+			std::span<const Vertex> vertices,
+			std::span<const uint32_t> indices,
+			uint32_t first_index,
+			uint32_t index_count,
+			uint32_t material,
+			std::vector<Renderer::Mesh::Meshlet> *meshlets);
+
+	/**
+	 * @brief Builds the meshlets of every level and submesh of the mesh.
+	 */
+	static void build_mesh(
+			Renderer::Mesh *mesh,
+			std::span<const Vertex> vertices,
+			std::span<const uint32_t> indices);
+
+protected:
+	static void _compute_bounds(
+			std::span<const Vertex> vertices,
+			std::span<const uint32_t> indices,
+			Renderer::Mesh::Meshlet *meshlet);
+};
+
+} // namespace Opal
+
+#endif // __MESHLET_BUILDER_H__
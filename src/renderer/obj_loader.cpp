@@ -0,0 +1,808 @@
+#include "obj_loader.h"
+
+#include "../utils/file.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+using namespace Opal;
+
+namespace {
+
+// corner flags for indices that were given relative to the end of the
+// attribute list.
+enum RelativeFlags : uint8_t {
+	RELATIVE_VERTEX	  = 1 << 0,
+	RELATIVE_TEXCOORD = 1 << 1,
+	RELATIVE_NORMAL	  = 1 << 2,
+};
+
+/**
+ * A `usemtl` record and how many triangles of its chunk came before it.
+ */
+struct MaterialSwitch {
+	size_t triangle;
+	std::string_view name;
+};
+
+/**
+ * Output of parsing a single line-aligned slice of the file.
+ */
+struct Chunk {
+	const char *begin = nullptr;
+	const char *end	  = nullptr;
+
+	std::vector<float> positions;
+	std::vector<float> texcoords;
+	std::vector<float> normals;
+	std::vector<ObjLoader::Index> indices;
+
+	// relative (negative) indices can only be resolved once we know how
+	// many attributes came before this chunk. Until then they are stored as
+	// an offset from the start of the chunk and flagged here. This stays
+	// empty unless the chunk actually uses relative indices.
+	std::vector<uint8_t> relative;
+
+	// material records, pointing into the text
+	std::vector<MaterialSwitch> material_switches;
+	std::vector<std::string_view> material_libraries;
+
+	// set when parsing failed
+	const char *error_at  = nullptr;
+	const char *error_msg = nullptr;
+};
+
+inline bool _is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool _is_digit(char c) {
+	return (unsigned)(c - '0') < 10;
+}
+
+inline const char *_skip_space(const char *p, const char *end) {
+	while (p < end && _is_space(*p))
+		++p;
+	return p;
+}
+
+inline const char *_skip_token(const char *p, const char *end) {
+	while (p < end && !_is_space(*p) && *p != '\n')
+		++p;
+	return p;
+}
+
+inline const char *_skip_line(const char *p, const char *end) {
+	const char *eol =
+			static_cast<const char *>(memchr(p, '\n', (size_t)(end - p)));
+	return eol ? eol + 1 : end;
+}
+
+inline bool _is_record(const char *p, const char *end, std::string_view name) {
+	return (size_t)(end - p) > name.size() &&
+		   memcmp(p, name.data(), name.size()) == 0 &&
+		   _is_space(p[name.size()]);
+}
+
+/**
+ * Calls fn with every file name of a `mtllib` record. Each library is a
+ * separate token.
+ * @returns the end of the record.
+ */
+template <typename F>
+const char *_read_libraries(const char *p, const char *end, F fn) {
+	for (p = _skip_space(p, end); p < end && *p != '\n';
+			p = _skip_space(p, end)) {
+		const char *token = p;
+		p				  = _skip_token(p, end);
+		fn(std::string_view(token, (size_t)(p - token)));
+	}
+	return p;
+}
+
+/**
+ * @returns the rest of the line without surrounding spaces. Material names
+ * may contain spaces.
+ */
+std::string_view _read_name(const char *p, const char *end) {
+	p					 = _skip_space(p, end);
+	const char *name_end = p;
+	while (name_end < end && *name_end != '\n')
+		++name_end;
+	while (name_end > p && _is_space(name_end[-1]))
+		--name_end;
+	return { p, (size_t)(name_end - p) };
+}
+
+/**
+ * Parses a single float token and returns a pointer past it. Tokens that are
+ * not a number parse as 0, which matches tinyobjloader.
+ *
+ * Anything with up to 19 significant digits and a small exponent is exact
+ * through the double fast path (Clinger's algorithm). Everything else falls
+ * back to strtod.
+ */
+const char *_parse_float(const char *p, const char *end, float *out) {
+	static constexpr double POW10[] = {
+		1e0,  1e1,	1e2,  1e3,	1e4,  1e5,	1e6,  1e7,
+		1e8,  1e9,	1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+
+	const char *start = p;
+
+	bool negative = false;
+	if (p < end && (*p == '+' || *p == '-')) {
+		negative = *p == '-';
+		++p;
+	}
+
+	uint64_t mantissa	= 0;
+	int32_t digits		= 0;
+	int32_t exponent	= 0;
+	bool has_digits		= false;
+	bool needs_fallback = false;
+
+	for (; p < end && _is_digit(*p); ++p) {
+		has_digits = true;
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			if (mantissa != 0)
+				++digits;
+		} else {
+			++exponent;
+			needs_fallback = true;
+		}
+	}
+
+	if (p < end && *p == '.') {
+		++p;
+		for (; p < end && _is_digit(*p); ++p) {
+			has_digits = true;
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+				if (mantissa != 0)
+					++digits;
+				--exponent;
+			} else {
+				needs_fallback = true;
+			}
+		}
+	}
+
+	if (has_digits && p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool exp_negative = false;
+		if (q < end && (*q == '+' || *q == '-')) {
+			exp_negative = *q == '-';
+			++q;
+		}
+		if (q < end && _is_digit(*q)) {
+			int32_t exp_value = 0;
+			for (; q < end && _is_digit(*q); ++q) {
+				if (exp_value < 10000)
+					exp_value = exp_value * 10 + (*q - '0');
+			}
+			exponent += exp_negative ? -exp_value : exp_value;
+			p = q;
+		}
+	}
+
+	const char *token_end = _skip_token(p, end);
+
+	if (!has_digits) {
+		*out = 0.0f;
+		return token_end;
+	}
+
+	double value;
+	if (likely(!needs_fallback && mantissa <= (1ull << 53) &&
+			   exponent >= -22 && exponent <= 22)) {
+		value = (double)mantissa;
+		value = exponent < 0 ? value / POW10[-exponent]
+							 : value * POW10[exponent];
+		if (negative)
+			value = -value;
+	} else {
+		// strtod needs a terminated string
+		const std::string token(start, p);
+		value = std::strtod(token.c_str(), nullptr);
+	}
+
+	*out = (float)value;
+	return token_end;
+}
+
+/**
+ * Parses up to count floats from the rest of the line into out. Missing
+ * values are 0.
+ */
+inline const char *
+_parse_floats(const char *p, const char *end, float *out, uint32_t count) {
+	for (uint32_t i = 0; i < count; ++i) {
+		p = _skip_space(p, end);
+		if (p >= end || *p == '\n') {
+			out[i] = 0.0f;
+			continue;
+		}
+		p = _parse_float(p, end, &out[i]);
+	}
+	return p;
+}
+
+/**
+ * Parses a single face index. Returns false if it is not a valid index.
+ * @param count number of attributes of this kind seen so far in the chunk.
+ * Relative indices are stored relative to the start of the chunk.
+ */
+inline bool _parse_index(
+		const char *&p,
+		const char *end,
+		size_t count,
+		int32_t *index,
+		bool *relative) {
+	bool negative = false;
+	if (p < end && *p == '-') {
+		negative = true;
+		++p;
+	}
+
+	if (p >= end || !_is_digit(*p))
+		return false;
+
+	int64_t value = 0;
+	for (; p < end && _is_digit(*p); ++p) {
+		value = value * 10 + (*p - '0');
+		if (value > INT32_MAX)
+			return false;
+	}
+
+	if (value == 0)
+		return false;
+
+	if (negative) {
+		*index	  = (int32_t)((int64_t)count - value);
+		*relative = true;
+	} else {
+		*index	  = (int32_t)(value - 1);
+		*relative = false;
+	}
+	return true;
+}
+
+inline void
+_push_corner(Chunk *chunk, const ObjLoader::Index &index, uint8_t flags) {
+	if (unlikely(flags != 0 || !chunk->relative.empty())) {
+		// backfill the corners from before the first relative index
+		chunk->relative.resize(chunk->indices.size(), 0);
+		chunk->relative.push_back(flags);
+	}
+	chunk->indices.push_back(index);
+}
+
+/**
+ * Parses the corners of an `f` record and fan triangulates them.
+ */
+const char *_parse_face(Chunk *chunk, const char *p, const char *end) {
+	ObjLoader::Index first {};
+	ObjLoader::Index prev {};
+	uint8_t first_flags = 0;
+	uint8_t prev_flags	= 0;
+	uint32_t corners	= 0;
+
+	while (true) {
+		p = _skip_space(p, end);
+		if (p >= end || *p == '\n')
+			break;
+
+		ObjLoader::Index index { -1, -1, -1 };
+		uint8_t flags = 0;
+		bool relative;
+
+		if (!_parse_index(
+					p,
+					end,
+					chunk->positions.size() / 3,
+					&index.vertex,
+					&relative)) {
+			chunk->error_at	 = p;
+			chunk->error_msg = "invalid vertex index";
+			return end;
+		}
+		flags |= relative ? RELATIVE_VERTEX : 0;
+
+		if (p < end && *p == '/') {
+			++p;
+			// v//vn leaves out the texcoord
+			if (p < end && *p != '/') {
+				if (!_parse_index(
+							p,
+							end,
+							chunk->texcoords.size() / 2,
+							&index.texcoord,
+							&relative)) {
+					chunk->error_at	 = p;
+					chunk->error_msg = "invalid texcoord index";
+					return end;
+				}
+				flags |= relative ? RELATIVE_TEXCOORD : 0;
+			}
+			if (p < end && *p == '/') {
+				++p;
+				if (!_parse_index(
+							p,
+							end,
+							chunk->normals.size() / 3,
+							&index.normal,
+							&relative)) {
+					chunk->error_at	 = p;
+					chunk->error_msg = "invalid normal index";
+					return end;
+				}
+				flags |= relative ? RELATIVE_NORMAL : 0;
+			}
+		}
+
+		if (p < end && !_is_space(*p) && *p != '\n') {
+			chunk->error_at	 = p;
+			chunk->error_msg = "unexpected character in face";
+			return end;
+		}
+
+		if (corners == 0) {
+			first		= index;
+			first_flags = flags;
+		} else if (corners >= 2) {
+			_push_corner(chunk, first, first_flags);
+			_push_corner(chunk, prev, prev_flags);
+			_push_corner(chunk, index, flags);
+		}
+
+		prev	   = index;
+		prev_flags = flags;
+		++corners;
+	}
+
+	return p;
+}
+
+void _parse_chunk(Chunk *chunk) {
+	const char *p	= chunk->begin;
+	const char *end = chunk->end;
+
+	// rough guess that keeps the vectors from growing too many times
+	const size_t lines = (size_t)(end - p) / 32;
+	chunk->positions.reserve(lines);
+	chunk->indices.reserve(lines);
+
+	while (p < end) {
+		p = _skip_space(p, end);
+		if (p >= end)
+			break;
+
+		const char *record = p;
+		const size_t left  = (size_t)(end - p);
+
+		if (record[0] == 'v' && left > 1 && _is_space(record[1])) {
+			float v[3];
+			p = _parse_floats(p + 2, end, v, 3);
+			chunk->positions.insert(chunk->positions.end(), v, v + 3);
+		} else if (
+				record[0] == 'v' && left > 2 && record[1] == 't' &&
+				_is_space(record[2])) {
+			float vt[2];
+			p = _parse_floats(p + 3, end, vt, 2);
+			chunk->texcoords.insert(chunk->texcoords.end(), vt, vt + 2);
+		} else if (
+				record[0] == 'v' && left > 2 && record[1] == 'n' &&
+				_is_space(record[2])) {
+			float vn[3];
+			p = _parse_floats(p + 3, end, vn, 3);
+			chunk->normals.insert(chunk->normals.end(), vn, vn + 3);
+		} else if (record[0] == 'f' && left > 1 && _is_space(record[1])) {
+			p = _parse_face(chunk, p + 2, end);
+			if (chunk->error_msg)
+				return;
+		} else if (_is_record(p, end, "usemtl")) {
+			chunk->material_switches.push_back({
+					.triangle = chunk->indices.size() / 3,
+					.name	  = _read_name(p + 6, end),
+			});
+		} else if (_is_record(p, end, "mtllib")) {
+			p = _read_libraries(p + 6, end, [&](std::string_view library) {
+				chunk->material_libraries.push_back(library);
+			});
+		}
+
+		// everything else (comments, groups, extra values) is ignored.
+		p = _skip_line(p, end);
+	}
+}
+
+/**
+ * Resolves the indices of one chunk against the attribute counts of all the
+ * chunks before it and checks they are in range.
+ */
+void _resolve_chunk(
+		Chunk *chunk,
+		ObjLoader::Index *out,
+		int64_t position_base,
+		int64_t texcoord_base,
+		int64_t normal_base,
+		int64_t position_count,
+		int64_t texcoord_count,
+		int64_t normal_count) {
+
+	const size_t count = chunk->indices.size();
+	const bool has_relative = !chunk->relative.empty();
+
+	for (size_t i = 0; i < count; ++i) {
+		const ObjLoader::Index &src = chunk->indices[i];
+		const uint8_t flags = has_relative ? chunk->relative[i] : 0;
+
+		int64_t vertex	 = src.vertex;
+		int64_t texcoord = src.texcoord;
+		int64_t normal	 = src.normal;
+
+		if (flags & RELATIVE_VERTEX)
+			vertex += position_base;
+		if (flags & RELATIVE_TEXCOORD)
+			texcoord += texcoord_base;
+		if (flags & RELATIVE_NORMAL)
+			normal += normal_base;
+
+		// only the vertex is required
+		if (unlikely(
+					vertex < 0 || vertex >= position_count ||
+					(((flags & RELATIVE_TEXCOORD) || texcoord >= 0) &&
+					 (texcoord < 0 || texcoord >= texcoord_count)) ||
+					(((flags & RELATIVE_NORMAL) || normal >= 0) &&
+					 (normal < 0 || normal >= normal_count)))) {
+			chunk->error_at	 = chunk->begin;
+			chunk->error_msg = "face index out of range";
+			return;
+		}
+
+		out[i] = {
+			.vertex	  = (int32_t)vertex,
+			.texcoord = (int32_t)texcoord,
+			.normal	  = (int32_t)normal,
+		};
+	}
+}
+
+// helper threads started by every _parallel_for running right now. loads
+// already run on the asset server's workers, so concurrent loads share one
+// budget instead of each starting a thread per hardware thread.
+std::atomic<uint32_t> _helper_threads = 0;
+
+/**
+ * Claims up to wanted helper threads from the shared budget.
+ * @returns how many were claimed, possibly none.
+ */
+uint32_t _claim_helpers(uint32_t wanted) {
+	const uint32_t budget =
+			std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	uint32_t running = _helper_threads.load();
+	uint32_t claimed = 0;
+	do {
+		claimed = std::min(wanted, budget - std::min(budget, running));
+	} while (claimed > 0 &&
+			 !_helper_threads.compare_exchange_weak(
+					 running, running + claimed));
+
+	return claimed;
+}
+
+/**
+ * Runs fn(i) for every i in [0, count). The calling thread takes items along
+ * with as many helper threads as the shared budget allows, so with none left
+ * it runs every item itself.
+ */
+template <typename F> void _parallel_for(size_t count, F fn) {
+	std::atomic<size_t> next = 0;
+	auto work = [&]() {
+		for (size_t i = next++; i < count; i = next++)
+			fn(i);
+	};
+
+	const uint32_t helpers =
+			count > 1 ? _claim_helpers((uint32_t)(count - 1)) : 0;
+
+	std::vector<std::thread> threads;
+	threads.reserve(helpers);
+	for (uint32_t i = 0; i < helpers; ++i)
+		threads.emplace_back(work);
+	work();
+	for (auto &thread : threads)
+		thread.join();
+
+	_helper_threads -= helpers;
+}
+
+/**
+ * Replays the material switches of every chunk in file order to give each
+ * triangle its material.
+ */
+void _merge_materials(
+		const std::vector<Chunk> &chunks,
+		const std::vector<size_t> &index_offsets,
+		ObjLoader::Data *out) {
+
+	out->materials.clear();
+	out->triangle_materials.clear();
+	out->material_libraries.clear();
+
+	bool has_materials = false;
+	for (const auto &chunk : chunks) {
+		has_materials |= !chunk.material_switches.empty();
+		out->material_libraries.insert(
+				out->material_libraries.end(),
+				chunk.material_libraries.begin(),
+				chunk.material_libraries.end());
+	}
+
+	if (!has_materials)
+		return;
+
+	out->triangle_materials.resize(out->indices.size() / 3);
+
+	std::unordered_map<std::string_view, int32_t> ids;
+	int32_t material = -1;
+	size_t filled	 = 0;
+
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		for (const auto &material_switch : chunks[i].material_switches) {
+			const size_t triangle =
+					index_offsets[i] / 3 + material_switch.triangle;
+			std::fill(
+					out->triangle_materials.begin() + filled,
+					out->triangle_materials.begin() + triangle,
+					material);
+			filled = triangle;
+
+			const auto [it, inserted] = ids.emplace(
+					material_switch.name, (int32_t)out->materials.size());
+			if (inserted) {
+				out->materials.push_back({
+						.name	 = std::string(material_switch.name),
+						.diffuse = { 1.0f, 1.0f, 1.0f },
+				});
+			}
+			material = it->second;
+		}
+	}
+
+	std::fill(
+			out->triangle_materials.begin() + filled,
+			out->triangle_materials.end(),
+			material);
+}
+
+std::string _library_path(const char *filename, std::string_view library) {
+	return (std::filesystem::path(filename).parent_path() / library).string();
+}
+
+} // namespace
+
+Error ObjLoader::load(const char *filename, Data *out) {
+	// each thread walks its own chunk front to back
+	MappedFile file;
+	ERR_FAIL_COND_V_MSG(
+			!file.open(
+					filename,
+					MappedFile::HINT_SEQUENTIAL | MappedFile::HINT_WILL_NEED),
+			FAIL,
+			"Failed to load model: can't open %s",
+			filename);
+
+	ERR_TRY(parse(
+			reinterpret_cast<const char *>(file.data()), file.size(), out));
+
+	// libraries are optional, materials just stay white without them
+	for (const auto &library : out->material_libraries) {
+		const std::string path = _library_path(filename, library);
+
+		MappedFile material_file;
+		if (!material_file.open(path.c_str(), MappedFile::HINT_SEQUENTIAL)) {
+			LOG_WARN("Can't open material library %s", path.c_str());
+			continue;
+		}
+
+		parse_materials(
+				reinterpret_cast<const char *>(material_file.data()),
+				material_file.size(),
+				out);
+	}
+
+	return OK;
+}
+
+Error ObjLoader::get_dependencies(
+		const char *filename, std::vector<std::string> *files) {
+
+	MappedFile file;
+	ERR_FAIL_COND_V_MSG(
+			!file.open(filename, MappedFile::HINT_SEQUENTIAL),
+			FAIL,
+			"Failed to open model %s",
+			filename);
+
+	// only the `mtllib` records matter, so skip the full parse
+	const char *p	= reinterpret_cast<const char *>(file.data());
+	const char *end = p + file.size();
+	while (p < end) {
+		p = _skip_space(p, end);
+		if (_is_record(p, end, "mtllib")) {
+			p = _read_libraries(p + 6, end, [&](std::string_view library) {
+				std::string path = _library_path(filename, library);
+				if (std::filesystem::exists(path))
+					files->push_back(std::move(path));
+			});
+		}
+		p = _skip_line(p, end);
+	}
+
+	return OK;
+}
+
+Error ObjLoader::parse(
+		const char *text, size_t size, Data *out, uint32_t thread_count) {
+
+	if (thread_count == 0) {
+		const size_t max_threads =
+				std::max(1u, std::thread::hardware_concurrency());
+		thread_count = (uint32_t)std::clamp(
+				size / MIN_CHUNK_SIZE, (size_t)1, max_threads);
+	}
+
+	const char *text_end = text + size;
+
+	// split the text into roughly even chunks, moving each split point
+	// forward to the start of the next line.
+	std::vector<Chunk> chunks(thread_count);
+	const char *begin = text;
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		const char *end = text_end;
+		if (i + 1 < thread_count) {
+			end = std::max(begin, text + size / thread_count * (i + 1));
+			if (end > text && end < text_end && end[-1] != '\n')
+				end = _skip_line(end, text_end);
+		}
+		chunks[i].begin = begin;
+		chunks[i].end	= end;
+		begin			= end;
+	}
+
+	_parallel_for(chunks.size(), [&](size_t i) { _parse_chunk(&chunks[i]); });
+
+	// report the first error in file order
+	for (const auto &chunk : chunks) {
+		if (chunk.error_msg) {
+			const size_t line = std::count(text, chunk.error_at, '\n') + 1;
+			LOG_ERR(
+					"Failed to load model: %s on line %zu",
+					chunk.error_msg,
+					line);
+			return FAIL;
+		}
+	}
+
+	// prefix sums so each chunk knows where its data goes
+	std::vector<size_t> position_offsets(chunks.size());
+	std::vector<size_t> texcoord_offsets(chunks.size());
+	std::vector<size_t> normal_offsets(chunks.size());
+	std::vector<size_t> index_offsets(chunks.size());
+
+	size_t position_total = 0;
+	size_t texcoord_total = 0;
+	size_t normal_total	  = 0;
+	size_t index_total	  = 0;
+
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		position_offsets[i] = position_total;
+		texcoord_offsets[i] = texcoord_total;
+		normal_offsets[i]	= normal_total;
+		index_offsets[i]	= index_total;
+
+		position_total += chunks[i].positions.size();
+		texcoord_total += chunks[i].texcoords.size();
+		normal_total += chunks[i].normals.size();
+		index_total += chunks[i].indices.size();
+	}
+
+	ERR_FAIL_COND_V_MSG(
+			position_total / 3 > INT32_MAX || index_total > UINT32_MAX,
+			FAIL,
+			"Failed to load model: too many vertices");
+
+	out->positions.resize(position_total);
+	out->texcoords.resize(texcoord_total);
+	out->normals.resize(normal_total);
+	out->indices.resize(index_total);
+
+	_parallel_for(chunks.size(), [&](size_t i) {
+		Chunk &chunk = chunks[i];
+
+		std::copy(
+				chunk.positions.begin(),
+				chunk.positions.end(),
+				out->positions.begin() + position_offsets[i]);
+		std::copy(
+				chunk.texcoords.begin(),
+				chunk.texcoords.end(),
+				out->texcoords.begin() + texcoord_offsets[i]);
+		std::copy(
+				chunk.normals.begin(),
+				chunk.normals.end(),
+				out->normals.begin() + normal_offsets[i]);
+
+		_resolve_chunk(
+				&chunk,
+				out->indices.data() + index_offsets[i],
+				position_offsets[i] / 3,
+				texcoord_offsets[i] / 2,
+				normal_offsets[i] / 3,
+				position_total / 3,
+				texcoord_total / 2,
+				normal_total / 3);
+
+		// free the chunk data as soon as we are done with it
+		chunk.positions = {};
+		chunk.texcoords = {};
+		chunk.normals	= {};
+		chunk.indices	= {};
+		chunk.relative	= {};
+	});
+
+	for (const auto &chunk : chunks) {
+		if (chunk.error_msg) {
+			const size_t line = std::count(text, chunk.error_at, '\n') + 1;
+			LOG_ERR(
+					"Failed to load model: %s in chunk starting on line %zu",
+					chunk.error_msg,
+					line);
+			return FAIL;
+		}
+	}
+
+	_merge_materials(chunks, index_offsets, out);
+
+	return OK;
+}
+
+void ObjLoader::parse_materials(const char *text, size_t size, Data *out) {
+	const char *p	= text;
+	const char *end = text + size;
+
+	Material *material = nullptr;
+	while (p < end) {
+		p = _skip_space(p, end);
+		if (p >= end)
+			break;
+
+		if (_is_record(p, end, "newmtl")) {
+			// only materials the model uses are kept
+			const std::string_view name = _read_name(p + 6, end);
+			material					= nullptr;
+			for (auto &candidate : out->materials) {
+				if (candidate.name == name) {
+					material = &candidate;
+					break;
+				}
+			}
+		} else if (material && _is_record(p, end, "Kd")) {
+			p = _parse_floats(p + 2, end, material->diffuse, 3);
+		}
+
+		p = _skip_line(p, end);
+	}
+}
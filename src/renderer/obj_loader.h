@@ -0,0 +1,98 @@
+#ifndef __OBJ_LOADER_H__
+#define __OBJ_LOADER_H__
+
+#include "../utils/error.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Opal {
+
+/**
+ * @brief Multi-threaded Wavefront OBJ parser.
+ *
+ * The file is split into line-aligned chunks which are parsed in parallel.
+ * Each chunk collects its own attribute and face lists which are then merged
+ * back together in file order, so the output is the same no matter how many
+ * threads were used.
+ *
+ * Only the geometry records (`v`, `vt`, `vn` and `f`) and the material
+ * records (`mtllib` and `usemtl`) are read. Polygons are triangulated as fans,
+ * the same way tinyobjloader does it. Of the material libraries only the
+ * diffuse color (`Kd`) of each material is used.
+ */
+class ObjLoader {
+
+public:
+	/**
+	 * Zero-based attribute indices of a single face corner. Attributes that
+	 * are not specified by the face are -1.
+	 */
+	struct Index {
+		int32_t vertex;
+		int32_t texcoord;
+		int32_t normal;
+	};
+
+	struct Material {
+		std::string name;
+		// white unless a material library defines the material
+		float diffuse[3];
+	};
+
+	struct Data {
+		// xyz per vertex
+		std::vector<float> positions;
+		// uv per texcoord
+		std::vector<float> texcoords;
+		// xyz per normal
+		std::vector<float> normals;
+		// three corners per triangle
+		std::vector<Index> indices;
+
+		// materials in order of first use
+		std::vector<Material> materials;
+		// index into materials per triangle, -1 for triangles before the
+		// first `usemtl`. empty when the file doesn't use any materials.
+		std::vector<int32_t> triangle_materials;
+		// `mtllib` file names, relative to the OBJ file
+		std::vector<std::string> material_libraries;
+	};
+
+	/**
+	 * Chunks smaller than this are not worth handing to another thread.
+	 */
+	static constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+	/**
+	 * @brief Reads and parses the given OBJ file and the diffuse colors from
+	 * its material libraries.
+	 */
+	static Error load(const char *filename, Data *out);
+
+	/**
+	 * @brief Parses OBJ text that is already in memory.
+	 * @param thread_count number of threads to use. 0 picks based on the
+	 * input size and hardware concurrency.
+	 */
+	static Error
+	parse(const char *text, size_t size, Data *out, uint32_t thread_count = 0);
+
+	/**
+	 * @brief Lists the material libraries of the given file that exist.
+	 */
+	static Error
+	get_dependencies(const char *filename, std::vector<std::string> *files);
+
+	/**
+	 * @brief Sets the diffuse colors of the materials the given MTL text
+	 * defines.
+	 */
+	static void parse_materials(const char *text, size_t size, Data *out);
+};
+
+} // namespace Opal
+
+#endif // __OBJ_LOADER_H__
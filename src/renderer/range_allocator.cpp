@@ -0,0 +1,99 @@
+#include "range_allocator.h"
+
+#include "../utils/error.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace Opal;
+
+RangeAllocator::RangeAllocator(uint64_t size) {
+	reset(size);
+}
+
+void RangeAllocator::reset(uint64_t size) {
+	_size	   = size;
+	_free_size = 0;
+	_free.clear();
+	_allocations.clear();
+
+	_add_free(0, size);
+}
+
+uint64_t RangeAllocator::allocate(uint64_t size, uint64_t alignment) {
+	if (size == 0)
+		return INVALID;
+
+	// best fit keeps the big ranges around for big meshes
+	auto best			 = _free.end();
+	uint64_t best_offset = INVALID;
+	for (auto it = _free.begin(); it != _free.end(); ++it) {
+		const uint64_t offset = (it->first + alignment - 1) & ~(alignment - 1);
+		const uint64_t end	  = it->first + it->second;
+		if (offset >= end || end - offset < size)
+			continue;
+
+		if (best == _free.end() || it->second < best->second) {
+			best		= it;
+			best_offset = offset;
+		}
+	}
+
+	if (best == _free.end())
+		return INVALID;
+
+	const uint64_t start = best->first;
+	const uint64_t end	 = best->first + best->second;
+	_free.erase(best);
+	_free_size -= end - start;
+
+	// the padding in front and whatever is left behind stay free
+	if (best_offset > start)
+		_add_free(start, best_offset - start);
+	if (best_offset + size < end)
+		_add_free(best_offset + size, end - best_offset - size);
+
+	_allocations.emplace(best_offset, size);
+	return best_offset;
+}
+
+void RangeAllocator::free(uint64_t offset) {
+	auto it = _allocations.find(offset);
+	ERR_FAIL_COND_MSG(
+			it == _allocations.end(),
+			"No allocation at offset %llu",
+			(unsigned long long)offset);
+
+	_add_free(it->first, it->second);
+	_allocations.erase(it);
+}
+
+uint64_t RangeAllocator::get_largest_free_range() const {
+	uint64_t largest = 0;
+	for (const auto &[offset, size] : _free)
+		largest = std::max(largest, size);
+	return largest;
+}
+
+void RangeAllocator::_add_free(uint64_t offset, uint64_t size) {
+	if (size == 0)
+		return;
+
+	_free_size += size;
+
+	auto next = _free.lower_bound(offset);
+	if (next != _free.end() && offset + size == next->first) {
+		size += next->second;
+		next = _free.erase(next);
+	}
+
+	if (next != _free.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			prev->second += size;
+			return;
+		}
+	}
+
+	_free.emplace_hint(next, offset, size);
+}
@@ -0,0 +1,68 @@
+#ifndef __RANGE_ALLOCATOR_H__
+#define __RANGE_ALLOCATOR_H__
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+
+namespace Opal {
+
+/**
+ * @brief Hands out ranges of a fixed size block, like a buffer that meshes
+ * are sub-allocated from. Only offsets are tracked, the block itself is up to
+ * the caller.
+ *
+ * Free ranges are kept sorted by offset and merged with their neighbours as
+ * soon as they are freed, so churn doesn't leave the block split into pieces
+ * too small to use. Allocations take the smallest free range they fit in.
+ *
+ * Not thread safe.
+ */
+class RangeAllocator {
+
+public:
+	static constexpr uint64_t INVALID = UINT64_MAX;
+
+	RangeAllocator(uint64_t size = 0);
+
+	/**
+	 * @brief Forgets every allocation and makes the whole block free.
+	 */
+	void reset(uint64_t size);
+
+	/**
+	 * @param alignment must be a power of two.
+	 * @returns the offset of size free bytes aligned to alignment, or INVALID
+	 * when no free range is big enough.
+	 */
+	uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+
+	/**
+	 * @brief Frees the allocation starting at offset.
+	 */
+	void free(uint64_t offset);
+
+	uint64_t get_size() const { return _size; }
+	uint64_t get_free_size() const { return _free_size; }
+
+	/**
+	 * @returns the biggest allocation that would currently succeed.
+	 */
+	uint64_t get_largest_free_range() const;
+
+protected:
+	uint64_t _size		= 0;
+	uint64_t _free_size = 0;
+
+	// free ranges by offset, never touching each other
+	std::map<uint64_t, uint64_t> _free;
+	// size of every allocation by its offset
+	std::unordered_map<uint64_t, uint64_t> _allocations;
+
+	// adds the range to the free list, merging it with its neighbours
+	void _add_free(uint64_t offset, uint64_t size);
+};
+
+} // namespace Opal
+
+#endif // __RANGE_ALLOCATOR_H__
@@ -1,12 +1,74 @@
 #include "renderer.h"
+#include "bc_decoder.h"
+#include "ktx2_loader.h"
+#include "mesh_cache.h"
+#include "mesh_codec.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "meshlet_builder.h"
+#include "obj_loader.h"
+#include "vertex_welder.h"
 #include "vk_debug.h"
 
+namespace {
+
+/**
+ * Memory that the output of the next image decode on this thread should be
+ * written to. stb_image allocates its output as width * height * 4 bytes for
+ * RGBA, plus one spare byte for JPEG. The target is armed right before the
+ * decode and handed out at most once, to the first allocation of that size;
+ * if stb frees or moves it the decode falls back to the heap and the caller
+ * copies the result.
+ */
+struct DecodeTarget {
+	void *data	= nullptr;
+	size_t size = 0;
+	bool armed	= false;
+	bool in_use = false;
+};
+
+thread_local DecodeTarget _decode_target;
+
+void *_stbi_malloc(size_t size) {
+	DecodeTarget &target = _decode_target;
+	if (target.armed && (size == target.size || size == target.size + 1)) {
+		target.armed  = false;
+		target.in_use = true;
+		return target.data;
+	}
+	return malloc(size);
+}
+
+void *_stbi_realloc(void *ptr, size_t size) {
+	DecodeTarget &target = _decode_target;
+	if (ptr == nullptr || !target.in_use || ptr != target.data)
+		return realloc(ptr, size);
+
+	// the target can't grow so the data moves to the heap
+	void *moved = malloc(size);
+	if (moved)
+		memcpy(moved, ptr, std::min(size, target.size));
+	target.in_use = false;
+	return moved;
+}
+
+void _stbi_free(void *ptr) {
+	DecodeTarget &target = _decode_target;
+	if (ptr != nullptr && target.in_use && ptr == target.data) {
+		target.in_use = false;
+		return;
+	}
+	free(ptr);
+}
+
+} // namespace
+
+#define STBI_MALLOC(size) _stbi_malloc(size)
+#define STBI_REALLOC(ptr, size) _stbi_realloc(ptr, size)
+#define STBI_FREE(ptr) _stbi_free(ptr)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-
 using namespace Opal;
 
 static void glfw_error_callback(int error, const char *description) {
@@ -15,47 +77,169 @@ static void glfw_error_callback(int error, const char *description) {
 
 Error Renderer::Mesh::load_from_obj(Mesh *mesh, const char *filename) {
 
-	mesh->vertices.clear();
-	mesh->indices.clear();
+#ifdef USE_MESH_CACHE
+	if (MeshCache::load(mesh, filename))
+		return OK;
+#endif
 
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string err;
+	const auto start_time = std::chrono::high_resolution_clock::now();
 
-	bool res = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename);
+	ERR_TRY(import_obj(mesh, filename));
 
-	ERR_FAIL_COND_V_MSG(!res, FAIL, "Failed to load model: %s", err.c_str());
+	const double import_time_ms =
+			std::chrono::duration<double, std::milli>(
+					std::chrono::high_resolution_clock::now() - start_time)
+					.count();
 
-	std::unordered_map<Vertex, uint32_t> unique_vertices {};
+	LOG_INFO("imported %s in %.2f ms", filename, import_time_ms);
 
-	for (const auto &shape : shapes) {
-		for (const auto &index : shape.mesh.indices) {
-			Vertex vertex {
-				.pos = {
-					attrib.vertices[3 * index.vertex_index + 0],
-					attrib.vertices[3 * index.vertex_index + 1],
-					attrib.vertices[3 * index.vertex_index + 2],
-				},
-				.color = {
-					1.0f, 1.0f, 1.0f
-				},
-				.tex_coord = {
-					attrib.texcoords[2 * index.texcoord_index + 0],
-					1.0f - attrib.texcoords[2 * index.texcoord_index + 1],
-				},
-			};
+#ifdef USE_MESH_CACHE
+	// a failed write only costs us the cache hit next time
+	MeshCache::store(mesh, filename, import_time_ms);
+#endif
 
-			if (unique_vertices.count(vertex) == 0) {
-				unique_vertices[vertex] =
-						static_cast<uint32_t>(mesh->vertices.size());
-				mesh->vertices.push_back(vertex);
-			}
+	return OK;
+}
+
+namespace {
+
+/**
+ * Sorts the triangles by material, keeping their order inside each
+ * material, and fills in one submesh per material. Triangles without a
+ * material get a white one after the others.
+ */
+void _group_by_material(const ObjLoader::Data &data, Renderer::Mesh *mesh) {
+
+	if (data.triangle_materials.empty())
+		return;
+
+	const uint32_t default_material = (uint32_t)data.materials.size();
+
+	auto material_of = [&](size_t triangle) {
+		const int32_t material = data.triangle_materials[triangle];
+		return material < 0 ? default_material : (uint32_t)material;
+	};
 
-			mesh->indices.push_back(unique_vertices[vertex]);
+	// counting sort, offsets[m] is where material m's triangles start
+	std::vector<uint32_t> offsets(default_material + 2, 0);
+	for (size_t t = 0; t < data.triangle_materials.size(); ++t)
+		offsets[material_of(t) + 1]++;
+	for (size_t m = 1; m < offsets.size(); ++m)
+		offsets[m] += offsets[m - 1];
+
+	for (uint32_t m = 0; m <= default_material; ++m) {
+		if (offsets[m + 1] == offsets[m])
+			continue;
+		mesh->submeshes.push_back({
+				.first_index = offsets[m] * 3,
+				.index_count = (offsets[m + 1] - offsets[m]) * 3,
+				.material	 = m,
+		});
+	}
+
+	for (const auto &material : data.materials) {
+		mesh->material_colors.emplace_back(
+				material.diffuse[0],
+				material.diffuse[1],
+				material.diffuse[2],
+				1.0f);
+	}
+	mesh->material_colors.emplace_back(1.0f);
+
+	std::vector<uint32_t> grouped(mesh->indices.size());
+	for (size_t t = 0; t < data.triangle_materials.size(); ++t) {
+		const uint32_t to = offsets[material_of(t)]++ * 3;
+		for (int corner = 0; corner < 3; ++corner)
+			grouped[to + corner] = mesh->indices[t * 3 + corner];
+	}
+	mesh->indices = std::move(grouped);
+}
+
+} // namespace
+
+Error Renderer::Mesh::import_obj(Mesh *mesh, const char *filename) {
+
+	mesh->vertices.clear();
+	mesh->indices.clear();
+	mesh->submeshes.clear();
+	mesh->material_colors.clear();
+
+	ObjLoader::Data data;
+	ERR_TRY(ObjLoader::load(filename, &data));
+
+	VertexWelder welder(
+			&mesh->vertices, data.indices.size(), MESH_WELD_EPSILON);
+	mesh->indices.reserve(data.indices.size());
+
+	for (const auto &index : data.indices) {
+		Vertex vertex {
+			.pos = {
+				data.positions[3 * index.vertex + 0],
+				data.positions[3 * index.vertex + 1],
+				data.positions[3 * index.vertex + 2],
+			},
+			.color = {
+				1.0f, 1.0f, 1.0f
+			},
+			.tex_coord = { 0.0f, 1.0f },
+		};
+
+		if (index.texcoord >= 0) {
+			vertex.tex_coord = {
+				data.texcoords[2 * index.texcoord + 0],
+				1.0f - data.texcoords[2 * index.texcoord + 1],
+			};
 		}
+
+		mesh->indices.push_back(welder.weld(vertex));
 	}
 
+	_group_by_material(data, mesh);
+
+	MeshOptimizer::optimize(
+			&mesh->vertices,
+			&mesh->indices,
+			mesh->submeshes,
+			MESH_VERTEX_CACHE_SIZE,
+			filename);
+	MeshSimplifier::build_lods(
+			mesh->vertices,
+			&mesh->indices,
+			&mesh->lods,
+			&mesh->submeshes,
+			MESH_LOD_COUNT,
+			MESH_VERTEX_CACHE_SIZE);
+	MeshletBuilder::optimize(
+			&mesh->vertices, &mesh->indices, mesh->lods, mesh->submeshes);
+
+	return OK;
+}
+
+Error Renderer::Pixels::load(Pixels *pixels, const char *filename) {
+
+	// decode straight from the mapped file instead of letting stb read it
+	// into its own buffer first
+	MappedFile file;
+	ERR_FAIL_COND_V_MSG(
+			!file.open(filename, MappedFile::HINT_SEQUENTIAL),
+			FAIL,
+			"Failed to open image texture %s",
+			filename);
+
+	int channels;
+	stbi_uc *data = stbi_load_from_memory(
+			file.data(),
+			static_cast<int>(file.size()),
+			&pixels->width,
+			&pixels->height,
+			&channels,
+			STBI_rgb_alpha);
+
+	ERR_FAIL_COND_V_MSG(
+			!data, FAIL, "Failed to load image texture %s", filename);
+
+	pixels->data = { data, stbi_image_free };
+
 	return OK;
 }
 
@@ -69,6 +253,12 @@ Error Renderer::initialize() {
 
 	ERR_FAIL_COND_V_MSG(volkInitialize(), FAIL, "Failed to initialize Volk");
 
+	if (!_asset_pack.open(ASSET_PACK_PATH)) {
+		LOG_WARN(
+				"No asset pack at %s, assets will be imported from source",
+				ASSET_PACK_PATH);
+	}
+
 	ERR_TRY(create_window());
 	ERR_TRY(create_vk_instance());
 	ERR_TRY(create_surface());
@@ -77,6 +267,14 @@ Error Renderer::initialize() {
 	ERR_TRY(create_swapchain());
 	// ERR_TRY(create_image_views());
 	ERR_TRY(get_queues());
+	ERR_TRY(create_upload_ring());
+	ERR_TRY(create_geometry_arenas());
+
+	// load the texture while the pipeline and framebuffers are being set up
+	_texture_load = std::async(std::launch::async, [this] {
+		return load_image(&_texture_image, TEXTURE_PATH.c_str());
+	});
+
 	ERR_TRY(create_render_pass());
 	ERR_TRY(create_descriptor_set_layout());
 	ERR_TRY(create_graphics_pipeline());
@@ -102,6 +300,7 @@ Error Renderer::initialize() {
 }
 
 bool Renderer::has_mesh(Mesh *mesh) {
+	std::lock_guard<std::mutex> lock(_assets_mutex);
 	return _meshes.contains(mesh);
 }
 
@@ -110,838 +309,2596 @@ void Renderer::add_mesh(Mesh *mesh) {
 	if (has_mesh(mesh))
 		return;
 
-	mesh->vertex_buffer = create_vertex_buffer(mesh->name, mesh->vertices);
-	mesh->index_buffer	= create_index_buffer(mesh->name, mesh->indices);
-
-	_meshes.emplace(mesh);
+	upload_mesh(
+			mesh,
+			mesh->vertices.data(),
+			static_cast<uint32_t>(mesh->vertices.size()),
+			mesh->indices.data(),
+			static_cast<uint32_t>(mesh->indices.size()));
 }
 
-void Renderer::set_render_object(RenderObject *render_object) {
-	_scene_root = render_object;
-	_scene_root->_set_tree_root(_scene_root);
-}
+Error Renderer::upload_mesh(
+		Mesh *mesh,
+		const Vertex *vertices,
+		uint32_t vertex_count,
+		const uint32_t *indices,
+		uint32_t index_count) {
 
-void Renderer::center_window(GLFWwindow *window, GLFWmonitor *monitor) {
-	if (!monitor)
-		return;
+	ERR_TRY(_claim_mesh(mesh, index_count));
 
-	const GLFWvidmode *mode = glfwGetVideoMode(monitor);
-	if (!mode)
-		return;
+	prepare_mesh(mesh, { vertices, vertex_count }, { indices, index_count });
 
-	int x, y;
-	int w, h;
-	glfwGetMonitorPos(monitor, &x, &y);
-	glfwGetWindowSize(window, &w, &h);
+	mesh->vertex_buffer = create_vertex_buffer(mesh, vertices, vertex_count);
+	mesh->index_buffer =
+			create_index_buffer(mesh, indices, index_count, vertex_count);
 
-	glfwSetWindowPos(
-			window, x + (mode->width - w) / 2, y + (mode->height - h) / 2);
+	return _finish_mesh_upload(mesh, index_count, OK);
 }
 
-void Renderer::glfw_key_callback(
-		GLFWwindow *window, int key, int scancode, int action, int mods) {
-	Renderer::singleton->_key_callback(key, scancode, action, mods);
-}
-void Renderer::glfw_char_callback(GLFWwindow *window, unsigned int codepoint) {
-	Renderer::singleton->_char_callback(codepoint);
-}
-void Renderer::glfw_cursor_pos_callback(
-		GLFWwindow *window, double x, double y) {
-	Renderer::singleton->_cursor_pos_callback(x, y);
-}
-void Renderer::glfw_mouse_button_callback(
-		GLFWwindow *window, int button, int action, int mods) {
-	Renderer::singleton->_mouse_button_callback(button, action, mods);
-}
+void Renderer::prepare_mesh(
+		Mesh *mesh,
+		std::span<const Vertex> vertices,
+		std::span<const uint32_t> indices) {
 
-void Renderer::_key_callback(int key, int scancode, int action, int mods) {
-	if (_scene_root) {
-		_scene_root->_propogate_input_key(key, scancode, action, mods);
+#ifdef USE_POSITION_STREAM
+	const bool separate_positions = true;
+#else
+	const bool separate_positions = false;
+#endif
+
+	const uint32_t count = (uint32_t)vertices.size();
+#if defined(USE_COMPACT_VERTICES) && defined(COMPACT_HALF_POSITIONS)
+	mesh->format = VertexFormat::choose(
+			vertices.data(), count, true, separate_positions);
+#elif defined(USE_COMPACT_VERTICES)
+	mesh->format = VertexFormat::choose(
+			vertices.data(), count, false, separate_positions);
+#else
+	mesh->format = VertexFormat::full(separate_positions);
+#endif
+
+	glm::vec3 min = count > 0 ? vertices[0].pos : glm::vec3(0.0f);
+	glm::vec3 max = min;
+	for (const Vertex &vertex : vertices) {
+		min = glm::min(min, vertex.pos);
+		max = glm::max(max, vertex.pos);
 	}
-}
-void Renderer::_char_callback(unsigned int codepoint) {
-	if (_scene_root) {
-		_scene_root->_propogate_input_char(codepoint);
+
+	mesh->bounds_center = (min + max) * 0.5f;
+	mesh->bounds_radius = 0.0f;
+	for (const Vertex &vertex : vertices) {
+		mesh->bounds_radius = std::max(
+				mesh->bounds_radius,
+				glm::distance(vertex.pos, mesh->bounds_center));
 	}
+
+	MeshletBuilder::build_mesh(mesh, vertices, indices);
 }
-void Renderer::_cursor_pos_callback(double x, double y) {
-	if (_scene_root) {
-		_scene_root->_propogate_input_cursor_pos(x, y);
+
+Error Renderer::_claim_mesh(Mesh *mesh, uint32_t index_count) {
+
+	for (const Mesh::Lod &lod : mesh->lods) {
+		ERR_FAIL_COND_V_MSG(
+				lod.first_index + lod.index_count > index_count,
+				FAIL,
+				"Level of detail of mesh %s is outside its indices",
+				mesh->name);
 	}
-}
-void Renderer::_mouse_button_callback(int button, int action, int mods) {
-	if (_scene_root) {
-		_scene_root->_propogate_input_mouse_button(button, action, mods);
+
+	for (const Mesh::Submesh &submesh : mesh->submeshes) {
+		ERR_FAIL_COND_V_MSG(
+				submesh.first_index + submesh.index_count > index_count,
+				FAIL,
+				"Submesh of mesh %s is outside its indices",
+				mesh->name);
 	}
-}
 
-Error Renderer::create_window() {
+	// claim the mesh up front so two threads can't upload it at once
+	std::lock_guard<std::mutex> lock(_assets_mutex);
+	ERR_FAIL_COND_V_MSG(
+			!_meshes.emplace(mesh).second,
+			FAIL,
+			"Mesh %s is already uploaded",
+			mesh->name);
 
-	// set callback for logging glfw errors
-	glfwSetErrorCallback(glfw_error_callback);
+	return OK;
+}
 
-	// initialize glfw library
-	ERR_FAIL_COND_V_MSG(!glfwInit(), FAIL, "Failed to initialize GLFW");
+Error Renderer::_finish_mesh_upload(
+		Mesh *mesh, uint32_t index_count, Error err) {
 
-	// disable automatic OpenGL context creation from glfw
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+	mesh->index_count	= index_count;
+	mesh->upload_ticket = get_upload_ticket();
 
-	// create window
-	_window =
-			glfwCreateWindow(WINDOW_INIT_SIZE, WINDOW_TITLE, nullptr, nullptr);
+	if (err != OK || mesh->vertex_buffer.buffer == VK_NULL_HANDLE ||
+			mesh->index_buffer.buffer == VK_NULL_HANDLE) {
+		// the copies into the buffer that did get made are already recorded
+		_release_mesh_buffers(mesh);
 
-	glfwSetKeyCallback(_window, glfw_key_callback);
-	glfwSetCharCallback(_window, glfw_char_callback);
-	glfwSetCursorPosCallback(_window, glfw_cursor_pos_callback);
-	glfwSetMouseButtonCallback(_window, glfw_mouse_button_callback);
+		std::lock_guard<std::mutex> lock(_assets_mutex);
+		_meshes.erase(mesh);
+
+		LOG_ERR("Failed to upload mesh %s", mesh->name);
+		return FAIL;
+	}
 
 	return OK;
 }
 
-Error Renderer::create_vk_instance() {
-	// start building vulkan instance
-	vkb::InstanceBuilder instance_builder;
+namespace {
+
+/**
+ * Checks that a mesh entry holds everything its info says, reads its tables
+ * into the mesh unless it's null, and finds its encoded vertices and indices.
+ */
+Error _read_cooked_mesh(
+		const char *name,
+		Renderer::Mesh *mesh,
+		const AssetPack::MeshInfo &info,
+		std::span<const uint8_t> data,
+		std::span<const uint8_t> *vertex_data,
+		std::span<const uint8_t> *index_data) {
+
+	using Lod	  = Renderer::Mesh::Lod;
+	using Submesh = Renderer::Mesh::Submesh;
+	using Meshlet = Renderer::Mesh::Meshlet;
+
+	// the counts are 32 bits, so none of these can overflow
+	const uint64_t format_bytes = sizeof(VertexFormat) + sizeof(glm::vec4);
+	const uint64_t lod_bytes	= (uint64_t)info.lod_count * sizeof(Lod);
+	const uint64_t submesh_bytes =
+			(uint64_t)info.submesh_count * sizeof(Submesh);
+	const uint64_t material_bytes =
+			(uint64_t)info.material_count * sizeof(glm::vec4);
+	const uint64_t meshlet_bytes =
+			(uint64_t)info.meshlet_count * sizeof(Meshlet);
+	const uint64_t lod_meshlet_bytes =
+			(uint64_t)info.lod_meshlet_count * sizeof(uint32_t);
+	const uint64_t table_bytes = format_bytes + lod_bytes + submesh_bytes +
+			material_bytes + meshlet_bytes + lod_meshlet_bytes;
+
+	// the stream sizes are checked on their own first so the sum can't wrap
+	ERR_FAIL_COND_V_MSG(
+			info.vertex_data_size > data.size() ||
+					info.index_data_size > data.size() ||
+					data.size() < table_bytes + info.vertex_data_size +
+										  info.index_data_size,
+			FAIL,
+			"Mesh entry %s is truncated",
+			name);
+
+	// checked before anything is sized by them
+	const uint64_t max_vertices =
+			MeshCodec::get_max_vertex_count(info.vertex_data_size);
+	const uint64_t max_indices =
+			MeshCodec::get_max_index_count(info.index_data_size);
+	ERR_FAIL_COND_V_MSG(
+			info.vertex_count > max_vertices || info.index_count > max_indices,
+			FAIL,
+			"Mesh entry %s has more vertices or indices than its data holds",
+			name);
+
+	const uint64_t index_offset = table_bytes + info.vertex_data_size;
+	*vertex_data = data.subspan(table_bytes, info.vertex_data_size);
+	*index_data	 = data.subspan(index_offset, info.index_data_size);
+
+	const uint8_t *tables = data.data();
+	if (mesh == nullptr)
+		return OK;
+
+	glm::vec4 bounds;
+	memcpy(&mesh->format, tables, sizeof(VertexFormat));
+	memcpy(&bounds, tables + sizeof(VertexFormat), sizeof(bounds));
+	mesh->bounds_center = glm::vec3(bounds);
+	mesh->bounds_radius = bounds.w;
+	tables += format_bytes;
+
+	const auto lods = reinterpret_cast<const Lod *>(tables);
+	mesh->lods.assign(lods, lods + info.lod_count);
+	tables += lod_bytes;
+
+	const auto submeshes = reinterpret_cast<const Submesh *>(tables);
+	mesh->submeshes.assign(submeshes, submeshes + info.submesh_count);
+	tables += submesh_bytes;
+
+	const auto colors = reinterpret_cast<const glm::vec4 *>(tables);
+	mesh->material_colors.assign(colors, colors + info.material_count);
+	tables += material_bytes;
+
+	const auto meshlets = reinterpret_cast<const Meshlet *>(tables);
+	mesh->meshlets.assign(meshlets, meshlets + info.meshlet_count);
+	tables += meshlet_bytes;
+
+	const auto lod_meshlets = reinterpret_cast<const uint32_t *>(tables);
+	mesh->lod_meshlets.assign(
+			lod_meshlets, lod_meshlets + info.lod_meshlet_count);
+
+	// these are drawn without going through the lods, so check them here
+	for (const Meshlet &meshlet : mesh->meshlets) {
+		ERR_FAIL_COND_V_MSG(
+				(uint64_t)meshlet.first_index + meshlet.index_count >
+						info.index_count,
+				FAIL,
+				"Meshlet of mesh %s is outside its indices",
+				name);
+	}
+	for (uint32_t first : mesh->lod_meshlets) {
+		ERR_FAIL_COND_V_MSG(
+				first > info.meshlet_count,
+				FAIL,
+				"Level of mesh %s starts past its meshlets",
+				name);
+	}
 
-	instance_builder.set_app_name(VK_APP_NAME)
-			.set_engine_name(VK_ENGINE_NAME)
-			.require_api_version(
-					VK_VERSION_MAJOR(VK_REQUIRED_API_VERSION),
-					VK_VERSION_MINOR(VK_REQUIRED_API_VERSION),
-					VK_VERSION_PATCH(VK_REQUIRED_API_VERSION));
+	return OK;
+}
 
-#ifdef USE_VALIDATION_LAYERS
-	// enable validation layers
-	instance_builder.request_validation_layers();
+} // namespace
 
-	// set callback for logging vulkan validation messages
-	instance_builder.set_debug_callback(
-			[](VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-			   VkDebugUtilsMessageTypeFlagsEXT messageType,
-			   const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-			   void *pUserData) -> VkBool32 {
-				LOG_DEBUG(
-						"VK [%s: %s]\n\t%s\n",
-						vkb::to_string_message_severity(messageSeverity),
-						vkb::to_string_message_type(messageType),
-						pCallbackData->pMessage);
-				return VK_FALSE;
-			});
-#endif
+Error Renderer::upload_cooked_mesh(Mesh *mesh, const AssetPack::Entry &entry) {
 
-	// enable instance extensions
-	for (auto &name : VK_INSTANCE_EXTENSIONS) {
-		instance_builder.enable_extension(name);
-	}
+	const AssetPack::MeshInfo &info = entry.mesh;
 
-	// build vulkan instance
-	auto instance_builder_return = instance_builder.build();
+	std::span<const uint8_t> vertex_data;
+	std::span<const uint8_t> index_data;
+	ERR_TRY(_read_cooked_mesh(
+			mesh->name,
+			mesh,
+			info,
+			_asset_pack.get_data(entry),
+			&vertex_data,
+			&index_data));
 
-	// check instance is valid
-	ERR_FAIL_COND_V_MSG(
-			!instance_builder_return,
-			FAIL,
-			"Failed to create Vulkan instance: %s",
-			instance_builder_return.error().message().c_str());
+	ERR_TRY(_claim_mesh(mesh, info.index_count));
 
-	// get the final vulkan instance
-	_vkb_instance = instance_builder_return.value();
+	// the cooker already worked out everything prepare_mesh would, so
+	// nothing needs the decoded mesh on the CPU
+	VertexDecoder vertices(vertex_data);
+	IndexDecoder indices(index_data);
 
-	// attach volk to instance
-	volkLoadInstance(_vkb_instance.instance);
+	mesh->vertex_buffer =
+			create_vertex_buffer(mesh, &vertices, info.vertex_count);
+	mesh->index_buffer = create_index_buffer(
+			mesh, &indices, info.index_count, info.vertex_count);
 
-	return OK;
+	// a stream with bytes left over doesn't hold what the entry says
+	const Error err = vertices.finish() == OK && indices.finish() == OK
+			? OK
+			: FAIL;
+
+	return _finish_mesh_upload(mesh, info.index_count, err);
 }
 
-Error Renderer::create_surface() {
-	_vk_surface	 = nullptr;
-	VkResult err = glfwCreateWindowSurface(
-			_vkb_instance.instance, _window, NULL, &_vk_surface);
+Error Renderer::get_mesh_data(
+		const Mesh *mesh,
+		std::vector<Vertex> *vertices,
+		std::vector<uint32_t> *indices) const {
+
+	if (!mesh->vertices.empty()) {
+		*vertices = mesh->vertices;
+		*indices  = mesh->indices;
+		return OK;
+	}
 
+	const AssetPack::Entry *entry =
+			mesh->name != nullptr ? _asset_pack.find(mesh->name) : nullptr;
 	ERR_FAIL_COND_V_MSG(
-			err != VK_SUCCESS,
+			entry == nullptr || entry->type != AssetPack::ENTRY_MESH,
 			FAIL,
-			"Failed to create glfw window surface: %s",
-			err);
-
-	return OK;
+			"Mesh %s doesn't keep its data and isn't in the asset pack",
+			mesh->name);
+
+	// the mesh already has its tables
+	std::span<const uint8_t> vertex_data;
+	std::span<const uint8_t> index_data;
+	ERR_TRY(_read_cooked_mesh(
+			mesh->name,
+			nullptr,
+			entry->mesh,
+			_asset_pack.get_data(*entry),
+			&vertex_data,
+			&index_data));
+
+	vertices->resize(entry->mesh.vertex_count);
+	indices->resize(entry->mesh.index_count);
+	ERR_TRY(MeshCodec::decode_vertices(vertex_data, *vertices));
+	return MeshCodec::decode_indices(index_data, *indices);
 }
 
-Error Renderer::create_vk_device() {
+Error Renderer::upload_image(Image *image, const Pixels &pixels) {
 
-	// create device selector
-	vkb::PhysicalDeviceSelector device_selector { _vkb_instance };
+	ERR_FAIL_COND_V_MSG(
+			!pixels.data, FAIL, "Cannot upload an image without pixels");
 
-	// add device extensions
-	device_selector.add_required_extensions(VK_REQUIRED_DEVICE_EXTENSIONS);
-	device_selector.add_desired_extensions(VK_OPTIONAL_DEVICE_EXTENSIONS);
+	const VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
 
-	// add device features
-	device_selector.set_required_features(VK_REQUIRED_DEVICE_FEATURES);
-	device_selector.set_required_features_11(VK_REQUIRED_DEVICE_FEATURES_11);
-	device_selector.set_required_features_12(VK_REQUIRED_DEVICE_FEATURES_12);
+	// decoded images only have their first level so the rest of the chain
+	// is generated on the GPU
+	uint32_t mip_levels = get_mip_level_count(pixels.width, pixels.height);
+	if (mip_levels > 1 && !supports_linear_blit(format)) {
+		LOG_WARN("Linear blits are not supported, skipping mipmaps");
+		mip_levels = 1;
+	}
 
-	// pick compatible device
-	vkb::PhysicalDevice physical_device =
-			device_selector
-					.set_minimum_version(
-							VK_VERSION_MAJOR(VK_DEVICE_MINIMUM_VERSION),
-							VK_VERSION_MINOR(VK_DEVICE_MINIMUM_VERSION))
-					.set_surface(_vk_surface)
-					.select()
-					.value();
+	return upload_image(
+			image,
+			pixels.data.get(),
+			(VkDeviceSize)pixels.width * pixels.height * 4,
+			pixels.width,
+			pixels.height,
+			mip_levels,
+			format,
+			mip_levels > 1);
+}
 
-	vkb::DeviceBuilder device_builder { physical_device };
-	auto device_builder_return = device_builder.build();
+Error Renderer::upload_image(
+		Image *image,
+		const void *pixels,
+		VkDeviceSize image_size,
+		uint32_t width,
+		uint32_t height,
+		uint32_t mip_levels,
+		VkFormat format,
+		bool generate_mips) {
 
 	ERR_FAIL_COND_V_MSG(
-			!device_builder_return,
+			get_level_size(format, 1, 1) == 0,
 			FAIL,
-			"Failed to create Vulkan device: %s",
-			device_builder_return.error().message().c_str());
+			"Unsupported texture format %d",
+			(int)format);
 
-	// get final vulkan device
-	_vkb_device = device_builder_return.value();
+	if (find_supported_format(
+				{ format },
+				VK_IMAGE_TILING_OPTIMAL,
+				VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+						VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ==
+			VK_FORMAT_UNDEFINED) {
 
-	// attach volk to device
-	volkLoadDevice(_vkb_device.device);
+		ERR_FAIL_COND_V_MSG(
+				!BcDecoder::can_decode(format) || generate_mips,
+				FAIL,
+				"Texture format %d is not supported by the device",
+				(int)format);
 
-	return OK;
-}
+		LOG_WARN("Texture format %d is not supported, decoding on the CPU",
+				 (int)format);
 
-Error Renderer::create_vma_allocator() {
+		// decode every level to RGBA8 and upload that instead
+		const VkFormat decoded_format = BcDecoder::get_decoded_format(format);
 
-	VmaAllocatorCreateInfo allocator_info {
-		.physicalDevice	  = _vkb_device.physical_device.physical_device,
+		VkDeviceSize decoded_size = 0;
+		for (uint32_t level = 0; level < mip_levels; ++level) {
+			decoded_size += get_level_size(
+					decoded_format,
+					std::max(1u, width >> level),
+					std::max(1u, height >> level));
+		}
+
+		std::vector<uint8_t> decoded(decoded_size);
+
+		const uint8_t *src = static_cast<const uint8_t *>(pixels);
+		uint8_t *dst	   = decoded.data();
+		for (uint32_t level = 0; level < mip_levels; ++level) {
+			const uint32_t w = std::max(1u, width >> level);
+			const uint32_t h = std::max(1u, height >> level);
+
+			const VkDeviceSize level_size = get_level_size(format, w, h);
+			ERR_FAIL_COND_V_MSG(
+					src + level_size >
+							static_cast<const uint8_t *>(pixels) + image_size,
+					FAIL,
+					"Texture data is too small for %u mip levels",
+					mip_levels);
+
+			ERR_TRY(BcDecoder::decode(format, src, w, h, dst));
+
+			src += level_size;
+			dst += get_level_size(decoded_format, w, h);
+		}
+
+		return upload_image(
+				image,
+				decoded.data(),
+				decoded.size(),
+				width,
+				height,
+				mip_levels,
+				decoded_format);
+	}
+
+	// transfer the texture pixels to a staging buffer
+	Buffer staging_buffer;
+	ERR_TRY(_create_staging_buffer(&staging_buffer, image_size));
+
+	memcpy(staging_buffer.mapped, pixels, static_cast<size_t>(image_size));
+
+	return _upload_staged_image(
+			image,
+			&staging_buffer,
+			width,
+			height,
+			mip_levels,
+			format,
+			generate_mips);
+}
+
+Error Renderer::decode_image(Image *image, const char *filename) {
+
+	MappedFile file;
+	ERR_FAIL_COND_V_MSG(
+			!file.open(filename, MappedFile::HINT_SEQUENTIAL),
+			FAIL,
+			"Failed to open image texture %s",
+			filename);
+
+	// the header tells us how big the staging buffer has to be
+	int width, height, channels;
+	ERR_FAIL_COND_V_MSG(
+			!stbi_info_from_memory(
+					file.data(),
+					static_cast<int>(file.size()),
+					&width,
+					&height,
+					&channels),
+			FAIL,
+			"Failed to load image texture %s: %s",
+			filename,
+			stbi_failure_reason());
+
+	const size_t image_size = (size_t)width * height * 4;
+
+	// one spare byte for stb's JPEG output. The decoder reads back what it
+	// writes, so the target has to be cached rather than write-combined.
+	Buffer staging_buffer;
+	ERR_TRY(_create_staging_buffer(&staging_buffer, image_size + 1, true));
+
+	_decode_target = {
+		.data  = staging_buffer.mapped,
+		.size  = image_size,
+		.armed = true,
+	};
+	stbi_uc *data = stbi_load_from_memory(
+			file.data(),
+			static_cast<int>(file.size()),
+			&width,
+			&height,
+			&channels,
+			STBI_rgb_alpha);
+	_decode_target = {};
+
+	if (!data) {
+		destroy_and_free_buffer(&staging_buffer);
+		LOG_ERR("Failed to load image texture %s: %s",
+				filename,
+				stbi_failure_reason());
+		return FAIL;
+	}
+
+	// formats that don't allocate their output in one piece still need a copy
+	if (data != staging_buffer.mapped) {
+		memcpy(staging_buffer.mapped, data, image_size);
+		stbi_image_free(data);
+	}
+
+	// cached memory isn't necessarily coherent
+	vmaFlushAllocation(_vma_allocator, staging_buffer.alloc, 0, VK_WHOLE_SIZE);
+
+	const VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+
+	uint32_t mip_levels = get_mip_level_count(width, height);
+	if (mip_levels > 1 && !supports_linear_blit(format)) {
+		LOG_WARN("Linear blits are not supported, skipping mipmaps");
+		mip_levels = 1;
+	}
+
+	return _upload_staged_image(
+			image,
+			&staging_buffer,
+			width,
+			height,
+			mip_levels,
+			format,
+			mip_levels > 1);
+}
+
+Error Renderer::_create_staging_buffer(
+		Buffer *buffer, VkDeviceSize size, bool cached) {
+
+	ERR_TRY(create_buffer(
+			buffer,
+			"staging buffer",
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			cached ? VMA_MEMORY_USAGE_GPU_TO_CPU : VMA_MEMORY_USAGE_CPU_ONLY,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+					(cached ? VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+							: VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+			VMA_ALLOCATION_CREATE_MAPPED_BIT));
+
+	if (buffer->mapped == nullptr) {
+		destroy_and_free_buffer(buffer);
+		LOG_ERR("Failed to map staging buffer");
+		return FAIL;
+	}
+
+	return OK;
+}
+
+namespace {
+
+/**
+ * Adds a region for each of the first level_count levels of the image, read
+ * from tightly packed levels.
+ * @returns the size of the packed levels.
+ */
+VkDeviceSize _get_level_copies(
+		const Renderer::Image &image,
+		uint32_t level_count,
+		std::vector<VkBufferImageCopy> *regions) {
+
+	VkDeviceSize offset = 0;
+	for (uint32_t level = 0; level < level_count; ++level) {
+		const VkExtent3D extent {
+			.width	= std::max(1u, image.extent.width >> level),
+			.height = std::max(1u, image.extent.height >> level),
+			.depth	= 1,
+		};
+
+		regions->push_back({
+				.bufferOffset	   = offset,
+				.bufferRowLength   = 0,
+				.bufferImageHeight = 0,
+				.imageSubresource {
+						.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel		= level,
+						.baseArrayLayer = 0,
+						.layerCount		= 1,
+				},
+				.imageOffset = { 0, 0, 0 },
+				.imageExtent = extent,
+		});
+
+		offset += Renderer::get_level_size(
+				image.format, extent.width, extent.height);
+	}
+
+	return offset;
+}
+
+} // namespace
+
+Error Renderer::_upload_staged_image(
+		Image *image,
+		Buffer *staging_buffer,
+		uint32_t width,
+		uint32_t height,
+		uint32_t mip_levels,
+		VkFormat format,
+		bool generate_mips) {
+
+	if (create_image(
+				image,
+				width,
+				height,
+				format,
+				VK_IMAGE_TILING_OPTIMAL,
+				// generated levels are blitted from the level above them
+				VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+						(generate_mips ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0),
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				mip_levels) != OK) {
+		destroy_and_free_buffer(staging_buffer);
+		return FAIL;
+	}
+
+	if (generate_mips) {
+		// blits need the graphics queue, so the chain is built there, all in
+		// one submit
+		CommandRecorder recorder(this);
+		const bool recorded =
+				recorder.transition(
+						image,
+						VK_IMAGE_LAYOUT_UNDEFINED,
+						VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) == OK &&
+				recorder.copy_buffer_to_image(staging_buffer, image, 1) ==
+						OK &&
+				generate_mipmaps(image, &recorder) == OK;
+		if (!recorded)
+			recorder.discard();
+
+		if (!recorded || recorder.submit() != OK) {
+			destroy_and_free_buffer(staging_buffer);
+			destroy_and_free_image(image);
+			return FAIL;
+		}
+		destroy_and_free_buffer(staging_buffer);
+	} else if (_record_image_upload(image, staging_buffer) != OK) {
+		destroy_and_free_buffer(staging_buffer);
+		destroy_and_free_image(image);
+		return FAIL;
+	}
+
+	std::lock_guard<std::mutex> lock(_assets_mutex);
+	_images.emplace(image);
+
+	return OK;
+}
+
+Error Renderer::_record_image_upload(Image *image, Buffer *staging_buffer) {
+
+	std::vector<VkBufferImageCopy> regions;
+	ERR_FAIL_COND_V_MSG(
+			_get_level_copies(*image, image->mip_levels, &regions) >
+					staging_buffer->size,
+			FAIL,
+			"Staging buffer is too small for %u mip levels",
+			image->mip_levels);
+
+	std::lock_guard<std::mutex> lock(_upload_mutex);
+
+	ERR_TRY(_begin_uploads());
+
+	VkImageMemoryBarrier barrier {
+		.sType				 = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask		 = 0,
+		.dstAccessMask		 = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.oldLayout			 = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout			 = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image				 = image->image,
+		.subresourceRange {
+				.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel	= 0,
+				.levelCount		= image->mip_levels,
+				.baseArrayLayer = 0,
+				.layerCount		= 1,
+		},
+	};
+
+	VkCommandBuffer cmd_buf = _open_upload.command_buffer;
+
+	vkCmdPipelineBarrier(
+			cmd_buf,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			0,
+			nullptr,
+			0,
+			nullptr,
+			1,
+			&barrier);
+
+	vkCmdCopyBufferToImage(
+			cmd_buf,
+			staging_buffer->buffer,
+			image->image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			(uint32_t)regions.size(),
+			regions.data());
+
+	barrier.oldLayout	  = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout	  = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	if (_transfer_family == _graphics_family) {
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(
+				cmd_buf,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				0,
+				0,
+				nullptr,
+				0,
+				nullptr,
+				1,
+				&barrier);
+	} else {
+		// the layout changes with the ownership transfer at the end of the
+		// batch
+		barrier.srcAccessMask		= 0;
+		barrier.srcQueueFamilyIndex = _transfer_family;
+		barrier.dstQueueFamilyIndex = _graphics_family;
+		_open_upload.image_acquires.push_back(barrier);
+	}
+
+	// the batch frees it once the copy is done
+	_open_upload.staging_buffers.push_back(*staging_buffer);
+	image->upload_ticket = _open_upload.id;
+
+	return OK;
+}
+
+VkDeviceSize
+Renderer::get_level_size(VkFormat format, uint32_t width, uint32_t height) {
+
+	// block compressed formats are stored in 4x4 texel blocks
+	const VkDeviceSize blocks = (VkDeviceSize)((width + 3) / 4) *
+								((height + 3) / 4);
+
+	switch (format) {
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			return (VkDeviceSize)width * height * 4;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+			return blocks * 8;
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			return blocks * 16;
+		default:
+			return 0;
+	}
+}
+
+Error Renderer::load_mesh(Mesh *mesh, const char *filename) {
+
+	const AssetPack::Entry *entry = _asset_pack.find(filename);
+	if (entry == nullptr) {
+		ERR_TRY(Mesh::load_from_obj(mesh, filename));
+		return upload_mesh(
+				mesh,
+				mesh->vertices.data(),
+				static_cast<uint32_t>(mesh->vertices.size()),
+				mesh->indices.data(),
+				static_cast<uint32_t>(mesh->indices.size()));
+	}
+
+	ERR_FAIL_COND_V_MSG(
+			entry->type != AssetPack::ENTRY_MESH,
+			FAIL,
+			"Asset %s is not a mesh",
+			filename);
+
+	return upload_cooked_mesh(mesh, *entry);
+}
+
+Error Renderer::load_image(Image *image, const char *filename) {
+
+	const AssetPack::Entry *entry = _asset_pack.find(filename);
+	if (entry == nullptr && std::string_view(filename).ends_with(".ktx2")) {
+		Ktx2Loader::Data ktx;
+		ERR_TRY(Ktx2Loader::load(filename, &ktx));
+		return upload_image(
+				image,
+				ktx.levels.data(),
+				ktx.levels.size(),
+				ktx.width,
+				ktx.height,
+				ktx.mip_levels,
+				ktx.format);
+	}
+
+	if (entry == nullptr)
+		return decode_image(image, filename);
+
+	ERR_FAIL_COND_V_MSG(
+			entry->type != AssetPack::ENTRY_TEXTURE,
+			FAIL,
+			"Asset %s is not a texture",
+			filename);
+
+	const std::span<const uint8_t> data = _asset_pack.get_data(*entry);
+	return upload_image(
+			image,
+			data.data(),
+			data.size(),
+			entry->texture.width,
+			entry->texture.height,
+			entry->texture.mip_levels,
+			(VkFormat)entry->texture.format);
+}
+
+void Renderer::set_render_object(RenderObject *render_object) {
+	_scene_root = render_object;
+	_scene_root->_set_tree_root(_scene_root);
+}
+
+void Renderer::center_window(GLFWwindow *window, GLFWmonitor *monitor) {
+	if (!monitor)
+		return;
+
+	const GLFWvidmode *mode = glfwGetVideoMode(monitor);
+	if (!mode)
+		return;
+
+	int x, y;
+	int w, h;
+	glfwGetMonitorPos(monitor, &x, &y);
+	glfwGetWindowSize(window, &w, &h);
+
+	glfwSetWindowPos(
+			window, x + (mode->width - w) / 2, y + (mode->height - h) / 2);
+}
+
+void Renderer::glfw_key_callback(
+		GLFWwindow *window, int key, int scancode, int action, int mods) {
+	Renderer::singleton->_key_callback(key, scancode, action, mods);
+}
+void Renderer::glfw_char_callback(GLFWwindow *window, unsigned int codepoint) {
+	Renderer::singleton->_char_callback(codepoint);
+}
+void Renderer::glfw_cursor_pos_callback(
+		GLFWwindow *window, double x, double y) {
+	Renderer::singleton->_cursor_pos_callback(x, y);
+}
+void Renderer::glfw_mouse_button_callback(
+		GLFWwindow *window, int button, int action, int mods) {
+	Renderer::singleton->_mouse_button_callback(button, action, mods);
+}
+
+void Renderer::_key_callback(int key, int scancode, int action, int mods) {
+	if (_scene_root) {
+		_scene_root->_propogate_input_key(key, scancode, action, mods);
+	}
+}
+void Renderer::_char_callback(unsigned int codepoint) {
+	if (_scene_root) {
+		_scene_root->_propogate_input_char(codepoint);
+	}
+}
+void Renderer::_cursor_pos_callback(double x, double y) {
+	if (_scene_root) {
+		_scene_root->_propogate_input_cursor_pos(x, y);
+	}
+}
+void Renderer::_mouse_button_callback(int button, int action, int mods) {
+	if (_scene_root) {
+		_scene_root->_propogate_input_mouse_button(button, action, mods);
+	}
+}
+
+Error Renderer::create_window() {
+
+	// set callback for logging glfw errors
+	glfwSetErrorCallback(glfw_error_callback);
+
+	// initialize glfw library
+	ERR_FAIL_COND_V_MSG(!glfwInit(), FAIL, "Failed to initialize GLFW");
+
+	// disable automatic OpenGL context creation from glfw
+	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+
+	// create window
+	_window =
+			glfwCreateWindow(WINDOW_INIT_SIZE, WINDOW_TITLE, nullptr, nullptr);
+
+	glfwSetKeyCallback(_window, glfw_key_callback);
+	glfwSetCharCallback(_window, glfw_char_callback);
+	glfwSetCursorPosCallback(_window, glfw_cursor_pos_callback);
+	glfwSetMouseButtonCallback(_window, glfw_mouse_button_callback);
+
+	return OK;
+}
+
+Error Renderer::create_vk_instance() {
+	// start building vulkan instance
+	vkb::InstanceBuilder instance_builder;
+
+	instance_builder.set_app_name(VK_APP_NAME)
+			.set_engine_name(VK_ENGINE_NAME)
+			.require_api_version(
+					VK_VERSION_MAJOR(VK_REQUIRED_API_VERSION),
+					VK_VERSION_MINOR(VK_REQUIRED_API_VERSION),
+					VK_VERSION_PATCH(VK_REQUIRED_API_VERSION));
+
+#ifdef USE_VALIDATION_LAYERS
+	// enable validation layers
+	instance_builder.request_validation_layers();
+
+	// set callback for logging vulkan validation messages
+	instance_builder.set_debug_callback(
+			[](VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+			   VkDebugUtilsMessageTypeFlagsEXT messageType,
+			   const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+			   void *pUserData) -> VkBool32 {
+				LOG_DEBUG(
+						"VK [%s: %s]\n\t%s\n",
+						vkb::to_string_message_severity(messageSeverity),
+						vkb::to_string_message_type(messageType),
+						pCallbackData->pMessage);
+				return VK_FALSE;
+			});
+#endif
+
+	// enable instance extensions
+	for (auto &name : VK_INSTANCE_EXTENSIONS) {
+		instance_builder.enable_extension(name);
+	}
+
+	// build vulkan instance
+	auto instance_builder_return = instance_builder.build();
+
+	// check instance is valid
+	ERR_FAIL_COND_V_MSG(
+			!instance_builder_return,
+			FAIL,
+			"Failed to create Vulkan instance: %s",
+			instance_builder_return.error().message().c_str());
+
+	// get the final vulkan instance
+	_vkb_instance = instance_builder_return.value();
+
+	// attach volk to instance
+	volkLoadInstance(_vkb_instance.instance);
+
+	return OK;
+}
+
+Error Renderer::create_surface() {
+	_vk_surface	 = nullptr;
+	VkResult err = glfwCreateWindowSurface(
+			_vkb_instance.instance, _window, NULL, &_vk_surface);
+
+	ERR_FAIL_COND_V_MSG(
+			err != VK_SUCCESS,
+			FAIL,
+			"Failed to create glfw window surface: %s",
+			err);
+
+	return OK;
+}
+
+Error Renderer::create_vk_device() {
+
+	// create device selector
+	vkb::PhysicalDeviceSelector device_selector { _vkb_instance };
+
+	// add device extensions
+	device_selector.add_required_extensions(VK_REQUIRED_DEVICE_EXTENSIONS);
+	device_selector.add_desired_extensions(VK_OPTIONAL_DEVICE_EXTENSIONS);
+
+	// add device features
+	device_selector.set_required_features(VK_REQUIRED_DEVICE_FEATURES);
+	device_selector.set_required_features_11(VK_REQUIRED_DEVICE_FEATURES_11);
+	device_selector.set_required_features_12(VK_REQUIRED_DEVICE_FEATURES_12);
+
+	// pick compatible device
+	vkb::PhysicalDevice physical_device =
+			device_selector
+					.set_minimum_version(
+							VK_VERSION_MAJOR(VK_DEVICE_MINIMUM_VERSION),
+							VK_VERSION_MINOR(VK_DEVICE_MINIMUM_VERSION))
+					.set_surface(_vk_surface)
+					.select()
+					.value();
+
+	vkb::DeviceBuilder device_builder { physical_device };
+	auto device_builder_return = device_builder.build();
+
+	ERR_FAIL_COND_V_MSG(
+			!device_builder_return,
+			FAIL,
+			"Failed to create Vulkan device: %s",
+			device_builder_return.error().message().c_str());
+
+	// get final vulkan device
+	_vkb_device = device_builder_return.value();
+
+	// attach volk to device
+	volkLoadDevice(_vkb_device.device);
+
+	return OK;
+}
+
+Error Renderer::create_vma_allocator() {
+
+	VmaAllocatorCreateInfo allocator_info {
+		.physicalDevice	  = _vkb_device.physical_device.physical_device,
 		.device			  = _vkb_device.device,
 		.instance		  = _vkb_instance.instance,
 		.vulkanApiVersion = VK_REQUIRED_API_VERSION,
 	};
 
-	// get vulkan function pointers from volk
+	// get vulkan function pointers from volk
+
+	VolkDeviceTable table;
+	volkLoadDeviceTable(&table, _vkb_device.device);
+
+	// remap volk table to vma table
+	VmaVulkanFunctions vulkan_funcs {
+		.vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties,
+		.vkGetPhysicalDeviceMemoryProperties =
+				vkGetPhysicalDeviceMemoryProperties,
+		.vkAllocateMemory = table.vkAllocateMemory,
+		.vkFreeMemory = table.vkFreeMemory, .vkMapMemory = table.vkMapMemory,
+		.vkUnmapMemory					= table.vkUnmapMemory,
+		.vkFlushMappedMemoryRanges		= table.vkFlushMappedMemoryRanges,
+		.vkInvalidateMappedMemoryRanges = table.vkInvalidateMappedMemoryRanges,
+		.vkBindBufferMemory				= table.vkBindBufferMemory,
+		.vkBindImageMemory				= table.vkBindImageMemory,
+		.vkGetBufferMemoryRequirements	= table.vkGetBufferMemoryRequirements,
+		.vkGetImageMemoryRequirements	= table.vkGetImageMemoryRequirements,
+		.vkCreateBuffer					= table.vkCreateBuffer,
+		.vkDestroyBuffer				= table.vkDestroyBuffer,
+		.vkCreateImage					= table.vkCreateImage,
+		.vkDestroyImage					= table.vkDestroyImage,
+		.vkCmdCopyBuffer				= table.vkCmdCopyBuffer,
+#if VMA_DEDICATED_ALLOCATION || VMA_VULKAN_VERSION >= 1001000
+		.vkGetBufferMemoryRequirements2KHR =
+				table.vkGetBufferMemoryRequirements2KHR,
+		.vkGetImageMemoryRequirements2KHR =
+				table.vkGetImageMemoryRequirements2KHR,
+#endif
+#if VMA_BIND_MEMORY2 || VMA_VULKAN_VERSION >= 1001000
+		.vkBindBufferMemory2KHR = table.vkBindBufferMemory2KHR,
+		.vkBindImageMemory2KHR	= table.vkBindImageMemory2KHR,
+#endif
+#if VMA_MEMORY_BUDGET || VMA_VULKAN_VERSION >= 1001000
+		.vkGetPhysicalDeviceMemoryProperties2KHR =
+				vkGetPhysicalDeviceMemoryProperties2KHR,
+#endif
+	};
+
+	allocator_info.pVulkanFunctions = &vulkan_funcs;
+
+	ERR_FAIL_COND_V_MSG(
+			vmaCreateAllocator(&allocator_info, &_vma_allocator) != VK_SUCCESS,
+			FAIL,
+			"Failed to create Vulkan Memory Allocator");
+
+	return OK;
+}
+
+Error Renderer::create_swapchain() {
+
+	// (re)build swapchain
+	vkb::SwapchainBuilder swapchain_builder { _vkb_device };
+	auto swap_ret = swapchain_builder
+							.set_old_swapchain(_vkb_swapchain)
+							// swapchain settings
+							.build();
+
+	if (!swap_ret) {
+		LOG_ERR("Failed to create Vulkan swapchain: %s",
+				swap_ret.error().message().c_str());
+		_vkb_swapchain.swapchain = VK_NULL_HANDLE;
+		return FAIL;
+	}
+
+	vkb::destroy_swapchain(_vkb_swapchain);
+
+	// get final swapchain
+	_vkb_swapchain = swap_ret.value();
+
+	_swapchain_images = _vkb_swapchain.get_images().value();
+
+	// this creates image views
+	_swapchain_image_views = _vkb_swapchain.get_image_views().value();
+
+	return OK;
+}
+
+// Error Renderer::create_image_views() {
+
+// 	_swapchain_images	   = _vkb_swapchain.get_images().value();
+// 	_swapchain_image_views = _vkb_swapchain.get_image_views().value();
+
+// for (size_t i = 0; i < _swapchain_images.size(); i++) {
+// 	_swapchain_image_views[i] = create_image_view(
+// 			"swapchain image view " + std::to_string(i),
+// 			_swapchain_images[i],
+// 			_vkb_swapchain.image_format,
+// 			VK_IMAGE_ASPECT_COLOR_BIT);
+// }
+
+// 	return OK;
+// }
+
+Error Renderer::get_queues() {
+
+	// get graphics queue
+	auto graphics_queue = _vkb_device.get_queue(vkb::QueueType::graphics);
+	ERR_FAIL_COND_V_MSG(
+			!graphics_queue.has_value(),
+			FAIL,
+			"Failed to get graphics queue: %s",
+			graphics_queue.error().message().c_str());
+	_graphics_queue = graphics_queue.value();
+
+	// get presentation queue
+	auto present_queue = _vkb_device.get_queue(vkb::QueueType::present);
+	ERR_FAIL_COND_V_MSG(
+			!present_queue.has_value(),
+			FAIL,
+			"Failed to get presentation queue: %s",
+			present_queue.error().message().c_str());
+	_present_queue = present_queue.value();
+
+	_graphics_family =
+			_vkb_device.get_queue_index(vkb::QueueType::graphics).value();
+
+	// copies on a dedicated transfer queue run alongside rendering
+	auto transfer_queue =
+			_vkb_device.get_dedicated_queue(vkb::QueueType::transfer);
+	if (transfer_queue.has_value()) {
+		_transfer_queue = transfer_queue.value();
+		_transfer_family =
+				_vkb_device.get_dedicated_queue_index(vkb::QueueType::transfer)
+						.value();
+	} else {
+		LOG_INFO("No dedicated transfer queue, uploading on graphics queue");
+		_transfer_queue	 = _graphics_queue;
+		_transfer_family = _graphics_family;
+	}
+
+	return OK;
+}
+
+Error Renderer::create_render_pass() {
+
+	VkAttachmentDescription color_attachment {
+		.format			= _vkb_swapchain.image_format,
+		.samples		= VK_SAMPLE_COUNT_1_BIT,
+		.loadOp			= VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp		= VK_ATTACHMENT_STORE_OP_STORE,
+		.stencilLoadOp	= VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout	= VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout	= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+	};
+
+	VkAttachmentReference color_attachment_ref {
+		.attachment = 0,
+		.layout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+	};
+
+	VkAttachmentDescription depth_attachment {
+		.format			= find_depth_format(),
+		.samples		= VK_SAMPLE_COUNT_1_BIT,
+		.loadOp			= VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp		= VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.stencilLoadOp	= VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		.initialLayout	= VK_IMAGE_LAYOUT_UNDEFINED,
+		.finalLayout	= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+	};
+
+	VkAttachmentReference depth_attachment_ref {
+		.attachment = 1,
+		.layout		= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+	};
+
+	VkSubpassDescription subpass {
+		.pipelineBindPoint		 = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount	 = 1,
+		.pColorAttachments		 = &color_attachment_ref,
+		.pDepthStencilAttachment = &depth_attachment_ref,
+	};
+
+	VkSubpassDependency dependency {
+		.srcSubpass	  = VK_SUBPASS_EXTERNAL,
+		.dstSubpass	  = 0,
+		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+						VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+						VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+						 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+	};
+
+	std::array<VkAttachmentDescription, 2> attachments {
+		color_attachment,
+		depth_attachment,
+	};
+
+	VkRenderPassCreateInfo pass_info {
+		.sType			 = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = static_cast<uint32_t>(attachments.size()),
+		.pAttachments	 = attachments.data(),
+		.subpassCount	 = 1,
+		.pSubpasses		 = &subpass,
+		.dependencyCount = 1,
+		.pDependencies	 = &dependency,
+	};
+
+	// create render pass
+	VkResult err = vkCreateRenderPass(
+			_vkb_device.device, &pass_info, nullptr, &_render_pass);
+	ERR_FAIL_COND_V_MSG(
+			err != VK_SUCCESS, FAIL, "Failed to create render pass");
+
+	return OK;
+}
+
+Error Renderer::create_descriptor_set_layout() {
+
+	// VkDescriptorSetLayoutBinding ubo_layout_binding {
+	// 	.binding			= 0,
+	// 	.descriptorType		= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+	// 	.descriptorCount	= 1,
+	// 	.stageFlags			= VK_SHADER_STAGE_VERTEX_BIT,
+	// 	.pImmutableSamplers = nullptr,
+	// };
+
+	VkDescriptorSetLayoutBinding sampler_layout_binding {
+		.binding		 = 1,
+		.descriptorType	 = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.descriptorCount = 1,
+		// only available for the fragment shader
+		.stageFlags			= VK_SHADER_STAGE_FRAGMENT_BIT,
+		.pImmutableSamplers = nullptr,
+	};
+
+	std::array<VkDescriptorSetLayoutBinding, 1> bindings {
+		// ubo_layout_binding,
+		sampler_layout_binding,
+	};
+
+	VkDescriptorSetLayoutCreateInfo layout_info {
+		.sType		  = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = static_cast<uint32_t>(bindings.size()),
+		.pBindings	  = bindings.data(),
+	};
+
+	VkResult res = vkCreateDescriptorSetLayout(
+			_vkb_device.device, &layout_info, nullptr, &_descriptor_set_layout);
+
+	ERR_FAIL_COND_V_MSG(
+			res != VK_SUCCESS,
+			FAIL,
+			"Failed to create descriptor set layout: %d",
+			(int)res);
+
+	return OK;
+}
+
+Error Renderer::create_graphics_pipeline() {
+
+	ERR_TRY(createShaderFromFile(
+			_vkb_device.device, &_vert_shader, "shaders/vert_shader.vert"));
+
+	ERR_TRY(createShaderFromFile(
+			_vkb_device.device, &_frag_shader, "shaders/frag_shader.frag"));
+
+	ERR_TRY(createShaderFromFile(
+			_vkb_device.device, &_depth_shader, "shaders/depth_shader.vert"));
+
+	// the fragment shader reads the material color at the end
+	VkPushConstantRange push_constant {
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+		.offset		= 0,
+		.size		= sizeof(PushConstants),
+	};
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info {
+		.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount			= 1,
+		.pSetLayouts			= &_descriptor_set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges	= &push_constant,
+	};
+
+	VkResult err = vkCreatePipelineLayout(
+			_vkb_device.device,
+			&pipeline_layout_info,
+			nullptr,
+			&_pipeline_layout);
+
+	ERR_FAIL_COND_V_MSG(
+			err != VK_SUCCESS, FAIL, "Failed to create pipeline layout");
+
+	return OK;
+}
+
+VkPipeline Renderer::get_pipeline(const VertexFormat &format) {
+
+	std::lock_guard<std::mutex> lock(_pipelines_mutex);
+
+	auto [it, inserted] =
+			_pipelines.emplace(format.get_key(), VK_NULL_HANDLE);
+	if (inserted && _create_pipeline(format, false, &it->second) != OK) {
+		_pipelines.erase(it);
+		return VK_NULL_HANDLE;
+	}
+
+	return it->second;
+}
+
+VkPipeline Renderer::get_depth_pipeline(const VertexFormat &format) {
+
+	std::lock_guard<std::mutex> lock(_pipelines_mutex);
+
+	auto [it, inserted] =
+			_depth_pipelines.emplace(format.get_position_key(), VK_NULL_HANDLE);
+	if (inserted && _create_pipeline(format, true, &it->second) != OK) {
+		_depth_pipelines.erase(it);
+		return VK_NULL_HANDLE;
+	}
+
+	return it->second;
+}
+
+Error Renderer::_create_pipeline(
+		const VertexFormat &format, bool depth_only, VkPipeline *pipeline) {
+
+	VkPipelineShaderStageCreateInfo vert_stage_info {
+		.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage	= VK_SHADER_STAGE_VERTEX_BIT,
+		.module = _vert_shader.module,
+		.pName	= "main",
+	};
+
+	VkPipelineShaderStageCreateInfo frag_stage_info {
+		.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.stage	= VK_SHADER_STAGE_FRAGMENT_BIT,
+		.module = _frag_shader.module,
+		.pName	= "main",
+	};
+
+	VkPipelineShaderStageCreateInfo shader_stages[] {
+		vert_stage_info,
+		frag_stage_info,
+	};
 
-	VolkDeviceTable table;
-	volkLoadDeviceTable(&table, _vkb_device.device);
+	std::vector<VkVertexInputBindingDescription> binding_descriptions;
+	std::vector<VkVertexInputAttributeDescription> attribute_descriptions;
 
-	// remap volk table to vma table
-	VmaVulkanFunctions vulkan_funcs {
-		.vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties,
-		.vkGetPhysicalDeviceMemoryProperties =
-				vkGetPhysicalDeviceMemoryProperties,
-		.vkAllocateMemory = table.vkAllocateMemory,
-		.vkFreeMemory = table.vkFreeMemory, .vkMapMemory = table.vkMapMemory,
-		.vkUnmapMemory					= table.vkUnmapMemory,
-		.vkFlushMappedMemoryRanges		= table.vkFlushMappedMemoryRanges,
-		.vkInvalidateMappedMemoryRanges = table.vkInvalidateMappedMemoryRanges,
-		.vkBindBufferMemory				= table.vkBindBufferMemory,
-		.vkBindImageMemory				= table.vkBindImageMemory,
-		.vkGetBufferMemoryRequirements	= table.vkGetBufferMemoryRequirements,
-		.vkGetImageMemoryRequirements	= table.vkGetImageMemoryRequirements,
-		.vkCreateBuffer					= table.vkCreateBuffer,
-		.vkDestroyBuffer				= table.vkDestroyBuffer,
-		.vkCreateImage					= table.vkCreateImage,
-		.vkDestroyImage					= table.vkDestroyImage,
-		.vkCmdCopyBuffer				= table.vkCmdCopyBuffer,
-#if VMA_DEDICATED_ALLOCATION || VMA_VULKAN_VERSION >= 1001000
-		.vkGetBufferMemoryRequirements2KHR =
-				table.vkGetBufferMemoryRequirements2KHR,
-		.vkGetImageMemoryRequirements2KHR =
-				table.vkGetImageMemoryRequirements2KHR,
-#endif
-#if VMA_BIND_MEMORY2 || VMA_VULKAN_VERSION >= 1001000
-		.vkBindBufferMemory2KHR = table.vkBindBufferMemory2KHR,
-		.vkBindImageMemory2KHR	= table.vkBindImageMemory2KHR,
-#endif
-#if VMA_MEMORY_BUDGET || VMA_VULKAN_VERSION >= 1001000
-		.vkGetPhysicalDeviceMemoryProperties2KHR =
-				vkGetPhysicalDeviceMemoryProperties2KHR,
+	if (depth_only) {
+		// only the position stream is read, and nothing is shaded
+		shader_stages[0].module = _depth_shader.module;
+		binding_descriptions.push_back(
+				format.get_position_binding_description());
+		attribute_descriptions.push_back(
+				format.get_position_attribute_description());
+	} else {
+		binding_descriptions   = format.get_binding_descriptions();
+		attribute_descriptions = format.get_attribute_descriptions();
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertex_input_info {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount =
+				static_cast<uint32_t>(binding_descriptions.size()),
+		.pVertexBindingDescriptions = binding_descriptions.data(),
+		.vertexAttributeDescriptionCount =
+				static_cast<uint32_t>(attribute_descriptions.size()),
+		.pVertexAttributeDescriptions = attribute_descriptions.data(),
+	};
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly {
+		.sType	  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+		.primitiveRestartEnable = VK_FALSE,
+	};
+
+	VkViewport viewport {
+		.x		  = 0.0f,
+		.y		  = 0.0f,
+		.width	  = (float)_vkb_swapchain.extent.width,
+		.height	  = (float)_vkb_swapchain.extent.height,
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f,
+	};
+
+	VkRect2D scissor {
+		.offset = { 0, 0 },
+		.extent = _vkb_swapchain.extent,
+	};
+
+	VkPipelineViewportStateCreateInfo viewport_state {
+		.sType		   = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.pViewports	   = &viewport,
+		.scissorCount  = 1,
+		.pScissors	   = &scissor,
+	};
+
+	VkPipelineRasterizationStateCreateInfo rasterizer {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.depthClampEnable		 = VK_FALSE,
+		.rasterizerDiscardEnable = VK_FALSE,
+		.polygonMode			 = VK_POLYGON_MODE_FILL,
+		.cullMode				 = VK_CULL_MODE_BACK_BIT,
+		.frontFace				 = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+		.depthBiasEnable		 = VK_FALSE,
+		.lineWidth				 = 1.0f,
+	};
+
+	VkPipelineMultisampleStateCreateInfo multisampling {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+		.sampleShadingEnable  = VK_FALSE,
+	};
+
+#ifdef USE_DEPTH_PREPASS
+	// the color pass only shades what the depth pass left in the buffer
+	const bool depth_write			= depth_only;
+	const VkCompareOp depth_compare = depth_only ? VK_COMPARE_OP_LESS
+												 : VK_COMPARE_OP_LESS_OR_EQUAL;
+#else
+	const bool depth_write			= true;
+	const VkCompareOp depth_compare = VK_COMPARE_OP_LESS;
 #endif
+
+	VkPipelineDepthStencilStateCreateInfo depth_stencil {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable	   = VK_TRUE,
+		.depthWriteEnable	   = depth_write ? VK_TRUE : VK_FALSE,
+		.depthCompareOp		   = depth_compare,
+		.depthBoundsTestEnable = VK_FALSE,
+		.stencilTestEnable	   = VK_FALSE,
+		.front				   = {},
+		.back				   = {},
+		.minDepthBounds		   = 0.0f,
+		.maxDepthBounds		   = 1.0f,
+	};
+
+	VkPipelineColorBlendAttachmentState color_blend_attachment {
+		.blendEnable	= VK_FALSE,
+		.colorWriteMask = // rgba
+		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	};
+	if (depth_only)
+		color_blend_attachment.colorWriteMask = 0;
+
+	VkPipelineColorBlendStateCreateInfo color_blending {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.logicOpEnable	 = VK_FALSE,
+		.logicOp		 = VK_LOGIC_OP_COPY,
+		.attachmentCount = 1,
+		.pAttachments	 = &color_blend_attachment,
+		.blendConstants	 = { 0.0f, 0.0f, 0.0f, 0.0f },
+	};
+
+	std::vector<VkDynamicState> dynamic_states {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamic_info {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
+		.pDynamicStates	   = dynamic_states.data(),
+	};
+
+	VkGraphicsPipelineCreateInfo pipeline_info {
+		.sType				 = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.stageCount			 = depth_only ? 1u : 2u,
+		.pStages			 = shader_stages,
+		.pVertexInputState	 = &vertex_input_info,
+		.pInputAssemblyState = &input_assembly,
+		.pViewportState		 = &viewport_state,
+		.pRasterizationState = &rasterizer,
+		.pMultisampleState	 = &multisampling,
+		.pDepthStencilState	 = &depth_stencil,
+		.pColorBlendState	 = &color_blending,
+		.pDynamicState		 = &dynamic_info,
+		.layout				 = _pipeline_layout,
+		.renderPass			 = _render_pass,
+		.subpass			 = 0,
+		.basePipelineHandle	 = VK_NULL_HANDLE,
+	};
+
+	VkResult err = vkCreateGraphicsPipelines(
+			_vkb_device.device,
+			VK_NULL_HANDLE,
+			1,
+			&pipeline_info,
+			nullptr,
+			pipeline);
+
+	ERR_FAIL_COND_V_MSG(
+			err != VK_SUCCESS,
+			FAIL,
+			"Failed to create %s pipeline for vertex format %x",
+			depth_only ? "depth" : "graphics",
+			format.get_key());
+
+	return OK;
+}
+
+Error Renderer::create_framebuffers() {
+
+	_framebuffers.resize(_swapchain_image_views.size());
+
+	VkResult err;
+
+	for (size_t i = 0; i < _swapchain_image_views.size(); i++) {
+		std::array<VkImageView, 2> attachments {
+			_swapchain_image_views[i],
+			_depth_image_view,
+		};
+
+		VkFramebufferCreateInfo framebuffer_info {
+			.sType			 = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+			.renderPass		 = _render_pass,
+			.attachmentCount = static_cast<uint32_t>(attachments.size()),
+			.pAttachments	 = attachments.data(),
+			.width			 = _vkb_swapchain.extent.width,
+			.height			 = _vkb_swapchain.extent.height,
+			.layers			 = 1,
+		};
+
+		err = vkCreateFramebuffer(
+				_vkb_device.device,
+				&framebuffer_info,
+				nullptr,
+				&_framebuffers[i]);
+
+		ERR_FAIL_COND_V_MSG(
+				err != VK_SUCCESS, FAIL, "Failed to create framebuffer[%d]", i);
+	}
+
+	return OK;
+}
+
+Error Renderer::create_command_pool() {
+
+	VkCommandPoolCreateInfo pool_info {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex =
+				_vkb_device.get_queue_index(vkb::QueueType::graphics).value(),
+	};
+
+	VkResult err = vkCreateCommandPool(
+			_vkb_device.device, &pool_info, nullptr, &_command_pool);
+	ERR_FAIL_COND_V_MSG(
+			err != VK_SUCCESS, FAIL, "Failed to create command pool");
+
+	return OK;
+}
+
+Error Renderer::create_depth_resources() {
+
+	VkFormat depth_format = find_depth_format();
+
+	create_image(
+			&_depth_image,
+			_vkb_swapchain.extent.width,
+			_vkb_swapchain.extent.height,
+			depth_format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	_depth_image_view = create_image_view(
+			"depth buffer image view",
+			_depth_image.image,
+			depth_format,
+			VK_IMAGE_ASPECT_DEPTH_BIT);
+
+	// the render pass moves it out of VK_IMAGE_LAYOUT_UNDEFINED itself, so
+	// it doesn't need a transition of its own
+
+	return OK;
+}
+
+VkCommandPool Renderer::_get_upload_pool() {
+
+	std::lock_guard<std::mutex> lock(_upload_pools_mutex);
+
+	auto [it, inserted] =
+			_upload_pools.emplace(std::this_thread::get_id(), VK_NULL_HANDLE);
+	if (!inserted)
+		return it->second;
+
+	VkCommandPoolCreateInfo pool_info {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex =
+				_vkb_device.get_queue_index(vkb::QueueType::graphics).value(),
+	};
+
+	VkResult err = vkCreateCommandPool(
+			_vkb_device.device, &pool_info, nullptr, &it->second);
+	if (err != VK_SUCCESS) {
+		_upload_pools.erase(it);
+		LOG_ERR("Failed to create upload command pool: %d", (int)err);
+		return VK_NULL_HANDLE;
+	}
+
+	return it->second;
+}
+
+VkCommandBuffer Renderer::_begin_single_use_command_buffer() {
+
+	VkCommandPool pool = _get_upload_pool();
+	if (pool == VK_NULL_HANDLE)
+		return VK_NULL_HANDLE;
+
+	VkCommandBufferAllocateInfo alloc_info {
+		.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool		= pool,
+		.level				= VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
 	};
 
-	allocator_info.pVulkanFunctions = &vulkan_funcs;
+	VkCommandBuffer command_buffer;
+	VkResult res = vkAllocateCommandBuffers(
+			_vkb_device.device, &alloc_info, &command_buffer);
 
 	ERR_FAIL_COND_V_MSG(
-			vmaCreateAllocator(&allocator_info, &_vma_allocator) != VK_SUCCESS,
-			FAIL,
-			"Failed to create Vulkan Memory Allocator");
+			res != VK_SUCCESS,
+			command_buffer,
+			"Failed to allocate command buffer: %d",
+			(int)res);
 
-	return OK;
+	VkCommandBufferBeginInfo begin_info {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+
+	res = vkBeginCommandBuffer(command_buffer, &begin_info);
+
+	ERR_FAIL_COND_V_MSG(
+			res != VK_SUCCESS,
+			command_buffer,
+			"Failed to begin command buffer: %d",
+			(int)res);
+
+	return command_buffer;
 }
 
-Error Renderer::create_swapchain() {
+Error Renderer::_end_and_submit_single_use_command_buffer(
+		VkCommandBuffer command_buffer) {
 
-	// (re)build swapchain
-	vkb::SwapchainBuilder swapchain_builder { _vkb_device };
-	auto swap_ret = swapchain_builder
-							.set_old_swapchain(_vkb_swapchain)
-							// swapchain settings
-							.build();
+	VkResult res = vkEndCommandBuffer(command_buffer);
 
-	if (!swap_ret) {
-		LOG_ERR("Failed to create Vulkan swapchain: %s",
-				swap_ret.error().message().c_str());
-		_vkb_swapchain.swapchain = VK_NULL_HANDLE;
+	if (res != VK_SUCCESS) {
+		vkFreeCommandBuffers(
+				_vkb_device.device, _get_upload_pool(), 1, &command_buffer);
+		LOG_ERR("Failed to end command buffer: %d", (int)res);
 		return FAIL;
 	}
 
-	vkb::destroy_swapchain(_vkb_swapchain);
+	VkSubmitInfo submit_info {
+		.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers	= &command_buffer,
+	};
 
-	// get final swapchain
-	_vkb_swapchain = swap_ret.value();
+	// wait on a fence for just this submit instead of idling the whole queue
+	// so uploads from other threads can run at the same time
+	VkFenceCreateInfo fence_info {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	};
 
-	_swapchain_images = _vkb_swapchain.get_images().value();
+	VkFence fence;
+	res = vkCreateFence(_vkb_device.device, &fence_info, nullptr, &fence);
+	if (res != VK_SUCCESS) {
+		vkFreeCommandBuffers(
+				_vkb_device.device, _get_upload_pool(), 1, &command_buffer);
+		LOG_ERR("Failed to create fence: %d", (int)res);
+		return FAIL;
+	}
 
-	// this creates image views
-	_swapchain_image_views = _vkb_swapchain.get_image_views().value();
+	{
+		std::lock_guard<std::mutex> lock(_queue_mutex);
+		res = vkQueueSubmit(_graphics_queue, 1, &submit_info, fence);
+	}
 
-	return OK;
+	if (res == VK_SUCCESS) {
+		res = vkWaitForFences(
+				_vkb_device.device, 1, &fence, VK_TRUE, UINT64_MAX);
+		if (res != VK_SUCCESS)
+			LOG_ERR("Failed to wait for single use command: %d", (int)res);
+	} else {
+		LOG_ERR("Failed to submit queue: %d", (int)res);
+	}
+
+	vkDestroyFence(_vkb_device.device, fence, nullptr);
+	vkFreeCommandBuffers(
+			_vkb_device.device, _get_upload_pool(), 1, &command_buffer);
+
+	return res == VK_SUCCESS ? OK : FAIL;
 }
 
-// Error Renderer::create_image_views() {
+namespace {
+
+/**
+ * Accesses and stages that use images in the given layout, so barriers
+ * moving an image out of it wait on them and barriers moving an image into it
+ * block them.
+ * @returns false if images can't be moved into the layout.
+ */
+bool _get_layout_usage(
+		VkImageLayout layout,
+		VkAccessFlags *access,
+		VkPipelineStageFlags *stages) {
+
+	switch (layout) {
+		case VK_IMAGE_LAYOUT_UNDEFINED:
+			*access = 0;
+			*stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			// the contents are discarded, so nothing can be moved into it
+			return false;
+		case VK_IMAGE_LAYOUT_GENERAL:
+			*access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+			*stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			return true;
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			*access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+					  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			*stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			return true;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+			*access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+					  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			*stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+					  VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			return true;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+			*access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+					  VK_ACCESS_SHADER_READ_BIT;
+			*stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+					  VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+					  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			return true;
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			*access = VK_ACCESS_SHADER_READ_BIT;
+			*stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+					  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			return true;
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			*access = VK_ACCESS_TRANSFER_READ_BIT;
+			*stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			return true;
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			*access = VK_ACCESS_TRANSFER_WRITE_BIT;
+			*stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			return true;
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+			// presentation waits on semaphores, not on barriers
+			*access = 0;
+			*stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			return true;
+		default:
+			return false;
+	}
+}
 
-// 	_swapchain_images	   = _vkb_swapchain.get_images().value();
-// 	_swapchain_image_views = _vkb_swapchain.get_image_views().value();
+VkImageAspectFlags _get_aspect(VkFormat format) {
+	switch (format) {
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		case VK_FORMAT_S8_UINT:
+			return VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+}
 
-// for (size_t i = 0; i < _swapchain_images.size(); i++) {
-// 	_swapchain_image_views[i] = create_image_view(
-// 			"swapchain image view " + std::to_string(i),
-// 			_swapchain_images[i],
-// 			_vkb_swapchain.image_format,
-// 			VK_IMAGE_ASPECT_COLOR_BIT);
-// }
+/**
+ * @returns true if the barriers touch some of the same mip levels.
+ */
+bool _overlaps(const VkImageMemoryBarrier &a, const VkImageMemoryBarrier &b) {
+	const VkImageSubresourceRange &ra = a.subresourceRange;
+	const VkImageSubresourceRange &rb = b.subresourceRange;
+	return a.image == b.image &&
+		   ra.baseMipLevel < rb.baseMipLevel + rb.levelCount &&
+		   rb.baseMipLevel < ra.baseMipLevel + ra.levelCount;
+}
 
-// 	return OK;
-// }
+} // namespace
 
-Error Renderer::get_queues() {
+Renderer::CommandRecorder::~CommandRecorder() {
+	if (_cmd_buf != VK_NULL_HANDLE || !_barriers.empty())
+		submit();
+}
+
+Error Renderer::CommandRecorder::transition(
+		Image *image,
+		VkImageLayout old_layout,
+		VkImageLayout new_layout,
+		uint32_t base_level,
+		uint32_t level_count) {
 
-	// get graphics queue
-	auto graphics_queue = _vkb_device.get_queue(vkb::QueueType::graphics);
 	ERR_FAIL_COND_V_MSG(
-			!graphics_queue.has_value(),
+			base_level >= image->mip_levels,
 			FAIL,
-			"Failed to get graphics queue: %s",
-			graphics_queue.error().message().c_str());
-	_graphics_queue = graphics_queue.value();
+			"Invalid base mip level %u",
+			base_level);
+
+	const uint32_t levels =
+			std::min(level_count, image->mip_levels - base_level);
+
+	VkImageMemoryBarrier barrier {
+		.sType				 = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.oldLayout			 = old_layout,
+		.newLayout			 = new_layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image				 = image->image,
+		.subresourceRange {
+				.aspectMask		= _get_aspect(image->format),
+				.baseMipLevel	= base_level,
+				.levelCount		= levels,
+				.baseArrayLayer = 0,
+				.layerCount		= 1,
+		},
+	};
+
+	VkPipelineStageFlags src_stages = 0;
+	VkPipelineStageFlags dst_stages = 0;
+	_get_layout_usage(old_layout, &barrier.srcAccessMask, &src_stages);
+	if (src_stages == 0 ||
+			!_get_layout_usage(
+					new_layout, &barrier.dstAccessMask, &dst_stages)) {
+		LOG_ERR(
+				"Unsupported layout transition %d -> %d",
+				(int)old_layout,
+				(int)new_layout);
+		return FAIL;
+	}
+
+	// barriers in one call aren't ordered, so a second transition of the
+	// same levels has to wait for the first
+	for (const VkImageMemoryBarrier &pending : _barriers) {
+		if (_overlaps(pending, barrier)) {
+			ERR_TRY(_flush_barriers());
+			break;
+		}
+	}
+
+	_barriers.push_back(barrier);
+	_src_stages |= src_stages;
+	_dst_stages |= dst_stages;
+
+	return OK;
+}
+
+Error Renderer::CommandRecorder::copy_buffer_to_image(
+		Buffer *buffer, Image *image, uint32_t level_count) {
 
-	// get presentation queue
-	auto present_queue = _vkb_device.get_queue(vkb::QueueType::present);
 	ERR_FAIL_COND_V_MSG(
-			!present_queue.has_value(),
+			level_count == 0 || level_count > image->mip_levels,
 			FAIL,
-			"Failed to get presentation queue: %s",
-			present_queue.error().message().c_str());
-	_present_queue = present_queue.value();
+			"Invalid mip level count %u",
+			level_count);
+
+	std::vector<VkBufferImageCopy> regions;
+	ERR_FAIL_COND_V_MSG(
+			_get_level_copies(*image, level_count, &regions) > buffer->size,
+			FAIL,
+			"Buffer is too small for %u mip levels",
+			level_count);
+
+	ERR_TRY(_flush_barriers());
+
+	vkCmdCopyBufferToImage(
+			_cmd_buf,
+			buffer->buffer,
+			image->image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(regions.size()),
+			regions.data());
 
 	return OK;
 }
 
-Error Renderer::create_render_pass() {
+Error Renderer::CommandRecorder::downsample(Image *image, uint32_t level) {
 
-	VkAttachmentDescription color_attachment {
-		.format			= _vkb_swapchain.image_format,
-		.samples		= VK_SAMPLE_COUNT_1_BIT,
-		.loadOp			= VK_ATTACHMENT_LOAD_OP_CLEAR,
-		.storeOp		= VK_ATTACHMENT_STORE_OP_STORE,
-		.stencilLoadOp	= VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-		.initialLayout	= VK_IMAGE_LAYOUT_UNDEFINED,
-		.finalLayout	= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-	};
+	ERR_FAIL_COND_V_MSG(
+			level == 0 || level >= image->mip_levels,
+			FAIL,
+			"Invalid mip level %u",
+			level);
 
-	VkAttachmentReference color_attachment_ref {
-		.attachment = 0,
-		.layout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-	};
+	ERR_TRY(_flush_barriers());
 
-	VkAttachmentDescription depth_attachment {
-		.format			= find_depth_format(),
-		.samples		= VK_SAMPLE_COUNT_1_BIT,
-		.loadOp			= VK_ATTACHMENT_LOAD_OP_CLEAR,
-		.storeOp		= VK_ATTACHMENT_STORE_OP_DONT_CARE,
-		.stencilLoadOp	= VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-		.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-		.initialLayout	= VK_IMAGE_LAYOUT_UNDEFINED,
-		.finalLayout	= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-	};
+	const uint32_t above = level - 1;
+	const int32_t width	 = (int32_t)std::max(1u, image->extent.width >> above);
+	const int32_t height = (int32_t)std::max(1u, image->extent.height >> above);
 
-	VkAttachmentReference depth_attachment_ref {
-		.attachment = 1,
-		.layout		= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-	};
+	const int32_t next_width  = std::max(1, width / 2);
+	const int32_t next_height = std::max(1, height / 2);
 
-	VkSubpassDescription subpass {
-		.pipelineBindPoint		 = VK_PIPELINE_BIND_POINT_GRAPHICS,
-		.colorAttachmentCount	 = 1,
-		.pColorAttachments		 = &color_attachment_ref,
-		.pDepthStencilAttachment = &depth_attachment_ref,
+	VkImageBlit blit {
+		.srcSubresource {
+				.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel		= above,
+				.baseArrayLayer = 0,
+				.layerCount		= 1,
+		},
+		.srcOffsets = { { 0, 0, 0 }, { width, height, 1 } },
+		.dstSubresource {
+				.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel		= level,
+				.baseArrayLayer = 0,
+				.layerCount		= 1,
+		},
+		.dstOffsets = { { 0, 0, 0 }, { next_width, next_height, 1 } },
 	};
 
-	VkSubpassDependency dependency {
-		.srcSubpass	  = VK_SUBPASS_EXTERNAL,
-		.dstSubpass	  = 0,
-		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-						VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-						VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-		.srcAccessMask = 0,
-		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
-						 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-	};
+	// srgb formats are filtered in linear space
+	vkCmdBlitImage(
+			_cmd_buf,
+			image->image,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image->image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1,
+			&blit,
+			VK_FILTER_LINEAR);
 
-	std::array<VkAttachmentDescription, 2> attachments {
-		color_attachment,
-		depth_attachment,
-	};
+	return OK;
+}
 
-	VkRenderPassCreateInfo pass_info {
-		.sType			 = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-		.attachmentCount = static_cast<uint32_t>(attachments.size()),
-		.pAttachments	 = attachments.data(),
-		.subpassCount	 = 1,
-		.pSubpasses		 = &subpass,
-		.dependencyCount = 1,
-		.pDependencies	 = &dependency,
-	};
+Error Renderer::CommandRecorder::submit() {
 
-	// create render pass
-	VkResult err = vkCreateRenderPass(
-			_vkb_device.device, &pass_info, nullptr, &_render_pass);
+	if (_cmd_buf == VK_NULL_HANDLE && _barriers.empty())
+		return OK;
+
+	ERR_TRY(_flush_barriers());
+
+	// the command buffer is gone whether or not it was submitted
+	VkCommandBuffer cmd_buf = _cmd_buf;
+	_cmd_buf				= VK_NULL_HANDLE;
+
+	return _renderer->_end_and_submit_single_use_command_buffer(cmd_buf);
+}
+
+void Renderer::CommandRecorder::discard() {
+
+	if (_cmd_buf != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(
+				_renderer->_vkb_device.device,
+				_renderer->_get_upload_pool(),
+				1,
+				&_cmd_buf);
+	}
+
+	_cmd_buf = VK_NULL_HANDLE;
+	_barriers.clear();
+	_src_stages = 0;
+	_dst_stages = 0;
+}
+
+Error Renderer::CommandRecorder::_begin() {
+
+	if (_cmd_buf != VK_NULL_HANDLE)
+		return OK;
+
+	_cmd_buf = _renderer->_begin_single_use_command_buffer();
 	ERR_FAIL_COND_V_MSG(
-			err != VK_SUCCESS, FAIL, "Failed to create render pass");
+			!_cmd_buf, FAIL, "Failed to create command buffer for recorder");
 
 	return OK;
 }
 
-Error Renderer::create_descriptor_set_layout() {
+Error Renderer::CommandRecorder::_flush_barriers() {
 
-	// VkDescriptorSetLayoutBinding ubo_layout_binding {
-	// 	.binding			= 0,
-	// 	.descriptorType		= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-	// 	.descriptorCount	= 1,
-	// 	.stageFlags			= VK_SHADER_STAGE_VERTEX_BIT,
-	// 	.pImmutableSamplers = nullptr,
-	// };
+	ERR_TRY(_begin());
 
-	VkDescriptorSetLayoutBinding sampler_layout_binding {
-		.binding		 = 1,
-		.descriptorType	 = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-		.descriptorCount = 1,
-		// only available for the fragment shader
-		.stageFlags			= VK_SHADER_STAGE_FRAGMENT_BIT,
-		.pImmutableSamplers = nullptr,
+	if (_barriers.empty())
+		return OK;
+
+	// access table
+	// https://www.khronos.org/registry/vulkan/specs/1.0/html/vkspec.html#synchronization-access-types-supported
+
+	vkCmdPipelineBarrier(
+			_cmd_buf,
+			_src_stages,
+			_dst_stages,
+			0,
+			0,
+			nullptr,
+			0,
+			nullptr,
+			static_cast<uint32_t>(_barriers.size()),
+			_barriers.data());
+
+	_barriers.clear();
+	_src_stages = 0;
+	_dst_stages = 0;
+
+	return OK;
+}
+
+namespace {
+
+// stages of a frame that read uploaded buffers and images
+const VkPipelineStageFlags UPLOAD_READ_STAGES =
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+} // namespace
+
+Error Renderer::create_upload_ring() {
+
+	VkCommandPoolCreateInfo pool_info {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+				 VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = _transfer_family,
 	};
 
-	std::array<VkDescriptorSetLayoutBinding, 1> bindings {
-		// ubo_layout_binding,
-		sampler_layout_binding,
-	};
+	VkResult err = vkCreateCommandPool(
+			_vkb_device.device, &pool_info, nullptr, &_upload_command_pool);
+	ERR_FAIL_COND_V_MSG(
+			err != VK_SUCCESS,
+			FAIL,
+			"Failed to create upload command pool: %d",
+			(int)err);
 
-	VkDescriptorSetLayoutCreateInfo layout_info {
-		.sType		  = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = static_cast<uint32_t>(bindings.size()),
-		.pBindings	  = bindings.data(),
+	// counts the completed batches
+	VkSemaphoreTypeCreateInfo type_info {
+		.sType		   = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue  = 0,
+	};
+	VkSemaphoreCreateInfo semaphore_info {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &type_info,
 	};
 
-	VkResult res = vkCreateDescriptorSetLayout(
-			_vkb_device.device, &layout_info, nullptr, &_descriptor_set_layout);
-
+	err = vkCreateSemaphore(
+			_vkb_device.device, &semaphore_info, nullptr, &_upload_semaphore);
 	ERR_FAIL_COND_V_MSG(
-			res != VK_SUCCESS,
+			err != VK_SUCCESS,
 			FAIL,
-			"Failed to create descriptor set layout: %d",
-			(int)res);
+			"Failed to create upload semaphore: %d",
+			(int)err);
 
-	return OK;
+	return _create_staging_buffer(&_upload_ring, UPLOAD_RING_SIZE);
 }
 
-Error Renderer::create_graphics_pipeline() {
+void Renderer::destroy_upload_ring() {
 
-	Shader vert_shader;
-	ERR_TRY(createShaderFromFile(
-			_vkb_device.device, &vert_shader, "shaders/vert_shader.vert"));
+	// the device is idle, so this only frees what the batches held
+	_retire_uploads(UINT64_MAX);
 
-	Shader frag_shader;
-	ERR_TRY(createShaderFromFile(
-			_vkb_device.device, &frag_shader, "shaders/frag_shader.frag"));
+	for (Buffer &staging_buffer : _open_upload.staging_buffers)
+		destroy_and_free_buffer(&staging_buffer);
 
-	VkPipelineShaderStageCreateInfo vert_stage_info {
-		.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage	= VK_SHADER_STAGE_VERTEX_BIT,
-		.module = vert_shader.module,
-		.pName	= "main",
-	};
+	_open_upload = { .id = _open_upload.id, .ring_end = _ring_head };
+	_free_upload_buffers.clear();
+	_pending_buffer_acquires.clear();
+	_pending_image_acquires.clear();
 
-	VkPipelineShaderStageCreateInfo frag_stage_info {
-		.sType	= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-		.stage	= VK_SHADER_STAGE_FRAGMENT_BIT,
-		.module = frag_shader.module,
-		.pName	= "main",
-	};
+	// frees the command buffers of every batch
+	vkDestroyCommandPool(_vkb_device.device, _upload_command_pool, nullptr);
+	_upload_command_pool = VK_NULL_HANDLE;
 
-	VkPipelineShaderStageCreateInfo shader_stages[] {
-		vert_stage_info,
-		frag_stage_info,
-	};
+	vkDestroySemaphore(_vkb_device.device, _upload_semaphore, nullptr);
+	_upload_semaphore = VK_NULL_HANDLE;
 
-	auto binding_description	= Vertex::get_binding_description();
-	auto attribute_descriptions = Vertex::get_attribute_descriptions();
+	destroy_and_free_buffer(&_upload_ring);
+}
 
-	VkPipelineVertexInputStateCreateInfo vertex_input_info {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-		.vertexBindingDescriptionCount = 1,
-		.pVertexBindingDescriptions	   = &binding_description,
-		.vertexAttributeDescriptionCount =
-				static_cast<uint32_t>(attribute_descriptions.size()),
-		.pVertexAttributeDescriptions = attribute_descriptions.data(),
-	};
+namespace {
 
-	VkPipelineInputAssemblyStateCreateInfo input_assembly {
-		.sType	  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-		.primitiveRestartEnable = VK_FALSE,
-	};
+// keeps every range aligned for any index type and vertex attribute
+const VkDeviceSize GEOMETRY_ARENA_ALIGNMENT = 16;
 
-	VkViewport viewport {
-		.x		  = 0.0f,
-		.y		  = 0.0f,
-		.width	  = (float)_vkb_swapchain.extent.width,
-		.height	  = (float)_vkb_swapchain.extent.height,
-		.minDepth = 0.0f,
-		.maxDepth = 1.0f,
-	};
+} // namespace
 
-	VkRect2D scissor {
-		.offset = { 0, 0 },
-		.extent = _vkb_swapchain.extent,
-	};
+Error Renderer::create_geometry_arenas() {
 
-	VkPipelineViewportStateCreateInfo viewport_state {
-		.sType		   = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-		.viewportCount = 1,
-		.pViewports	   = &viewport,
-		.scissorCount  = 1,
-		.pScissors	   = &scissor,
-	};
+	// read by frames while the transfer queue fills other ranges, so
+	// neither queue family can own them
+	ERR_TRY(create_buffer(
+			&_vertex_arena.buffer,
+			"vertex arena",
+			GEOMETRY_ARENA_VERTEX_SIZE,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0,
+			true));
+	ERR_TRY(create_buffer(
+			&_index_arena.buffer,
+			"index arena",
+			GEOMETRY_ARENA_INDEX_SIZE,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VMA_MEMORY_USAGE_GPU_ONLY,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0,
+			true));
 
-	VkPipelineRasterizationStateCreateInfo rasterizer {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-		.depthClampEnable		 = VK_FALSE,
-		.rasterizerDiscardEnable = VK_FALSE,
-		.polygonMode			 = VK_POLYGON_MODE_FILL,
-		.cullMode				 = VK_CULL_MODE_BACK_BIT,
-		.frontFace				 = VK_FRONT_FACE_COUNTER_CLOCKWISE,
-		.depthBiasEnable		 = VK_FALSE,
-		.lineWidth				 = 1.0f,
-	};
+	_vertex_arena.ranges.reset(GEOMETRY_ARENA_VERTEX_SIZE);
+	_index_arena.ranges.reset(GEOMETRY_ARENA_INDEX_SIZE);
 
-	VkPipelineMultisampleStateCreateInfo multisampling {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-		.sampleShadingEnable  = VK_FALSE,
-	};
+	return OK;
+}
 
-	VkPipelineDepthStencilStateCreateInfo depth_stencil {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-		.depthTestEnable	   = VK_TRUE,
-		.depthWriteEnable	   = VK_TRUE,
-		.depthCompareOp		   = VK_COMPARE_OP_LESS,
-		.depthBoundsTestEnable = VK_FALSE,
-		.stencilTestEnable	   = VK_FALSE,
-		.front				   = {},
-		.back				   = {},
-		.minDepthBounds		   = 0.0f,
-		.maxDepthBounds		   = 1.0f,
-	};
+void Renderer::destroy_geometry_arenas() {
+	destroy_and_free_buffer(&_vertex_arena.buffer);
+	destroy_and_free_buffer(&_index_arena.buffer);
+	_vertex_arena.ranges.reset(0);
+	_index_arena.ranges.reset(0);
+}
 
-	VkPipelineColorBlendAttachmentState color_blend_attachment {
-		.blendEnable	= VK_FALSE,
-		.colorWriteMask = // rgba
-		VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-	};
+void Renderer::_free_mesh_buffers(Mesh *mesh) {
 
-	VkPipelineColorBlendStateCreateInfo color_blending {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-		.logicOpEnable	 = VK_FALSE,
-		.logicOp		 = VK_LOGIC_OP_COPY,
-		.attachmentCount = 1,
-		.pAttachments	 = &color_blend_attachment,
-		.blendConstants	 = { 0.0f, 0.0f, 0.0f, 0.0f },
-	};
+	const VkDeviceSize index_size =
+			mesh->index_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+													 : sizeof(uint32_t);
 
-	VkPushConstantRange push_constant {
-		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-		.offset		= 0,
-		.size		= sizeof(PushConstants),
-	};
+	if (mesh->vertex_buffer.buffer != VK_NULL_HANDLE &&
+			mesh->vertex_buffer.buffer == _vertex_arena.buffer.buffer) {
+		std::lock_guard<std::mutex> lock(_vertex_arena.mutex);
+		_vertex_arena.ranges.free(mesh->vertex_base);
+	} else {
+		destroy_and_free_buffer(&mesh->vertex_buffer);
+	}
 
-	VkPipelineLayoutCreateInfo pipeline_layout_info {
-		.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-		.setLayoutCount			= 1,
-		.pSetLayouts			= &_descriptor_set_layout,
-		.pushConstantRangeCount = 1,
-		.pPushConstantRanges	= &push_constant,
-	};
+	if (mesh->index_buffer.buffer != VK_NULL_HANDLE &&
+			mesh->index_buffer.buffer == _index_arena.buffer.buffer) {
+		std::lock_guard<std::mutex> lock(_index_arena.mutex);
+		_index_arena.ranges.free(index_size * mesh->base_index);
+	} else {
+		destroy_and_free_buffer(&mesh->index_buffer);
+	}
 
-	VkResult err = vkCreatePipelineLayout(
-			_vkb_device.device,
-			&pipeline_layout_info,
-			nullptr,
-			&_pipeline_layout);
+	mesh->vertex_buffer = Buffer();
+	mesh->index_buffer	= Buffer();
+	mesh->vertex_base	= 0;
+	mesh->base_index	= 0;
+}
 
-	ERR_FAIL_COND_V_MSG(
-			err != VK_SUCCESS, FAIL, "Failed to create pipeline layout");
+void Renderer::_release_mesh_buffers(Mesh *mesh) {
+
+	// arena buffers are shared and never acquired on their own
+	_drop_acquires(
+			mesh->vertex_buffer.buffer != _vertex_arena.buffer.buffer
+					? mesh->vertex_buffer.buffer
+					: VK_NULL_HANDLE,
+			VK_NULL_HANDLE);
+	_drop_acquires(
+			mesh->index_buffer.buffer != _index_arena.buffer.buffer
+					? mesh->index_buffer.buffer
+					: VK_NULL_HANDLE,
+			VK_NULL_HANDLE);
+
+	// the buffers move to a mesh of their own, so this one can be uploaded
+	// again before they are freed
+	const uint64_t upload = mesh->upload_ticket;
+	Mesh released;
+	released.vertex_buffer = mesh->vertex_buffer;
+	released.index_buffer  = mesh->index_buffer;
+	released.vertex_base   = mesh->vertex_base;
+	released.base_index	   = mesh->base_index;
+	released.index_type	   = mesh->index_type;
+
+	mesh->vertex_buffer = Buffer();
+	mesh->index_buffer	= Buffer();
+	mesh->vertex_base	= 0;
+	mesh->base_index	= 0;
+	mesh->index_count	= 0;
+	mesh->upload_ticket = 0;
+
+	_defer_deletion(
+			[this, released]() mutable { _free_mesh_buffers(&released); },
+			upload);
+}
 
-	std::vector<VkDynamicState> dynamic_states {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR,
-	};
+void Renderer::release_mesh(Mesh *mesh) {
 
-	VkPipelineDynamicStateCreateInfo dynamic_info {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-		.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
-		.pDynamicStates	   = dynamic_states.data(),
-	};
+	{
+		std::lock_guard<std::mutex> lock(_assets_mutex);
+		ERR_FAIL_COND_MSG(
+				_meshes.erase(mesh) == 0,
+				"Mesh %s isn't uploaded",
+				mesh->name);
+	}
 
-	VkGraphicsPipelineCreateInfo pipeline_info {
-		.sType				 = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-		.stageCount			 = 2,
-		.pStages			 = shader_stages,
-		.pVertexInputState	 = &vertex_input_info,
-		.pInputAssemblyState = &input_assembly,
-		.pViewportState		 = &viewport_state,
-		.pRasterizationState = &rasterizer,
-		.pMultisampleState	 = &multisampling,
-		.pDepthStencilState	 = &depth_stencil,
-		.pColorBlendState	 = &color_blending,
-		.pDynamicState		 = &dynamic_info,
-		.layout				 = _pipeline_layout,
-		.renderPass			 = _render_pass,
-		.subpass			 = 0,
-		.basePipelineHandle	 = VK_NULL_HANDLE,
-	};
+	_release_mesh_buffers(mesh);
+}
 
-	err = vkCreateGraphicsPipelines(
-			_vkb_device.device,
-			VK_NULL_HANDLE,
-			1,
-			&pipeline_info,
-			nullptr,
-			&_graphics_pipeline);
+void Renderer::release_image(Image *image) {
 
-	ERR_FAIL_COND_V_MSG(
-			err != VK_SUCCESS, FAIL, "Failed to create graphics pipeline");
+	{
+		std::lock_guard<std::mutex> lock(_assets_mutex);
+		_images.erase(image);
+	}
 
-	// clean up shader modules
-	destroyShader(_vkb_device.device, &frag_shader);
-	destroyShader(_vkb_device.device, &vert_shader);
+	_drop_acquires(VK_NULL_HANDLE, image->image);
+	_defer_deletion(
+			[this, released = *image]() mutable {
+				destroy_and_free_image(&released);
+			},
+			image->upload_ticket);
 
-	return OK;
+	image->image = VK_NULL_HANDLE;
+	image->alloc = nullptr;
 }
 
-Error Renderer::create_framebuffers() {
+void Renderer::release_buffer(Buffer *buffer) {
 
-	_framebuffers.resize(_swapchain_image_views.size());
+	// buffers don't keep their ticket, so wait on every batch so far
+	_drop_acquires(buffer->buffer, VK_NULL_HANDLE);
+	_defer_deletion(
+			[this, released = *buffer]() mutable {
+				destroy_and_free_buffer(&released);
+			},
+			get_upload_ticket());
 
-	VkResult err;
+	*buffer = Buffer();
+}
 
-	for (size_t i = 0; i < _swapchain_image_views.size(); i++) {
-		std::array<VkImageView, 2> attachments {
-			_swapchain_image_views[i],
-			_depth_image_view,
-		};
+void Renderer::release_image_view(VkImageView view) {
+	_defer_deletion([this, view]() {
+		vkDestroyImageView(_vkb_device.device, view, nullptr);
+	});
+}
 
-		VkFramebufferCreateInfo framebuffer_info {
-			.sType			 = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-			.renderPass		 = _render_pass,
-			.attachmentCount = static_cast<uint32_t>(attachments.size()),
-			.pAttachments	 = attachments.data(),
-			.width			 = _vkb_swapchain.extent.width,
-			.height			 = _vkb_swapchain.extent.height,
-			.layers			 = 1,
-		};
+void Renderer::release_pipeline(VkPipeline pipeline) {
+	_defer_deletion([this, pipeline]() {
+		vkDestroyPipeline(_vkb_device.device, pipeline, nullptr);
+	});
+}
 
-		err = vkCreateFramebuffer(
-				_vkb_device.device,
-				&framebuffer_info,
-				nullptr,
-				&_framebuffers[i]);
+void Renderer::_defer_deletion(
+		std::function<void()> destroy, uint64_t upload) {
 
-		ERR_FAIL_COND_V_MSG(
-				err != VK_SUCCESS, FAIL, "Failed to create framebuffer[%d]", i);
+	// read under the lock so the queue stays sorted by frame
+	std::lock_guard<std::mutex> lock(_deletion_mutex);
+	_deletions.push_back({
+			.frame	 = _frame_number,
+			.upload	 = upload,
+			.destroy = std::move(destroy),
+	});
+}
+
+void Renderer::_collect_deletions(uint64_t frame, uint64_t upload) {
+
+	std::vector<std::function<void()>> ready;
+	{
+		std::lock_guard<std::mutex> lock(_deletion_mutex);
+		// a later release can be ready before an earlier one still waiting
+		// on its upload
+		auto it = _deletions.begin();
+		while (it != _deletions.end() && it->frame <= frame) {
+			if (it->upload <= upload) {
+				ready.push_back(std::move(it->destroy));
+				it = _deletions.erase(it);
+			} else {
+				++it;
+			}
+		}
 	}
 
-	return OK;
+	// destroyed outside the lock, freeing mesh ranges takes the arena locks
+	for (const std::function<void()> &destroy : ready)
+		destroy();
 }
 
-Error Renderer::create_command_pool() {
+void Renderer::_drop_acquires(VkBuffer buffer, VkImage image) {
 
-	VkCommandPoolCreateInfo pool_info {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-		.queueFamilyIndex =
-				_vkb_device.get_queue_index(vkb::QueueType::graphics).value(),
+	const auto names_buffer = [buffer](const VkBufferMemoryBarrier &barrier) {
+		return buffer != VK_NULL_HANDLE && barrier.buffer == buffer;
+	};
+	const auto names_image = [image](const VkImageMemoryBarrier &barrier) {
+		return image != VK_NULL_HANDLE && barrier.image == image;
 	};
 
-	VkResult err = vkCreateCommandPool(
-			_vkb_device.device, &pool_info, nullptr, &_command_pool);
-	ERR_FAIL_COND_V_MSG(
-			err != VK_SUCCESS, FAIL, "Failed to create command pool");
+	std::lock_guard<std::mutex> lock(_upload_mutex);
 
-	return OK;
+	std::erase_if(_open_upload.buffer_acquires, names_buffer);
+	std::erase_if(_open_upload.image_acquires, names_image);
+	for (UploadBatch &batch : _submitted_uploads) {
+		std::erase_if(batch.buffer_acquires, names_buffer);
+		std::erase_if(batch.image_acquires, names_image);
+	}
+	std::erase_if(_pending_buffer_acquires, names_buffer);
+	std::erase_if(_pending_image_acquires, names_image);
 }
 
-Error Renderer::create_depth_resources() {
+uint64_t Renderer::get_upload_ticket() {
 
-	VkFormat depth_format = find_depth_format();
+	std::lock_guard<std::mutex> lock(_upload_mutex);
 
-	create_image(
-			&_depth_image,
-			_vkb_swapchain.extent.width,
-			_vkb_swapchain.extent.height,
-			depth_format,
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	// an empty open batch has nothing to wait for
+	if (_open_upload.command_buffer == VK_NULL_HANDLE)
+		return _open_upload.id - 1;
+	return _open_upload.id;
+}
+
+Error Renderer::flush_uploads() {
+
+	std::lock_guard<std::mutex> lock(_upload_mutex);
+
+	ERR_TRY(_submit_uploads());
+
+	// recycle the batches that already finished without waiting on the rest
+	uint64_t completed = 0;
+
+	VkResult res = vkGetSemaphoreCounterValue(
+			_vkb_device.device, _upload_semaphore, &completed);
+	ERR_FAIL_COND_V_MSG(
+			res != VK_SUCCESS,
+			FAIL,
+			"Failed to read upload semaphore: %d",
+			(int)res);
+
+	return _retire_uploads(completed);
+}
 
-	_depth_image_view = create_image_view(
-			"depth buffer image view",
-			_depth_image.image,
-			depth_format,
-			VK_IMAGE_ASPECT_DEPTH_BIT);
+Error Renderer::wait_for_uploads(uint64_t ticket) {
 
-	transition_image_layout(
-			&_depth_image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	std::lock_guard<std::mutex> lock(_upload_mutex);
 
-	return OK;
+	if (ticket >= _open_upload.id) {
+		ERR_TRY(_submit_uploads());
+	}
+
+	return _retire_uploads(ticket);
 }
 
-VkCommandBuffer Renderer::_begin_single_use_command_buffer() {
+Error Renderer::_begin_uploads() {
+
+	if (_open_upload.command_buffer != VK_NULL_HANDLE)
+		return OK;
 
 	VkCommandBufferAllocateInfo alloc_info {
 		.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool		= _command_pool,
+		.commandPool		= _upload_command_pool,
 		.level				= VK_COMMAND_BUFFER_LEVEL_PRIMARY,
 		.commandBufferCount = 1,
 	};
 
-	VkCommandBuffer command_buffer;
-	VkResult res = vkAllocateCommandBuffers(
-			_vkb_device.device, &alloc_info, &command_buffer);
-
-	ERR_FAIL_COND_V_MSG(
-			res != VK_SUCCESS,
-			command_buffer,
-			"Failed to allocate command buffer: %d",
-			(int)res);
+	// command buffers of completed batches are reused
+	VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+	if (!_free_upload_buffers.empty()) {
+		command_buffer = _free_upload_buffers.back();
+		_free_upload_buffers.pop_back();
+	} else {
+		VkResult res = vkAllocateCommandBuffers(
+				_vkb_device.device, &alloc_info, &command_buffer);
+		ERR_FAIL_COND_V_MSG(
+				res != VK_SUCCESS,
+				FAIL,
+				"Failed to allocate upload command buffer: %d",
+				(int)res);
+	}
 
 	VkCommandBufferBeginInfo begin_info {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 	};
+	VkResult res = vkBeginCommandBuffer(command_buffer, &begin_info);
+	if (res != VK_SUCCESS) {
+		_free_upload_buffers.push_back(command_buffer);
+		LOG_ERR("Failed to begin upload batch: %d", (int)res);
+		return FAIL;
+	}
 
-	res = vkBeginCommandBuffer(command_buffer, &begin_info);
+	_open_upload.command_buffer = command_buffer;
+
+	return OK;
+}
 
+void *Renderer::_stage_upload(VkDeviceSize size, VkDeviceSize *offset) {
+
+	const uint64_t ring_size = _upload_ring.size;
+
+	// keeps the source of every copy aligned for any element type
+	size = (size + 15) & ~(VkDeviceSize)15;
 	ERR_FAIL_COND_V_MSG(
-			res != VK_SUCCESS,
-			command_buffer,
-			"Failed to begin command buffer: %d",
-			(int)res);
+			size > ring_size / 2,
+			nullptr,
+			"Upload of %llu bytes doesn't fit in the staging ring",
+			(unsigned long long)size);
+
+	// allocations never wrap around the end of the ring
+	uint64_t start = _ring_head;
+	if (start % ring_size + size > ring_size)
+		start += ring_size - start % ring_size;
+
+	while (start + size - _ring_tail > ring_size) {
+		// the open batch holds the rest of the ring
+		if (_submitted_uploads.empty()) {
+			ERR_FAIL_COND_V(_submit_uploads() != OK, nullptr);
+		}
+		ERR_FAIL_COND_V(_submitted_uploads.empty(), nullptr);
+		ERR_FAIL_COND_V(
+				_retire_uploads(_submitted_uploads.front().id) != OK,
+				nullptr);
+	}
 
-	return command_buffer;
+	ERR_FAIL_COND_V(_begin_uploads() != OK, nullptr);
+
+	_ring_head			  = start + size;
+	_open_upload.ring_end = _ring_head;
+
+	*offset = start % ring_size;
+	return static_cast<uint8_t *>(_upload_ring.mapped) + *offset;
 }
 
-void Renderer::_end_and_submit_single_use_command_buffer(
-		VkCommandBuffer command_buffer) {
+Error Renderer::_submit_uploads() {
 
-	VkResult res = vkEndCommandBuffer(command_buffer);
+	UploadBatch &batch = _open_upload;
+	if (batch.command_buffer == VK_NULL_HANDLE)
+		return OK;
+
+	if (_transfer_family == _graphics_family) {
+		// everything submitted after the batch sees what it wrote
+		VkMemoryBarrier barrier {
+			.sType		   = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+		};
+		vkCmdPipelineBarrier(
+				batch.command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0,
+				1,
+				&barrier,
+				0,
+				nullptr,
+				0,
+				nullptr);
+	} else {
+		// release ownership to the graphics queue. the acquires match these
+		// except for the access masks
+		std::vector<VkBufferMemoryBarrier> buffer_releases =
+				batch.buffer_acquires;
+		std::vector<VkImageMemoryBarrier> image_releases =
+				batch.image_acquires;
+		for (VkBufferMemoryBarrier &release : buffer_releases) {
+			release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			release.dstAccessMask = 0;
+		}
+		for (VkImageMemoryBarrier &release : image_releases) {
+			release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			release.dstAccessMask = 0;
+		}
+
+		if (!buffer_releases.empty() || !image_releases.empty()) {
+			vkCmdPipelineBarrier(
+					batch.command_buffer,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					0,
+					0,
+					nullptr,
+					(uint32_t)buffer_releases.size(),
+					buffer_releases.data(),
+					(uint32_t)image_releases.size(),
+					image_releases.data());
+		}
+	}
+
+	VkResult res = vkEndCommandBuffer(batch.command_buffer);
+	ERR_FAIL_COND_V_MSG(
+			res != VK_SUCCESS,
+			FAIL,
+			"Failed to end upload batch: %d",
+			(int)res);
 
-	ERR_FAIL_COND_MSG(
-			res != VK_SUCCESS, "Failed to end command buffer: %d", (int)res);
+	VkTimelineSemaphoreSubmitInfo timeline_info {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues	   = &batch.id,
+	};
 
 	VkSubmitInfo submit_info {
-		.sType				= VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers	= &command_buffer,
+		.sType				  = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext				  = &timeline_info,
+		.commandBufferCount	  = 1,
+		.pCommandBuffers	  = &batch.command_buffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores	  = &_upload_semaphore,
 	};
 
-	res = vkQueueSubmit(_graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-	ERR_FAIL_COND_MSG(
-			res != VK_SUCCESS, "Failed to submit queue: %d", (int)res);
+	{
+		// the transfer queue can be the graphics queue
+		std::lock_guard<std::mutex> lock(_queue_mutex);
+		res = vkQueueSubmit(_transfer_queue, 1, &submit_info, VK_NULL_HANDLE);
+	}
+	ERR_FAIL_COND_V_MSG(
+			res != VK_SUCCESS,
+			FAIL,
+			"Failed to submit upload batch: %d",
+			(int)res);
 
-	res = vkQueueWaitIdle(_graphics_queue);
-	ERR_FAIL_COND_MSG(
-			res != VK_SUCCESS, "Failed to wait for queue: %d", (int)res);
+	const uint64_t next = batch.id + 1;
+	_submitted_uploads.push_back(std::move(batch));
+	// a batch that stages nothing mustn't move the tail back
+	_open_upload = { .id = next, .ring_end = _ring_head };
 
-	vkFreeCommandBuffers(_vkb_device.device, _command_pool, 1, &command_buffer);
+	return OK;
 }
 
-Error Renderer::create_texture_image() {
+Error Renderer::_retire_uploads(uint64_t ticket) {
 
-	// todo move this to a util class or something
+	if (_submitted_uploads.empty() || _submitted_uploads.front().id > ticket)
+		return OK;
 
-	int width, height, channels;
-	stbi_uc *pixels = stbi_load(
-			TEXTURE_PATH.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	// batches complete in the order they were submitted
+	const uint64_t value = std::min(ticket, _submitted_uploads.back().id);
 
-	VkDeviceSize image_size = width * height * 4;
+	VkSemaphoreWaitInfo wait_info {
+		.sType			= VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores	= &_upload_semaphore,
+		.pValues		= &value,
+	};
+	VkResult res = vkWaitSemaphores(_vkb_device.device, &wait_info, UINT64_MAX);
+	ERR_FAIL_COND_V_MSG(
+			res != VK_SUCCESS,
+			FAIL,
+			"Failed to wait for upload batch: %d",
+			(int)res);
 
-	ERR_FAIL_COND_V_MSG(!pixels, FAIL, "Failed to load image texture");
+	while (!_submitted_uploads.empty() &&
+			_submitted_uploads.front().id <= value) {
+		UploadBatch &batch = _submitted_uploads.front();
 
-	// transfer the texture pixels to a staging buffer
+		vkResetCommandBuffer(batch.command_buffer, 0);
+		_free_upload_buffers.push_back(batch.command_buffer);
 
-	Buffer staging_buffer;
-	create_buffer(
-			&staging_buffer,
-			"texture image staging buffer",
-			image_size,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_MEMORY_USAGE_CPU_ONLY,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		for (Buffer &staging_buffer : batch.staging_buffers)
+			destroy_and_free_buffer(&staging_buffer);
 
-	void *data;
-	VkResult err = vmaMapMemory(_vma_allocator, staging_buffer.alloc, &data);
+		_pending_buffer_acquires.insert(
+				_pending_buffer_acquires.end(),
+				batch.buffer_acquires.begin(),
+				batch.buffer_acquires.end());
+		_pending_image_acquires.insert(
+				_pending_image_acquires.end(),
+				batch.image_acquires.begin(),
+				batch.image_acquires.end());
 
-	ERR_FAIL_COND_V_MSG(
-			err != VK_SUCCESS,
-			FAIL,
-			"Failed to map staging buffer memory while loading texture image: "
-			"%d",
-			(int)err);
+		_ring_tail		  = std::max(_ring_tail, batch.ring_end);
+		_completed_upload = batch.id;
+		_submitted_uploads.pop_front();
+	}
+
+	return OK;
+}
 
-	memcpy(data, pixels, static_cast<size_t>(image_size));
-	vmaUnmapMemory(_vma_allocator, staging_buffer.alloc);
+uint64_t Renderer::_acquire_uploads(VkCommandBuffer cmd_buf) {
 
-	stbi_image_free(pixels);
+	std::lock_guard<std::mutex> lock(_upload_mutex);
 
-	ERR_TRY(create_image(
-			&_texture_image,
-			width,
-			height,
-			VK_FORMAT_R8G8B8A8_SRGB,
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+	if (!_pending_buffer_acquires.empty() || !_pending_image_acquires.empty()) {
+		// the frame waits on the batches at these stages, so the barrier
+		// starts from them
+		vkCmdPipelineBarrier(
+				cmd_buf,
+				UPLOAD_READ_STAGES,
+				UPLOAD_READ_STAGES,
+				0,
+				0,
+				nullptr,
+				(uint32_t)_pending_buffer_acquires.size(),
+				_pending_buffer_acquires.data(),
+				(uint32_t)_pending_image_acquires.size(),
+				_pending_image_acquires.data());
 
-	transition_image_layout(
-			&_texture_image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		_pending_buffer_acquires.clear();
+		_pending_image_acquires.clear();
+	}
 
-	copy_buffer_to_image(&staging_buffer, &_texture_image);
+	_ready_upload = _completed_upload;
 
-	transition_image_layout(
-			&_texture_image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	return _completed_upload;
+}
 
-	destroy_and_free_buffer(&staging_buffer);
+Error Renderer::create_texture_image() {
 
-	return OK;
+	Error err = _texture_load.valid()
+			? _texture_load.get()
+			: load_image(&_texture_image, TEXTURE_PATH.c_str());
+	ERR_TRY(err);
+
+	// the first frame samples it
+	return wait_for_uploads(_texture_image.upload_ticket);
 }
 
 Error Renderer::create_texture_image_view() {
@@ -949,7 +2906,8 @@ Error Renderer::create_texture_image_view() {
 			"texture image view",
 			_texture_image.image,
 			_texture_image.format,
-			VK_IMAGE_ASPECT_COLOR_BIT);
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			_texture_image.mip_levels);
 	return OK;
 }
 
@@ -970,7 +2928,8 @@ Error Renderer::create_texture_sampler() {
 		.compareEnable			 = VK_FALSE,
 		.compareOp				 = VK_COMPARE_OP_ALWAYS,
 		.minLod					 = 0.0f,
-		.maxLod					 = 0.0f,
+		// sample from every mip level the image has
+		.maxLod					 = VK_LOD_CLAMP_NONE,
 		.borderColor			 = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
 		.unnormalizedCoordinates = VK_FALSE,
 	};
@@ -991,7 +2950,8 @@ Error Renderer::create_image(
 		VkFormat format,
 		VkImageTiling tiling,
 		VkImageUsageFlags usage,
-		VkMemoryPropertyFlags properties) {
+		VkMemoryPropertyFlags properties,
+		uint32_t mip_levels) {
 
 	VkImageCreateInfo image_info {
 		.sType	   = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -1003,7 +2963,7 @@ Error Renderer::create_image(
 				.height = height,
 				.depth	= 1,
 		},
-		.mipLevels	   = 1,
+		.mipLevels	   = mip_levels,
 		.arrayLayers   = 1,
 		.samples	   = VK_SAMPLE_COUNT_1_BIT,
 		.tiling		   = tiling,
@@ -1035,6 +2995,7 @@ Error Renderer::create_image(
 			err != VK_SUCCESS, FAIL, "Failed to allocate image: %d", (int)err);
 
 	image->extent	  = image_info.extent;
+	image->mip_levels = mip_levels;
 	image->format	  = format;
 	image->tiling	  = tiling;
 	image->usage	  = usage;
@@ -1047,7 +3008,8 @@ VkImageView Renderer::create_image_view(
 		std::string name,
 		VkImage image,
 		VkFormat format,
-		VkImageAspectFlags aspect) {
+		VkImageAspectFlags aspect,
+		uint32_t mip_levels) {
 
 	VkImageViewCreateInfo view_info {
 		.sType	  = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -1057,7 +3019,7 @@ VkImageView Renderer::create_image_view(
 		.subresourceRange {
 				.aspectMask		= aspect,
 				.baseMipLevel	= 0,
-				.levelCount		= 1,
+				.levelCount		= mip_levels,
 				.baseArrayLayer = 0,
 				.layerCount		= 1,
 		},
@@ -1085,194 +3047,394 @@ VkImageView Renderer::create_image_view(
 Error Renderer::transition_image_layout(
 		Image *image, VkImageLayout old_layout, VkImageLayout new_layout) {
 
-	VkImageMemoryBarrier barrier {
-		.sType				 = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.oldLayout			 = old_layout,
-		.newLayout			 = new_layout,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image				 = image->image,
-		.subresourceRange {
-				.baseMipLevel	= 0,
-				.levelCount		= 1,
-				.baseArrayLayer = 0,
-				.layerCount		= 1,
-		},
-	};
-
-	if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	CommandRecorder recorder(this);
+	ERR_TRY(recorder.transition(image, old_layout, new_layout));
+	return recorder.submit();
+}
 
-		if (has_stencil_component(image->format)) {
-			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-	} else {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	}
+Error Renderer::copy_buffer_to_image(
+		Buffer *buffer, Image *image, uint32_t level_count) {
 
-	VkPipelineStageFlags src_stage;
-	VkPipelineStageFlags dst_stage;
+	CommandRecorder recorder(this);
+	ERR_TRY(recorder.copy_buffer_to_image(buffer, image, level_count));
+	return recorder.submit();
+}
 
-	if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED &&
-		new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+bool Renderer::supports_linear_blit(VkFormat format) {
+	VkFormatProperties props;
+	vkGetPhysicalDeviceFormatProperties(
+			_vkb_device.physical_device.physical_device, format, &props);
 
-		src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	} else if (
-			old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-			new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	} else if (
-			old_layout == VK_IMAGE_LAYOUT_UNDEFINED &&
-			new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-								VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-		src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	} else {
-		LOG_ERR("Unsupported layout transition");
-		return FAIL;
-	}
+	const VkFormatFeatureFlags features =
+			VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (props.optimalTilingFeatures & features) == features;
+}
 
-	// access table
-	// https://www.khronos.org/registry/vulkan/specs/1.0/html/vkspec.html#synchronization-access-types-supported
+Error Renderer::generate_mipmaps(Image *image, CommandRecorder *recorder) {
 
-	VK_SUBMIT_SINGLE_CMD_OR_FAIL(
-			vkCmdPipelineBarrier,
-			src_stage,
-			dst_stage,
-			0,
-			0,
-			nullptr,
-			0,
-			nullptr,
-			1,
-			&barrier);
+	for (uint32_t level = 1; level < image->mip_levels; ++level) {
 
-	return OK;
-}
+		// wait for the level above to be written, then read from it
+		ERR_TRY(recorder->transition(
+				image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				level - 1,
+				1));
 
-Error Renderer::copy_buffer_to_image(Buffer *buffer, Image *image) {
+		ERR_TRY(recorder->downsample(image, level));
 
-	// define the region we are copying
-	VkBufferImageCopy region {
-		.bufferOffset	   = 0,
-		.bufferRowLength   = 0,
-		.bufferImageHeight = 0,
-		.imageSubresource {
-				.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT,
-				.mipLevel		= 0,
-				.baseArrayLayer = 0,
-				.layerCount		= 1,
-		},
-		.imageOffset = { 0, 0, 0 },
-		.imageExtent = image->extent,
-	};
+		// the level above is done. this goes out with the transition of the
+		// next level
+		ERR_TRY(recorder->transition(
+				image,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				level - 1,
+				1));
+	}
 
-	VK_SUBMIT_SINGLE_CMD_OR_FAIL(
-			vkCmdCopyBufferToImage,
-			buffer->buffer,
-			image->image,
+	// the last level was only ever written to
+	return recorder->transition(
+			image,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			// btw multiple regions can be used if we need that in the future.
-			&region);
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			image->mip_levels - 1,
+			1);
+}
 
-	return OK;
+namespace {
+
+/**
+ * @returns how many items of the given size fit in the staging window, at
+ * least one and at most count. overhead is staged with every chunk on top of
+ * the items themselves.
+ */
+uint64_t _get_chunk_count(
+		uint64_t count, VkDeviceSize item_size, VkDeviceSize overhead = 0) {
+	const VkDeviceSize window = UPLOAD_STAGING_WINDOW -
+			std::min<VkDeviceSize>(overhead, UPLOAD_STAGING_WINDOW);
+	const uint64_t fit = std::max<uint64_t>(
+			1, window / std::max<VkDeviceSize>(item_size, 1));
+	return std::min(count, fit);
 }
 
-Renderer::Buffer
-Renderer::create_vertex_buffer(std::string name, std::vector<Vertex> vertices) {
+// cooked vertices that are packed on the way to the GPU are decoded this
+// many at a time, so the decoded ones are still in cache when they're packed
+const uint32_t COOKED_DECODE_VERTICES = 16 * 1024;
 
-	uint32_t size = sizeof(vertices[0]) * vertices.size();
+} // namespace
 
-	Buffer staging_buffer;
-	create_buffer(
-			&staging_buffer,
-			"vertex staging buffer for " + name,
+Renderer::Buffer Renderer::create_device_buffer(
+		std::string name,
+		const void *data,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage) {
+
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	const uint64_t chunk = _get_chunk_count(size, 1);
+
+	return _create_streamed_buffer(
+			name,
 			size,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_MEMORY_USAGE_CPU_ONLY,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			usage,
+			size,
+			chunk,
+			chunk,
+			[&](uint64_t first,
+					uint64_t count,
+					void *staging,
+					std::vector<VkBufferCopy> *regions) {
+				memcpy(staging, bytes + first, (size_t)count);
+				regions->push_back({ 0, first, count });
+				return OK;
+			});
+}
+
+Renderer::Buffer Renderer::_create_streamed_buffer(
+		std::string name,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		uint64_t count,
+		uint64_t chunk_count,
+		VkDeviceSize staging_size,
+		const ChunkWriter &write,
+		GeometryArena *arena,
+		VkDeviceSize *base) {
+
+	VkDeviceSize start = RangeAllocator::INVALID;
+	if (arena != nullptr) {
+		std::lock_guard<std::mutex> lock(arena->mutex);
+		start = arena->ranges.allocate(size, GEOMETRY_ARENA_ALIGNMENT);
+	}
 
-	void *data	 = nullptr;
-	VkResult err = vmaMapMemory(_vma_allocator, staging_buffer.alloc, &data);
+	// ranges of the arena's buffer belong to the arena, not the caller
+	const bool shared = start != RangeAllocator::INVALID;
 
 	Buffer buffer;
-	ERR_FAIL_COND_V_MSG(
-			err != VK_SUCCESS,
-			buffer,
-			"Failed to map vertex staging buffer memory for %s: %d",
-			name.c_str(),
-			(int)err);
+	if (shared) {
+		buffer = arena->buffer;
+	} else {
+		if (arena != nullptr) {
+			LOG_WARN(
+					"No room for %s in %s, it gets a buffer of its own",
+					name.c_str(),
+					arena->buffer.name.c_str());
+		}
 
-	memcpy(data, vertices.data(), (size_t)size);
-	vmaUnmapMemory(_vma_allocator, staging_buffer.alloc);
+		start = 0;
+		if (create_buffer(
+					&buffer,
+					name,
+					size,
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+					VMA_MEMORY_USAGE_GPU_ONLY,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != OK)
+			return Buffer();
+	}
 
-	create_buffer(
-			&buffer,
-			"vertex buffer for " + name,
-			size,
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-					VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VMA_MEMORY_USAGE_GPU_ONLY,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (base != nullptr)
+		*base = start;
+
+	// chunks are written under the lock so the batch can't be submitted
+	// between writing a chunk and recording the copy that reads it
+	std::lock_guard<std::mutex> lock(_upload_mutex);
+
+	std::vector<VkBufferCopy> regions;
+	for (uint64_t first = 0; first < count; first += chunk_count) {
+		const uint64_t n = std::min(chunk_count, count - first);
+
+		VkDeviceSize offset = 0;
+		void *staging		= _stage_upload(staging_size, &offset);
+
+		regions.clear();
+		if (staging == nullptr ||
+				write(first, n, staging, &regions) != OK) {
+			// earlier chunks can still be copying into the buffer
+			_submit_uploads();
+			_retire_uploads(UINT64_MAX);
+			if (shared) {
+				std::lock_guard<std::mutex> arena_lock(arena->mutex);
+				arena->ranges.free(start);
+			} else {
+				destroy_and_free_buffer(&buffer);
+			}
+			return Buffer();
+		}
 
-	copy_buffer(&staging_buffer, &buffer, size);
+		if (regions.empty())
+			continue;
 
-	destroy_and_free_buffer(&staging_buffer);
+		for (VkBufferCopy &region : regions) {
+			region.srcOffset += offset;
+			region.dstOffset += start;
+		}
 
-	return buffer;
-}
+		vkCmdCopyBuffer(
+				_open_upload.command_buffer,
+				_upload_ring.buffer,
+				buffer.buffer,
+				(uint32_t)regions.size(),
+				regions.data());
+	}
 
-Renderer::Buffer
-Renderer::create_index_buffer(std::string name, std::vector<uint32_t> indices) {
-	uint32_t size = sizeof(indices[0]) * indices.size();
+	// released by the batch holding the last chunk, after every copy
+	if (_transfer_family != _graphics_family && !buffer.concurrent &&
+			count > 0) {
+		_open_upload.buffer_acquires.push_back({
+				.sType				 = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.srcAccessMask		 = 0,
+				.dstAccessMask		 = VK_ACCESS_MEMORY_READ_BIT,
+				.srcQueueFamilyIndex = _transfer_family,
+				.dstQueueFamilyIndex = _graphics_family,
+				.buffer				 = buffer.buffer,
+				.offset				 = 0,
+				.size				 = VK_WHOLE_SIZE,
+		});
+	}
 
-	Buffer staging_buffer;
-	create_buffer(
-			&staging_buffer,
-			"index staging buffer for " + name,
-			size,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_MEMORY_USAGE_CPU_ONLY,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-					VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	return buffer;
+}
 
-	void *data	 = nullptr;
-	VkResult err = vmaMapMemory(_vma_allocator, staging_buffer.alloc, &data);
+Renderer::Buffer Renderer::create_vertex_buffer(
+		Mesh *mesh, const Vertex *vertices, uint32_t count) {
+
+	mesh->vertex_offset	  = mesh->format.get_vertex_offset(count);
+	mesh->constant_offset = mesh->format.get_constant_offset(count);
+
+	// every chunk is packed straight into the staging memory, constants and
+	// the padding after each of the two vertex streams included
+	const VertexFormat &format	   = mesh->format;
+	const VkDeviceSize vertex_size = format.position_stride + format.stride;
+	const uint32_t chunk		   = (uint32_t)_get_chunk_count(
+			count, vertex_size, format.constant_size + 2 * 3);
+
+	return _create_streamed_buffer(
+			"vertex buffer for " + std::string(mesh->name),
+			format.get_size(count),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			count,
+			chunk,
+			format.get_size(chunk),
+			[&](uint64_t first,
+					uint64_t n,
+					void *staging,
+					std::vector<VkBufferCopy> *regions) {
+				format.encode(vertices + first, (uint32_t)n, staging);
+				format.get_chunk_copies(
+						count, (uint32_t)first, (uint32_t)n, regions);
+				return OK;
+			},
+			&_vertex_arena,
+			&mesh->vertex_base);
+}
 
-	Buffer buffer;
-	ERR_FAIL_COND_V_MSG(
-			err != VK_SUCCESS,
-			buffer,
-			"Failed to map staging buffer memory for %s: %d",
-			name.c_str(),
-			(int)err);
+Renderer::Buffer Renderer::create_vertex_buffer(
+		Mesh *mesh, VertexDecoder *decoder, uint32_t count) {
+
+	mesh->vertex_offset	  = mesh->format.get_vertex_offset(count);
+	mesh->constant_offset = mesh->format.get_constant_offset(count);
+
+	const VertexFormat &format	   = mesh->format;
+	const VkDeviceSize vertex_size = format.position_stride + format.stride;
+	uint32_t chunk				   = (uint32_t)_get_chunk_count(
+			count, vertex_size, format.constant_size + 2 * 3);
+
+	// the full layout is what the decoder writes, so those vertices are
+	// decoded right into the staging memory. packed ones are decoded a
+	// cache sized piece at a time and packed from there.
+	const bool packed = format.get_key() != VertexFormat::full().get_key();
+	if (packed)
+		chunk = std::min(chunk, COOKED_DECODE_VERTICES);
+
+	// the decoder only stops at the end of a block
+	if (chunk < count) {
+		chunk = std::max(
+				MeshCodec::BLOCK_VERTICES,
+				chunk / MeshCodec::BLOCK_VERTICES * MeshCodec::BLOCK_VERTICES);
+	}
 
-	memcpy(data, indices.data(), (size_t)size);
-	vmaUnmapMemory(_vma_allocator, staging_buffer.alloc);
+	std::vector<Vertex> decoded(packed ? chunk : 0);
+
+	return _create_streamed_buffer(
+			"vertex buffer for " + std::string(mesh->name),
+			format.get_size(count),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			count,
+			chunk,
+			format.get_size(chunk),
+			[&](uint64_t first,
+					uint64_t n,
+					void *staging,
+					std::vector<VkBufferCopy> *regions) {
+				if (packed) {
+					ERR_TRY(decoder->decode({ decoded.data(), (size_t)n }));
+					format.encode(decoded.data(), (uint32_t)n, staging);
+				} else {
+					ERR_TRY(decoder->decode(
+							{ static_cast<Vertex *>(staging), (size_t)n }));
+				}
+				format.get_chunk_copies(
+						count, (uint32_t)first, (uint32_t)n, regions);
+				return OK;
+			},
+			&_vertex_arena,
+			&mesh->vertex_base);
+}
 
-	create_buffer(
-			&buffer,
-			"index buffer for " + name,
-			size,
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-			VMA_MEMORY_USAGE_GPU_ONLY,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+Renderer::Buffer Renderer::create_index_buffer(
+		Mesh *mesh,
+		const uint32_t *indices,
+		uint32_t count,
+		uint32_t vertex_count) {
+
+	const bool narrow = vertex_count <= UINT16_MAX;
+	const VkDeviceSize index_size =
+			narrow ? sizeof(uint16_t) : sizeof(uint32_t);
+	const uint64_t chunk = _get_chunk_count(count, index_size);
+
+	mesh->index_type = narrow ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+	VkDeviceSize base = 0;
+	Buffer buffer	  = _create_streamed_buffer(
+			"index buffer for " + std::string(mesh->name),
+			index_size * count,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			count,
+			chunk,
+			index_size * chunk,
+			[&](uint64_t first,
+					uint64_t n,
+					void *staging,
+					std::vector<VkBufferCopy> *regions) {
+				if (narrow) {
+					uint16_t *narrowed = static_cast<uint16_t *>(staging);
+					for (uint64_t i = 0; i < n; ++i)
+						narrowed[i] = static_cast<uint16_t>(indices[first + i]);
+				} else {
+					memcpy(staging, indices + first, (size_t)(index_size * n));
+				}
+				regions->push_back({
+						.srcOffset = 0,
+						.dstOffset = index_size * first,
+						.size	   = index_size * n,
+				});
+				return OK;
+			},
+			&_index_arena,
+			&base);
+
+	// arena ranges are aligned to more than an index, so this is exact
+	mesh->base_index = (uint32_t)(base / index_size);
 
-	copy_buffer(&staging_buffer, &buffer, size);
+	return buffer;
+}
 
-	destroy_and_free_buffer(&staging_buffer);
+Renderer::Buffer Renderer::create_index_buffer(
+		Mesh *mesh,
+		IndexDecoder *decoder,
+		uint32_t count,
+		uint32_t vertex_count) {
+
+	const bool narrow = vertex_count <= UINT16_MAX;
+	const VkDeviceSize index_size =
+			narrow ? sizeof(uint16_t) : sizeof(uint32_t);
+	const uint64_t chunk = _get_chunk_count(count, index_size);
+
+	mesh->index_type = narrow ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+	// indices are always decoded right into the staging memory
+	VkDeviceSize base = 0;
+	Buffer buffer	  = _create_streamed_buffer(
+			"index buffer for " + std::string(mesh->name),
+			index_size * count,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			count,
+			chunk,
+			index_size * chunk,
+			[&](uint64_t first,
+					uint64_t n,
+					void *staging,
+					std::vector<VkBufferCopy> *regions) {
+				if (narrow) {
+					ERR_TRY(decoder->decode(std::span<uint16_t>(
+							static_cast<uint16_t *>(staging), (size_t)n)));
+				} else {
+					ERR_TRY(decoder->decode(std::span<uint32_t>(
+							static_cast<uint32_t *>(staging), (size_t)n)));
+				}
+				regions->push_back({
+						.srcOffset = 0,
+						.dstOffset = index_size * first,
+						.size	   = index_size * n,
+				});
+				return OK;
+			},
+			&_index_arena,
+			&base);
+
+	mesh->base_index = (uint32_t)(base / index_size);
 
 	return buffer;
 }
@@ -1434,10 +3596,12 @@ Error Renderer::create_descriptor_sets() {
 Error Renderer::create_buffer(
 		Buffer *buffer,
 		std::string name,
-		uint32_t size,
+		VkDeviceSize size,
 		uint32_t usage,
 		VmaMemoryUsage mapping,
-		VkMemoryPropertyFlags mem_flags) {
+		VkMemoryPropertyFlags mem_flags,
+		VmaAllocationCreateFlags alloc_flags,
+		bool concurrent) {
 
 	VkBufferCreateInfo buffer_info {
 		.sType		 = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -1446,22 +3610,32 @@ Error Renderer::create_buffer(
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 	};
 
+	// a single queue family already shares everything with itself
+	const uint32_t families[] = { _graphics_family, _transfer_family };
+	if (concurrent && _graphics_family != _transfer_family) {
+		buffer_info.sharingMode			  = VK_SHARING_MODE_CONCURRENT;
+		buffer_info.queueFamilyIndexCount = 2;
+		buffer_info.pQueueFamilyIndices	  = families;
+	}
+
 	auto name_cstr = name.c_str();
 
 	VmaAllocationCreateInfo alloc_info {
-		.flags			= VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT,
+		.flags			= VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT |
+				 alloc_flags,
 		.usage			= mapping,
 		.preferredFlags = mem_flags,
 		.pUserData		= (void *_Nullable)name_cstr,
 	};
 
+	VmaAllocationInfo allocation_info {};
 	VkResult err = vmaCreateBuffer(
 			_vma_allocator,
 			&buffer_info,
 			&alloc_info,
 			&buffer->buffer,
 			&buffer->alloc,
-			nullptr);
+			&allocation_info);
 
 	VkDebug::object_name(
 			_vkb_device.device,
@@ -1472,30 +3646,43 @@ Error Renderer::create_buffer(
 	ERR_FAIL_COND_V_MSG(
 			err != VK_SUCCESS, FAIL, "Failed to allocate buffer: %d", (int)err);
 
-	buffer->name		= name_cstr;
+	buffer->name		= name;
 	buffer->info.buffer = buffer->buffer;
 	buffer->info.offset = 0;
 	buffer->info.range	= size;
 	buffer->size		= size;
 	buffer->usage		= usage;
+	buffer->mapped		= allocation_info.pMappedData;
+	buffer->concurrent	= concurrent;
 
 	return OK;
 }
 
 Error Renderer::copy_buffer(
-		Buffer *src_buffer, Buffer *dst_buffer, uint32_t size) {
+		Buffer *src_buffer, Buffer *dst_buffer, VkDeviceSize size) {
 
 	// create a command buffer
 	VkBufferCopy copy_region = {
 		.size = size,
 	};
 
+	return copy_buffer(src_buffer, dst_buffer, { &copy_region, 1 });
+}
+
+Error Renderer::copy_buffer(
+		Buffer *src_buffer,
+		Buffer *dst_buffer,
+		std::span<const VkBufferCopy> regions) {
+
+	if (regions.empty())
+		return OK;
+
 	VK_SUBMIT_SINGLE_CMD_OR_FAIL(
 			vkCmdCopyBuffer,
 			src_buffer->buffer,
 			dst_buffer->buffer,
-			1,
-			&copy_region);
+			(uint32_t)regions.size(),
+			regions.data());
 
 	return OK;
 }
@@ -1508,6 +3695,7 @@ Error Renderer::destroy_and_free_buffer(Buffer *buffer) {
 	buffer->buffer = VK_NULL_HANDLE;
 	buffer->alloc  = nullptr;
 	buffer->size   = 0;
+	buffer->mapped = nullptr;
 
 	return OK;
 }
@@ -1557,6 +3745,7 @@ Error Renderer::create_sync_objects() {
 	_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	_in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
+	_fence_frames.assign(MAX_FRAMES_IN_FLIGHT, 0);
 	_images_in_flight.resize(_vkb_swapchain.image_count, VK_NULL_HANDLE);
 
 	VkSemaphoreCreateInfo semaphore_info {
@@ -1640,6 +3829,10 @@ Error Renderer::recreate_swapchain() {
 
 	vkDeviceWaitIdle(_vkb_device.device);
 
+	// the GPU is idle anyway, so everything released can go
+	_completed_frame = _frame_number;
+	_collect_deletions(_completed_frame, _ready_upload);
+
 	destroy_swapchain();
 
 	ERR_FAIL_COND_V_MSG(
@@ -1709,8 +3902,19 @@ Error Renderer::destroy_swapchain() {
 	// 		static_cast<uint32_t>(_command_buffers.size()),
 	// 		_command_buffers.data());
 
-	vkDestroyPipeline(_vkb_device.device, _graphics_pipeline, nullptr);
+	{
+		std::lock_guard<std::mutex> lock(_pipelines_mutex);
+		for (auto [key, pipeline] : _pipelines)
+			vkDestroyPipeline(_vkb_device.device, pipeline, nullptr);
+		for (auto [key, pipeline] : _depth_pipelines)
+			vkDestroyPipeline(_vkb_device.device, pipeline, nullptr);
+		_pipelines.clear();
+		_depth_pipelines.clear();
+	}
 	vkDestroyPipelineLayout(_vkb_device.device, _pipeline_layout, nullptr);
+	destroyShader(_vkb_device.device, &_depth_shader);
+	destroyShader(_vkb_device.device, &_frag_shader);
+	destroyShader(_vkb_device.device, &_vert_shader);
 	vkDestroyRenderPass(_vkb_device.device, _render_pass, nullptr);
 
 	_vkb_swapchain.destroy_image_views(_swapchain_image_views);
@@ -1730,6 +3934,9 @@ void Renderer::destroy() {
 
 	vkDeviceWaitIdle(_vkb_device.device);
 
+	// released resources aren't tracked anywhere else
+	_collect_deletions(UINT64_MAX, UINT64_MAX);
+
 #ifdef VMA_DUMP_STATS_ON_DESTROY
 	char *vma_stats_pre = nullptr;
 	vmaBuildStatsString(_vma_allocator, &vma_stats_pre, true);
@@ -1743,15 +3950,25 @@ void Renderer::destroy() {
 	vkDestroySampler(_vkb_device.device, _texture_sampler, nullptr);
 	vkDestroyImageView(_vkb_device.device, _texture_image_view, nullptr);
 
-	destroy_and_free_image(&_texture_image);
-
 	vkDestroyDescriptorSetLayout(
 			_vkb_device.device, _descriptor_set_layout, nullptr);
 
 	for (auto mesh : _meshes) {
-		destroy_and_free_buffer(&mesh->vertex_buffer);
-		destroy_and_free_buffer(&mesh->index_buffer);
+		_free_mesh_buffers(mesh);
+	}
+	destroy_geometry_arenas();
+
+	// includes _texture_image
+	for (auto image : _images) {
+		destroy_and_free_image(image);
+	}
+
+	for (auto &[thread_id, pool] : _upload_pools) {
+		vkDestroyCommandPool(_vkb_device.device, pool, nullptr);
 	}
+	_upload_pools.clear();
+
+	destroy_upload_ring();
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 		vkDestroySemaphore(
@@ -1812,8 +4029,14 @@ Error Renderer::send_update() {
 
 void DrawContext::draw(RenderObject *object) {
 	VkDebug::begin_label(cmd_buf, object->name);
+
+	RenderObject *bound = prev_object;
+	culled				= false;
 	object->draw(this);
-	prev_object = object;
+
+	// what's bound still belongs to the object before a culled one
+	prev_object = culled ? bound : object;
+	culled		= false;
 	VkDebug::end_label(cmd_buf);
 }
 
@@ -1833,9 +4056,26 @@ Error Renderer::draw_scene(VkCommandBuffer cmd_buf, uint32_t image_index) {
 			0.1f,
 			10.0f);
 	ctx.proj[1][1] *= -1;
+	ctx.viewport_height = (float)_vkb_swapchain.extent.height;
+
+	if (_scene_root == nullptr) {
+		VkDebug::end_label(cmd_buf);
+		return OK;
+	}
 
-	if (_scene_root != nullptr)
-		ctx.draw(_scene_root);
+#ifdef USE_DEPTH_PREPASS
+	VkDebug::begin_label(cmd_buf, "depth prepass");
+	ctx.pass = DrawContext::PASS_DEPTH;
+	ctx.draw(_scene_root);
+	VkDebug::end_label(cmd_buf);
+
+	// nothing bound in the depth pass is used by the color pass
+	ctx.pass			 = DrawContext::PASS_COLOR;
+	ctx.prev_object		 = nullptr;
+	ctx.reuse_visibility = true;
+#endif
+
+	ctx.draw(_scene_root);
 
 	VkDebug::end_label(cmd_buf);
 
@@ -1853,6 +4093,13 @@ Error Renderer::draw_frame() {
 			VK_TRUE,
 			UINT64_MAX);
 
+	// frames finish in the order they were submitted, so every frame up to
+	// the one last submitted with this fence is done
+	_completed_frame =
+			std::max(_completed_frame, _fence_frames[_current_frame]);
+	// _ready_upload only counts batches that have completed
+	_collect_deletions(_completed_frame, _ready_upload);
+
 	// get the index of the next presentable swapchain image to draw to.
 
 	uint32_t image_index = 0;
@@ -1894,6 +4141,13 @@ Error Renderer::draw_frame() {
 
 	// now we can start drawing.
 
+	// resources released from here on may be used by this frame
+	_fence_frames[_current_frame] = ++_frame_number;
+
+	// copies recorded since the last frame are submitted ahead of it, so
+	// the meshes they fill can be drawn
+	ERR_TRY(flush_uploads());
+
 	// grab the command buffer for this frame.
 	auto cmd_buf = _command_buffers[image_index];
 
@@ -1910,6 +4164,10 @@ Error Renderer::draw_frame() {
 	ERR_FAIL_COND_V_MSG(
 			result != VK_SUCCESS, FAIL, "Failed to begin command buffer");
 
+	// takes over whatever finished uploading since the last frame. the batch
+	// has already completed, so waiting on it never stalls the frame.
+	const uint64_t upload_value = _acquire_uploads(cmd_buf);
+
 	VkDebug::begin_label(cmd_buf, "render pass");
 
 	VkViewport viewport {
@@ -1967,17 +4225,28 @@ Error Renderer::draw_frame() {
 
 	VkSemaphore wait_semaphores[] {
 		_available_semaphores[_current_frame],
+		_upload_semaphore,
 	};
 	VkPipelineStageFlags wait_stages[] {
 		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		UPLOAD_READ_STAGES,
 	};
+	// the value of the binary semaphore is ignored
+	const uint64_t wait_values[] { 0, upload_value };
 	VkSemaphore signal_semaphores[] {
 		_finished_semaphores[_current_frame],
 	};
 
+	VkTimelineSemaphoreSubmitInfo timeline_info {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = 2,
+		.pWaitSemaphoreValues	 = wait_values,
+	};
+
 	VkSubmitInfo submit_info {
 		.sType				  = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount	  = 1,
+		.pNext				  = &timeline_info,
+		.waitSemaphoreCount	  = 2,
 		.pWaitSemaphores	  = wait_semaphores,
 		.pWaitDstStageMask	  = wait_stages,
 		.commandBufferCount	  = 1,
@@ -1988,11 +4257,15 @@ Error Renderer::draw_frame() {
 
 	vkResetFences(_vkb_device.device, 1, &_in_flight_fences[_current_frame]);
 
-	result = vkQueueSubmit(
-			_graphics_queue,
-			1,
-			&submit_info,
-			_in_flight_fences[_current_frame]);
+	{
+		// asset uploads submit to the same queue from worker threads
+		std::lock_guard<std::mutex> lock(_queue_mutex);
+		result = vkQueueSubmit(
+				_graphics_queue,
+				1,
+				&submit_info,
+				_in_flight_fences[_current_frame]);
+	}
 	ERR_FAIL_COND_V_MSG(
 			result != VK_SUCCESS,
 			FAIL,
@@ -2012,7 +4285,11 @@ Error Renderer::draw_frame() {
 		.pImageIndices		= &image_index,
 	};
 
-	result = vkQueuePresentKHR(_present_queue, &present_info);
+	{
+		// the present queue is usually the graphics queue
+		std::lock_guard<std::mutex> lock(_queue_mutex);
+		result = vkQueuePresentKHR(_present_queue, &present_info);
+	}
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 		return recreate_swapchain();
 	} else {
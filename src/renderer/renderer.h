@@ -2,6 +2,10 @@
 #define __RENDERER_H__
 
 #include "../typedefs.h"
+#include "../utils/hash.h"
+#include "asset_pack.h"
+#include "range_allocator.h"
+#include "vertex_format.h"
 #include "vk_types.h"
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -9,14 +13,25 @@
 
 #include "vk_shader.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <set>
+#include <span>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -24,6 +39,8 @@ namespace Opal {
 
 class Renderer;
 class RenderObject;
+class VertexDecoder;
+class IndexDecoder;
 
 const std::string TEXTURE_PATH = "assets/models/viking_room.png";
 
@@ -37,52 +54,46 @@ struct Vertex {
 	glm::vec3 color;
 	glm::vec2 tex_coord;
 
-	static VkVertexInputBindingDescription get_binding_description() {
-		VkVertexInputBindingDescription desc {
-			.binding   = 0,
-			.stride	   = sizeof(Vertex),
-			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-		};
-		return desc;
-	}
-
-	static std::array<VkVertexInputAttributeDescription, 3>
-	get_attribute_descriptions() {
-		std::array<VkVertexInputAttributeDescription, 3>
-				attribute_descriptions {};
-
-		attribute_descriptions[0].binding  = 0;
-		attribute_descriptions[0].location = 0;
-		attribute_descriptions[0].format   = VK_FORMAT_R32G32B32_SFLOAT;
-		attribute_descriptions[0].offset   = offsetof(Vertex, pos);
-
-		attribute_descriptions[1].binding  = 0;
-		attribute_descriptions[1].location = 1;
-		attribute_descriptions[1].format   = VK_FORMAT_R32G32B32_SFLOAT;
-		attribute_descriptions[1].offset   = offsetof(Vertex, color);
-
-		attribute_descriptions[2].binding  = 0;
-		attribute_descriptions[2].location = 2;
-		attribute_descriptions[2].format   = VK_FORMAT_R32G32_SFLOAT;
-		attribute_descriptions[2].offset   = offsetof(Vertex, tex_coord);
-
-		return attribute_descriptions;
-	}
-
 	bool operator==(const Vertex &other) const {
 		return pos == other.pos && color == other.color &&
 			   tex_coord == other.tex_coord;
 	}
+
+	/**
+	 * Hashes the raw bytes of the vertex. -0.0 is folded into 0.0 first so
+	 * vertices that compare equal always hash the same.
+	 */
+	uint64_t hash() const {
+		float values[sizeof(Vertex) / sizeof(float)];
+		memcpy(values, this, sizeof(values));
+		for (float &value : values)
+			value += 0.0f;
+		return hash_bytes(values, sizeof(values));
+	}
 };
 
 class DrawContext {
 public:
+	enum Pass {
+		// only fills the depth buffer
+		PASS_DEPTH,
+		PASS_COLOR,
+	};
+
 	Renderer *renderer;
 	VkCommandBuffer cmd_buf = VK_NULL_HANDLE;
 	uint32_t image_index;
 	RenderObject *prev_object = nullptr;
 	glm::mat4 view;
 	glm::mat4 proj;
+	// in pixels, for turning object space errors into screen space ones
+	float viewport_height = 0.0f;
+	// set by objects that were culled and didn't bind anything
+	bool culled = false;
+
+	Pass pass = PASS_COLOR;
+	// objects already picked what to draw during an earlier pass this frame
+	bool reuse_visibility = false;
 
 	DrawContext(
 			Renderer *renderer, VkCommandBuffer cmd_buf, uint32_t image_index) :
@@ -146,19 +157,42 @@ public:
 		VkImage image		= VK_NULL_HANDLE;
 		VmaAllocation alloc = nullptr;
 		VkExtent3D extent;
+		uint32_t mip_levels		= 1;
 		VkFormat format			= VK_FORMAT_UNDEFINED;
 		VkImageTiling tiling	= VK_IMAGE_TILING_MAX_ENUM;
 		VkImageUsageFlags usage = VK_IMAGE_USAGE_FLAG_BITS_MAX_ENUM;
 		VkMemoryPropertyFlags properties =
 				VK_MEMORY_PROPERTY_FLAG_BITS_MAX_ENUM;
+		// upload batch holding the copies into the image, 0 if it was
+		// uploaded on the graphics queue
+		uint64_t upload_ticket = 0;
+	};
+
+	/**
+	 * @brief Decoded RGBA8 pixels waiting to be uploaded to an Image.
+	 */
+	struct Pixels {
+		int width  = 0;
+		int height = 0;
+		std::unique_ptr<uint8_t, void (*)(void *)> data { nullptr, free };
+
+		/**
+		 * @brief Decodes the given image file. Safe to call from any thread.
+		 */
+		static Error load(Pixels *pixels, const char *filename);
 	};
 
 	struct Buffer {
-		const char *name	= nullptr;
+		std::string name;
 		VkBuffer buffer		= VK_NULL_HANDLE;
 		VmaAllocation alloc = nullptr;
-		uint32_t size		= 0;
+		VkDeviceSize size	= 0;
 		uint32_t usage		= 0;
+		// persistent mapping of host visible buffers, or null
+		void *mapped = nullptr;
+		// shared by the graphics and transfer queue families, so uploads
+		// don't transfer its ownership
+		bool concurrent = false;
 		VkDescriptorBufferInfo info;
 		Buffer() {}
 	};
@@ -175,6 +209,9 @@ public:
 		alignas(16) glm::mat4 model;
 		alignas(16) glm::mat4 view;
 		alignas(16) glm::mat4 proj;
+		// diffuse color of the submesh's material, read by the fragment
+		// shader
+		alignas(16) glm::vec4 color;
 	};
 
 	struct Uniform {};
@@ -188,17 +225,277 @@ public:
 		Buffer vertex_buffer;
 		Buffer index_buffer;
 
+		// number of indices in index_buffer. indices can be empty when the
+		// mesh was uploaded straight from file data.
+		uint32_t index_count = 0;
+
+		// layout the vertices were packed into when they were uploaded
+		VertexFormat format;
+		// where the mesh starts in vertex_buffer and index_buffer. both are
+		// the renderer's shared geometry arenas unless the mesh didn't fit.
+		VkDeviceSize vertex_base = 0;
+		uint32_t base_index		 = 0;
+		// where the format's interleaved and constant attributes start,
+		// relative to vertex_base. separate positions start at vertex_base.
+		VkDeviceSize vertex_offset	 = 0;
+		VkDeviceSize constant_offset = 0;
+		// meshes with few enough vertices get 16 bit indices
+		VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+		// upload batch holding the copies into the buffers. the mesh isn't
+		// drawn until that batch is ready.
+		uint64_t upload_ticket = 0;
+
+		/**
+		 * A range of index_buffer drawing the mesh at a lower detail. Every
+		 * level uses the same vertices.
+		 */
+		struct Lod {
+			uint32_t first_index;
+			uint32_t index_count;
+			// how far the surface is from the full detail one, in object
+			// space units
+			float error;
+		};
+
+		// levels from full detail down, empty if the whole index buffer is
+		// the only level
+		std::vector<Lod> lods;
+
+		/**
+		 * A range of index_buffer drawn with a single material.
+		 */
+		struct Submesh {
+			uint32_t first_index;
+			uint32_t index_count;
+			uint32_t material;
+		};
+
+		// submeshes of every level sorted by first_index, with one range per
+		// material inside each level ordered by material. empty if the whole
+		// mesh uses material 0.
+		std::vector<Submesh> submeshes;
+		// diffuse color of every material
+		std::vector<glm::vec4> material_colors;
+
+		/**
+		 * @returns the color of the given material, white if it has none.
+		 */
+		glm::vec4 get_material_color(uint32_t material) const {
+			if (material < material_colors.size())
+				return material_colors[material];
+			return glm::vec4(1.0f);
+		}
+
+		// sphere around all vertices, used to pick the level to draw
+		glm::vec3 bounds_center = glm::vec3(0.0f);
+		float bounds_radius		= 0.0f;
+
+		/**
+		 * A small range of index_buffer with bounds for culling it on its
+		 * own.
+		 */
+		struct Meshlet {
+			uint32_t first_index;
+			uint32_t index_count;
+			// sphere around the meshlet's vertices
+			glm::vec3 center;
+			float radius;
+			// every triangle faces away from viewers far enough along the
+			// axis. the cutoff is the sine of the cone's half angle, 1 when
+			// the meshlet can't be backface culled.
+			glm::vec3 cone_axis;
+			float cone_cutoff;
+			// meshlets never span more than one submesh
+			uint32_t material;
+		};
+
+		std::vector<Meshlet> meshlets;
+		// level i is drawn by meshlets lod_meshlets[i] up to
+		// lod_meshlets[i + 1]
+		std::vector<uint32_t> lod_meshlets;
+
 		static Error load_from_obj(Mesh *mesh, const char *filename);
+
+		/**
+		 * @brief Parses and welds the OBJ file without going through the
+		 * mesh cache.
+		 */
+		static Error import_obj(Mesh *mesh, const char *filename);
 	};
 
 	bool has_mesh(Mesh *mesh);
 	void add_mesh(Mesh *mesh);
+
+	/**
+	 * @brief Uploads the given vertex and index data into the mesh's GPU
+	 * buffers without going through the mesh's vectors. The indices must
+	 * hold every level in the mesh's lods and submeshes.
+	 *
+	 * The copies go into the open upload batch instead of being waited on,
+	 * see Mesh::upload_ticket.
+	 */
+	Error upload_mesh(
+			Mesh *mesh,
+			const Vertex *vertices,
+			uint32_t vertex_count,
+			const uint32_t *indices,
+			uint32_t index_count);
+
+	/**
+	 * @brief Works out what upload_mesh needs from the vertices and indices
+	 * on the CPU: the mesh's vertex format, bounds and meshlets. The mesh's
+	 * lods and submeshes must already be set. The cooker stores the result,
+	 * so meshes from the asset pack skip this.
+	 */
+	static void prepare_mesh(
+			Mesh *mesh,
+			std::span<const Vertex> vertices,
+			std::span<const uint32_t> indices);
+
+	/**
+	 * @returns the upload batch that every buffer copy recorded so far
+	 * belongs to, or 0 if there are none.
+	 */
+	uint64_t get_upload_ticket();
+
+	/**
+	 * @returns true once the upload batch has completed and the frame being
+	 * recorded owns what it filled.
+	 */
+	bool is_upload_ready(uint64_t ticket) const {
+		return ticket <= _ready_upload;
+	}
+
+	/**
+	 * @brief Submits the recorded buffer copies without waiting for them.
+	 */
+	Error flush_uploads();
+
+	/**
+	 * @brief Blocks until the upload batch and every one before it have
+	 * finished on the GPU, submitting it first if it's still recording.
+	 */
+	Error wait_for_uploads(uint64_t ticket);
+
+	/**
+	 * @brief Uploads a mesh entry of the asset pack, decoding its vertices
+	 * and indices straight into the staging memory. They aren't kept.
+	 */
+	Error upload_cooked_mesh(Mesh *mesh, const AssetPack::Entry &entry);
+
+	/**
+	 * @brief Gets the vertices and indices an uploaded mesh was built from.
+	 * Meshes uploaded from the asset pack are decoded again from the pack,
+	 * found by their name, since they don't keep a copy of their data.
+	 */
+	Error get_mesh_data(
+			const Mesh *mesh,
+			std::vector<Vertex> *vertices,
+			std::vector<uint32_t> *indices) const;
+
+	/**
+	 * @brief Creates a sampled image from the given pixels. The image is
+	 * freed when the renderer is destroyed.
+	 *
+	 * Like upload_mesh, this can be called from any thread once the renderer
+	 * is initialized. Each thread records its copies into its own command
+	 * pool and only the queue submission is serialized.
+	 */
+	Error upload_image(Image *image, const Pixels &pixels);
+
+	/**
+	 * @brief Creates a sampled image from tightly packed mip levels, largest
+	 * first. The format can be RGBA8 or one of the BC formats. BC data is
+	 * decoded on the CPU when the device can't sample it.
+	 * @param generate_mips when true the data only holds the first level and
+	 * the rest of the chain is blitted from it on the GPU.
+	 */
+	Error upload_image(
+			Image *image,
+			const void *data,
+			VkDeviceSize size,
+			uint32_t width,
+			uint32_t height,
+			uint32_t mip_levels,
+			VkFormat format,
+			bool generate_mips = false);
+
+	/**
+	 * @brief Frees the mesh's buffers once every frame that could have drawn
+	 * it, and its upload, have finished. Call it once nothing recorded from
+	 * now on draws the mesh, which can then be uploaded again right away.
+	 */
+	void release_mesh(Mesh *mesh);
+
+	/**
+	 * @brief Destroys the image once every frame that could have used it, and
+	 * its upload, have finished. Call it once nothing recorded from now on
+	 * uses the image.
+	 */
+	void release_image(Image *image);
+
+	/**
+	 * @brief Like release_image, for buffers.
+	 */
+	void release_buffer(Buffer *buffer);
+
+	/**
+	 * @brief Like release_image, for image views.
+	 */
+	void release_image_view(VkImageView view);
+
+	/**
+	 * @brief Like release_image, for pipelines.
+	 */
+	void release_pipeline(VkPipeline pipeline);
+
+	/**
+	 * @returns the number of levels in a full mip chain down to 1x1.
+	 */
+	static uint32_t get_mip_level_count(uint32_t width, uint32_t height) {
+		return std::bit_width(std::max({ width, height, 1u }));
+	}
+
+	/**
+	 * @returns the size in bytes of a mip level of the given size, or 0 if
+	 * the format can't be uploaded.
+	 */
+	static VkDeviceSize
+	get_level_size(VkFormat format, uint32_t width, uint32_t height);
+
+	/**
+	 * @brief Uploads the mesh from the asset pack, or imports it from the
+	 * given source file if it hasn't been cooked.
+	 */
+	Error load_mesh(Mesh *mesh, const char *filename);
+
+	/**
+	 * @brief Uploads the texture from the asset pack, or decodes it from the
+	 * given source file if it hasn't been cooked. KTX2 files are uploaded in
+	 * their stored format.
+	 */
+	Error load_image(Image *image, const char *filename);
+
+	/**
+	 * @brief Decodes the given image file straight into mapped staging memory
+	 * and uploads it as RGBA8 with a generated mip chain.
+	 */
+	Error decode_image(Image *image, const char *filename);
+
+	const AssetPack &get_asset_pack() const { return _asset_pack; }
+
 	void set_render_object(RenderObject *object);
 
 protected:
 	bool _initialized;
 
+	// mapped for the lifetime of the renderer so uploads can read from it
+	AssetPack _asset_pack;
+
+	// guards _meshes and _images since uploads can come from worker threads
+	std::mutex _assets_mutex;
 	std::set<Mesh *> _meshes;
+	std::set<Image *> _images;
 
 	RenderObject *_scene_root;
 
@@ -219,6 +516,11 @@ protected:
 	// queues
 	VkQueue _graphics_queue;
 	VkQueue _present_queue;
+	// a dedicated transfer queue when the device has one, the graphics queue
+	// otherwise
+	VkQueue _transfer_queue;
+	uint32_t _graphics_family;
+	uint32_t _transfer_family;
 
 	VkDescriptorSetLayout _descriptor_set_layout;
 	VkDescriptorPool _descriptor_pool;
@@ -228,15 +530,157 @@ public:
 
 	// graphics pipeline
 	VkPipelineLayout _pipeline_layout;
-	VkPipeline _graphics_pipeline;
+
+	/**
+	 * @returns the graphics pipeline for meshes of the given vertex format.
+	 * Pipelines are created the first time a format is drawn.
+	 */
+	VkPipeline get_pipeline(const VertexFormat &format);
+
+	/**
+	 * @returns the pipeline that only writes the depth of meshes of the
+	 * given vertex format, reading nothing but their positions.
+	 */
+	VkPipeline get_depth_pipeline(const VertexFormat &format);
 
 protected:
 	VkRenderPass _render_pass;
 
+	// kept around so pipelines for new vertex formats can be created later
+	Shader _vert_shader;
+	Shader _frag_shader;
+	Shader _depth_shader;
+
+	// graphics pipelines by VertexFormat::get_key, and depth only ones by
+	// VertexFormat::get_position_key
+	std::unordered_map<uint32_t, VkPipeline> _pipelines;
+	std::unordered_map<uint32_t, VkPipeline> _depth_pipelines;
+	std::mutex _pipelines_mutex;
+
 	// commands
 	VkCommandPool _command_pool;
 	std::vector<VkCommandBuffer> _command_buffers;
 
+	// vkQueueSubmit requires external synchronization on the queue
+	std::mutex _queue_mutex;
+
+	// command pools can only be used by one thread at a time, so every thread
+	// that submits single-use commands gets its own
+	std::mutex _upload_pools_mutex;
+	std::unordered_map<std::thread::id, VkCommandPool> _upload_pools;
+
+	VkCommandPool _get_upload_pool();
+
+	/**
+	 * Copies recorded into one command buffer and submitted to the transfer
+	 * queue. Batches are numbered from 1 in the order they are submitted and
+	 * signal their number on _upload_semaphore when they complete.
+	 */
+	struct UploadBatch {
+		uint64_t id					   = 0;
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		// the staging ring is free up to here once the batch completes
+		uint64_t ring_end = 0;
+		// ownership of every buffer and image the batch filled is released
+		// to the graphics queue at its end, and acquired there by the first
+		// frame recorded after it completes
+		std::vector<VkBufferMemoryBarrier> buffer_acquires;
+		std::vector<VkImageMemoryBarrier> image_acquires;
+		// staging buffers too big for the ring, freed once the batch completes
+		std::vector<Buffer> staging_buffers;
+	};
+
+	// buffer uploads are staged in one persistently mapped ring and their
+	// copies recorded into the open batch, which is submitted when the ring
+	// runs out of room, before every frame, or when it's waited on
+	std::mutex _upload_mutex;
+	VkCommandPool _upload_command_pool = VK_NULL_HANDLE;
+	VkSemaphore _upload_semaphore	   = VK_NULL_HANDLE;
+	Buffer _upload_ring;
+	// running byte offsets into the ring, taken modulo its size
+	uint64_t _ring_head = 0;
+	uint64_t _ring_tail = 0;
+	// has no command buffer until something is recorded into it
+	UploadBatch _open_upload = { .id = 1 };
+	std::deque<UploadBatch> _submitted_uploads;
+	// command buffers of completed batches, ready for reuse
+	std::vector<VkCommandBuffer> _free_upload_buffers;
+	// acquires of completed batches that no frame has recorded yet
+	std::vector<VkBufferMemoryBarrier> _pending_buffer_acquires;
+	std::vector<VkImageMemoryBarrier> _pending_image_acquires;
+	uint64_t _completed_upload = 0;
+	// last batch whose acquires are recorded, read while drawing
+	std::atomic<uint64_t> _ready_upload = 0;
+
+	/**
+	 * Starts recording the open batch if it isn't already. Requires
+	 * _upload_mutex.
+	 */
+	Error _begin_uploads();
+
+	/**
+	 * Reserves size bytes of the staging ring for the open batch, waiting for
+	 * older batches to free up room if needed. Requires _upload_mutex.
+	 * @returns the mapped memory, or nullptr on failure.
+	 */
+	void *_stage_upload(VkDeviceSize size, VkDeviceSize *offset);
+
+	/**
+	 * Submits the open batch if it has anything in it. Requires
+	 * _upload_mutex.
+	 */
+	Error _submit_uploads();
+
+	/**
+	 * Waits for submitted batches up to and including the given one and
+	 * recycles them. Requires _upload_mutex.
+	 */
+	Error _retire_uploads(uint64_t ticket);
+
+	/**
+	 * Records the acquires of every completed batch into the frame's command
+	 * buffer.
+	 * @returns the batch the frame has to wait on before reading them.
+	 */
+	uint64_t _acquire_uploads(VkCommandBuffer cmd_buf);
+
+	/**
+	 * A device local buffer that meshes are sub-allocated from, so draws of
+	 * different meshes can keep it bound.
+	 */
+	struct GeometryArena {
+		Buffer buffer;
+		RangeAllocator ranges;
+		std::mutex mutex;
+	};
+
+	GeometryArena _vertex_arena;
+	GeometryArena _index_arena;
+
+	/**
+	 * @brief Gives the mesh's ranges back to the arenas, or destroys its own
+	 * buffers if it didn't fit in them.
+	 */
+	void _free_mesh_buffers(Mesh *mesh);
+
+	/**
+	 * @brief Takes the mesh's buffers away from it and frees them once the
+	 * frames and the upload batch that could still use them have finished.
+	 */
+	void _release_mesh_buffers(Mesh *mesh);
+
+	/**
+	 * @brief Marks the mesh as uploaded once its levels and submeshes are
+	 * checked against its indices.
+	 */
+	Error _claim_mesh(Mesh *mesh, uint32_t index_count);
+
+	/**
+	 * @brief Finishes an upload started by _claim_mesh, undoing it if either
+	 * buffer couldn't be created or err says something else went wrong.
+	 */
+	Error _finish_mesh_upload(Mesh *mesh, uint32_t index_count, Error err);
+
 	// images
 	std::vector<VkImage> _swapchain_images;
 	std::vector<VkImageView> _swapchain_image_views;
@@ -250,6 +694,48 @@ protected:
 
 	size_t _current_frame = 0;
 
+	/**
+	 * A resource released while frames that may still use it are in flight.
+	 */
+	struct Deletion {
+		// the last frame recorded before it was released
+		uint64_t frame;
+		// the last upload batch that could still be copying into it
+		uint64_t upload;
+		std::function<void()> destroy;
+	};
+
+	// frames are numbered from 1 in the order they are recorded
+	std::atomic<uint64_t> _frame_number = 0;
+	// the frame last submitted with each of _in_flight_fences
+	std::vector<uint64_t> _fence_frames;
+	// every frame up to this one has finished on the GPU
+	uint64_t _completed_frame = 0;
+
+	// oldest first, so the frames they wait on only go up, the upload
+	// batches they wait on don't
+	std::mutex _deletion_mutex;
+	std::deque<Deletion> _deletions;
+
+	/**
+	 * @brief Queues destroy to run once the frame being recorded, or the
+	 * last one if none is, has finished, and so has the upload batch.
+	 */
+	void _defer_deletion(std::function<void()> destroy, uint64_t upload = 0);
+
+	/**
+	 * @brief Destroys everything released up to and including the given
+	 * frame whose uploads are done by the given batch. Both must have
+	 * finished.
+	 */
+	void _collect_deletions(uint64_t frame, uint64_t upload);
+
+	/**
+	 * @brief Forgets the queue ownership acquires naming the buffer or image,
+	 * so no frame records them once it's released.
+	 */
+	void _drop_acquires(VkBuffer buffer, VkImage image);
+
 	Error create_window();
 	Error create_vk_instance();
 	Error create_surface();
@@ -261,8 +747,14 @@ protected:
 	Error create_render_pass();
 	Error create_descriptor_set_layout();
 	Error create_graphics_pipeline();
+	Error _create_pipeline(
+			const VertexFormat &format, bool depth_only, VkPipeline *pipeline);
 	Error create_framebuffers();
 	Error create_command_pool();
+	Error create_upload_ring();
+	void destroy_upload_ring();
+	Error create_geometry_arenas();
+	void destroy_geometry_arenas();
 	Error create_depth_resources();
 	Error create_texture_image();
 	Error create_texture_image_view();
@@ -324,7 +816,7 @@ protected:
 	/* insert command in command buffer */                                     \
 	vkCmd(cmd_buf, __VA_ARGS__);                                               \
 	/* end buffer and submit command */                                        \
-	_end_and_submit_single_use_command_buffer(cmd_buf);                        \
+	ERR_TRY(_end_and_submit_single_use_command_buffer(cmd_buf));               \
 	((void)0)
 
 	/**
@@ -334,14 +826,85 @@ protected:
 	VkCommandBuffer _begin_single_use_command_buffer();
 
 	/**
-	 * Ends and deallocates a "single-use" command buffer.
+	 * Ends, submits and deallocates a "single-use" command buffer. It is
+	 * deallocated even when submitting fails.
 	 * Use the `VK_SUBMIT_SINGLE_CMD` macro instead.
 	 */
-	void
+	Error
 	_end_and_submit_single_use_command_buffer(VkCommandBuffer command_buffer);
 
+	/**
+	 * @brief Records layout transitions, copies and blits for the graphics
+	 * queue and submits them together as one single-use command buffer.
+	 *
+	 * Transitions are held back until a command needs them or the recorder
+	 * is submitted, so the transitions of many images and mip levels share
+	 * one vkCmdPipelineBarrier.
+	 */
+	class CommandRecorder {
+
+	public:
+		CommandRecorder(Renderer *renderer) : _renderer(renderer) {}
+		// submits whatever is still recorded
+		~CommandRecorder();
+
+		/**
+		 * @brief Moves level_count mip levels of the image, starting at
+		 * base_level, from one layout to another.
+		 */
+		Error transition(
+				Image *image,
+				VkImageLayout old_layout,
+				VkImageLayout new_layout,
+				uint32_t base_level	 = 0,
+				uint32_t level_count = VK_REMAINING_MIP_LEVELS);
+
+		/**
+		 * @brief Copies the first level_count mip levels of the image from
+		 * the tightly packed levels in the buffer. The levels must be in
+		 * VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+		 */
+		Error copy_buffer_to_image(
+				Buffer *buffer, Image *image, uint32_t level_count);
+
+		/**
+		 * @brief Fills the mip level by blitting down from the level above
+		 * it, which must be in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL while the
+		 * level itself is in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+		 */
+		Error downsample(Image *image, uint32_t level);
+
+		/**
+		 * @brief Submits everything recorded so far and waits for it.
+		 */
+		Error submit();
+
+		/**
+		 * @brief Throws away everything recorded so far without submitting
+		 * it, for when recording failed halfway.
+		 */
+		void discard();
+
+	protected:
+		Renderer *_renderer;
+		VkCommandBuffer _cmd_buf = VK_NULL_HANDLE;
+
+		// transitions that haven't been recorded yet
+		std::vector<VkImageMemoryBarrier> _barriers;
+		VkPipelineStageFlags _src_stages = 0;
+		VkPipelineStageFlags _dst_stages = 0;
+
+		// starts the command buffer on first use
+		Error _begin();
+		// records the held back transitions in one barrier
+		Error _flush_barriers();
+	};
+
 	// images
 
+	// loaded on another thread while the rest of the renderer initializes
+	std::future<Error> _texture_load;
+
 	Image _texture_image;
 	VkSampler _texture_sampler;
 	VkImageView _texture_image_view;
@@ -356,14 +919,19 @@ protected:
 			VkFormat format,
 			VkImageTiling tiling,
 			VkImageUsageFlags usage,
-			VkMemoryPropertyFlags properties);
+			VkMemoryPropertyFlags properties,
+			uint32_t mip_levels = 1);
 
 	VkImageView create_image_view(
 			std::string name,
 			VkImage image,
 			VkFormat format,
-			VkImageAspectFlags aspect);
+			VkImageAspectFlags aspect,
+			uint32_t mip_levels = 1);
 
+	/**
+	 * @brief Records a single transition of every mip level and submits it.
+	 */
 	Error transition_image_layout(
 			Image *image, VkImageLayout old_layout, VkImageLayout new_layout);
 
@@ -373,14 +941,30 @@ protected:
 
 	std::vector<Buffer> _uniform_buffers;
 
+	/**
+	 * @param concurrent shares the buffer between the graphics and transfer
+	 * queue families instead of leaving it to one of them at a time.
+	 */
 	Error create_buffer(
 			Buffer *buffer,
 			std::string name,
-			uint32_t size,
+			VkDeviceSize size,
 			uint32_t usage,
 			VmaMemoryUsage mapping,
-			VkMemoryPropertyFlags mem_flags);
-	Error copy_buffer(Buffer *src_buffer, Buffer *dst_buffer, uint32_t size);
+			VkMemoryPropertyFlags mem_flags,
+			VmaAllocationCreateFlags alloc_flags = 0,
+			bool concurrent = false);
+	Error copy_buffer(
+			Buffer *src_buffer, Buffer *dst_buffer, VkDeviceSize size);
+
+	/**
+	 * @brief Copies every region from src_buffer to dst_buffer with a single
+	 * submit.
+	 */
+	Error copy_buffer(
+			Buffer *src_buffer,
+			Buffer *dst_buffer,
+			std::span<const VkBufferCopy> regions);
 
 	/**
 	 * @brief Deallocates and nullifies the given buffer.
@@ -388,16 +972,132 @@ protected:
 	Error destroy_and_free_buffer(Buffer *buffer);
 
 	/**
-	 * @brief wraps vkCmdCopyBufferToImage and submits it.
+	 * @brief Records a single copy and submits it. The first
+	 * level_count mip levels of the image are copied from the tightly packed
+	 * levels in the buffer.
 	 */
-	Error copy_buffer_to_image(Buffer *buffer, Image *image);
+	Error copy_buffer_to_image(
+			Buffer *buffer, Image *image, uint32_t level_count);
+
+	/**
+	 * @brief Creates a persistently mapped buffer for copying to the GPU.
+	 * Buffers that are read back on the CPU, like decode targets, should be
+	 * cached and flushed once written.
+	 */
+	Error _create_staging_buffer(
+			Buffer *buffer, VkDeviceSize size, bool cached = false);
+
+	/**
+	 * @brief Creates the image, copies its levels out of the staging buffer
+	 * and frees the staging buffer. Images with all their levels are copied
+	 * on the transfer queue, see Image::upload_ticket.
+	 */
+	Error _upload_staged_image(
+			Image *image,
+			Buffer *staging_buffer,
+			uint32_t width,
+			uint32_t height,
+			uint32_t mip_levels,
+			VkFormat format,
+			bool generate_mips);
+
+	/**
+	 * @brief Records the layout transitions and the copy of every mip level
+	 * of the image into the open upload batch, which takes over the staging
+	 * buffer.
+	 */
+	Error _record_image_upload(Image *image, Buffer *staging_buffer);
+
+	/**
+	 * @brief Records blits filling every mip level after the first from the
+	 * level above it, which then leave the whole image ready for sampling.
+	 *
+	 * Every level must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+	 */
+	Error generate_mipmaps(Image *image, CommandRecorder *recorder);
+
+	/**
+	 * @returns true if images of the format can be downsampled with linear
+	 * blits.
+	 */
+	bool supports_linear_blit(VkFormat format);
 
 	// Error update_uniform_buffer(uint32_t image_index);
 
+	/**
+	 * @brief Creates a device local buffer and fills it with the given data
+	 * through a staging buffer.
+	 */
+	Renderer::Buffer create_device_buffer(
+			std::string name,
+			const void *data,
+			VkDeviceSize size,
+			VkBufferUsageFlags usage);
+
+	/**
+	 * @brief Writes the items from first to first + count of an upload into
+	 * the staging memory and adds the regions they are copied to.
+	 */
+	using ChunkWriter = std::function<Error(
+			uint64_t first,
+			uint64_t count,
+			void *staging,
+			std::vector<VkBufferCopy> *regions)>;
+
+	/**
+	 * @brief Creates a device local buffer of the given size and fills it
+	 * with count items, chunk_count items at a time. Every chunk is written
+	 * to staging_size bytes of the staging ring and copied in the open
+	 * upload batch, so the buffer is ready once that batch is submitted.
+	 *
+	 * With an arena, the data goes into a range of the arena's buffer when
+	 * it fits and base is set to where that range starts. The returned
+	 * buffer is then the arena's own and must not be destroyed.
+	 */
+	Renderer::Buffer _create_streamed_buffer(
+			std::string name,
+			VkDeviceSize size,
+			VkBufferUsageFlags usage,
+			uint64_t count,
+			uint64_t chunk_count,
+			VkDeviceSize staging_size,
+			const ChunkWriter &write,
+			GeometryArena *arena = nullptr,
+			VkDeviceSize *base = nullptr);
+
+	/**
+	 * @brief Packs the vertices into the mesh's vertex format on the way to
+	 * the GPU.
+	 */
 	Renderer::Buffer
-	create_vertex_buffer(std::string name, std::vector<Vertex> vertices);
+	create_vertex_buffer(Mesh *mesh, const Vertex *vertices, uint32_t count);
+
+	/**
+	 * @brief Like create_vertex_buffer, decoding the vertices as they are
+	 * staged.
+	 */
 	Renderer::Buffer
-	create_index_buffer(std::string name, std::vector<uint32_t> indices);
+	create_vertex_buffer(Mesh *mesh, VertexDecoder *decoder, uint32_t count);
+
+	/**
+	 * @brief Narrows the indices to 16 bits when every vertex can be reached
+	 * with them and sets the mesh's index type to match.
+	 */
+	Renderer::Buffer create_index_buffer(
+			Mesh *mesh,
+			const uint32_t *indices,
+			uint32_t count,
+			uint32_t vertex_count);
+
+	/**
+	 * @brief Like create_index_buffer, decoding the indices as they are
+	 * staged.
+	 */
+	Renderer::Buffer create_index_buffer(
+			Mesh *mesh,
+			IndexDecoder *decoder,
+			uint32_t count,
+			uint32_t vertex_count);
 };
 
 } // namespace Opal
@@ -405,10 +1105,7 @@ protected:
 namespace std {
 template <> struct hash<Opal::Vertex> {
 	size_t operator()(Opal::Vertex const &vertex) const {
-		return ((hash<glm::vec3>()(vertex.pos) ^
-				 (hash<glm::vec3>()(vertex.color) << 1)) >>
-				1) ^
-			   (hash<glm::vec2>()(vertex.tex_coord) << 1);
+		return (size_t)vertex.hash();
 	}
 };
 } // namespace std
@@ -0,0 +1,350 @@
+#include "vertex_format.h"
+#include "renderer.h"
+
+#include <glm/gtc/packing.hpp>
+
+using namespace Opal;
+
+namespace {
+
+struct AttributeType {
+	VkFormat format;
+	uint32_t size;
+};
+
+AttributeType _get_attribute_type(
+		VertexFormat::Attribute attribute, VertexFormat::Encoding encoding) {
+
+	// 3 component 16 bit formats are barely supported so positions get
+	// padded to 4
+	switch (attribute) {
+		case VertexFormat::ATTRIBUTE_POSITION:
+			if (encoding == VertexFormat::ENCODING_HALF)
+				return { VK_FORMAT_R16G16B16A16_SFLOAT, 8 };
+			if (encoding == VertexFormat::ENCODING_UNORM16)
+				return { VK_FORMAT_R16G16B16A16_UNORM, 8 };
+			return { VK_FORMAT_R32G32B32_SFLOAT, 12 };
+		case VertexFormat::ATTRIBUTE_COLOR:
+			if (encoding == VertexFormat::ENCODING_UNORM8)
+				return { VK_FORMAT_R8G8B8A8_UNORM, 4 };
+			return { VK_FORMAT_R32G32B32_SFLOAT, 12 };
+		case VertexFormat::ATTRIBUTE_TEX_COORD:
+			if (encoding == VertexFormat::ENCODING_UNORM16)
+				return { VK_FORMAT_R16G16_UNORM, 4 };
+			return { VK_FORMAT_R32G32_SFLOAT, 8 };
+		default:
+			return { VK_FORMAT_UNDEFINED, 0 };
+	}
+}
+
+uint16_t _unorm16(float value) {
+	return (uint16_t)(glm::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+uint8_t _unorm8(float value) {
+	return (uint8_t)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+bool _in_unit_range(const float *values, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		if (!(values[i] >= 0.0f && values[i] <= 1.0f))
+			return false;
+	}
+	return true;
+}
+
+} // namespace
+
+VertexFormat VertexFormat::full(bool separate_positions) {
+	VertexFormat format;
+	format.separate_positions = separate_positions;
+	format._update_layout();
+	return format;
+}
+
+VertexFormat VertexFormat::choose(
+		const Vertex *vertices,
+		uint32_t count,
+		bool half_positions,
+		bool separate_positions) {
+
+	VertexFormat format;
+	if (count == 0)
+		return full(separate_positions);
+
+	format.separate_positions = separate_positions;
+
+	glm::vec3 min	   = vertices[0].pos;
+	glm::vec3 max	   = vertices[0].pos;
+	bool same_color	   = true;
+	bool same_tex	   = true;
+	bool color_in_unit = true;
+	bool tex_in_unit   = true;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		const Vertex &vertex = vertices[i];
+		min					 = glm::min(min, vertex.pos);
+		max					 = glm::max(max, vertex.pos);
+
+		same_color &= vertex.color == vertices[0].color;
+		same_tex &= vertex.tex_coord == vertices[0].tex_coord;
+		color_in_unit &= _in_unit_range(&vertex.color.x, 3);
+		tex_in_unit &= _in_unit_range(&vertex.tex_coord.x, 2);
+	}
+
+	AttributeFormat &position = format.attributes[ATTRIBUTE_POSITION];
+	if (half_positions) {
+		position.encoding = ENCODING_HALF;
+	} else {
+		position.encoding	  = ENCODING_UNORM16;
+		format.position_min	  = min;
+		format.position_scale = max - min;
+		// flat meshes would divide by 0
+		for (int i = 0; i < 3; ++i) {
+			if (format.position_scale[i] <= 0.0f)
+				format.position_scale[i] = 1.0f;
+		}
+	}
+
+	AttributeFormat &color = format.attributes[ATTRIBUTE_COLOR];
+	color.encoding		   = color_in_unit ? ENCODING_UNORM8 : ENCODING_FLOAT;
+	color.constant		   = same_color;
+
+	AttributeFormat &tex_coord = format.attributes[ATTRIBUTE_TEX_COORD];
+	tex_coord.encoding = tex_in_unit ? ENCODING_UNORM16 : ENCODING_FLOAT;
+	tex_coord.constant = same_tex;
+
+	format._update_layout();
+	return format;
+}
+
+void VertexFormat::_update_layout() {
+	stride			= 0;
+	constant_size	= 0;
+	position_stride = 0;
+
+	for (int i = 0; i < ATTRIBUTE_COUNT; ++i) {
+		AttributeFormat &attribute = attributes[i];
+
+		uint32_t *size = &stride;
+		if (attribute.constant)
+			size = &constant_size;
+		else if (separate_positions && i == ATTRIBUTE_POSITION)
+			size = &position_stride;
+
+		attribute.offset = *size;
+		*size += _get_attribute_type((Attribute)i, attribute.encoding).size;
+	}
+}
+
+void VertexFormat::encode(
+		const Vertex *vertices, uint32_t count, void *out) const {
+
+	uint8_t *data = static_cast<uint8_t *>(out);
+
+	if (get_key() == full().get_key()) {
+		memcpy(data, vertices, (size_t)count * sizeof(Vertex));
+		return;
+	}
+
+	uint8_t *positions	 = data;
+	uint8_t *interleaved = data + get_vertex_offset(count);
+	uint8_t *constants	 = data + get_constant_offset(count);
+
+	const glm::vec3 inv_scale = glm::vec3(1.0f) / position_scale;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		const Vertex &vertex = vertices[i];
+
+		for (int a = 0; a < ATTRIBUTE_COUNT; ++a) {
+			const AttributeFormat &attribute = attributes[a];
+
+			// constants are taken from the first vertex
+			if (attribute.constant && i > 0)
+				continue;
+
+			uint8_t *dst;
+			if (attribute.constant)
+				dst = constants + attribute.offset;
+			else if (separate_positions && a == ATTRIBUTE_POSITION)
+				dst = positions + (size_t)i * position_stride;
+			else
+				dst = interleaved + (size_t)i * stride + attribute.offset;
+
+			switch (a) {
+				case ATTRIBUTE_POSITION: {
+					uint16_t packed[4] = { 0, 0, 0, 0 };
+					if (attribute.encoding == ENCODING_UNORM16) {
+						const glm::vec3 normalized =
+								(vertex.pos - position_min) * inv_scale;
+						for (int c = 0; c < 3; ++c)
+							packed[c] = _unorm16(normalized[c]);
+					} else if (attribute.encoding == ENCODING_HALF) {
+						for (int c = 0; c < 3; ++c)
+							packed[c] = glm::packHalf1x16(vertex.pos[c]);
+					} else {
+						memcpy(dst, &vertex.pos, sizeof(vertex.pos));
+						break;
+					}
+					memcpy(dst, packed, sizeof(packed));
+					break;
+				}
+				case ATTRIBUTE_COLOR:
+					if (attribute.encoding == ENCODING_UNORM8) {
+						const uint8_t packed[4] = {
+							_unorm8(vertex.color.x),
+							_unorm8(vertex.color.y),
+							_unorm8(vertex.color.z),
+							255,
+						};
+						memcpy(dst, packed, sizeof(packed));
+					} else {
+						memcpy(dst, &vertex.color, sizeof(vertex.color));
+					}
+					break;
+				case ATTRIBUTE_TEX_COORD:
+					if (attribute.encoding == ENCODING_UNORM16) {
+						const uint16_t packed[2] = {
+							_unorm16(vertex.tex_coord.x),
+							_unorm16(vertex.tex_coord.y),
+						};
+						memcpy(dst, packed, sizeof(packed));
+					} else {
+						memcpy(dst, &vertex.tex_coord, sizeof(vertex.tex_coord));
+					}
+					break;
+			}
+		}
+	}
+}
+
+void VertexFormat::get_chunk_copies(
+		uint32_t count,
+		uint32_t first,
+		uint32_t chunk_count,
+		std::vector<VkBufferCopy> *copies) const {
+
+	// a chunk is laid out like a buffer of chunk_count vertices
+	if (separate_positions && position_stride > 0) {
+		copies->push_back({
+				.srcOffset = 0,
+				.dstOffset = (VkDeviceSize)first * position_stride,
+				.size	   = (VkDeviceSize)chunk_count * position_stride,
+		});
+	}
+	if (stride > 0) {
+		copies->push_back({
+				.srcOffset = get_vertex_offset(chunk_count),
+				.dstOffset = get_vertex_offset(count) +
+							 (VkDeviceSize)first * stride,
+				.size	   = (VkDeviceSize)chunk_count * stride,
+		});
+	}
+	if (constant_size > 0 && first == 0) {
+		copies->push_back({
+				.srcOffset = get_constant_offset(chunk_count),
+				.dstOffset = get_constant_offset(count),
+				.size	   = constant_size,
+		});
+	}
+}
+
+glm::mat4 VertexFormat::get_dequantize_transform() const {
+	if (attributes[ATTRIBUTE_POSITION].encoding != ENCODING_UNORM16)
+		return glm::mat4(1.0f);
+
+	return glm::scale(
+			glm::translate(glm::mat4(1.0f), position_min), position_scale);
+}
+
+uint32_t VertexFormat::get_key() const {
+	// the offsets and strides follow from these
+	uint32_t key = 0;
+	for (int i = 0; i < ATTRIBUTE_COUNT; ++i) {
+		key |= (uint32_t)attributes[i].encoding << (i * 4);
+		key |= (uint32_t)attributes[i].constant << (i * 4 + 3);
+	}
+	key |= (uint32_t)separate_positions << (ATTRIBUTE_COUNT * 4);
+	return key;
+}
+
+uint32_t VertexFormat::get_position_key() const {
+	// interleaved positions also depend on the size of the rest of the vertex
+	const uint32_t binding_stride =
+			separate_positions ? position_stride : stride;
+	return (uint32_t)attributes[ATTRIBUTE_POSITION].encoding |
+		   binding_stride << 4;
+}
+
+std::vector<VkVertexInputBindingDescription>
+VertexFormat::get_binding_descriptions() const {
+	std::vector<VkVertexInputBindingDescription> bindings;
+
+	// split off positions can leave nothing else that changes per vertex
+	if (stride > 0) {
+		bindings.push_back({
+				.binding   = VERTEX_BINDING,
+				.stride	   = stride,
+				.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+		});
+	}
+
+	// a stride of 0 reads the same constants for every instance
+	if (constant_size > 0) {
+		bindings.push_back({
+				.binding   = CONSTANT_BINDING,
+				.stride	   = 0,
+				.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+		});
+	}
+
+	if (separate_positions)
+		bindings.push_back(get_position_binding_description());
+
+	return bindings;
+}
+
+std::vector<VkVertexInputAttributeDescription>
+VertexFormat::get_attribute_descriptions() const {
+	std::vector<VkVertexInputAttributeDescription> descriptions(
+			ATTRIBUTE_COUNT);
+
+	// shader locations match the attribute order
+	for (int i = 0; i < ATTRIBUTE_COUNT; ++i) {
+		const AttributeFormat &attribute = attributes[i];
+		descriptions[i]					 = {
+			.location = (uint32_t)i,
+			.binding  = attribute.constant ? CONSTANT_BINDING : VERTEX_BINDING,
+			.format	  = _get_attribute_type((Attribute)i, attribute.encoding)
+							  .format,
+			.offset = attribute.offset,
+		};
+	}
+
+	descriptions[ATTRIBUTE_POSITION] = get_position_attribute_description();
+
+	return descriptions;
+}
+
+VkVertexInputBindingDescription
+VertexFormat::get_position_binding_description() const {
+	return {
+		.binding   = get_position_binding(),
+		.stride	   = separate_positions ? position_stride : stride,
+		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	};
+}
+
+VkVertexInputAttributeDescription
+VertexFormat::get_position_attribute_description() const {
+	const AttributeFormat &position = attributes[ATTRIBUTE_POSITION];
+	const VkFormat format =
+			_get_attribute_type(ATTRIBUTE_POSITION, position.encoding).format;
+
+	return {
+		.location = ATTRIBUTE_POSITION,
+		.binding  = get_position_binding(),
+		.format	  = format,
+		.offset	  = position.offset,
+	};
+}
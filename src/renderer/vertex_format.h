@@ -0,0 +1,179 @@
+#ifndef __VERTEX_FORMAT_H__
+#define __VERTEX_FORMAT_H__
+
+#include "vk_types.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace Opal {
+
+struct Vertex;
+
+/**
+ * @brief GPU layout of a mesh's vertex buffer.
+ *
+ * Meshes are imported as full float Vertex structs and packed into the
+ * smallest layout that fits them when they are uploaded. Positions are stored
+ * as half floats, or as 16 bit normalized integers relative to the mesh bounds
+ * which get_dequantize_transform scales back. Texture coordinates that fit in
+ * [0, 1] are stored as 16 bit normalized integers and colors as 8 bit ones.
+ *
+ * Attributes that are the same for every vertex are stored once after the
+ * vertex data and read through a second binding that only advances per
+ * instance, so the shaders work with every layout as is.
+ *
+ * Positions can also be split off into their own tightly packed stream at the
+ * start of the buffer, read through a third binding. Depth only pipelines
+ * then bind just that stream.
+ */
+struct VertexFormat {
+
+	enum Attribute {
+		ATTRIBUTE_POSITION,
+		ATTRIBUTE_COLOR,
+		ATTRIBUTE_TEX_COORD,
+		ATTRIBUTE_COUNT,
+	};
+
+	enum Encoding : uint8_t {
+		ENCODING_FLOAT,
+		ENCODING_HALF,
+		ENCODING_UNORM16,
+		ENCODING_UNORM8,
+	};
+
+	struct AttributeFormat {
+		Encoding encoding = ENCODING_FLOAT;
+		// stored once after the vertex data instead of per vertex
+		bool constant = false;
+		// offset in the vertex, or in the constant block
+		uint32_t offset = 0;
+	};
+
+	static constexpr uint32_t VERTEX_BINDING   = 0;
+	static constexpr uint32_t CONSTANT_BINDING = 1;
+	static constexpr uint32_t POSITION_BINDING = 2;
+
+	AttributeFormat attributes[ATTRIBUTE_COUNT];
+	uint32_t stride		   = 0;
+	uint32_t constant_size = 0;
+
+	// positions are stored in their own stream in front of the others
+	bool separate_positions	 = false;
+	uint32_t position_stride = 0;
+
+	// object space bounds that normalized positions are relative to
+	glm::vec3 position_min	 = glm::vec3(0.0f);
+	glm::vec3 position_scale = glm::vec3(1.0f);
+
+	/**
+	 * @returns the layout of the Vertex struct itself, or of its float
+	 * attributes with the positions split off.
+	 */
+	static VertexFormat full(bool separate_positions = false);
+
+	/**
+	 * @brief Picks the smallest layout that can hold the given vertices.
+	 * @param half_positions store positions as half floats instead of
+	 * normalizing them to the bounds.
+	 * @param separate_positions store positions in their own stream.
+	 */
+	static VertexFormat choose(
+			const Vertex *vertices,
+			uint32_t count,
+			bool half_positions,
+			bool separate_positions = false);
+
+	/**
+	 * @returns where the interleaved attributes start in a buffer of count
+	 * vertices. Only the position stream comes before them.
+	 */
+	VkDeviceSize get_vertex_offset(uint32_t count) const {
+		if (!separate_positions)
+			return 0;
+		// keep every stream aligned for the 4 byte attribute formats
+		return ((VkDeviceSize)count * position_stride + 3) & ~(VkDeviceSize)3;
+	}
+
+	/**
+	 * @returns where the constant attributes start in a buffer of count
+	 * vertices.
+	 */
+	VkDeviceSize get_constant_offset(uint32_t count) const {
+		const VkDeviceSize end =
+				get_vertex_offset(count) + (VkDeviceSize)count * stride;
+		return (end + 3) & ~(VkDeviceSize)3;
+	}
+
+	/**
+	 * @returns the size of a buffer holding count vertices.
+	 */
+	VkDeviceSize get_size(uint32_t count) const {
+		return get_constant_offset(count) + constant_size;
+	}
+
+	/**
+	 * @brief Packs the vertices into out, which must hold get_size(count)
+	 * bytes.
+	 */
+	void encode(const Vertex *vertices, uint32_t count, void *out) const;
+
+	/**
+	 * @brief Adds the copies that move chunk_count vertices, encoded on their
+	 * own starting at vertex first, to their place in a buffer of count
+	 * vertices. Constant attributes are only copied with the first chunk.
+	 */
+	void get_chunk_copies(
+			uint32_t count,
+			uint32_t first,
+			uint32_t chunk_count,
+			std::vector<VkBufferCopy> *copies) const;
+
+	/**
+	 * @returns a matrix that moves decoded positions back to object space.
+	 */
+	glm::mat4 get_dequantize_transform() const;
+
+	/**
+	 * @returns an id that is the same for every format with the same vertex
+	 * input state.
+	 */
+	uint32_t get_key() const;
+
+	/**
+	 * @returns an id that is the same for every format with the same
+	 * position only vertex input state.
+	 */
+	uint32_t get_position_key() const;
+
+	std::vector<VkVertexInputBindingDescription>
+	get_binding_descriptions() const;
+	std::vector<VkVertexInputAttributeDescription>
+	get_attribute_descriptions() const;
+
+	/**
+	 * @returns the binding positions are read from. Depth only pipelines
+	 * bind nothing else.
+	 */
+	uint32_t get_position_binding() const {
+		return separate_positions ? POSITION_BINDING : VERTEX_BINDING;
+	}
+
+	/**
+	 * @brief Vertex input state that only reads the positions, for depth
+	 * only pipelines.
+	 */
+	VkVertexInputBindingDescription get_position_binding_description() const;
+	VkVertexInputAttributeDescription
+	get_position_attribute_description() const;
+
+protected:
+	// lays the attributes out from their encoding and constant flags
+	void _update_layout();
+};
+
+} // namespace Opal
+
+#endif // __VERTEX_FORMAT_H__
@@ -0,0 +1,68 @@
+#include "vertex_welder.h"
+
+#include <cmath>
+
+using namespace Opal;
+
+VertexWelder::VertexWelder(
+		std::vector<Vertex> *vertices, size_t max_count, float epsilon) :
+		_vertices(vertices),
+		_inv_epsilon(epsilon > 0.0f ? 1.0f / epsilon : 0.0f) {
+
+	// keep the load factor at or below 0.5 so probe sequences stay short
+	size_t capacity = 16;
+	while (capacity < max_count * 2)
+		capacity <<= 1;
+
+	_slots.assign(capacity, Slot { .hash = 0, .index = EMPTY });
+	_mask = capacity - 1;
+
+	// worst case every vertex is unique
+	_vertices->reserve(_vertices->size() + max_count);
+}
+
+void VertexWelder::_quantize(const Vertex &vertex, int32_t *cell) const {
+	float values[COMPONENTS];
+	memcpy(values, &vertex, sizeof(values));
+	for (size_t i = 0; i < COMPONENTS; ++i)
+		cell[i] = (int32_t)std::floor(values[i] * _inv_epsilon);
+}
+
+uint64_t VertexWelder::_hash(const Vertex &vertex) const {
+	if (_inv_epsilon == 0.0f)
+		return vertex.hash();
+
+	int32_t cell[COMPONENTS];
+	_quantize(vertex, cell);
+	return hash_bytes(cell, sizeof(cell));
+}
+
+bool VertexWelder::_equal(const Vertex &a, const Vertex &b) const {
+	if (_inv_epsilon == 0.0f)
+		return a == b;
+
+	int32_t cell_a[COMPONENTS];
+	int32_t cell_b[COMPONENTS];
+	_quantize(a, cell_a);
+	_quantize(b, cell_b);
+	return memcmp(cell_a, cell_b, sizeof(cell_a)) == 0;
+}
+
+uint32_t VertexWelder::weld(const Vertex &vertex) {
+	const uint64_t hash	 = _hash(vertex);
+	const uint32_t check = (uint32_t)(hash >> 32);
+
+	for (size_t i = (size_t)hash & _mask;; i = (i + 1) & _mask) {
+		Slot &slot = _slots[i];
+
+		if (slot.index == EMPTY) {
+			slot.hash  = check;
+			slot.index = (uint32_t)_vertices->size();
+			_vertices->push_back(vertex);
+			return slot.index;
+		}
+
+		if (slot.hash == check && _equal((*_vertices)[slot.index], vertex))
+			return slot.index;
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef __VERTEX_WELDER_H__
+#define __VERTEX_WELDER_H__
+
+#include "renderer.h"
+
+namespace Opal {
+
+/**
+ * @brief Deduplicates vertices while building an index buffer.
+ *
+ * Uses a flat open addressing table with linear probing that is sized up
+ * front, so welding never rehashes and every corner is a single probe
+ * sequence that either finds the existing vertex or inserts the new one.
+ *
+ * With an epsilon above 0, every attribute is snapped to a grid of that size
+ * and vertices falling in the same cell are welded together. The first vertex
+ * in a cell is the one that is kept.
+ */
+class VertexWelder {
+
+public:
+	/**
+	 * @param vertices unique vertices are appended here.
+	 * @param max_count upper bound on how many vertices will be welded.
+	 * Usually the index count.
+	 * @param epsilon grid size for welding nearby vertices. 0 only welds
+	 * exact duplicates.
+	 */
+	VertexWelder(
+			std::vector<Vertex> *vertices,
+			size_t max_count,
+			float epsilon = 0.0f);
+
+	/**
+	 * @returns the index of the vertex, appending it if it hasn't been seen
+	 * before.
+	 */
+	uint32_t weld(const Vertex &vertex);
+
+protected:
+	struct Slot {
+		// upper bits of the hash so most mismatches skip the vertex compare
+		uint32_t hash;
+		// index into _vertices, EMPTY if the slot is free
+		uint32_t index;
+	};
+
+	static constexpr uint32_t EMPTY = UINT32_MAX;
+
+	static constexpr size_t COMPONENTS = sizeof(Vertex) / sizeof(float);
+
+	std::vector<Vertex> *_vertices;
+	std::vector<Slot> _slots;
+	size_t _mask;
+	float _inv_epsilon;
+
+	// grid cell of every vertex component, only used when epsilon > 0
+	void _quantize(const Vertex &vertex, int32_t *cell) const;
+	uint64_t _hash(const Vertex &vertex) const;
+	bool _equal(const Vertex &a, const Vertex &b) const;
+};
+
+} // namespace Opal
+
+#endif // __VERTEX_WELDER_H__
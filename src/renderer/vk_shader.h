@@ -16,10 +16,6 @@ struct Shader {
 	 * Optional name for debugging.
 	 */
 	const char *name;
-	/**
-	 * Shader code used to create the module.
-	 */
-	std::vector<char> code;
 	/**
 	 * The actual VkShaderModule handle.
 	 */
@@ -176,7 +172,13 @@ static Error createShader(
 		VkDevice device,
 		Shader *shader,
 		const std::string &name,
-		const std::vector<char> &code) {
+		std::span<const uint8_t> code) {
+
+	ERR_FAIL_COND_V_MSG(
+			code.size() % sizeof(uint32_t) != 0,
+			FAIL,
+			"SPIR-V code for shader %s is not a multiple of 4 bytes",
+			name.c_str());
 
 	VkShaderModuleCreateInfo shader_info {
 		.sType	  = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -185,7 +187,6 @@ static Error createShader(
 	};
 
 	shader->name = name.c_str();
-	shader->code = code;
 
 	// reflect the shader code to gather more info
 
@@ -236,8 +237,15 @@ static Error createShader(
  */
 static Error createShaderFromFile(
 		VkDevice device, Shader *shader, const std::string &filename) {
-	auto code = readFile(filename + ".spv");
-	return createShader(device, shader, filename, code);
+	// the module is created straight from the mapping. vulkan copies the
+	// code so the file can be unmapped right after.
+	MappedFile file;
+	ERR_FAIL_COND_V_MSG(
+			!file.open(filename + ".spv", MappedFile::HINT_WILL_NEED),
+			FAIL,
+			"Failed to open shader %s.spv",
+			filename.c_str());
+	return createShader(device, shader, filename, file.span());
 }
 
 /**
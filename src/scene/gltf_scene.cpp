@@ -0,0 +1,884 @@
+#include "gltf_scene.h"
+
+#include "../renderer/mesh_optimizer.h"
+#include "../renderer/mesh_simplifier.h"
+#include "../renderer/meshlet_builder.h"
+#include "../utils/file.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <nlohmann/json.hpp>
+
+#include <filesystem>
+#include <functional>
+#include <span>
+
+using namespace Opal;
+
+using json = nlohmann::json;
+
+namespace {
+
+// binary glTF container, see the GLB section of the glTF 2.0 spec
+constexpr uint32_t GLB_MAGIC	  = 0x46546C67; // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+constexpr uint32_t GLB_CHUNK_BIN  = 0x004E4942; // "BIN"
+
+enum ComponentType : uint32_t {
+	COMPONENT_BYTE			 = 5120,
+	COMPONENT_UNSIGNED_BYTE	 = 5121,
+	COMPONENT_SHORT			 = 5122,
+	COMPONENT_UNSIGNED_SHORT = 5123,
+	COMPONENT_UNSIGNED_INT	 = 5125,
+	COMPONENT_FLOAT			 = 5126,
+};
+
+constexpr uint32_t MODE_TRIANGLES = 4;
+
+struct BufferData {
+	const uint8_t *data = nullptr;
+	size_t size			= 0;
+};
+
+/**
+ * An accessor resolved to a pointer into one of the mapped buffers.
+ */
+struct AccessorView {
+	const uint8_t *data		= nullptr;
+	size_t stride			= 0;
+	size_t count			= 0;
+	uint32_t component_type = 0;
+	uint32_t components		= 0;
+};
+
+uint32_t _component_size(uint32_t component_type) {
+	switch (component_type) {
+		case COMPONENT_BYTE:
+		case COMPONENT_UNSIGNED_BYTE:
+			return 1;
+		case COMPONENT_SHORT:
+		case COMPONENT_UNSIGNED_SHORT:
+			return 2;
+		case COMPONENT_UNSIGNED_INT:
+		case COMPONENT_FLOAT:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+uint32_t _type_components(const std::string &type) {
+	if (type == "SCALAR")
+		return 1;
+	if (type == "VEC2")
+		return 2;
+	if (type == "VEC3")
+		return 3;
+	if (type == "VEC4")
+		return 4;
+	if (type == "MAT2")
+		return 4;
+	if (type == "MAT3")
+		return 9;
+	if (type == "MAT4")
+		return 16;
+	return 0;
+}
+
+bool _is_aligned(const void *ptr, size_t align) {
+	return ((uintptr_t)ptr & (align - 1)) == 0;
+}
+
+Error _resolve_accessor(
+		const json &gltf,
+		const std::vector<BufferData> &buffers,
+		uint32_t index,
+		AccessorView *view) {
+
+	const json &accessors = gltf.at("accessors");
+	ERR_FAIL_COND_V_MSG(
+			index >= accessors.size(), FAIL, "Invalid accessor %u", index);
+
+	const json &accessor = accessors[index];
+
+	// sparse accessors and accessors without a buffer view are all zeros
+	// plus patches. We don't export those so they aren't supported.
+	ERR_FAIL_COND_V_MSG(
+			!accessor.contains("bufferView") || accessor.contains("sparse"),
+			FAIL,
+			"Accessor %u has no buffer view or is sparse",
+			index);
+
+	const uint32_t view_index = accessor.at("bufferView").get<uint32_t>();
+	const json &buffer_views  = gltf.at("bufferViews");
+	ERR_FAIL_COND_V_MSG(
+			view_index >= buffer_views.size(),
+			FAIL,
+			"Invalid buffer view %u",
+			view_index);
+
+	const json &buffer_view	  = buffer_views[view_index];
+	const uint32_t buffer	  = buffer_view.at("buffer").get<uint32_t>();
+	const size_t view_offset  = buffer_view.value("byteOffset", (size_t)0);
+	const size_t view_length  = buffer_view.at("byteLength").get<size_t>();
+	const size_t byte_offset  = accessor.value("byteOffset", (size_t)0);
+	const uint32_t components =
+			_type_components(accessor.at("type").get<std::string>());
+
+	view->component_type = accessor.at("componentType").get<uint32_t>();
+	view->components	 = components;
+	view->count			 = accessor.at("count").get<size_t>();
+
+	const size_t element_size =
+			_component_size(view->component_type) * components;
+	ERR_FAIL_COND_V_MSG(
+			element_size == 0,
+			FAIL,
+			"Accessor %u has an unsupported type",
+			index);
+
+	view->stride = buffer_view.value("byteStride", element_size);
+
+	ERR_FAIL_COND_V_MSG(
+			buffer >= buffers.size() || buffers[buffer].data == nullptr,
+			FAIL,
+			"Accessor %u uses missing buffer %u",
+			index,
+			buffer);
+
+	// make sure the whole range is inside the buffer view and the buffer
+	const size_t used = view->count == 0
+			? 0
+			: (view->count - 1) * view->stride + element_size;
+	ERR_FAIL_COND_V_MSG(
+			byte_offset + used > view_length ||
+					view_offset + view_length > buffers[buffer].size,
+			FAIL,
+			"Accessor %u is out of bounds",
+			index);
+
+	view->data = buffers[buffer].data + view_offset + byte_offset;
+
+	return OK;
+}
+
+float _read_component(const AccessorView &view, size_t element, uint32_t c) {
+	const uint8_t *p = view.data + element * view.stride +
+					   c * _component_size(view.component_type);
+	switch (view.component_type) {
+		case COMPONENT_FLOAT: {
+			float value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		// normalized integers are allowed for texcoords and colors
+		case COMPONENT_UNSIGNED_BYTE:
+			return *p / 255.0f;
+		case COMPONENT_UNSIGNED_SHORT: {
+			uint16_t value;
+			memcpy(&value, p, sizeof(value));
+			return value / 65535.0f;
+		}
+		default:
+			return 0.0f;
+	}
+}
+
+uint32_t _read_index(const AccessorView &view, size_t element) {
+	const uint8_t *p = view.data + element * view.stride;
+	switch (view.component_type) {
+		case COMPONENT_UNSIGNED_BYTE:
+			return *p;
+		case COMPONENT_UNSIGNED_SHORT: {
+			uint16_t value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		default: {
+			uint32_t value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+	}
+}
+
+/**
+ * @returns true if the accessors are interleaved exactly like Vertex so the
+ * buffer view can be uploaded as is.
+ */
+bool _matches_vertex_layout(
+		const AccessorView &position,
+		const AccessorView *color,
+		const AccessorView *tex_coord) {
+	if (color == nullptr || tex_coord == nullptr)
+		return false;
+
+	return position.component_type == COMPONENT_FLOAT &&
+		   position.components == 3 && position.stride == sizeof(Vertex) &&
+		   _is_aligned(position.data, alignof(Vertex)) &&
+		   color->component_type == COMPONENT_FLOAT &&
+		   color->components == 3 && color->stride == sizeof(Vertex) &&
+		   color->count == position.count &&
+		   color->data == position.data + offsetof(Vertex, color) &&
+		   tex_coord->component_type == COMPONENT_FLOAT &&
+		   tex_coord->components == 2 && tex_coord->stride == sizeof(Vertex) &&
+		   tex_coord->count == position.count &&
+		   tex_coord->data == position.data + offsetof(Vertex, tex_coord);
+}
+
+glm::mat4 _node_transform(const json &node) {
+	if (node.contains("matrix")) {
+		const auto values = node.at("matrix").get<std::vector<float>>();
+		if (values.size() == 16)
+			return glm::make_mat4(values.data());
+	}
+
+	glm::mat4 transform(1.0f);
+
+	if (node.contains("translation")) {
+		const auto t = node.at("translation").get<std::vector<float>>();
+		if (t.size() == 3)
+			transform = glm::translate(transform, glm::vec3(t[0], t[1], t[2]));
+	}
+
+	if (node.contains("rotation")) {
+		// glTF stores quaternions as xyzw
+		const auto r = node.at("rotation").get<std::vector<float>>();
+		if (r.size() == 4)
+			transform *= glm::mat4_cast(glm::quat(r[3], r[0], r[1], r[2]));
+	}
+
+	if (node.contains("scale")) {
+		const auto s = node.at("scale").get<std::vector<float>>();
+		if (s.size() == 3)
+			transform = glm::scale(transform, glm::vec3(s[0], s[1], s[2]));
+	}
+
+	return transform;
+}
+
+/**
+ * The json and buffers of a glTF file. Anything that was mapped stays mapped
+ * for as long as this is alive.
+ */
+struct Document {
+	MappedFile file;
+	json gltf;
+	BufferData glb_buffer;
+	std::vector<MappedFile> buffer_files;
+	std::vector<BufferData> buffers;
+};
+
+/**
+ * Splits a binary glTF container and parses the json. Plain glTF files are
+ * just json.
+ */
+Error _parse_document(
+		Document *doc, const char *filename, std::span<const uint8_t> data) {
+
+	const char *json_begin = reinterpret_cast<const char *>(data.data());
+	const char *json_end   = json_begin + data.size();
+
+	// binary glTF keeps the json and the first buffer in one file
+	uint32_t magic = 0;
+	if (data.size() >= sizeof(magic))
+		memcpy(&magic, data.data(), sizeof(magic));
+
+	if (magic == GLB_MAGIC) {
+		uint32_t header[3];
+		uint32_t chunk[2];
+		ERR_FAIL_COND_V_MSG(
+				data.size() < sizeof(header) + sizeof(chunk),
+				FAIL,
+				"Invalid glb file %s",
+				filename);
+
+		memcpy(header, data.data(), sizeof(header));
+		ERR_FAIL_COND_V_MSG(
+				header[1] != 2,
+				FAIL,
+				"Unsupported glb version %u in %s",
+				header[1],
+				filename);
+
+		size_t offset = sizeof(header);
+		while (offset + sizeof(chunk) <= data.size()) {
+			memcpy(chunk, data.data() + offset, sizeof(chunk));
+			offset += sizeof(chunk);
+
+			ERR_FAIL_COND_V_MSG(
+					offset + chunk[0] > data.size(),
+					FAIL,
+					"Truncated glb chunk in %s",
+					filename);
+
+			if (chunk[1] == GLB_CHUNK_JSON) {
+				json_begin =
+						reinterpret_cast<const char *>(data.data() + offset);
+				json_end   = json_begin + chunk[0];
+			} else if (chunk[1] == GLB_CHUNK_BIN) {
+				doc->glb_buffer = { data.data() + offset, chunk[0] };
+			}
+
+			// chunks are 4 byte aligned
+			offset += (chunk[0] + 3) & ~3u;
+		}
+	}
+
+	doc->gltf = json::parse(json_begin, json_end, nullptr, false);
+	ERR_FAIL_COND_V_MSG(
+			doc->gltf.is_discarded(),
+			FAIL,
+			"Failed to parse glTF json %s",
+			filename);
+
+	return OK;
+}
+
+/**
+ * @returns the paths of the external buffers of the document.
+ */
+std::vector<std::string> _buffer_paths(const json &gltf, const char *filename) {
+
+	const std::filesystem::path base_dir =
+			std::filesystem::path(filename).parent_path();
+
+	std::vector<std::string> paths;
+	for (const json &buffer : gltf.value("buffers", json::array())) {
+		if (!buffer.contains("uri")) {
+			paths.emplace_back();
+			continue;
+		}
+		const std::string uri = buffer.at("uri").get<std::string>();
+		paths.push_back(
+				uri.starts_with("data:") ? uri : (base_dir / uri).string());
+	}
+
+	return paths;
+}
+
+Error _map_buffers(Document *doc, const char *filename) {
+
+	const std::vector<std::string> paths = _buffer_paths(doc->gltf, filename);
+	doc->buffer_files.resize(paths.size());
+	doc->buffers.resize(paths.size());
+
+	for (size_t i = 0; i < paths.size(); ++i) {
+		if (paths[i].empty()) {
+			// the glb binary chunk
+			ERR_FAIL_COND_V_MSG(
+					doc->glb_buffer.data == nullptr,
+					FAIL,
+					"Buffer %zu in %s has no uri",
+					i,
+					filename);
+			doc->buffers[i] = doc->glb_buffer;
+			continue;
+		}
+
+		ERR_FAIL_COND_V_MSG(
+				paths[i].starts_with("data:"),
+				FAIL,
+				"Embedded buffers are not supported: %s",
+				filename);
+
+		ERR_FAIL_COND_V_MSG(
+				!doc->buffer_files[i].open(
+						paths[i], MappedFile::HINT_WILL_NEED),
+				FAIL,
+				"Failed to open glTF buffer %s",
+				paths[i].c_str());
+
+		doc->buffers[i] = { doc->buffer_files[i].data(),
+							doc->buffer_files[i].size() };
+	}
+
+	return OK;
+}
+
+/**
+ * Geometry of a primitive. Points straight into the mapped buffers when they
+ * already match the layout of Vertex and uint32 indices.
+ */
+struct PrimitiveData {
+	const Vertex *vertices	= nullptr;
+	size_t vertex_count		= 0;
+	const uint32_t *indices = nullptr;
+	size_t index_count		= 0;
+	bool zero_copy			= true;
+
+	// only used when the data had to be repacked
+	std::vector<Vertex> vertex_storage;
+	std::vector<uint32_t> index_storage;
+};
+
+Error _read_primitive(
+		const Document &doc,
+		const json &primitive,
+		const std::string &name,
+		PrimitiveData *data) {
+
+	const json &gltf	   = doc.gltf;
+	const json &attributes = primitive.at("attributes");
+
+	ERR_FAIL_COND_V_MSG(
+			!attributes.contains("POSITION"),
+			FAIL,
+			"Primitive %s has no positions",
+			name.c_str());
+
+	AccessorView position;
+	ERR_TRY(_resolve_accessor(
+			gltf,
+			doc.buffers,
+			attributes.at("POSITION").get<uint32_t>(),
+			&position));
+	ERR_FAIL_COND_V_MSG(
+			position.component_type != COMPONENT_FLOAT ||
+					position.components != 3,
+			FAIL,
+			"Positions of %s must be float vec3",
+			name.c_str());
+
+	AccessorView color_view;
+	AccessorView *color = nullptr;
+	if (attributes.contains("COLOR_0")) {
+		ERR_TRY(_resolve_accessor(
+				gltf,
+				doc.buffers,
+				attributes.at("COLOR_0").get<uint32_t>(),
+				&color_view));
+		color = &color_view;
+	}
+
+	AccessorView tex_coord_view;
+	AccessorView *tex_coord = nullptr;
+	if (attributes.contains("TEXCOORD_0")) {
+		ERR_TRY(_resolve_accessor(
+				gltf,
+				doc.buffers,
+				attributes.at("TEXCOORD_0").get<uint32_t>(),
+				&tex_coord_view));
+		tex_coord = &tex_coord_view;
+	}
+
+	// vertices
+
+	data->vertex_count = position.count;
+
+	if (_matches_vertex_layout(position, color, tex_coord)) {
+		data->vertices = reinterpret_cast<const Vertex *>(position.data);
+	} else {
+		data->zero_copy = false;
+		data->vertex_storage.resize(position.count);
+		for (size_t i = 0; i < position.count; ++i) {
+			Vertex &vertex = data->vertex_storage[i];
+			vertex.pos	   = {
+				_read_component(position, i, 0),
+				_read_component(position, i, 1),
+				_read_component(position, i, 2),
+			};
+			vertex.color = { 1.0f, 1.0f, 1.0f };
+			if (color && i < color->count) {
+				vertex.color = {
+					_read_component(*color, i, 0),
+					_read_component(*color, i, 1),
+					_read_component(*color, i, 2),
+				};
+			}
+			// glTF texcoords already have their origin at the top left so
+			// they don't get flipped like OBJ ones
+			vertex.tex_coord = { 0.0f, 0.0f };
+			if (tex_coord && i < tex_coord->count) {
+				vertex.tex_coord = {
+					_read_component(*tex_coord, i, 0),
+					_read_component(*tex_coord, i, 1),
+				};
+			}
+		}
+		data->vertices = data->vertex_storage.data();
+	}
+
+	// indices
+
+	if (primitive.contains("indices")) {
+		AccessorView index_view;
+		ERR_TRY(_resolve_accessor(
+				gltf,
+				doc.buffers,
+				primitive.at("indices").get<uint32_t>(),
+				&index_view));
+
+		data->index_count = index_view.count;
+
+		if (index_view.component_type == COMPONENT_UNSIGNED_INT &&
+			index_view.stride == sizeof(uint32_t) &&
+			_is_aligned(index_view.data, alignof(uint32_t))) {
+			data->indices =
+					reinterpret_cast<const uint32_t *>(index_view.data);
+		} else {
+			data->zero_copy = false;
+			data->index_storage.resize(data->index_count);
+			for (size_t i = 0; i < data->index_count; ++i)
+				data->index_storage[i] = _read_index(index_view, i);
+			data->indices = data->index_storage.data();
+		}
+	} else {
+		// non-indexed primitives draw every vertex in order
+		data->zero_copy	  = false;
+		data->index_count = position.count;
+		data->index_storage.resize(data->index_count);
+		for (size_t i = 0; i < data->index_count; ++i)
+			data->index_storage[i] = (uint32_t)i;
+		data->indices = data->index_storage.data();
+	}
+
+	// the mesh is built on the CPU from these before it's uploaded, so a
+	// malformed file must not be able to point outside the vertices
+	ERR_FAIL_COND_V_MSG(
+			data->index_count % 3 != 0,
+			FAIL,
+			"Primitive %s has %zu indices, which isn't whole triangles",
+			name.c_str(),
+			data->index_count);
+	for (size_t i = 0; i < data->index_count; ++i) {
+		ERR_FAIL_COND_V_MSG(
+				data->indices[i] >= data->vertex_count,
+				FAIL,
+				"Index %u of primitive %s is past its %zu vertices",
+				data->indices[i],
+				name.c_str(),
+				data->vertex_count);
+	}
+
+	return OK;
+}
+
+std::string _mesh_name(const json &gltf_mesh, size_t index) {
+	return gltf_mesh.value("name", "mesh " + std::to_string(index));
+}
+
+} // namespace
+
+const char *GltfScene::_add_name(std::string name) {
+	return _names.emplace_back(std::move(name)).c_str();
+}
+
+std::string GltfScene::get_primitive_name(
+		const char *filename, size_t mesh, size_t primitive) {
+	return std::string(filename) + "#" + std::to_string(mesh) + "." +
+		   std::to_string(primitive);
+}
+
+Error GltfScene::get_dependencies(
+		const char *filename, std::vector<std::string> *files) {
+
+	MappedFile file;
+	ERR_FAIL_COND_V_MSG(
+			!file.open(filename, MappedFile::HINT_SEQUENTIAL),
+			FAIL,
+			"Failed to open glTF file %s",
+			filename);
+
+	Document doc;
+	ERR_TRY(_parse_document(&doc, filename, file.span()));
+
+	try {
+		for (std::string &path : _buffer_paths(doc.gltf, filename)) {
+			if (!path.empty() && !path.starts_with("data:"))
+				files->push_back(std::move(path));
+		}
+	} catch (const json::exception &e) {
+		LOG_ERR("Invalid glTF file %s: %s", filename, e.what());
+		return FAIL;
+	}
+
+	return OK;
+}
+
+Error GltfScene::cook(
+		const char *filename,
+		std::string *json_text,
+		std::vector<CookedPrimitive> *primitives) {
+
+	Document doc;
+	ERR_FAIL_COND_V_MSG(
+			!doc.file.open(filename, MappedFile::HINT_WILL_NEED),
+			FAIL,
+			"Failed to open glTF file %s",
+			filename);
+
+	ERR_TRY(_parse_document(&doc, filename, doc.file.span()));
+
+	// glb files get stored without their binary chunk since all of the
+	// geometry is cooked separately
+	*json_text = doc.gltf.dump();
+
+	try {
+		ERR_TRY(_map_buffers(&doc, filename));
+
+		const json &gltf_meshes = doc.gltf.value("meshes", json::array());
+		for (size_t m = 0; m < gltf_meshes.size(); ++m) {
+			const std::string name = _mesh_name(gltf_meshes[m], m);
+			const json &gltf_primitives = gltf_meshes[m].at("primitives");
+
+			for (size_t p = 0; p < gltf_primitives.size(); ++p) {
+				const json &primitive = gltf_primitives[p];
+				if (primitive.value("mode", MODE_TRIANGLES) != MODE_TRIANGLES)
+					continue;
+
+				PrimitiveData data;
+				ERR_TRY(_read_primitive(doc, primitive, name, &data));
+
+				CookedPrimitive &cooked = primitives->emplace_back();
+				cooked.mesh				= m;
+				cooked.primitive		= p;
+				cooked.vertices.assign(
+						data.vertices, data.vertices + data.vertex_count);
+				cooked.indices.assign(
+						data.indices, data.indices + data.index_count);
+
+				// a primitive only has a single material, so there are no
+				// submeshes to keep apart
+				std::vector<Renderer::Mesh::Submesh> submeshes;
+
+				MeshOptimizer::optimize(
+						&cooked.vertices,
+						&cooked.indices,
+						submeshes,
+						MESH_VERTEX_CACHE_SIZE,
+						get_primitive_name(filename, m, p).c_str());
+				MeshSimplifier::build_lods(
+						cooked.vertices,
+						&cooked.indices,
+						&cooked.lods,
+						&submeshes,
+						MESH_LOD_COUNT,
+						MESH_VERTEX_CACHE_SIZE);
+				MeshletBuilder::optimize(
+						&cooked.vertices,
+						&cooked.indices,
+						cooked.lods,
+						submeshes);
+			}
+		}
+	} catch (const json::exception &e) {
+		LOG_ERR("Invalid glTF file %s: %s", filename, e.what());
+		return FAIL;
+	}
+
+	return OK;
+}
+
+Error GltfScene::load(GltfScene *scene, const char *filename) {
+
+	const auto start_time = std::chrono::high_resolution_clock::now();
+
+	Renderer *renderer = Renderer::get_singleton();
+	ERR_FAIL_COND_V_MSG(
+			renderer == nullptr,
+			FAIL,
+			"The renderer must be initialized before loading %s",
+			filename);
+
+	const AssetPack &pack = renderer->get_asset_pack();
+
+	// cooked files keep their json in the pack
+	Document doc;
+	const AssetPack::Entry *raw = pack.find(filename);
+	if (raw != nullptr && raw->type == AssetPack::ENTRY_RAW) {
+		ERR_TRY(_parse_document(&doc, filename, pack.get_data(*raw)));
+	} else {
+		ERR_FAIL_COND_V_MSG(
+				!doc.file.open(filename, MappedFile::HINT_WILL_NEED),
+				FAIL,
+				"Failed to open glTF file %s",
+				filename);
+		ERR_TRY(_parse_document(&doc, filename, doc.file.span()));
+	}
+
+	// buffers are only mapped if a primitive isn't in the pack
+	bool buffers_mapped = false;
+
+	uint32_t uploaded_primitives  = 0;
+	uint32_t zero_copy_primitives = 0;
+	uint32_t cooked_primitives	  = 0;
+
+	try {
+		const json &gltf  = doc.gltf;
+		const json empty = json::array();
+
+		// upload every primitive of every mesh up front so meshes that are
+		// used by multiple nodes are only uploaded once.
+		const json &gltf_meshes = gltf.value("meshes", empty);
+		std::vector<std::vector<Renderer::Mesh *>> mesh_primitives(
+				gltf_meshes.size());
+
+		for (size_t m = 0; m < gltf_meshes.size(); ++m) {
+			const json &gltf_mesh	 = gltf_meshes[m];
+			const std::string name = _mesh_name(gltf_mesh, m);
+			const json &primitives = gltf_mesh.at("primitives");
+
+			for (size_t p = 0; p < primitives.size(); ++p) {
+				const json &primitive = primitives[p];
+
+				if (primitive.value("mode", MODE_TRIANGLES) != MODE_TRIANGLES) {
+					LOG_WARN(
+							"Skipping non triangle primitive %zu of %s",
+							p,
+							name.c_str());
+					continue;
+				}
+
+				auto mesh  = std::make_unique<Renderer::Mesh>();
+				mesh->name = scene->_add_name(
+						primitives.size() > 1
+								? name + " " + std::to_string(p)
+								: name);
+
+				const AssetPack::Entry *entry =
+						pack.find(get_primitive_name(filename, m, p));
+
+				if (entry != nullptr && entry->type == AssetPack::ENTRY_MESH) {
+					ERR_TRY(renderer->upload_cooked_mesh(mesh.get(), *entry));
+					cooked_primitives++;
+				} else {
+					if (!buffers_mapped) {
+						ERR_TRY(_map_buffers(&doc, filename));
+						buffers_mapped = true;
+					}
+
+					PrimitiveData data;
+					ERR_TRY(_read_primitive(doc, primitive, mesh->name, &data));
+
+					ERR_TRY(renderer->upload_mesh(
+							mesh.get(),
+							data.vertices,
+							(uint32_t)data.vertex_count,
+							data.indices,
+							(uint32_t)data.index_count));
+
+					if (data.zero_copy)
+						zero_copy_primitives++;
+				}
+
+				uploaded_primitives++;
+
+				mesh_primitives[m].push_back(mesh.get());
+				scene->_meshes.push_back(std::move(mesh));
+			}
+		}
+
+		// build the node tree
+
+		const json &gltf_nodes = gltf.value("nodes", empty);
+		std::vector<bool> visited(gltf_nodes.size(), false);
+
+		const std::string root_name =
+				std::filesystem::path(filename).filename().string();
+		scene->_root = std::make_unique<Node3D>(scene->_add_name(root_name));
+		scene->_root->transform = glm::mat4(1.0f);
+
+		// Node3D transforms are not relative to their parent so every node
+		// gets its world transform.
+		std::function<Error(uint32_t, const glm::mat4 &, Node3D *)> add_node =
+				[&](uint32_t index,
+					const glm::mat4 &parent_transform,
+					Node3D *parent) -> Error {
+			ERR_FAIL_COND_V_MSG(
+					index >= gltf_nodes.size() || visited[index],
+					FAIL,
+					"Invalid or cyclic node %u in %s",
+					index,
+					filename);
+			visited[index] = true;
+
+			const json &gltf_node = gltf_nodes[index];
+			const glm::mat4 transform =
+					parent_transform * _node_transform(gltf_node);
+
+			const char *name = scene->_add_name(
+					gltf_node.value("name", "node " + std::to_string(index)));
+
+			auto node		= std::make_unique<Node3D>(name);
+			node->transform = transform;
+			parent->add_child(node.get());
+
+			if (gltf_node.contains("mesh")) {
+				const uint32_t mesh_index =
+						gltf_node.at("mesh").get<uint32_t>();
+				ERR_FAIL_COND_V_MSG(
+						mesh_index >= mesh_primitives.size(),
+						FAIL,
+						"Invalid mesh %u in %s",
+						mesh_index,
+						filename);
+
+				for (Renderer::Mesh *mesh : mesh_primitives[mesh_index]) {
+					auto instance =
+							std::make_unique<MeshInstance>(mesh->name, mesh);
+					instance->transform = transform;
+					node->add_child(instance.get());
+					scene->_nodes.push_back(std::move(instance));
+				}
+			}
+
+			Node3D *node_ptr = node.get();
+			scene->_nodes.push_back(std::move(node));
+
+			for (const json &child : gltf_node.value("children", empty))
+				ERR_TRY(add_node(child.get<uint32_t>(), transform, node_ptr));
+
+			return OK;
+		};
+
+		const json &scenes = gltf.value("scenes", empty);
+		if (!scenes.empty()) {
+			const uint32_t scene_index = gltf.value("scene", 0u);
+			ERR_FAIL_COND_V_MSG(
+					scene_index >= scenes.size(),
+					FAIL,
+					"Invalid scene %u in %s",
+					scene_index,
+					filename);
+
+			for (const json &node : scenes[scene_index].value("nodes", empty))
+				ERR_TRY(add_node(
+						node.get<uint32_t>(),
+						glm::mat4(1.0f),
+						scene->_root.get()));
+		} else {
+			// without scenes every node that isn't a child is a root
+			std::vector<bool> is_child(gltf_nodes.size(), false);
+			for (const json &node : gltf_nodes)
+				for (const json &child : node.value("children", empty))
+					if (child.get<size_t>() < is_child.size())
+						is_child[child.get<size_t>()] = true;
+
+			for (uint32_t i = 0; i < gltf_nodes.size(); ++i) {
+				if (!is_child[i]) {
+					ERR_TRY(add_node(i, glm::mat4(1.0f), scene->_root.get()));
+				}
+			}
+		}
+	} catch (const json::exception &e) {
+		LOG_ERR("Invalid glTF file %s: %s", filename, e.what());
+		return FAIL;
+	}
+
+	const double import_time_ms =
+			std::chrono::duration<double, std::milli>(
+					std::chrono::high_resolution_clock::now() - start_time)
+					.count();
+
+	LOG_INFO(
+			"imported %s in %.2f ms (%u primitives, %u from the asset pack, "
+			"%u uploaded without repacking)",
+			filename,
+			import_time_ms,
+			uploaded_primitives,
+			cooked_primitives,
+			zero_copy_primitives);
+
+	return OK;
+}
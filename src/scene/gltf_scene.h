@@ -0,0 +1,87 @@
+#ifndef __GLTF_SCENE_H__
+#define __GLTF_SCENE_H__
+
+#include "mesh_instance.h"
+#include "scene.h"
+
+#include <deque>
+#include <memory>
+
+namespace Opal {
+
+/**
+ * @brief Node tree and meshes imported from a glTF 2.0 file.
+ *
+ * Both .gltf files with external buffers and binary .glb files are supported.
+ * Buffers are memory mapped and accessor ranges are uploaded straight from the
+ * mapping when they already match the layout of Vertex and uint32 indices.
+ * Anything else is repacked once on the CPU before uploading. Files that were
+ * cooked into the asset pack are loaded from there instead.
+ *
+ * Every glTF node becomes a Node3D with its world transform. Each primitive
+ * of the node's mesh is added to it as a MeshInstance child.
+ */
+class GltfScene {
+
+public:
+	/**
+	 * @brief Loads the default scene of the given file and uploads its
+	 * meshes. The renderer must already be initialized.
+	 */
+	static Error load(GltfScene *scene, const char *filename);
+
+	/**
+	 * @brief Geometry of a triangle primitive repacked into the Vertex layout,
+	 * with its levels of detail appended to the indices.
+	 */
+	struct CookedPrimitive {
+		size_t mesh;
+		size_t primitive;
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<Renderer::Mesh::Lod> lods;
+	};
+
+	/**
+	 * @brief Reads the json and every triangle primitive of the file without
+	 * uploading anything. Used by the asset cooker.
+	 *
+	 * load() reads the json and primitives from the asset pack when they are
+	 * stored there under the file name and get_primitive_name.
+	 */
+	static Error cook(
+			const char *filename,
+			std::string *json,
+			std::vector<CookedPrimitive> *primitives);
+
+	/**
+	 * @brief Lists the external buffer files the given file depends on.
+	 */
+	static Error
+	get_dependencies(const char *filename, std::vector<std::string> *files);
+
+	/**
+	 * @returns the name a primitive is stored under in the asset pack.
+	 */
+	static std::string
+	get_primitive_name(const char *filename, size_t mesh, size_t primitive);
+
+	/**
+	 * @returns the node that all of the scene's root nodes are added to.
+	 */
+	Node3D *get_root() const { return _root.get(); }
+
+protected:
+	std::unique_ptr<Node3D> _root;
+	std::vector<std::unique_ptr<Node3D>> _nodes;
+	std::vector<std::unique_ptr<Renderer::Mesh>> _meshes;
+
+	// storage for the node and mesh names since they only hold pointers
+	std::deque<std::string> _names;
+
+	const char *_add_name(std::string name);
+};
+
+} // namespace Opal
+
+#endif // __GLTF_SCENE_H__
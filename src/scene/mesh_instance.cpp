@@ -1,10 +1,47 @@
 #include "mesh_instance.h"
 
+#include <algorithm>
+#include <cstddef>
+
 using namespace Opal;
 
+namespace {
+
+/**
+ * Extracts the planes of the clip space volume from the matrix, in the space
+ * the matrix transforms from. The planes point inwards and are normalized so
+ * they give distances.
+ */
+void _get_frustum_planes(const glm::mat4 &matrix, glm::vec4 *planes) {
+	const glm::mat4 m = glm::transpose(matrix);
+
+	// vulkan clips depth to 0..w instead of -w..w
+	planes[0] = m[3] + m[0];
+	planes[1] = m[3] - m[0];
+	planes[2] = m[3] + m[1];
+	planes[3] = m[3] - m[1];
+	planes[4] = m[2];
+	planes[5] = m[3] - m[2];
+
+	for (int i = 0; i < 6; ++i)
+		planes[i] = planes[i] * (1.0f / glm::length(glm::vec3(planes[i])));
+}
+
+bool _is_sphere_visible(
+		const glm::vec4 *planes, const glm::vec3 &center, float radius) {
+	for (int i = 0; i < 6; ++i) {
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+} // namespace
+
 void MeshInstance::set_mesh(Renderer::Mesh *mesh) {
 	this->_mesh = mesh;
-	Renderer::get_singleton()->add_mesh(mesh);
+	if (mesh != nullptr)
+		Renderer::get_singleton()->add_mesh(mesh);
 }
 
 void MeshInstance::set_material(Material *material) {
@@ -41,46 +78,219 @@ void MeshInstance::update(float delta) {
 	// 		glm::vec3(0.0f, 0.0f, 1.0f));
 }
 
+void MeshInstance::_update_lod(const DrawContext *context) {
+
+	const std::vector<Renderer::Mesh::Lod> &lods = _mesh->lods;
+	if (lods.size() < 2 || context->viewport_height <= 0.0f) {
+		_lod = 0;
+		return;
+	}
+	_lod = std::min(_lod, (uint32_t)lods.size() - 1);
+
+	// errors are in object space, so scale them by the largest axis
+	const float scale = std::max({
+			glm::length(glm::vec3(transform[0])),
+			glm::length(glm::vec3(transform[1])),
+			glm::length(glm::vec3(transform[2])),
+	});
+
+	const glm::vec4 center =
+			context->view * transform * glm::vec4(_mesh->bounds_center, 1.0f);
+	const float distance =
+			glm::length(glm::vec3(center)) - _mesh->bounds_radius * scale;
+
+	// the camera is inside the bounds
+	if (distance <= 0.0f) {
+		_lod = 0;
+		return;
+	}
+
+	// pixels an object space unit covers at the closest point of the bounds
+	const float pixels = scale * std::abs(context->proj[1][1]) *
+						 context->viewport_height * 0.5f / distance;
+
+	const float refine	= MESH_LOD_PIXEL_ERROR * (1.0f + MESH_LOD_HYSTERESIS);
+	const float coarsen = MESH_LOD_PIXEL_ERROR * (1.0f - MESH_LOD_HYSTERESIS);
+
+	while (_lod > 0 && lods[_lod].error * pixels > refine)
+		_lod--;
+	while (_lod + 1 < lods.size() && lods[_lod + 1].error * pixels <= coarsen)
+		_lod++;
+}
+
+bool MeshInstance::_cull(const DrawContext *context) {
+
+	_draw_ranges.clear();
+
+	DrawRange level = { 0, _mesh->index_count, 0 };
+	if (!_mesh->lods.empty()) {
+		level = { _mesh->lods[_lod].first_index,
+			_mesh->lods[_lod].index_count,
+			0 };
+	}
+
+	// everything is tested in object space
+	const glm::mat4 model_view = context->view * transform;
+	glm::vec4 planes[6];
+	_get_frustum_planes(context->proj * model_view, planes);
+
+	if (!_is_sphere_visible(
+				planes, _mesh->bounds_center, _mesh->bounds_radius))
+		return false;
+
+	if (_mesh->lod_meshlets.size() < _lod + 2) {
+		if (_mesh->submeshes.empty()) {
+			_draw_ranges.push_back(level);
+			return true;
+		}
+
+		// the level's submeshes are already in material order
+		const uint32_t level_end = level.first_index + level.index_count;
+		for (const Renderer::Mesh::Submesh &submesh : _mesh->submeshes) {
+			if (submesh.first_index >= level.first_index &&
+					submesh.first_index < level_end) {
+				_draw_ranges.push_back({
+						submesh.first_index,
+						submesh.index_count,
+						submesh.material,
+				});
+			}
+		}
+		return !_draw_ranges.empty();
+	}
+
+	// mirroring transforms flip which side of the triangles faces the
+	// camera, so only the frustum test is safe for them
+	const glm::vec3 camera = glm::vec3(
+			glm::inverse(model_view) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	const bool cull_backfaces = glm::determinant(model_view) > 0.0f;
+
+	for (uint32_t i = _mesh->lod_meshlets[_lod];
+			i < _mesh->lod_meshlets[_lod + 1];
+			++i) {
+		const Renderer::Mesh::Meshlet &meshlet = _mesh->meshlets[i];
+
+		if (!_is_sphere_visible(planes, meshlet.center, meshlet.radius))
+			continue;
+
+		// the whole sphere is inside the cone of directions that only see
+		// the back of the meshlet's triangles
+		if (cull_backfaces) {
+			const glm::vec3 view = meshlet.center - camera;
+			if (glm::dot(view, meshlet.cone_axis) >
+					meshlet.cone_cutoff * glm::length(view) + meshlet.radius)
+				continue;
+		}
+
+		// neighbouring meshlets with the same material are drawn together
+		if (!_draw_ranges.empty() &&
+				_draw_ranges.back().material == meshlet.material &&
+				_draw_ranges.back().first_index +
+								_draw_ranges.back().index_count ==
+						meshlet.first_index) {
+			_draw_ranges.back().index_count += meshlet.index_count;
+		} else {
+			_draw_ranges.push_back({
+					meshlet.first_index,
+					meshlet.index_count,
+					meshlet.material,
+			});
+		}
+	}
+
+	return !_draw_ranges.empty();
+}
+
 void MeshInstance::draw(DrawContext *context) {
 
-	MeshInstance *prev = (MeshInstance *)context->prev_object;
+	// meshes still uploading would read garbage
+	if (_mesh == nullptr ||
+			!context->renderer->is_upload_ready(_mesh->upload_ticket)) {
+		context->culled = true;
+		return;
+	}
+
+	// the previous object isn't always a mesh instance
+	MeshInstance *prev = dynamic_cast<MeshInstance *>(context->prev_object);
 
-	// skip if previous object used the same material
-	if (prev == nullptr || prev->_material != _material) {
+	const bool depth_only = context->pass == DrawContext::PASS_DEPTH;
+
+	VkPipeline pipeline =
+			depth_only ? context->renderer->get_depth_pipeline(_mesh->format)
+					   : context->renderer->get_pipeline(_mesh->format);
+	if (pipeline == VK_NULL_HANDLE) {
+		// keeps a later pass from reusing what wasn't drawn
+		_draw_ranges.clear();
+		context->culled = true;
+		return;
+	}
+
+	// the color pass draws exactly what the depth pass drew, so the depth
+	// test can expect equal values
+	if (context->reuse_visibility) {
+		if (_draw_ranges.empty()) {
+			context->culled = true;
+			return;
+		}
+	} else {
+		_update_lod(context);
+		if (!_cull(context)) {
+			context->culled = true;
+			return;
+		}
+	}
+
+	// skip if previous object used the same material and vertex format. the
+	// depth pass only reads positions, so only their layout has to match
+	bool same_state = prev != nullptr;
+	if (same_state && depth_only) {
+		same_state = prev->_mesh->format.get_position_key() ==
+					 _mesh->format.get_position_key();
+	} else if (same_state) {
+		same_state = prev->_material == _material &&
+					 prev->_mesh->format.get_key() == _mesh->format.get_key();
+	}
+
+	if (!same_state) {
 
 		// bind the material
 
 		vkCmdBindPipeline(
 				context->cmd_buf,
 				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				context->renderer->_graphics_pipeline
+				pipeline
 				// material->pipeline
 		);
 
-		vkCmdBindDescriptorSets(
-				context->cmd_buf,
-				VK_PIPELINE_BIND_POINT_GRAPHICS,
-				context->renderer->_pipeline_layout,
-				// material->pipeline_layout,
-				0,
-				1,
-				&context->renderer->_descriptor_sets[context->image_index],
-				// &_descriptor_sets[image_index],
-				0,
-				nullptr);
+		if (!depth_only) {
+			vkCmdBindDescriptorSets(
+					context->cmd_buf,
+					VK_PIPELINE_BIND_POINT_GRAPHICS,
+					context->renderer->_pipeline_layout,
+					// material->pipeline_layout,
+					0,
+					1,
+					&context->renderer->_descriptor_sets[context->image_index],
+					// &_descriptor_sets[image_index],
+					0,
+					nullptr);
+		}
 	}
 
 	// send push constants
 
+	// compact positions are scaled back to object space by the model matrix
+	uint32_t material = _draw_ranges.front().material;
 	Renderer::PushConstants push_constants {
-		.model = transform,
+		.model = transform * _mesh->format.get_dequantize_transform(),
 		.view  = context->view,
 		.proj  = context->proj,
+		.color = _mesh->get_material_color(material),
 	};
 	vkCmdPushConstants(
 			context->cmd_buf,
 			context->renderer->_pipeline_layout,
-			VK_SHADER_STAGE_VERTEX_BIT,
+			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
 			0,
 			sizeof(Renderer::PushConstants),
 			&push_constants);
@@ -90,31 +300,83 @@ void MeshInstance::draw(DrawContext *context) {
 
 		// send the geometry
 
-		VkBuffer vertex_buffers[] = { _mesh->vertex_buffer.buffer };
-		VkDeviceSize offsets[]	  = { 0 };
+		// every stream lives in the same buffer: the positions when they are
+		// separate, then the interleaved attributes, then the constant ones.
+		// formats differ in stride, so the streams are rebound per mesh even
+		// when meshes share the vertex arena
+		const VkDeviceSize base	  = _mesh->vertex_base;
+		VkBuffer vertex_buffers[] = {
+			_mesh->vertex_buffer.buffer,
+			_mesh->vertex_buffer.buffer,
+			_mesh->vertex_buffer.buffer,
+		};
+		VkDeviceSize offsets[] = {
+			base + _mesh->vertex_offset,
+			base + _mesh->constant_offset,
+			base,
+		};
 
-		vkCmdBindVertexBuffers(context->cmd_buf, 0, 1, vertex_buffers, offsets);
-		vkCmdBindIndexBuffer(
+		uint32_t first_binding = VertexFormat::VERTEX_BINDING;
+		uint32_t binding_count = _mesh->format.constant_size > 0 ? 2 : 1;
+		if (depth_only) {
+			// the position stream is all the depth pipeline reads
+			first_binding = _mesh->format.get_position_binding();
+			binding_count = 1;
+			offsets[0]	  = base;
+		} else if (_mesh->format.separate_positions) {
+			binding_count = 3;
+		}
+
+		vkCmdBindVertexBuffers(
 				context->cmd_buf,
-				_mesh->index_buffer.buffer,
-				// offset
-				0,
-				// index type
-				VK_INDEX_TYPE_UINT32);
+				first_binding,
+				binding_count,
+				vertex_buffers,
+				offsets);
+
+		// meshes in the index arena share the binding, and their ranges of it
+		// are picked by the first index of every draw
+		if (prev == nullptr ||
+				prev->_mesh->index_type != _mesh->index_type ||
+				prev->_mesh->index_buffer.buffer !=
+						_mesh->index_buffer.buffer) {
+			vkCmdBindIndexBuffer(
+					context->cmd_buf,
+					_mesh->index_buffer.buffer,
+					// offset
+					0,
+					// index type
+					_mesh->index_type);
+		}
 	}
 
 	// draw the geometry
 
-	vkCmdDrawIndexed(
-			context->cmd_buf,
-			// index count
-			static_cast<uint32_t>(_mesh->indices.size()),
-			// instance count
-			1,
-			// first index
-			0,
-			// vertex offset
-			0,
-			// first instance
-			0);
+	for (const DrawRange &range : _draw_ranges) {
+		// only the color changes between materials
+		if (!depth_only && range.material != material) {
+			material			  = range.material;
+			const glm::vec4 color = _mesh->get_material_color(material);
+			vkCmdPushConstants(
+					context->cmd_buf,
+					context->renderer->_pipeline_layout,
+					VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+					offsetof(Renderer::PushConstants, color),
+					sizeof(color),
+					&color);
+		}
+
+		vkCmdDrawIndexed(
+				context->cmd_buf,
+				// index count
+				range.index_count,
+				// instance count
+				1,
+				// first index
+				_mesh->base_index + range.first_index,
+				// vertex offset
+				0,
+				// first instance
+				0);
+	}
 }
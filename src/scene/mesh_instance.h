@@ -8,8 +8,34 @@ namespace Opal {
 class MeshInstance : public Node3D {
 
 protected:
-	Renderer::Mesh *_mesh;
-	Material *_material;
+	Renderer::Mesh *_mesh = nullptr;
+	Material *_material	  = nullptr;
+
+	// level of detail drawn last frame
+	uint32_t _lod = 0;
+
+	/**
+	 * Picks the coarsest level whose error stays below MESH_LOD_PIXEL_ERROR
+	 * pixels on screen. The level only changes once the error moves far
+	 * enough past the threshold, so it doesn't flicker at the boundary.
+	 */
+	void _update_lod(const DrawContext *context);
+
+	struct DrawRange {
+		uint32_t first_index;
+		uint32_t index_count;
+		uint32_t material;
+	};
+
+	// index ranges that survived culling this frame, grouped by material
+	std::vector<DrawRange> _draw_ranges;
+
+	/**
+	 * Fills _draw_ranges with the parts of the current level that can be
+	 * visible. Meshes without meshlets are only culled as a whole.
+	 * @returns false if nothing is visible.
+	 */
+	bool _cull(const DrawContext *context);
 
 public:
 	MeshInstance() : Node3D("MeshInstance") {}
@@ -18,8 +44,15 @@ public:
 		set_mesh(mesh);
 	}
 
+	/**
+	 * @brief Sets the mesh to draw, uploading it if needed. Instances without
+	 * a mesh draw nothing.
+	 */
 	void set_mesh(Renderer::Mesh *mesh);
 	void set_material(Material *material);
+
+	Renderer::Mesh *get_mesh() const { return _mesh; }
+	Material *get_material() const { return _material; }
 	void init();
 	void update(float delta);
 	void draw(DrawContext *context);
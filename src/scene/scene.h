@@ -14,8 +14,8 @@ namespace Opal {
 class Node3D : public RenderObject {
 
 protected:
-	Node3D *_tree_root;
-	Node3D *_parent;
+	Node3D *_tree_root = nullptr;
+	Node3D *_parent	   = nullptr;
 	std::vector<Node3D *> _children;
 
 public:
@@ -53,6 +53,8 @@ public:
 	void add_child(Node3D *child);
 	void remove_child(Node3D *child);
 
+	const std::vector<Node3D *> &get_children() const { return _children; }
+
 	void print_tree() const;
 
 protected:
@@ -0,0 +1,192 @@
+#include "static_batch.h"
+
+#include <span>
+
+using namespace Opal;
+
+namespace {
+
+/**
+ * Triangles of one material color in a batch.
+ */
+struct ColorBucket {
+	glm::vec4 color;
+	std::vector<uint32_t> indices;
+};
+
+struct PendingBatch {
+	Material *material = nullptr;
+	std::vector<Vertex> vertices;
+	std::vector<ColorBucket> buckets;
+};
+
+void _collect_instances(Node3D *node, std::vector<MeshInstance *> *out) {
+	if (MeshInstance *instance = dynamic_cast<MeshInstance *>(node))
+		out->push_back(instance);
+	for (Node3D *child : node->get_children())
+		_collect_instances(child, out);
+}
+
+std::vector<uint32_t> &
+_get_bucket(PendingBatch *batch, const glm::vec4 &color) {
+	for (ColorBucket &bucket : batch->buckets) {
+		if (bucket.color == color)
+			return bucket.indices;
+	}
+	return batch->buckets.emplace_back(ColorBucket { .color = color }).indices;
+}
+
+/**
+ * Appends the full detail level of the instance's mesh to the batch, with the
+ * vertices moved into world space.
+ */
+void _append_instance(
+		PendingBatch *batch,
+		const MeshInstance *instance,
+		std::span<const Vertex> vertices,
+		std::span<const uint32_t> indices) {
+
+	const Renderer::Mesh *mesh = instance->get_mesh();
+	const glm::mat4 &transform = instance->transform;
+	const uint32_t base		   = (uint32_t)batch->vertices.size();
+
+	for (const Vertex &vertex : vertices) {
+		Vertex &baked = batch->vertices.emplace_back(vertex);
+		baked.pos	  = glm::vec3(transform * glm::vec4(vertex.pos, 1.0f));
+	}
+
+	// mirroring transforms flip the winding, so flip it back
+	const bool mirrored	  = glm::determinant(glm::mat3(transform)) < 0.0f;
+	const uint32_t second = mirrored ? 2 : 1;
+	const uint32_t third  = mirrored ? 1 : 2;
+
+	auto append_range = [&](const Renderer::Mesh::Submesh &range) {
+		std::vector<uint32_t> &out =
+				_get_bucket(batch, mesh->get_material_color(range.material));
+
+		const uint32_t end =
+				range.first_index + range.index_count - range.index_count % 3;
+		for (uint32_t i = range.first_index; i < end; i += 3) {
+			out.push_back(base + indices[i]);
+			out.push_back(base + indices[i + second]);
+			out.push_back(base + indices[i + third]);
+		}
+	};
+
+	Renderer::Mesh::Submesh level = { 0, (uint32_t)indices.size(), 0 };
+	if (!mesh->lods.empty())
+		level = { mesh->lods[0].first_index, mesh->lods[0].index_count, 0 };
+
+	if (mesh->submeshes.empty()) {
+		append_range(level);
+		return;
+	}
+
+	for (const Renderer::Mesh::Submesh &submesh : mesh->submeshes) {
+		if (submesh.first_index >= level.first_index &&
+				submesh.first_index < level.first_index + level.index_count)
+			append_range(submesh);
+	}
+}
+
+} // namespace
+
+Error StaticBatch::bake(Node3D *root) {
+
+	ERR_FAIL_COND_V_MSG(root == nullptr, FAIL, "root is null");
+	ERR_FAIL_COND_V_MSG(!_meshes.empty(), FAIL, "%s is already baked", name);
+
+	Renderer *renderer = Renderer::get_singleton();
+
+	std::vector<MeshInstance *> instances;
+	_collect_instances(root, &instances);
+
+	std::vector<PendingBatch> batches;
+	size_t baked_count = 0;
+
+	for (MeshInstance *instance : instances) {
+		Renderer::Mesh *mesh = instance->get_mesh();
+		if (mesh == nullptr)
+			continue;
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		if (renderer->get_mesh_data(mesh, &vertices, &indices) != OK) {
+			LOG_WARN("Not baking %s, its mesh data is gone", instance->name);
+			continue;
+		}
+
+		// the last batch of the material is the one being filled
+		PendingBatch *batch = nullptr;
+		for (auto it = batches.rbegin(); it != batches.rend(); ++it) {
+			if (it->material == instance->get_material()) {
+				batch = &*it;
+				break;
+			}
+		}
+
+		if (batch == nullptr ||
+				(!batch->vertices.empty() &&
+						batch->vertices.size() + vertices.size() >
+								STATIC_BATCH_MAX_VERTICES)) {
+			batch			= &batches.emplace_back();
+			batch->material = instance->get_material();
+		}
+
+		_append_instance(batch, instance, vertices, indices);
+
+		// the batch draws it from now on
+		instance->set_mesh(nullptr);
+		baked_count++;
+	}
+
+	for (PendingBatch &batch : batches) {
+		const std::string &mesh_name = _names.emplace_back(
+				std::string(name) + " " + std::to_string(_meshes.size()));
+
+		auto mesh	   = std::make_unique<Renderer::Mesh>();
+		mesh->name	   = mesh_name.c_str();
+		mesh->vertices = std::move(batch.vertices);
+
+		// one range per color, each drawn with a single call
+		for (const ColorBucket &bucket : batch.buckets) {
+			if (bucket.indices.empty())
+				continue;
+
+			mesh->submeshes.push_back({
+					.first_index = (uint32_t)mesh->indices.size(),
+					.index_count = (uint32_t)bucket.indices.size(),
+					.material	 = (uint32_t)mesh->material_colors.size(),
+			});
+			mesh->material_colors.push_back(bucket.color);
+			mesh->indices.insert(
+					mesh->indices.end(),
+					bucket.indices.begin(),
+					bucket.indices.end());
+		}
+
+		ERR_TRY(renderer->upload_mesh(
+				mesh.get(),
+				mesh->vertices.data(),
+				(uint32_t)mesh->vertices.size(),
+				mesh->indices.data(),
+				(uint32_t)mesh->indices.size()));
+
+		auto instance = std::make_unique<MeshInstance>(mesh->name, mesh.get());
+		// the vertices are already in world space
+		instance->transform = glm::mat4(1.0f);
+		instance->set_material(batch.material);
+		add_child(instance.get());
+
+		_meshes.push_back(std::move(mesh));
+		_instances.push_back(std::move(instance));
+	}
+
+	LOG_INFO(
+			"baked %zu instances under %s into %zu batches",
+			baked_count,
+			root->name,
+			batches.size());
+
+	return OK;
+}
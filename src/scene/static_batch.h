@@ -0,0 +1,47 @@
+#ifndef __STATIC_BATCH_H__
+#define __STATIC_BATCH_H__
+
+#include "mesh_instance.h"
+
+#include <deque>
+#include <memory>
+
+namespace Opal {
+
+/**
+ * @brief Merges the static meshes of a subtree into a few large meshes.
+ *
+ * Baking pre-transforms the vertices of every MeshInstance under a node into
+ * world space and appends them to a batch for the instance's material. A
+ * batch holds up to STATIC_BATCH_MAX_VERTICES vertices, so a whole scene of
+ * small meshes is drawn with a bind and one draw per material color of each
+ * batch instead of once per instance. The batches are still culled per
+ * meshlet.
+ *
+ * Only the full detail level of each mesh is baked. The baked instances stay
+ * in the tree but no longer draw, so moving them afterwards has no effect.
+ */
+class StaticBatch : public Node3D {
+
+public:
+	StaticBatch() : Node3D("StaticBatch") {}
+	StaticBatch(const char *name) : Node3D(name) {}
+
+	/**
+	 * @brief Bakes every MeshInstance under root, including root itself,
+	 * and adds the batches as children of this node. Instances whose mesh
+	 * data isn't available anymore are left as they are.
+	 */
+	Error bake(Node3D *root);
+
+protected:
+	std::vector<std::unique_ptr<Renderer::Mesh>> _meshes;
+	std::vector<std::unique_ptr<MeshInstance>> _instances;
+
+	// storage for the mesh names since they only hold pointers
+	std::deque<std::string> _names;
+};
+
+} // namespace Opal
+
+#endif // __STATIC_BATCH_H__
@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// only reads the position stream, for passes that just fill the depth buffer
+
+layout(location = 0) in vec3 inPosition;
+
+layout(push_constant) uniform constants {
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+	vec4 color;
+}
+PushConstants;
+
+// must match vert_shader.vert exactly so the color pass passes the depth test
+invariant gl_Position;
+
+void main() {
+	gl_Position = PushConstants.proj * PushConstants.view * PushConstants.model * vec4(inPosition, 1.0);
+}
@@ -3,11 +3,17 @@
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// the matrices before the color are only used by the vertex shader
+layout(push_constant) uniform constants {
+	layout(offset = 192) vec4 color;
+}
+PushConstants;
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-	outColor = texture(texSampler, fragTexCoord);
+	outColor = texture(texSampler, fragTexCoord) * PushConstants.color;
 }
\ No newline at end of file
@@ -9,12 +9,16 @@ layout(push_constant) uniform constants {
 	mat4 model;
 	mat4 view;
 	mat4 proj;
+	vec4 color;
 }
 PushConstants;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
+// must match depth_shader.vert exactly so the depth prepass lines up
+invariant gl_Position;
+
 void main() {
 	gl_Position = PushConstants.proj * PushConstants.view * PushConstants.model * vec4(inPosition, 1.0);
 	fragColor = inColor;
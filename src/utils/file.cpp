@@ -1,5 +1,15 @@
 #include "file.h"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 std::vector<char> readFile(const std::string &filename) {
 	std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
@@ -34,3 +44,122 @@ void writeFile(const std::string &filename, const char *content) {
 
 	file.close();
 }
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+	*this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+	if (this != &other) {
+		close();
+		std::swap(_data, other._data);
+		std::swap(_size, other._size);
+#ifdef _WIN32
+		std::swap(_file, other._file);
+		std::swap(_mapping, other._mapping);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::string &filename, uint32_t hints) {
+	close();
+
+#ifdef _WIN32
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	if (hints & HINT_SEQUENTIAL)
+		flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	if (hints & HINT_RANDOM)
+		flags |= FILE_FLAG_RANDOM_ACCESS;
+
+	HANDLE file = CreateFileA(
+			filename.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			nullptr,
+			OPEN_EXISTING,
+			flags,
+			nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	_file = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping == nullptr) {
+		close();
+		return false;
+	}
+
+	_data = static_cast<const uint8_t *>(
+			MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	_size = static_cast<size_t>(file_size.QuadPart);
+	if (_data == nullptr) {
+		close();
+		return false;
+	}
+
+#if _WIN32_WINNT >= 0x0602
+	if (hints & HINT_WILL_NEED) {
+		WIN32_MEMORY_RANGE_ENTRY range { (void *)_data, _size };
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+#endif
+	return true;
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference to the file
+	::close(fd);
+	if (ptr == MAP_FAILED)
+		return false;
+
+	_data = static_cast<const uint8_t *>(ptr);
+	_size = static_cast<size_t>(st.st_size);
+
+	// these are only hints so failures are ignored
+	if (hints & HINT_SEQUENTIAL)
+		madvise(ptr, _size, MADV_SEQUENTIAL);
+	if (hints & HINT_RANDOM)
+		madvise(ptr, _size, MADV_RANDOM);
+	if (hints & HINT_WILL_NEED)
+		madvise(ptr, _size, MADV_WILLNEED);
+	return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle(_mapping);
+	if (_file)
+		CloseHandle(_file);
+	_file	 = nullptr;
+	_mapping = nullptr;
+#else
+	if (_data)
+		munmap(const_cast<uint8_t *>(_data), _size);
+#endif
+	_data = nullptr;
+	_size = 0;
+}
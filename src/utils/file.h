@@ -1,11 +1,74 @@
 #ifndef __FILE_H__
 #define __FILE_H__
 
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <span>
 #include <vector>
 
 std::vector<char> readFile(const std::string &filename);
 
 void writeFile(const std::string &filename, const char *content);
 
-#endif // __FILE_H__
\ No newline at end of file
+/**
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * Pages are only read from disk as they are touched, and the contents can be
+ * used in place without copying them into a buffer first. The mapping is
+ * released when this goes out of scope.
+ */
+class MappedFile {
+
+public:
+	/**
+	 * Hints about how the mapping will be accessed so the OS can tune its
+	 * read ahead. These can be combined.
+	 */
+	enum Hint : uint32_t {
+		HINT_NONE = 0,
+		// read mostly front to back so read ahead aggressively
+		HINT_SEQUENTIAL = 1 << 0,
+		// read in no particular order so don't bother reading ahead
+		HINT_RANDOM = 1 << 1,
+		// start paging the whole file in now
+		HINT_WILL_NEED = 1 << 2,
+	};
+
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+
+	/**
+	 * @brief Maps the given file, closing any file that was already mapped.
+	 * @param hints combination of Hint flags.
+	 * @returns false if the file doesn't exist or is empty.
+	 */
+	bool open(const std::string &filename, uint32_t hints = HINT_NONE);
+	void close();
+
+	bool is_open() const { return _data != nullptr; }
+	const uint8_t *data() const { return _data; }
+	size_t size() const { return _size; }
+
+	/**
+	 * @returns the contents of the file. Only valid while the file is open.
+	 */
+	std::span<const uint8_t> span() const { return { _data, _size }; }
+
+protected:
+	const uint8_t *_data = nullptr;
+	size_t _size		 = 0;
+#ifdef _WIN32
+	// file and mapping HANDLEs
+	void *_file	   = nullptr;
+	void *_mapping = nullptr;
+#endif
+};
+
+#endif // __FILE_H__
@@ -0,0 +1,100 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include "../typedefs.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// wyhash style hashing. These are much stronger (and faster on big inputs)
+// than the xor-shift combining std::hash does for glm types.
+// https://github.com/wangyi-fudan/wyhash
+
+namespace Opal {
+
+static constexpr uint64_t HASH_SECRET_0 = 0xa0761d6478bd642full;
+static constexpr uint64_t HASH_SECRET_1 = 0xe7037ed1a0b428dbull;
+static constexpr uint64_t HASH_SECRET_2 = 0x8ebc6af09c88c6e3ull;
+
+/**
+ * Multiplies the two values into 128 bits and folds the result back into 64.
+ */
+static inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+#if defined(_MSC_VER) && !defined(__clang__)
+	uint64_t hi;
+	uint64_t lo = _umul128(a, b, &hi);
+	return lo ^ hi;
+#else
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#endif
+}
+
+static inline uint64_t hash_read_64(const uint8_t *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t hash_read_32(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/**
+ * @brief Hashes an arbitrary run of bytes into 64 bits.
+ */
+static inline uint64_t
+hash_bytes(const void *data, size_t size, uint64_t seed = 0) {
+	const uint8_t *p = static_cast<const uint8_t *>(data);
+	seed ^= hash_mix(seed ^ HASH_SECRET_0, HASH_SECRET_1);
+
+	uint64_t a = 0;
+	uint64_t b = 0;
+	size_t left = size;
+
+	if (likely(left <= 16)) {
+		if (left >= 4) {
+			a = (hash_read_32(p) << 32) | hash_read_32(p + ((left >> 3) << 2));
+			b = (hash_read_32(p + left - 4) << 32) |
+				hash_read_32(p + left - 4 - ((left >> 3) << 2));
+		} else if (left > 0) {
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[left >> 1] << 8) |
+				p[left - 1];
+		}
+	} else {
+		// consume 16 bytes per round
+		while (left > 16) {
+			seed = hash_mix(
+					hash_read_64(p) ^ HASH_SECRET_1,
+					hash_read_64(p + 8) ^ seed);
+			p += 16;
+			left -= 16;
+		}
+		// the tail overlaps the previous round so it is always 16 bytes
+		a = hash_read_64(p + left - 16);
+		b = hash_read_64(p + left - 8);
+	}
+
+	a ^= HASH_SECRET_1;
+	b ^= seed;
+	a = hash_mix(a, b);
+	return hash_mix(a ^ HASH_SECRET_0 ^ size, b ^ HASH_SECRET_1);
+}
+
+/**
+ * @brief Hashes a single 64 bit value.
+ */
+static inline uint64_t hash_u64(uint64_t value, uint64_t seed = 0) {
+	return hash_mix(value ^ HASH_SECRET_0, seed ^ HASH_SECRET_2);
+}
+
+} // namespace Opal
+
+#endif // __HASH_H__
@@ -0,0 +1,29 @@
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#include <coroutine>
+#include <exception>
+
+namespace Opal {
+
+/**
+ * @brief Return type for fire-and-forget coroutines.
+ *
+ * The coroutine starts running as soon as it is called and frees itself once
+ * it finishes. Results have to be handed back through something the coroutine
+ * was given, like an AssetHandle.
+ */
+struct Job {
+	struct promise_type {
+		Job get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		// errors are reported through Error values, not exceptions
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+} // namespace Opal
+
+#endif // __TASK_H__
@@ -0,0 +1,52 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+using namespace Opal;
+
+ThreadPool::ThreadPool(uint32_t thread_count) {
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	_threads.reserve(thread_count);
+	for (uint32_t i = 0; i < thread_count; ++i)
+		_threads.emplace_back(&ThreadPool::_worker, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_condition.notify_all();
+
+	for (auto &thread : _threads)
+		thread.join();
+}
+
+void ThreadPool::_enqueue(std::coroutine_handle<> handle) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back(handle);
+	}
+	_condition.notify_one();
+}
+
+void ThreadPool::_worker() {
+	while (true) {
+		std::coroutine_handle<> handle;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(
+					lock, [this] { return _stopping || !_queue.empty(); });
+
+			// finish the queued work before stopping
+			if (_queue.empty())
+				return;
+
+			handle = _queue.front();
+			_queue.pop_front();
+		}
+		handle.resume();
+	}
+}
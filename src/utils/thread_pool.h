@@ -0,0 +1,64 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Opal {
+
+/**
+ * @brief Fixed set of worker threads that coroutines can hop onto.
+ *
+ * `co_await pool.schedule()` suspends the calling coroutine and resumes the
+ * rest of it on one of the workers.
+ */
+class ThreadPool {
+
+public:
+	/**
+	 * @param thread_count number of workers. 0 uses one per hardware thread.
+	 */
+	explicit ThreadPool(uint32_t thread_count = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	struct ScheduleAwaiter {
+		ThreadPool *pool;
+
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle) {
+			pool->_enqueue(handle);
+		}
+		void await_resume() const noexcept {}
+	};
+
+	/**
+	 * @returns an awaitable that continues the awaiting coroutine on a
+	 * worker thread.
+	 */
+	ScheduleAwaiter schedule() { return { this }; }
+
+	uint32_t get_thread_count() const { return (uint32_t)_threads.size(); }
+
+protected:
+	std::vector<std::thread> _threads;
+
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	std::deque<std::coroutine_handle<>> _queue;
+	bool _stopping = false;
+
+	void _enqueue(std::coroutine_handle<> handle);
+	void _worker();
+};
+
+} // namespace Opal
+
+#endif // __THREAD_POOL_H__